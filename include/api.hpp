@@ -0,0 +1,172 @@
+/// \file api.hpp
+/// This file contains the description of client API calls as seen
+/// by API observers.
+///
+/// Every call of the client API is made through invoke_api(), which
+/// notifies the observer selected at compile time with FB_API_OBSERVER
+/// before and after the call. The default observer does nothing and
+/// compiles away. To select another one, define the macro before
+/// including the library:
+///
+/// \code{.cpp}
+///     #include "observers.hpp"
+///     #define FB_API_OBSERVER fb::timing_observer
+///     #include "firebird.hpp"
+/// \endcode
+///
+/// An observer is a type with static members:
+///
+/// \code{.cpp}
+///     struct my_observer {
+///         static constexpr bool enabled = true;
+///         static void before(const fb::api_call& call) noexcept;
+///         static void after(const fb::api_call& call) noexcept;
+///     };
+/// \endcode
+
+#pragma once
+#include <ibase.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/// List of client API functions known by name.
+#define FB_API_FUNCTIONS(X) \
+    X(isc_attach_database) \
+    X(isc_detach_database) \
+    X(isc_database_info) \
+    X(isc_start_transaction) \
+    X(isc_commit_transaction) \
+    X(isc_commit_retaining) \
+    X(isc_rollback_transaction) \
+    X(isc_transaction_info) \
+    X(isc_dsql_execute_immediate) \
+    X(isc_dsql_allocate_statement) \
+    X(isc_dsql_prepare) \
+    X(isc_dsql_describe) \
+    X(isc_dsql_describe_bind) \
+    X(isc_dsql_execute) \
+    X(isc_dsql_execute2) \
+    X(isc_dsql_fetch) \
+    X(isc_dsql_free_statement) \
+    X(isc_dsql_sql_info) \
+    X(isc_create_blob) \
+    X(isc_open_blob) \
+    X(isc_close_blob) \
+    X(isc_get_segment) \
+    X(isc_put_segment) \
+    X(isc_que_events) \
+    X(isc_cancel_events) \
+    X(isc_service_attach) \
+    X(isc_service_detach) \
+    X(isc_service_query) \
+    X(isc_service_start) \
+    X(fb_cancel_operation)
+
+namespace fb
+{
+
+/// Client API functions known by name.
+enum class api_function : uint16_t
+{
+    #define FB_API_ENUM(fn) fn,
+    FB_API_FUNCTIONS(FB_API_ENUM)
+    #undef FB_API_ENUM
+    /// Any other function.
+    unknown
+};
+
+/// Number of api_function values (including unknown).
+inline constexpr size_t api_function_count = size_t(api_function::unknown) + 1;
+
+namespace detail
+{
+    /// Names of api_function values.
+    inline constexpr const char* api_names[] = {
+        #define FB_API_NAME(fn) #fn,
+        FB_API_FUNCTIONS(FB_API_NAME)
+        #undef FB_API_NAME
+        "unknown"
+    };
+
+} // namespace detail
+
+/// Get name of an API function.
+constexpr const char* api_name(api_function fn) noexcept
+{ return detail::api_names[size_t(fn)]; }
+
+/// API function of a function known at compile time.
+///
+/// \code{.cpp}
+///     static_assert(fb::api_id<isc_dsql_fetch> == fb::api_function::isc_dsql_fetch);
+/// \endcode
+///
+/// \tparam Fn - Client API function.
+///
+template <auto Fn>
+inline constexpr api_function api_id = api_function::unknown;
+
+#define FB_API_ID(fn) \
+    template <> inline constexpr api_function api_id<&fn> = api_function::fn;
+FB_API_FUNCTIONS(FB_API_ID)
+#undef FB_API_ID
+
+/// Description of an API call passed to observers.
+struct api_call
+{
+    /// Called function.
+    api_function function = api_function::unknown;
+    /// Handle passed as first argument (statement, transaction,
+    /// database, ...) or 0 if none. It is the value before the
+    /// call in before() and after the call in after().
+    isc_db_handle handle = 0;
+    /// Time when the call started.
+    std::chrono::steady_clock::time_point start;
+    /// Duration of the call (set in after() only).
+    std::chrono::nanoseconds duration{};
+    /// Value returned by the function (set in after() only).
+    ISC_STATUS status = 0;
+    /// Status vector (set in after() only).
+    const ISC_STATUS* status_vector = nullptr;
+
+    /// Get name of the called function.
+    const char* name() const noexcept
+    { return api_name(function); }
+
+    /// Checks if the call failed (valid in after() only).
+    bool failed() const noexcept
+    { return status_vector && status_vector[0] == 1 && status_vector[1]; }
+
+    /// Get error code of the call, 0 on success.
+    ISC_STATUS error_code() const noexcept
+    { return failed() ? status_vector[1] : 0; }
+};
+
+/// Observer that does nothing. Calls are not measured at all.
+struct null_observer
+{
+    static constexpr bool enabled = false;
+    static void before(const api_call&) noexcept { }
+    static void after(const api_call&) noexcept { }
+};
+
+namespace detail
+{
+    /// Get pointer to handle if the first argument is a handle.
+    template <class A0, class... Args>
+    inline const isc_db_handle* api_handle(const A0& a0, const Args&...) noexcept
+    {
+        if constexpr (std::is_convertible_v<const A0&, const isc_db_handle*>)
+            return a0;
+        else
+            return nullptr;
+    }
+
+    /// Overload for functions without arguments.
+    inline const isc_db_handle* api_handle() noexcept
+    { return nullptr; }
+
+} // namespace detail
+
+} // namespace fb
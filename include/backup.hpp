@@ -0,0 +1,326 @@
+/// \file backup.hpp
+/// This file contains backup and restore through the Services API,
+/// with the backup streamed to and from the client.
+
+#pragma once
+#include "services.hpp"
+
+#include <vector>
+
+namespace fb
+{
+
+/// Progress of a backup or restore.
+struct backup_progress
+{
+    /// Bytes of backup transferred so far.
+    uint64_t bytes = 0;
+    /// Line of verbose output (empty if progress is of data).
+    std::string_view message;
+};
+
+/// Backup and restore of databases through the Services API.
+/// Logical backups (gbak) are streamed: the backup is received and
+/// sent in chunks through callbacks, so it can be compressed or
+/// uploaded on the fly without a file on the server.
+///
+/// \code{.cpp}
+///     fb::service svc("localhost");
+///     svc.connect();
+///     std::ofstream out("employee.fbk", std::ios::binary);
+///     fb::backup_service(svc).backup("employee",
+///         [&](std::string_view chunk) { out.write(chunk.data(), chunk.size()); });
+/// \endcode
+///
+struct backup_service
+{
+    /// Backup and restore settings.
+    struct settings
+    {
+        /// Number of parallel workers (0 for server default).
+        /// Requires Firebird 5.
+        uint32_t parallel_workers = 0;
+        /// Backup options, such as isc_spb_bkp_ignore_limbo.
+        uint32_t backup_options = 0;
+        /// Restore options, such as isc_spb_res_replace.
+        uint32_t restore_options = isc_spb_res_create;
+        /// Page size of restored database (0 to keep).
+        uint32_t page_size = 0;
+        /// Page buffers of restored database (0 to keep).
+        uint32_t buffers = 0;
+        /// Report verbose output of restore to progress callback.
+        bool verbose = false;
+    };
+
+    /// Callback receiving chunks of backup.
+    using write_callback = std::function<void(std::string_view)>;
+    /// Callback filling buffer with backup, returns bytes
+    /// read or 0 at end.
+    using read_callback = std::function<size_t(char*, size_t)>;
+    /// Callback receiving progress.
+    using progress_callback = std::function<void(const backup_progress&)>;
+
+    /// Construct with default settings.
+    ///
+    /// \param[in] svc - Connected service (shared).
+    ///
+    explicit backup_service(service& svc);
+
+    /// Construct.
+    ///
+    /// \param[in] svc - Connected service (shared).
+    /// \param[in] s - Settings.
+    ///
+    backup_service(service& svc, const settings& s);
+
+    /// Backup database, streamed to the client.
+    ///
+    /// \param[in] database - Database path on the server.
+    /// \param[in] write - Callback receiving the backup.
+    /// \param[in] progress - Callback receiving progress (optional).
+    ///
+    /// \throw fb::exception
+    ///
+    void backup(std::string_view database, const write_callback& write,
+        const progress_callback& progress = nullptr);
+
+    /// Restore database, streamed from the client.
+    ///
+    /// \param[in] database - Database path on the server.
+    /// \param[in] read - Callback providing the backup.
+    /// \param[in] progress - Callback receiving progress (optional).
+    ///
+    /// \throw fb::exception
+    ///
+    void restore(std::string_view database, const read_callback& read,
+        const progress_callback& progress = nullptr);
+
+    /// Make physical backup (nbackup) of a level. Level 0 is a full
+    /// backup, level N contains pages changed since level N-1.
+    ///
+    /// \note The backup file is written by the server, physical
+    ///       backups can't be streamed.
+    ///
+    /// \param[in] database - Database path on the server.
+    /// \param[in] file - Backup file path on the server.
+    /// \param[in] level - Backup level.
+    /// \param[in] progress - Callback receiving output (optional).
+    ///
+    /// \throw fb::exception
+    ///
+    void nbackup(std::string_view database, std::string_view file, uint32_t level,
+        const progress_callback& progress = nullptr);
+
+    /// Restore database from physical backups (nbackup).
+    ///
+    /// \param[in] database - Database path on the server.
+    /// \param[in] files - Backup files of levels 0 to N.
+    /// \param[in] progress - Callback receiving output (optional).
+    ///
+    /// \throw fb::exception
+    ///
+    void nrestore(std::string_view database, const std::vector<std::string>& files,
+        const progress_callback& progress = nullptr);
+
+    /// Build request of backup().
+    ///
+    /// \throw fb::exception if parallel workers are not supported.
+    ///
+    service::request backup_request(std::string_view database) const;
+
+    /// Build request of restore().
+    ///
+    /// \throw fb::exception if parallel workers are not supported.
+    ///
+    service::request restore_request(std::string_view database) const;
+
+    /// Build request of nbackup().
+    static service::request nbackup_request(std::string_view database,
+        std::string_view file, uint32_t level);
+
+    /// Build request of nrestore().
+    static service::request nrestore_request(std::string_view database,
+        const std::vector<std::string>& files);
+
+private:
+    /// Add parallel workers to request (if set).
+    void add_workers(service::request& req, uint8_t tag) const;
+
+    /// Wait for action reporting output lines.
+    void wait(const progress_callback& progress);
+
+    service _svc;
+    settings _settings;
+};
+
+// Construct with default settings.
+backup_service::backup_service(service& svc)
+: backup_service(svc, settings())
+{ }
+
+// Construct.
+backup_service::backup_service(service& svc, const settings& s)
+: _svc(svc)
+, _settings(s)
+{ }
+
+// Backup database, streamed to the client.
+void backup_service::backup(std::string_view database, const write_callback& write,
+    const progress_callback& progress)
+{
+    _svc.start(backup_request(database));
+
+    // Backup is the output of the service
+    const char items[] = { isc_info_svc_to_eof };
+    const auto send = service::timeout(1);
+
+    backup_progress p;
+    for (;;) {
+        auto out = _svc.query(send, { items, sizeof(items) }, 0xffff);
+        if (out.is_finished())
+            break;
+        if (!out.data.empty()) {
+            write(out.data);
+            p.bytes += out.data.size();
+            if (progress)
+                progress(p);
+        }
+    }
+}
+
+// Restore database, streamed from the client.
+void backup_service::restore(std::string_view database, const read_callback& read,
+    const progress_callback& progress)
+{
+    _svc.start(restore_request(database));
+
+    // Server requests data for its stdin, which is sent as a
+    // line item, while verbose output is received as lines
+    const char items[] = { isc_info_svc_stdin, isc_info_svc_line };
+    constexpr size_t max_chunk = 32000;
+
+    std::string send;
+    std::vector<char> chunk(max_chunk);
+    uint32_t requested = 0;
+    backup_progress p;
+
+    for (;;) {
+        if (requested) {
+            // Zero length line tells end of data
+            size_t len = read(chunk.data(), std::min<size_t>(requested, max_chunk));
+            send = service::stdin_data({ chunk.data(), len });
+            p.bytes += len;
+        }
+        else
+            send = service::timeout(1);
+
+        auto out = _svc.query(send, { items, sizeof(items) });
+        requested = out.stdin_request;
+        if (out.is_finished())
+            break;
+
+        if (progress && (!out.data.empty() || requested)) {
+            p.message = out.data;
+            progress(p);
+        }
+    }
+}
+
+// Make physical backup (nbackup) of a level.
+void backup_service::nbackup(std::string_view database, std::string_view file,
+    uint32_t level, const progress_callback& progress)
+{
+    _svc.start(nbackup_request(database, file, level));
+    wait(progress);
+}
+
+// Restore database from physical backups (nbackup).
+void backup_service::nrestore(std::string_view database,
+    const std::vector<std::string>& files, const progress_callback& progress)
+{
+    _svc.start(nrestore_request(database, files));
+    wait(progress);
+}
+
+// Build request of backup().
+service::request backup_service::backup_request(std::string_view database) const
+{
+    service::request req(isc_action_svc_backup);
+    req.add(isc_spb_dbname, database)
+       .add(isc_spb_bkp_file, "stdout");
+    if (_settings.backup_options)
+        req.add(isc_spb_options, _settings.backup_options);
+    #ifdef isc_spb_bkp_parallel_workers
+    add_workers(req, isc_spb_bkp_parallel_workers);
+    #else
+    add_workers(req, 0);
+    #endif
+    return req;
+}
+
+// Build request of restore().
+service::request backup_service::restore_request(std::string_view database) const
+{
+    service::request req(isc_action_svc_restore);
+    req.add(isc_spb_bkp_file, "stdin")
+       .add(isc_spb_dbname, database)
+       .add(isc_spb_options, _settings.restore_options);
+    if (_settings.page_size)
+        req.add(isc_spb_res_page_size, _settings.page_size);
+    if (_settings.buffers)
+        req.add(isc_spb_res_buffers, _settings.buffers);
+    if (_settings.verbose)
+        req.add(isc_spb_verbose);
+    #ifdef isc_spb_res_parallel_workers
+    add_workers(req, isc_spb_res_parallel_workers);
+    #else
+    add_workers(req, 0);
+    #endif
+    return req;
+}
+
+// Build request of nbackup().
+service::request backup_service::nbackup_request(std::string_view database,
+    std::string_view file, uint32_t level)
+{
+    service::request req(isc_action_svc_nbak);
+    req.add(isc_spb_dbname, database)
+       .add(isc_spb_nbk_file, file)
+       .add(isc_spb_nbk_level, level);
+    return req;
+}
+
+// Build request of nrestore().
+service::request backup_service::nrestore_request(std::string_view database,
+    const std::vector<std::string>& files)
+{
+    service::request req(isc_action_svc_nrest);
+    req.add(isc_spb_dbname, database);
+    for (auto& f : files)
+        req.add(isc_spb_nbk_file, f);
+    return req;
+}
+
+// Add parallel workers to request.
+void backup_service::add_workers(service::request& req, uint8_t tag) const
+{
+    if (_settings.parallel_workers) {
+        if (!tag)
+            throw fb::exception("parallel workers are not supported by client library");
+        req.add(tag, _settings.parallel_workers);
+    }
+}
+
+// Wait for action reporting output lines.
+void backup_service::wait(const progress_callback& progress)
+{
+    backup_progress p;
+    _svc.wait([&](std::string_view line) {
+        if (progress) {
+            p.message = line;
+            progress(p);
+        }
+    });
+}
+
+} // namespace fb
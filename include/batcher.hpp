@@ -0,0 +1,456 @@
+/// \file batcher.hpp
+/// This file contains the statement_batcher that packs rows of a
+/// parameterized DML statement into EXECUTE BLOCK statements. This
+/// reduces the number of round trips on servers without batch API.
+
+#pragma once
+#include "query.hpp"
+
+#include <map>
+#include <cctype>
+#include <tuple>
+#include <string>
+#include <vector>
+
+namespace fb
+{
+
+namespace detail
+{
+    /// Character set of the server.
+    struct charset_t
+    {
+        const char* name;
+        /// Maximum bytes per character.
+        int bytes_per_char;
+    };
+
+    /// Get character set by id (RDB$CHARACTER_SET_ID).
+    ///
+    /// \return Character set, or null name if the id is unknown.
+    ///
+    inline charset_t charset_of(int id) noexcept
+    {
+        switch (id) {
+            case 0:  return { "NONE", 1 };
+            case 1:  return { "OCTETS", 1 };
+            case 2:  return { "ASCII", 1 };
+            case 3:  return { "UNICODE_FSS", 3 };
+            case 4:  return { "UTF8", 4 };
+            case 5:  return { "SJIS_0208", 2 };
+            case 6:  return { "EUCJ_0208", 2 };
+            case 9:  return { "DOS737", 1 };
+            case 10: return { "DOS437", 1 };
+            case 11: return { "DOS850", 1 };
+            case 12: return { "DOS865", 1 };
+            case 13: return { "DOS860", 1 };
+            case 14: return { "DOS863", 1 };
+            case 15: return { "DOS775", 1 };
+            case 16: return { "DOS858", 1 };
+            case 17: return { "DOS862", 1 };
+            case 18: return { "DOS864", 1 };
+            case 19: return { "NEXT", 1 };
+            case 21: return { "ISO8859_1", 1 };
+            case 22: return { "ISO8859_2", 1 };
+            case 23: return { "ISO8859_3", 1 };
+            case 34: return { "ISO8859_4", 1 };
+            case 35: return { "ISO8859_5", 1 };
+            case 36: return { "ISO8859_6", 1 };
+            case 37: return { "ISO8859_7", 1 };
+            case 38: return { "ISO8859_8", 1 };
+            case 39: return { "ISO8859_9", 1 };
+            case 40: return { "ISO8859_13", 1 };
+            case 44: return { "KSC_5601", 2 };
+            case 45: return { "DOS852", 1 };
+            case 46: return { "DOS857", 1 };
+            case 47: return { "DOS861", 1 };
+            case 48: return { "DOS866", 1 };
+            case 49: return { "DOS869", 1 };
+            case 50: return { "CYRL", 1 };
+            case 51: return { "WIN1250", 1 };
+            case 52: return { "WIN1251", 1 };
+            case 53: return { "WIN1252", 1 };
+            case 54: return { "WIN1253", 1 };
+            case 55: return { "WIN1254", 1 };
+            case 56: return { "BIG_5", 2 };
+            case 57: return { "GB_2312", 2 };
+            case 58: return { "WIN1255", 1 };
+            case 59: return { "WIN1256", 1 };
+            case 60: return { "WIN1257", 1 };
+            case 63: return { "KOI8R", 1 };
+            case 64: return { "KOI8U", 1 };
+            case 65: return { "WIN1258", 1 };
+            case 66: return { "TIS620", 1 };
+            case 67: return { "GBK", 2 };
+            case 68: return { "CP943C", 2 };
+            case 69: return { "GB18030", 4 };
+        }
+        return { nullptr, 1 };
+    }
+
+} // namespace detail
+
+/// Builder of EXECUTE BLOCK statements that repeat one DML
+/// statement for a number of parameter rows.
+///
+/// \code{.sql}
+///     EXECUTE BLOCK (P0_0 INTEGER = ?, P0_1 VARCHAR(20) CHARACTER SET UTF8 = ?,
+///                    P1_0 INTEGER = ?, P1_1 VARCHAR(20) CHARACTER SET UTF8 = ?)
+///     AS BEGIN
+///     insert into t (a, b) values (:P0_0, :P0_1);
+///     insert into t (a, b) values (:P1_0, :P1_1);
+///     END
+/// \endcode
+///
+struct execute_block
+{
+    /// Maximum number of input parameters in one statement.
+    static constexpr size_t max_params = 255;
+    /// Maximum length of statement text and of input message.
+    static constexpr size_t max_length = 65535;
+
+    /// Construct builder for a DML statement.
+    ///
+    /// \param[in] sql - DML statement with '?' placeholders.
+    /// \param[in] params - Described input parameters of the statement
+    ///                     (as returned by query::params()).
+    /// \param[in] max_rows - Upper limit of rows per statement (optional,
+    ///                       default is as many as fits in the limits).
+    ///
+    /// \throw fb::exception
+    ///
+    execute_block(std::string_view sql, const sqlda& params, size_t max_rows = 0);
+
+    /// Number of parameters in one row.
+    size_t columns() const noexcept
+    { return _types.size(); }
+
+    /// Maximum number of rows that fits in one statement.
+    size_t max_rows() const noexcept
+    { return _max_rows; }
+
+    /// Generate EXECUTE BLOCK statement for given number of rows.
+    ///
+    /// \param[in] rows - Number of rows, must not exceed max_rows().
+    ///
+    /// \return Statement text.
+    ///
+    std::string sql(size_t rows) const;
+
+    /// Get SQL type declaration of a described parameter, for
+    /// example "NUMERIC(18, 2)" or "VARCHAR(20) CHARACTER SET UTF8".
+    ///
+    /// \throw fb::exception
+    ///
+    static std::string type_decl(const sqlvar& var);
+
+private:
+    /// Statement split by placeholders.
+    std::vector<std::string> _parts;
+    /// Type declaration per parameter.
+    std::vector<std::string> _types;
+    /// Original statement.
+    std::string _sql;
+    size_t _max_rows = 1;
+};
+
+/// Collects rows of parameters for a DML statement and executes them
+/// in EXECUTE BLOCK statements, a block of rows per round trip. The
+/// prepared block is cached for each number of rows.
+///
+/// \code{.cpp}
+///     fb::statement_batcher<int, std::string> batch(trans,
+///         "insert into country (id, name) values (?, ?)");
+///     for (auto& [id, name] : countries)
+///         batch.add(id, name);  // executes when a block is full
+///     batch.flush();  // executes the remainder
+///     trans.commit();
+/// \endcode
+///
+/// \tparam Args... - Types of parameters in one row. Values are
+///                   copied and kept until executed.
+///
+template <class... Args>
+struct statement_batcher
+{
+    /// Construct batcher for given transaction.
+    ///
+    /// \param[in] tr - Transaction.
+    /// \param[in] sql - DML statement with one placeholder per argument.
+    /// \param[in] max_rows - Maximum number of rows per block (optional,
+    ///                       default is as many as fits in the limits).
+    ///
+    statement_batcher(transaction tr, std::string_view sql, size_t max_rows = 0) noexcept
+    : _trans(tr)
+    , _sql(sql)
+    , _max_rows(max_rows)
+    { }
+
+    /// Construct batcher to be used in default transaction
+    /// for given database.
+    ///
+    /// \param[in] db - Database.
+    /// \param[in] sql - DML statement with one placeholder per argument.
+    /// \param[in] max_rows - Maximum number of rows per block (optional).
+    ///
+    statement_batcher(database db, std::string_view sql, size_t max_rows = 0) noexcept
+    : statement_batcher(db.default_transaction(), sql, max_rows)
+    { }
+
+    /// Add a row of parameters. Executes a block when
+    /// enough rows are collected.
+    ///
+    /// \throw fb::exception
+    ///
+    void add(const Args&... args);
+
+    /// Execute all pending rows.
+    ///
+    /// \note Rows stay pending if execution fails.
+    ///
+    /// \throw fb::exception
+    ///
+    void flush();
+
+    /// Number of rows waiting for execution.
+    size_t size() const noexcept
+    { return _rows.size(); }
+
+    /// Number of rows executed per round trip.
+    ///
+    /// \throw fb::exception
+    ///
+    size_t block_size()
+    { return builder().max_rows(); }
+
+private:
+    using row_type = std::tuple<Args...>;
+
+    /// Describe statement and create block builder (once).
+    const execute_block& builder();
+
+    /// Execute first given number of pending rows in one block.
+    void execute(size_t nr_rows);
+
+    transaction _trans;
+    std::string _sql;
+    size_t _max_rows;
+
+    std::vector<row_type> _rows;
+    std::unique_ptr<execute_block> _builder;
+    /// Prepared statements by number of rows.
+    std::map<size_t, query> _blocks;
+};
+
+// Construct builder for a DML statement.
+execute_block::execute_block(
+    std::string_view dml, const sqlda& params, size_t max_rows)
+: _sql(dml)
+{
+    // Statement inside the block needs terminator of its own
+    while (!_sql.empty() && (std::isspace(_sql.back()) || _sql.back() == ';'))
+        _sql.pop_back();
+
+    // Split by placeholders, skipping literals, quoted names and comments
+    std::string_view s = _sql;
+    size_t start = 0;
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        char ch = s[i];
+        if (ch == '\'' || ch == '"') {
+            // Doubled quote is an escaped one, it is
+            // handled as two adjacent literals here
+            i = std::min(s.find(ch, i + 1), s.size());
+        }
+        else if (s.compare(i, 2, "--") == 0)
+            i = std::min(s.find('\n', i), s.size());
+        else if (s.compare(i, 2, "/*") == 0) {
+            size_t end = s.find("*/", i + 2);
+            i = end == s.npos ? s.size() : end + 1;
+        }
+        else if (ch == '?') {
+            _parts.emplace_back(s.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+    _parts.emplace_back(s.substr(start));
+
+    if (_parts.size() - 1 != params.size())
+        throw fb::exception("execute_block: found ") << (_parts.size() - 1)
+            << " placeholders, but statement has " << params.size() << " parameters";
+
+    // Message size of one row
+    size_t row_length = 0;
+    for (auto& var : params) {
+        _types.push_back(type_decl(var));
+        // Data (with length of varchar) aligned and null indicator
+        row_length += ((var.size() + 3) & ~1) + sizeof(short);
+    }
+
+    // Rows limited by number of parameters and by message size
+    if (columns()) {
+        _max_rows = std::min(max_params / columns(),
+            std::max(max_length / row_length, size_t(1)));
+    }
+    else
+        _max_rows = max_params;
+    if (max_rows)
+        _max_rows = std::min(_max_rows, max_rows);
+
+    // and by length of the statement itself
+    while (_max_rows > 1 && sql(_max_rows).size() > max_length)
+        _max_rows = _max_rows * 3 / 4;
+}
+
+// Generate EXECUTE BLOCK statement for given number of rows.
+std::string execute_block::sql(size_t rows) const
+{
+    // Single row does not need a block
+    if (rows == 1)
+        return _sql;
+
+    auto name = [](std::string& out, size_t row, size_t col) {
+        out.append("P").append(std::to_string(row))
+           .append("_").append(std::to_string(col));
+    };
+
+    std::string out = "EXECUTE BLOCK";
+    if (columns()) {
+        out.append(" (");
+        for (size_t row = 0; row < rows; ++row) {
+            for (size_t col = 0; col < columns(); ++col) {
+                if (row || col)
+                    out.append(", ");
+                name(out, row, col);
+                out.append(" ").append(_types[col]).append(" = ?");
+            }
+        }
+        out.append(")");
+    }
+    out.append("\nAS BEGIN\n");
+
+    for (size_t row = 0; row < rows; ++row) {
+        out.append(_parts[0]);
+        for (size_t col = 1; col < _parts.size(); ++col) {
+            out.append(":");
+            name(out, row, col - 1);
+            out.append(_parts[col]);
+        }
+        out.append(";\n");
+    }
+    out.append("END");
+    return out;
+}
+
+// Get SQL type declaration of a described parameter.
+std::string execute_block::type_decl(const sqlvar& var)
+{
+    auto p = var.handle();
+
+    // Numeric and decimal are integers with negative scale
+    auto integer = [p](const char* name, int precision) {
+        if (p->sqlscale >= 0)
+            return std::string(name);
+        return "NUMERIC(" + std::to_string(precision) + ", "
+            + std::to_string(-p->sqlscale) + ")";
+    };
+    // Character set id is kept in low byte of subtype, length
+    // is declared in characters of it
+    auto text = [&](const char* name) {
+        int id = p->sqlsubtype & 0xff;
+        auto cs = detail::charset_of(id);
+        if (!cs.name)
+            throw fb::exception("execute_block: character set (")
+                << id << ") of parameter " << std::quoted(var.name()) << " is unknown";
+        return std::string(name) + "(" + std::to_string(var.size() / cs.bytes_per_char)
+            + ") CHARACTER SET " + cs.name;
+    };
+    // Text blobs keep character set id in scale
+    auto blob = [&]() {
+        std::string ret = "BLOB SUB_TYPE " + std::to_string(p->sqlsubtype);
+        if (p->sqlsubtype == 1) {
+            if (auto cs = detail::charset_of(p->sqlscale & 0xff); cs.name)
+                ret.append(" CHARACTER SET ").append(cs.name);
+        }
+        return ret;
+    };
+
+    switch (var.sql_datatype()) {
+    case SQL_TEXT:      return text("CHAR");
+    case SQL_VARYING:   return text("VARCHAR");
+    case SQL_SHORT:     return integer("SMALLINT", 4);
+    case SQL_LONG:      return integer("INTEGER", 9);
+    case SQL_INT64:     return integer("BIGINT", 18);
+    case SQL_FLOAT:     return "FLOAT";
+    case SQL_DOUBLE:    return "DOUBLE PRECISION";
+    case SQL_TIMESTAMP: return "TIMESTAMP";
+    case SQL_TYPE_DATE: return "DATE";
+    case SQL_TYPE_TIME: return "TIME";
+    case SQL_BLOB:      return blob();
+    #ifdef SQL_BOOLEAN
+    case SQL_BOOLEAN:   return "BOOLEAN";
+    #endif
+    default:
+        throw fb::exception("execute_block: type (")
+            << var.sql_datatype() << ") of parameter "
+            << std::quoted(var.name()) << " not supported";
+    }
+}
+
+// Describe statement and create block builder (once).
+template <class... Args>
+const execute_block& statement_batcher<Args...>::builder()
+{
+    if (!_builder) {
+        query probe(_trans, _sql);
+        auto& params = probe.params(sizeof...(Args));
+        if (params.size() != sizeof...(Args))
+            throw fb::exception("statement_batcher: statement has ")
+                << params.size() << " parameters, batcher is declared with "
+                << sizeof...(Args);
+
+        _builder = std::make_unique<execute_block>(_sql, params, _max_rows);
+    }
+    return *_builder;
+}
+
+// Add a row of parameters.
+template <class... Args>
+void statement_batcher<Args...>::add(const Args&... args)
+{
+    _rows.emplace_back(args...);
+    size_t block = block_size();
+    while (_rows.size() >= block)
+        execute(block);
+}
+
+// Execute all pending rows.
+template <class... Args>
+void statement_batcher<Args...>::flush()
+{
+    size_t block = block_size();
+    while (!_rows.empty())
+        execute(std::min(block, _rows.size()));
+}
+
+// Execute first given number of pending rows in one block.
+template <class... Args>
+void statement_batcher<Args...>::execute(size_t nr_rows)
+{
+    auto it = _blocks.find(nr_rows);
+    if (it == _blocks.end())
+        it = _blocks.emplace(nr_rows, query(_trans, builder().sql(nr_rows))).first;
+
+    query& q = it->second;
+    auto var = q.params(nr_rows * sizeof...(Args)).begin();
+    for (size_t row = 0; row < nr_rows; ++row) {
+        std::apply([&](const auto&... val) {
+            ((var->set(val), ++var), ...);
+        }, _rows[row]);
+    }
+    q.execute();
+
+    _rows.erase(_rows.begin(), _rows.begin() + nr_rows);
+}
+
+} // namespace fb
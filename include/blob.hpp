@@ -114,7 +114,7 @@ private:
         {
             // Start transaction if not already
             tr.start();
-            invoke_except(isc_create_blob,
+            invoke_except<isc_create_blob>(
                 tr.db().handle(), tr.handle(), &_handle, &_id);
         }
 
@@ -122,7 +122,7 @@ private:
         context_t(transaction& tr, blob_id_t id)
         : _id(id)
         {
-            invoke_except(isc_open_blob,
+            invoke_except<isc_open_blob>(
                 tr.db().handle(), tr.handle(), &_handle, &id);
         }
 
@@ -132,7 +132,7 @@ private:
 
         /// Close the blob handle.
         void close() noexcept
-        { _handle && (invoke_noexcept(isc_close_blob, &_handle), true); }
+        { _handle && (invoke_noexcept<isc_close_blob>(&_handle), true); }
 
         isc_blob_handle _handle = 0;
         blob_id_t _id;
@@ -147,8 +147,8 @@ uint16_t blob::read_chunk(char* buf, uint16_t buf_length) const
     ISC_STATUS_ARRAY status;
     uint16_t nr_read = 0;
 
-    ISC_STATUS get_status = isc_get_segment(
-        status, &_context->_handle, &nr_read, buf_length, buf);
+    ISC_STATUS get_status = invoke_api<isc_get_segment>(status,
+        &_context->_handle, &nr_read, buf_length, buf);
 
     // TODO should we close the stream on isc_segstr_eof?
 
@@ -162,7 +162,7 @@ uint16_t blob::read_chunk(char* buf, uint16_t buf_length) const
 // Write a chunk of data to the blob.
 void blob::write_chunk(const char* buf, uint16_t buf_length)
 {
-    invoke_except(isc_put_segment,
+    invoke_except<isc_put_segment>(
         &_context->_handle, buf_length, const_cast<char*>(buf));
 }
 
@@ -0,0 +1,389 @@
+/// \file breaker.hpp
+/// This file contains the circuit breaker failing calls fast
+/// while a database is unreachable.
+
+#pragma once
+#include "exception.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace fb
+{
+
+/// Circuit breaker of one database (DSN). It keeps outcomes of
+/// the last calls. When too many of them failed because the
+/// database is unreachable, or were too slow, the breaker opens
+/// and calls fail immediately instead of waiting for network
+/// timeouts. After a while a few probe calls are let through
+/// (half-open), and the breaker closes when they succeed.
+///
+/// Only errors of connection (network, shutdown, unavailable
+/// database) count as failures. SQL errors mean that the database
+/// is healthy.
+///
+/// \code{.cpp}
+///     fb::database db("dbhost:employee");
+///     db.enable_circuit_breaker();
+///     // ... later, export metrics of all breakers
+///     for (auto& [dsn, st] : fb::circuit_breaker::all_stats())
+///         std::cout << dsn << " " << fb::circuit_breaker::state_name(st.state) << std::endl;
+/// \endcode
+///
+struct circuit_breaker
+{
+    /// State of the breaker.
+    enum class state : int
+    {
+        /// Calls pass, outcomes are counted.
+        closed,
+        /// Calls fail immediately.
+        open,
+        /// Limited number of probe calls pass.
+        half_open,
+    };
+
+    /// Breaker settings.
+    struct settings
+    {
+        /// Number of last calls to evaluate.
+        size_t window = 20;
+        /// Minimum number of calls in window before the breaker may open.
+        size_t min_calls = 10;
+        /// Open when this fraction of calls in window failed.
+        double failure_ratio = 0.5;
+        /// Calls slower than this are counted as slow.
+        std::chrono::nanoseconds slow_call = std::chrono::seconds(5);
+        /// Open when this fraction of calls in window was slow.
+        double slow_ratio = 0.8;
+        /// Time to stay open before letting probes through.
+        std::chrono::nanoseconds open_time = std::chrono::seconds(10);
+        /// Successful probes needed to close (also the maximum
+        /// number of probes in flight).
+        size_t probes = 3;
+    };
+
+    /// Breaker metrics.
+    struct breaker_stats
+    {
+        /// Current state.
+        circuit_breaker::state state = circuit_breaker::state::closed;
+        /// Calls let through.
+        size_t calls = 0;
+        /// Calls failed with connection error.
+        size_t failures = 0;
+        /// Calls slower than settings::slow_call.
+        size_t slow = 0;
+        /// Calls rejected while open.
+        size_t rejected = 0;
+        /// Number of times the breaker opened.
+        size_t opened = 0;
+        /// Fraction of failed calls in current window.
+        double failure_ratio = 0;
+    };
+
+    /// Construct breaker with default settings.
+    ///
+    /// \param[in] name - Name used in errors (optional).
+    ///
+    circuit_breaker(std::string_view name = {})
+    : circuit_breaker(settings{}, name)
+    { }
+
+    /// Construct breaker.
+    ///
+    /// \param[in] s - Settings.
+    /// \param[in] name - Name used in errors (optional).
+    ///
+    circuit_breaker(const settings& s, std::string_view name = {})
+    : _settings(s)
+    , _name(name)
+    , _window(std::max(s.window, size_t(1)), outcome::none)
+    { }
+
+    /// Get shared breaker of a DSN, created with default
+    /// settings on first use.
+    ///
+    /// \param[in] dsn - Database connection string.
+    ///
+    static std::shared_ptr<circuit_breaker> get(std::string_view dsn);
+
+    /// Get shared breaker of a DSN. Settings are used only
+    /// if the breaker is created.
+    ///
+    /// \param[in] dsn - Database connection string.
+    /// \param[in] s - Settings.
+    ///
+    static std::shared_ptr<circuit_breaker> get(std::string_view dsn, const settings& s);
+
+    /// Get metrics of all shared breakers, by DSN.
+    static std::vector<std::pair<std::string, breaker_stats>> all_stats();
+
+    /// Get name of a state ("closed", "open" or "half_open").
+    static const char* state_name(state s) noexcept
+    {
+        switch (s) {
+            case state::closed: return "closed";
+            case state::open: return "open";
+            case state::half_open: return "half_open";
+        }
+        return "";
+    }
+
+    /// Checks if the error means that the database is unreachable.
+    static bool is_failure(const exception& ex) noexcept
+    {
+        return ex.is_connection_lost()
+            || ex.code() == isc_net_connect_err
+            || ex.code() == isc_unavailable;
+    }
+
+    /// Ask permission for a call. Every permitted call must
+    /// be followed by record().
+    ///
+    /// \return false if the call must fail fast.
+    ///
+    bool allow() noexcept;
+
+    /// Record outcome of a permitted call.
+    ///
+    /// \param[in] failed - Call failed with connection error.
+    /// \param[in] elapsed - Duration of the call.
+    ///
+    void record(bool failed, std::chrono::nanoseconds elapsed) noexcept;
+
+    /// Run a call through the breaker.
+    ///
+    /// \param[in] fn - Call, may throw fb::exception.
+    ///
+    /// \return Result of the call.
+    /// \throw fb::exception (also when the breaker is open)
+    ///
+    template <class F>
+    decltype(auto) call(F&& fn);
+
+    /// Get name of the breaker (DSN for shared breakers).
+    const std::string& name() const noexcept
+    { return _name; }
+
+    /// Get current state.
+    state current() const noexcept
+    { return _state.load(std::memory_order_relaxed); }
+
+    /// Get metrics.
+    breaker_stats stats() const;
+
+    /// Close the breaker and forget outcomes.
+    void reset() noexcept;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    /// Outcome of a call in window.
+    enum class outcome : uint8_t { none, ok, failed, slow };
+
+    /// Move to state, must be called under lock.
+    void move_to(state s) noexcept;
+
+    settings _settings;
+    std::string _name;
+    mutable std::mutex _mutex;
+    std::atomic<state> _state = state::closed;
+    /// Time when opened.
+    clock::time_point _opened_at;
+    /// Outcomes of last calls (ring).
+    std::vector<outcome> _window;
+    size_t _pos = 0;
+    size_t _in_window = 0;
+    size_t _failed_in_window = 0;
+    size_t _slow_in_window = 0;
+    /// Probes let through and succeeded in half-open state.
+    size_t _probes = 0;
+    size_t _probes_ok = 0;
+    breaker_stats _stats;
+};
+
+namespace detail
+{
+    /// Shared breakers by DSN.
+    struct breaker_registry
+    {
+        std::mutex mutex;
+        std::map<std::string, std::shared_ptr<circuit_breaker>, std::less<>> breakers;
+
+        static breaker_registry& instance()
+        {
+            static breaker_registry r;
+            return r;
+        }
+    };
+
+} // namespace detail
+
+// Get shared breaker of a DSN.
+std::shared_ptr<circuit_breaker> circuit_breaker::get(std::string_view dsn)
+{ return get(dsn, settings{}); }
+
+// Get shared breaker of a DSN.
+std::shared_ptr<circuit_breaker> circuit_breaker::get(
+    std::string_view dsn, const settings& s)
+{
+    auto& r = detail::breaker_registry::instance();
+    std::lock_guard lock(r.mutex);
+    auto it = r.breakers.find(dsn);
+    if (it == r.breakers.end())
+        it = r.breakers.emplace(dsn, std::make_shared<circuit_breaker>(s, dsn)).first;
+    return it->second;
+}
+
+// Get metrics of all shared breakers.
+std::vector<std::pair<std::string, circuit_breaker::breaker_stats>>
+circuit_breaker::all_stats()
+{
+    auto& r = detail::breaker_registry::instance();
+    std::lock_guard lock(r.mutex);
+    std::vector<std::pair<std::string, breaker_stats>> ret;
+    ret.reserve(r.breakers.size());
+    for (auto& [dsn, b] : r.breakers)
+        ret.emplace_back(dsn, b->stats());
+    return ret;
+}
+
+// Ask permission for a call.
+bool circuit_breaker::allow() noexcept
+{
+    // Fast path, nothing to decide
+    if (current() == state::closed)
+        return true;
+
+    std::lock_guard lock(_mutex);
+    if (_state == state::open) {
+        if (clock::now() - _opened_at < _settings.open_time) {
+            ++_stats.rejected;
+            return false;
+        }
+        move_to(state::half_open);
+    }
+    if (_state == state::half_open) {
+        if (_probes >= _settings.probes) {
+            ++_stats.rejected;
+            return false;
+        }
+        ++_probes;
+    }
+    return true;
+}
+
+// Record outcome of a permitted call.
+void circuit_breaker::record(bool failed, std::chrono::nanoseconds elapsed) noexcept
+{
+    bool slow = elapsed >= _settings.slow_call;
+
+    std::lock_guard lock(_mutex);
+    ++_stats.calls;
+    _stats.failures += failed;
+    _stats.slow += slow;
+
+    switch (_state.load(std::memory_order_relaxed)) {
+    case state::closed: {
+        // Replace the oldest outcome in window
+        auto& o = _window[_pos];
+        _pos = (_pos + 1) % _window.size();
+        if (o == outcome::none)
+            ++_in_window;
+        _failed_in_window -= (o == outcome::failed);
+        _slow_in_window -= (o == outcome::slow);
+
+        o = failed ? outcome::failed : slow ? outcome::slow : outcome::ok;
+        _failed_in_window += failed;
+        _slow_in_window += (o == outcome::slow);
+
+        if (_in_window >= _settings.min_calls &&
+            (_failed_in_window >= _settings.failure_ratio * _in_window ||
+             _slow_in_window >= _settings.slow_ratio * _in_window))
+            move_to(state::open);
+        break;
+    }
+    case state::half_open:
+        if (failed || slow)
+            move_to(state::open);
+        else if (++_probes_ok >= _settings.probes)
+            move_to(state::closed);
+        break;
+    case state::open:
+        // Call permitted before the breaker opened
+        break;
+    }
+}
+
+// Run a call through the breaker.
+template <class F>
+decltype(auto) circuit_breaker::call(F&& fn)
+{
+    if (!allow())
+        throw exception() << "circuit breaker is open: " << _name;
+
+    auto start = clock::now();
+    try {
+        if constexpr (std::is_void_v<decltype(fn())>) {
+            fn();
+            record(false, clock::now() - start);
+        }
+        else {
+            decltype(auto) ret = fn();
+            record(false, clock::now() - start);
+            return ret;
+        }
+    }
+    catch (const exception& ex) {
+        record(is_failure(ex), clock::now() - start);
+        throw;
+    }
+    catch (...) {
+        record(false, clock::now() - start);
+        throw;
+    }
+}
+
+// Get metrics.
+circuit_breaker::breaker_stats circuit_breaker::stats() const
+{
+    std::lock_guard lock(_mutex);
+    breaker_stats ret = _stats;
+    ret.state = _state;
+    ret.failure_ratio = _in_window ? double(_failed_in_window) / _in_window : 0.0;
+    return ret;
+}
+
+// Close the breaker and forget outcomes.
+void circuit_breaker::reset() noexcept
+{
+    std::lock_guard lock(_mutex);
+    move_to(state::closed);
+}
+
+// Move to state.
+void circuit_breaker::move_to(state s) noexcept
+{
+    if (s == state::open) {
+        _opened_at = clock::now();
+        ++_stats.opened;
+    }
+    // Window starts over when closed
+    if (s == state::closed) {
+        std::fill(_window.begin(), _window.end(), outcome::none);
+        _pos = _in_window = _failed_in_window = _slow_in_window = 0;
+    }
+    _probes = _probes_ok = 0;
+    _state.store(s, std::memory_order_relaxed);
+}
+
+} // namespace fb
@@ -0,0 +1,466 @@
+/// \file cache.hpp
+/// This file contains the cache of materialized query results.
+
+#pragma once
+#include "routing.hpp"
+#include "events.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+namespace fb
+{
+
+namespace detail
+{
+    /// Append parameter value to a cache key. Every value is
+    /// prefixed with its length, so keys of different values
+    /// never collide.
+    template <class T>
+    void append_key(std::string& key, const T& val)
+    {
+        std::string s;
+        if constexpr (std::is_same_v<T, std::nullptr_t>) {
+            // Null differs from empty string
+            key.append("N;");
+            return;
+        }
+        else if constexpr (std::is_floating_point_v<T>) {
+            // Exact value, std::to_string rounds to 6 decimals
+            char buf[64];
+            int n = std::snprintf(buf, sizeof(buf), "%La", static_cast<long double>(val));
+            s.assign(buf, size_t(n));
+        }
+        else if constexpr (std::is_arithmetic_v<T>)
+            s = std::to_string(val);
+        else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+            s = std::string_view(val);
+        else if constexpr (std::is_same_v<T, timestamp_t>)
+            s = std::to_string(val.timestamp_date) + "." + std::to_string(val.timestamp_time);
+        else {
+            // Value of skip_t is unknown, blobs may change
+            static_assert(!sizeof(T), "type of parameter is not supported by cache key");
+        }
+        key.append(std::to_string(s.size())).append(":").append(s).append(";");
+    }
+
+} // namespace detail
+
+/// Cache of materialized query results, split into shards with an
+/// LRU list each. Entries expire after time to live (TTL), and are
+/// invalidated by tag. Tags are usually names of events posted by
+/// triggers of the tables the query reads, so listen() invalidates
+/// them when the event is posted.
+///
+/// \code{.cpp}
+///     fb::query_cache cache;
+///     // Trigger of table setting does POST_EVENT 'setting_changed'
+///     cache.listen(events_db, { "setting_changed" });
+///
+///     fb::cached_query<std::string> q(cache, db,
+///         "select val from setting where name = ?", { "setting_changed" });
+///     auto rows = q.execute("timeout");  // from server first time, then cached
+/// \endcode
+///
+struct query_cache
+{
+private:
+    struct context_t;
+
+public:
+    /// Cache settings.
+    struct settings
+    {
+        /// Number of shards (each with a lock of its own).
+        size_t shards = 16;
+        /// Maximum number of entries (in all shards).
+        size_t capacity = 10000;
+        /// Time to live of an entry.
+        std::chrono::nanoseconds ttl = std::chrono::seconds(60);
+    };
+
+    /// Cache statistics.
+    struct cache_stats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        /// Entries removed to make room.
+        size_t evictions = 0;
+        /// Entries found expired.
+        size_t expired = 0;
+        /// Entries found invalidated by tag.
+        size_t invalidated = 0;
+        /// Number of entries.
+        size_t size = 0;
+    };
+
+    /// Construct cache with default settings.
+    query_cache();
+
+    /// Construct cache.
+    ///
+    /// \param[in] s - Settings.
+    ///
+    query_cache(const settings& s);
+
+    /// Get cached value.
+    ///
+    /// \tparam T - Type of value, as stored.
+    /// \param[in] key - Key.
+    ///
+    /// \return Value or null if not found, expired or invalidated.
+    ///
+    template <class T>
+    std::shared_ptr<const T> get(const std::string& key);
+
+    /// Store value. Tags invalidated later make it stale.
+    ///
+    /// \param[in] key - Key.
+    /// \param[in] value - Value.
+    /// \param[in] tags - Tags invalidating the value.
+    ///
+    template <class T>
+    void put(const std::string& key, std::shared_ptr<const T> value,
+        const std::vector<std::string>& tags = {});
+
+    /// Invalidate entries stored with tag.
+    ///
+    /// \param[in] tag - Tag.
+    ///
+    void invalidate(std::string_view tag);
+
+    /// Remove all entries.
+    void clear() noexcept;
+
+    /// Invalidate tags of the same name as events posted in database.
+    ///
+    /// \param[in] db - Connected database, preferably of its own.
+    /// \param[in] events - Names of events (up to event_listener::max_events).
+    ///
+    /// \throw fb::exception
+    ///
+    void listen(database db, std::vector<std::string> events);
+
+    /// Get statistics.
+    cache_stats stats() const;
+
+private:
+    template <class... T> friend struct cached_query;
+
+    /// Tags with their generation.
+    using tag_list = std::vector<std::pair<std::string, uint64_t>>;
+
+    /// Get current generation of tags.
+    tag_list snapshot(const std::vector<std::string>& tags);
+
+    /// Store value valid for the tag generations.
+    void store(const std::string& key, std::shared_ptr<const void> value, tag_list tags);
+
+    std::shared_ptr<context_t> _context;
+};
+
+/// Query with results cached in query_cache, keyed by statement text,
+/// column types and values of parameters. Rows are materialized in a
+/// read-only transaction of its own.
+///
+/// \tparam T... - Column types, use std::optional for nullable columns.
+///
+template <class... T>
+struct cached_query
+{
+    /// Rows of the result.
+    using rows = std::vector<std::tuple<T...>>;
+
+    /// Construct cached query.
+    ///
+    /// \param[in] cache - Cache.
+    /// \param[in] db - Database.
+    /// \param[in] sql - SELECT statement.
+    /// \param[in] tags - Tags (event names) invalidating results (optional).
+    ///
+    cached_query(query_cache cache, database db, std::string_view sql,
+        std::vector<std::string> tags = {})
+    : _cache(std::move(cache))
+    , _db(std::move(db))
+    , _sql(sql)
+    , _tags(std::move(tags))
+    {
+        // Same statement on another database or with other column
+        // types is another entry
+        if (_db.path().empty())
+            _key.append("@").append(std::to_string(*_db.handle()));
+        else
+            _key.append(_db.path());
+        _key.append("\n").append(_sql).append("\n").append(typeid(rows).name()).append("\n");
+    }
+
+    /// Get result from the cache, or execute and cache it.
+    ///
+    /// \param[in] args - Parameters (optional).
+    ///
+    /// \return Rows.
+    /// \throw fb::exception
+    ///
+    template <class... Args>
+    std::shared_ptr<const rows> execute(const Args&... args);
+
+private:
+    query_cache _cache;
+    database _db;
+    std::string _sql;
+    std::vector<std::string> _tags;
+    /// Key without parameters.
+    std::string _key;
+};
+
+/// Query cache internal data.
+struct query_cache::context_t
+{
+    using clock = std::chrono::steady_clock;
+
+    /// Cached value.
+    struct entry
+    {
+        std::string key;
+        std::shared_ptr<const void> value;
+        clock::time_point expires;
+        /// Tags and their generation when stored.
+        tag_list tags;
+    };
+
+    /// Part of the cache with a lock of its own.
+    struct shard
+    {
+        std::mutex mutex;
+        /// Most recently used first.
+        std::list<entry> lru;
+        std::unordered_map<std::string_view, std::list<entry>::iterator> index;
+    };
+
+    context_t(const settings& s)
+    : _settings(s)
+    , _shards(std::max(s.shards, size_t(1)))
+    , _shard_capacity(std::max(s.capacity / _shards.size(), size_t(1)))
+    { }
+
+    /// Stop listeners before the tags they invalidate are destroyed.
+    ~context_t()
+    {
+        for (auto& l : _listeners)
+            l->stop();
+    }
+
+    /// Get shard of a key.
+    shard& shard_of(const std::string& key) noexcept
+    { return _shards[std::hash<std::string>()(key) % _shards.size()]; }
+
+    /// Checks if entry was invalidated by any of its tags.
+    bool is_invalidated(const entry& e)
+    {
+        if (e.tags.empty())
+            return false;
+        std::lock_guard lock(_tags_mutex);
+        for (auto& [tag, gen] : e.tags) {
+            if (_tags[tag] != gen)
+                return true;
+        }
+        return false;
+    }
+
+    /// Remove entry (under lock of shard).
+    static void remove(shard& s, std::list<entry>::iterator it)
+    {
+        s.index.erase(it->key);
+        s.lru.erase(it);
+    }
+
+    settings _settings;
+    std::vector<shard> _shards;
+    size_t _shard_capacity;
+
+    /// Generation of tags, incremented on invalidation.
+    std::mutex _tags_mutex;
+    std::unordered_map<std::string, uint64_t> _tags;
+
+    std::atomic<size_t> _hits = 0;
+    std::atomic<size_t> _misses = 0;
+    std::atomic<size_t> _evictions = 0;
+    std::atomic<size_t> _expired = 0;
+    std::atomic<size_t> _invalidated = 0;
+
+    /// Listeners of invalidation events.
+    std::mutex _listeners_mutex;
+    std::vector<std::unique_ptr<event_listener>> _listeners;
+};
+
+// Construct cache with default settings.
+query_cache::query_cache()
+: query_cache(settings{})
+{ }
+
+// Construct cache.
+query_cache::query_cache(const settings& s)
+: _context(std::make_shared<context_t>(s))
+{ }
+
+// Get cached value.
+template <class T>
+std::shared_ptr<const T> query_cache::get(const std::string& key)
+{
+    context_t* c = _context.get();
+    auto& s = c->shard_of(key);
+
+    std::lock_guard lock(s.mutex);
+    auto it = s.index.find(key);
+    if (it == s.index.end()) {
+        ++c->_misses;
+        return nullptr;
+    }
+
+    auto e = it->second;
+    if (context_t::clock::now() >= e->expires) {
+        ++c->_expired;
+        ++c->_misses;
+        context_t::remove(s, e);
+        return nullptr;
+    }
+    if (c->is_invalidated(*e)) {
+        ++c->_invalidated;
+        ++c->_misses;
+        context_t::remove(s, e);
+        return nullptr;
+    }
+
+    // Most recently used to the front
+    s.lru.splice(s.lru.begin(), s.lru, e);
+    ++c->_hits;
+    return std::static_pointer_cast<const T>(e->value);
+}
+
+// Store value.
+template <class T>
+void query_cache::put(const std::string& key, std::shared_ptr<const T> value,
+    const std::vector<std::string>& tags)
+{
+    store(key, std::move(value), snapshot(tags));
+}
+
+// Get current generation of tags.
+query_cache::tag_list query_cache::snapshot(const std::vector<std::string>& tags)
+{
+    context_t* c = _context.get();
+    tag_list ret;
+    std::lock_guard lock(c->_tags_mutex);
+    for (auto& t : tags)
+        ret.emplace_back(t, c->_tags[t]);
+    return ret;
+}
+
+// Store value valid for the tag generations.
+void query_cache::store(const std::string& key, std::shared_ptr<const void> value, tag_list tags)
+{
+    context_t* c = _context.get();
+
+    context_t::entry e;
+    e.key = key;
+    e.value = std::move(value);
+    e.expires = context_t::clock::now() + c->_settings.ttl;
+    e.tags = std::move(tags);
+
+    auto& s = c->shard_of(key);
+    std::lock_guard lock(s.mutex);
+    if (auto it = s.index.find(key); it != s.index.end())
+        context_t::remove(s, it->second);
+
+    s.lru.push_front(std::move(e));
+    s.index.emplace(s.lru.front().key, s.lru.begin());
+
+    while (s.lru.size() > c->_shard_capacity) {
+        context_t::remove(s, std::prev(s.lru.end()));
+        ++c->_evictions;
+    }
+}
+
+// Invalidate entries stored with tag.
+void query_cache::invalidate(std::string_view tag)
+{
+    context_t* c = _context.get();
+    std::lock_guard lock(c->_tags_mutex);
+    ++c->_tags[std::string(tag)];
+}
+
+// Remove all entries.
+void query_cache::clear() noexcept
+{
+    for (auto& s : _context->_shards) {
+        std::lock_guard lock(s.mutex);
+        s.index.clear();
+        s.lru.clear();
+    }
+}
+
+// Invalidate tags of the same name as events posted in database.
+void query_cache::listen(database db, std::vector<std::string> events)
+{
+    // Listener is owned by the cache and stopped before it is destroyed.
+    // It must not own the cache, it would be destroyed on its own thread.
+    context_t* c = _context.get();
+    auto l = std::make_unique<event_listener>(std::move(db), std::move(events),
+        [c](std::string_view name, uint32_t) {
+            std::lock_guard lock(c->_tags_mutex);
+            ++c->_tags[std::string(name)];
+        });
+
+    std::lock_guard lock(_context->_listeners_mutex);
+    _context->_listeners.push_back(std::move(l));
+}
+
+// Get statistics.
+query_cache::cache_stats query_cache::stats() const
+{
+    context_t* c = _context.get();
+    cache_stats ret;
+    ret.hits = c->_hits;
+    ret.misses = c->_misses;
+    ret.evictions = c->_evictions;
+    ret.expired = c->_expired;
+    ret.invalidated = c->_invalidated;
+    for (auto& s : c->_shards) {
+        std::lock_guard lock(s.mutex);
+        ret.size += s.lru.size();
+    }
+    return ret;
+}
+
+// Get result from the cache, or execute and cache it.
+template <class... T>
+template <class... Args>
+auto cached_query<T...>::execute(const Args&... args) -> std::shared_ptr<const rows>
+{
+    std::string key = _key;
+    (detail::append_key(key, args), ...);
+
+    if (auto hit = _cache.get<rows>(key))
+        return hit;
+
+    // Generations before reading, so rows are stale
+    // if invalidated while reading
+    auto tags = _cache.snapshot(_tags);
+    auto ret = std::make_shared<const rows>(
+        detail::read_rows<T...>(_db, _sql, std::tie(args...)));
+    _cache.store(key, ret, std::move(tags));
+    return ret;
+}
+
+} // namespace fb
@@ -0,0 +1,472 @@
+/// \file capture.hpp
+/// This file contains the workload capture. Statements, their
+/// parameters, transaction boundaries and timings are recorded
+/// to a compact binary log for replay (see tools/fb_replay.cpp).
+
+#pragma once
+#include "sqlda.hpp"
+#include "writer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fb
+{
+
+/// Input parameter of a captured statement.
+struct workload_param
+{
+    /// SQL type, SQL_NULL for null.
+    int type = SQL_NULL;
+    /// Raw value in the layout of the type (native byte order).
+    std::string data;
+
+    /// Checks if the value is null.
+    bool is_null() const noexcept
+    { return type == SQL_NULL; }
+};
+
+/// Entry of the workload log.
+struct workload_entry
+{
+    /// Type of entry.
+    enum kind_t : uint8_t
+    {
+        start = 1,
+        commit,
+        rollback,
+        execute,
+    };
+
+    kind_t kind = execute;
+    /// Attachment id.
+    int64_t session = 0;
+    /// Id of the transaction (unique in the capturing process).
+    uint64_t transaction = 0;
+    /// Time since capture began, when the operation started.
+    std::chrono::nanoseconds offset{};
+    /// Duration of the operation (all fetches included).
+    std::chrono::nanoseconds elapsed{};
+    /// Statement text (execute).
+    std::string sql;
+    /// Input parameters (execute).
+    std::vector<workload_param> params;
+    /// Fetched rows of SELECT (execute).
+    uint64_t rows = 0;
+    /// Transaction parameters (start).
+    std::vector<char> tpb;
+};
+
+namespace detail
+{
+    /// Write unsigned LEB128.
+    inline void write_varint(std::ostream& os, uint64_t v)
+    {
+        do {
+            char b = v & 0x7f;
+            v >>= 7;
+            os.put(v ? char(b | 0x80) : b);
+        } while (v);
+    }
+
+    /// Read unsigned LEB128.
+    inline bool read_varint(std::istream& is, uint64_t& v)
+    {
+        v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            int b = is.get();
+            if (b == std::char_traits<char>::eof())
+                return false;
+            v |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    /// Write length and bytes.
+    inline void write_bytes(std::ostream& os, const char* data, size_t len)
+    {
+        write_varint(os, len);
+        os.write(data, len);
+    }
+
+    /// Read length and bytes.
+    template <class C>
+    bool read_bytes(std::istream& is, C& out)
+    {
+        uint64_t len;
+        if (!read_varint(is, len) || len > (1u << 30))
+            return false;
+        out.resize(len);
+        return bool(is.read(out.data(), len));
+    }
+
+} // namespace detail
+
+/// Workload capture. While an instance exists, every fb::query
+/// execution and every transaction start, commit and rollback is
+/// recorded. Recording is a push to a lock-free ring buffer, entries
+/// are written to the file by a background thread. Entries are
+/// dropped (and counted) when the buffer is full, the log is then
+/// incomplete for replay.
+///
+/// Statement text is written once, later entries refer to it.
+///
+/// \code{.cpp}
+///     fb::workload_capture capture("prod.fbwl");
+///     // ... run the application workload ...
+/// \endcode
+///
+/// Replay the log with `tools/fb_replay prod.fbwl localhost:test`.
+///
+/// \note Values are recorded in native byte order, replay on a
+///       machine of the same architecture. Blob parameters are
+///       recorded as null.
+///
+struct workload_capture
+{
+    /// Capture settings.
+    struct settings
+    {
+        /// Maximum number of entries waiting to be written.
+        size_t capacity = 65536;
+    };
+
+    /// Guard of the active capture. Keeps the capture from being
+    /// destroyed while in use.
+    struct guard
+    {
+        guard(workload_capture* cap) noexcept
+        : _cap(cap)
+        { }
+
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+
+        ~guard() noexcept
+        { if (_cap) --_users; }
+
+        workload_capture* operator->() const noexcept
+        { return _cap; }
+
+        explicit operator bool() const noexcept
+        { return _cap; }
+
+    private:
+        workload_capture* _cap;
+    };
+
+    /// Magic bytes and version at start of the file.
+    static constexpr char header[] = "FBWL\x01";
+
+    /// Create log file with default settings and make it the
+    /// active capture.
+    ///
+    /// \param[in] path - Path to the log file (truncated).
+    ///
+    /// \throw fb::exception if file can't be opened or another
+    ///        capture is already active.
+    ///
+    explicit workload_capture(const std::string& path);
+
+    /// Create log file and make it the active capture.
+    ///
+    /// \param[in] path - Path to the log file (truncated).
+    /// \param[in] s - Settings.
+    ///
+    /// \throw fb::exception if file can't be opened or another
+    ///        capture is already active.
+    ///
+    workload_capture(const std::string& path, const settings& s);
+
+    /// Deactivate and write all recorded entries.
+    ~workload_capture() noexcept;
+
+    workload_capture(const workload_capture&) = delete;
+    workload_capture& operator=(const workload_capture&) = delete;
+
+    /// Checks if a capture is active, without using it. Costs
+    /// a relaxed atomic load.
+    static bool is_active() noexcept
+    { return _active.load(std::memory_order_relaxed); }
+
+    /// Get the active capture, if any.
+    static guard active() noexcept
+    {
+        if (!_active.load(std::memory_order_relaxed))
+            return nullptr;
+        ++_users;
+        workload_capture* cap = _active;
+        if (!cap)
+            --_users;
+        return cap;
+    }
+
+    /// Get time since capture began.
+    std::chrono::nanoseconds offset(std::chrono::steady_clock::time_point tp) const noexcept
+    { return tp - _began; }
+
+    /// Record an entry (never blocks).
+    void push(workload_entry&& e) noexcept
+    { _writer.push(std::move(e)); }
+
+    /// Copy input parameters.
+    static std::vector<workload_param> copy(const sqlda& params);
+
+    /// Number of entries dropped due to full buffer.
+    size_t dropped() const noexcept
+    { return _writer.dropped(); }
+
+    /// Number of entries written to the file.
+    size_t written() const noexcept
+    { return _writer.written(); }
+
+private:
+    /// Claim of the only capture, taken before the file is opened
+    /// so a rejected capture doesn't touch the file of another.
+    struct claim_t
+    {
+        claim_t()
+        {
+            if (_claimed.exchange(true))
+                throw fb::exception("workload_capture: another capture is already active");
+        }
+
+        ~claim_t() noexcept
+        { _claimed = false; }
+
+        claim_t(const claim_t&) = delete;
+        claim_t& operator=(const claim_t&) = delete;
+    };
+
+    /// Write entry to the file (background thread).
+    void write(std::ostream& os, const workload_entry& e);
+
+    claim_t _claim;
+    std::chrono::steady_clock::time_point _began;
+    /// Ids of statement texts written, used by the writer only.
+    std::unordered_map<std::string, uint64_t> _sql_ids;
+    bool _has_header = false;
+    background_writer<workload_entry> _writer;
+
+    static inline std::atomic<workload_capture*> _active = nullptr;
+    static inline std::atomic<bool> _claimed = false;
+    /// Number of guards in use.
+    static inline std::atomic<size_t> _users = 0;
+};
+
+/// Reader of the workload log.
+///
+/// \code{.cpp}
+///     fb::workload_reader r("prod.fbwl");
+///     fb::workload_entry e;
+///     while (r.next(e))
+///         std::cout << e.offset.count() << ' ' << e.sql << std::endl;
+/// \endcode
+///
+struct workload_reader
+{
+    /// Open log file.
+    ///
+    /// \param[in] path - Path to the log file.
+    ///
+    /// \throw fb::exception if file can't be opened or is not a log.
+    ///
+    explicit workload_reader(const std::string& path);
+
+    /// Read next entry.
+    ///
+    /// \return false at the end of the log.
+    /// \throw fb::exception if the log is corrupted.
+    ///
+    bool next(workload_entry& e);
+
+private:
+    std::ifstream _file;
+    std::string _path;
+    /// Statement texts by id.
+    std::vector<std::string> _sql;
+};
+
+// Create log file with default settings.
+workload_capture::workload_capture(const std::string& path)
+: workload_capture(path, settings())
+{ }
+
+// Create log file and make it the active capture.
+workload_capture::workload_capture(const std::string& path, const settings& s)
+: _began(std::chrono::steady_clock::now())
+, _writer(path, s.capacity,
+    [this](std::ostream& os, const workload_entry& e) { write(os, e); },
+    std::ios::binary | std::ios::trunc | std::ios::out)
+{
+    if (!_writer.is_open())
+        throw fb::exception("workload_capture: can't open ") << std::quoted(path);
+    // Published when ready to record
+    _active = this;
+}
+
+// Deactivate and write all recorded entries.
+workload_capture::~workload_capture() noexcept
+{
+    _active = nullptr;
+    // Wait for statements that are recording right now
+    while (_users)
+        std::this_thread::yield();
+    // Writer drains remaining entries on destruction,
+    // then the claim is released
+}
+
+// Copy input parameters.
+std::vector<workload_param> workload_capture::copy(const sqlda& params)
+{
+    std::vector<workload_param> ret;
+    ret.reserve(params.size());
+    for (auto& var : params) {
+        workload_param p;
+        auto x = var.handle();
+        int type = var.sql_datatype();
+        if (x->sqldata && type != SQL_NULL && type != SQL_BLOB && !var.is_null()) {
+            // Varying is kept as text, without its length prefix
+            if (type == SQL_VARYING) {
+                p.type = SQL_TEXT;
+                p.data.assign(x->sqldata + 2, *reinterpret_cast<const uint16_t*>(x->sqldata));
+            }
+            else {
+                p.type = type;
+                p.data.assign(x->sqldata, x->sqllen);
+            }
+        }
+        ret.push_back(std::move(p));
+    }
+    return ret;
+}
+
+// Write entry to the file.
+void workload_capture::write(std::ostream& os, const workload_entry& e)
+{
+    using namespace detail;
+
+    if (!_has_header) {
+        os.write(header, sizeof(header) - 1);
+        _has_header = true;
+    }
+
+    // Statement text is defined by an entry of kind 0
+    uint64_t sql_id = 0;
+    if (e.kind == workload_entry::execute) {
+        auto [it, added] = _sql_ids.emplace(e.sql, _sql_ids.size());
+        sql_id = it->second;
+        if (added) {
+            os.put(0);
+            write_bytes(os, e.sql.data(), e.sql.size());
+        }
+    }
+
+    os.put(char(e.kind));
+    write_varint(os, uint64_t(e.session));
+    write_varint(os, e.transaction);
+    write_varint(os, uint64_t(e.offset.count()));
+    write_varint(os, uint64_t(e.elapsed.count()));
+
+    if (e.kind == workload_entry::start)
+        write_bytes(os, e.tpb.data(), e.tpb.size());
+    else if (e.kind == workload_entry::execute) {
+        write_varint(os, sql_id);
+        write_varint(os, e.rows);
+        write_varint(os, e.params.size());
+        for (auto& p : e.params) {
+            write_varint(os, uint64_t(p.type));
+            if (!p.is_null())
+                write_bytes(os, p.data.data(), p.data.size());
+        }
+    }
+}
+
+// Open log file.
+workload_reader::workload_reader(const std::string& path)
+: _file(path, std::ios::binary)
+, _path(path)
+{
+    if (!_file)
+        throw fb::exception("workload_reader: can't open ") << std::quoted(path);
+
+    // Empty log has no header
+    char buf[sizeof(workload_capture::header) - 1];
+    if (_file.peek() != std::char_traits<char>::eof() &&
+        (!_file.read(buf, sizeof(buf)) ||
+         std::string_view(buf, sizeof(buf)) != std::string_view(workload_capture::header, sizeof(buf))))
+        throw fb::exception("workload_reader: not a workload log ") << std::quoted(path);
+}
+
+// Read next entry.
+bool workload_reader::next(workload_entry& e)
+{
+    using namespace detail;
+
+    for (;;) {
+        int kind = _file.get();
+        if (kind == std::char_traits<char>::eof())
+            return false;
+
+        uint64_t v[4];
+        bool ok = true;
+        if (kind == 0) {
+            // Statement text definition
+            ok = read_bytes(_file, _sql.emplace_back());
+            if (!ok)
+                break;
+            continue;
+        }
+        if (kind < workload_entry::start || kind > workload_entry::execute)
+            break;
+
+        for (auto& x : v)
+            ok = ok && read_varint(_file, x);
+        if (!ok)
+            break;
+
+        e.kind = workload_entry::kind_t(kind);
+        e.session = int64_t(v[0]);
+        e.transaction = v[1];
+        e.offset = std::chrono::nanoseconds(v[2]);
+        e.elapsed = std::chrono::nanoseconds(v[3]);
+        e.sql.clear();
+        e.params.clear();
+        e.rows = 0;
+        e.tpb.clear();
+
+        if (e.kind == workload_entry::start) {
+            if (!read_bytes(_file, e.tpb))
+                break;
+        }
+        else if (e.kind == workload_entry::execute) {
+            uint64_t sql_id, n;
+            if (!read_varint(_file, sql_id) || sql_id >= _sql.size() ||
+                !read_varint(_file, e.rows) || !read_varint(_file, n))
+                break;
+            e.sql = _sql[sql_id];
+            for (uint64_t i = 0; ok && i < n; ++i) {
+                auto& p = e.params.emplace_back();
+                uint64_t type;
+                ok = read_varint(_file, type);
+                p.type = int(type);
+                if (ok && !p.is_null())
+                    ok = read_bytes(_file, p.data);
+            }
+            if (!ok)
+                break;
+        }
+        return true;
+    }
+    throw fb::exception("workload_reader: corrupted log ") << std::quoted(_path);
+}
+
+} // namespace fb
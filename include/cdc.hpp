@@ -0,0 +1,378 @@
+/// \file cdc.hpp
+/// This file contains the change data capture stream reading changes
+/// logged by triggers.
+
+#pragma once
+#include "events.hpp"
+#include "query.hpp"
+
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace fb
+{
+
+/// Change logged by a trigger.
+struct cdc_change
+{
+    /// Operation on the row.
+    enum op_t : char { insert = 'I', update = 'U', remove = 'D' };
+
+    /// Position in the log, increasing.
+    int64_t id;
+    /// Name of the table.
+    std::string table;
+    /// Primary key of the row, as text.
+    std::string key;
+    op_t op;
+    /// Transaction that made the change.
+    int64_t transaction;
+};
+
+/// Stream of changes from a log table filled by AFTER triggers of
+/// the captured tables. Triggers installed by install() log the
+/// table, the key, the operation and the transaction, and post an
+/// event. The stream waits for the event (or polls), reads the log
+/// in batches ordered by id, passes every batch to the callback and
+/// deletes it from the log.
+///
+/// Delivery is at least once: the batch is deleted in the same
+/// transaction after the callback returns. If the callback throws,
+/// the batch is delivered again on the next round. Only one stream
+/// should consume a log table.
+///
+/// \code{.cpp}
+///     fb::cdc_stream::install(db, "customer", "cust_no");
+///
+///     fb::cdc_stream cdc(db, [](const std::vector<fb::cdc_change>& batch) {
+///         for (auto& c : batch)
+///             index.update(c.table, c.key, c.op);
+///     });
+/// \endcode
+///
+struct cdc_stream
+{
+    /// Callback receiving a batch of changes in order of the log.
+    /// Called from the thread of the stream.
+    using callback_t = std::function<void(const std::vector<cdc_change>&)>;
+
+    /// Stream settings.
+    struct settings
+    {
+        /// Name of the log table (sequence of the ids has
+        /// the same name with _SEQ).
+        std::string log_table = "CDC_LOG";
+        /// Event posted by triggers.
+        std::string event = "cdc_log";
+        /// Maximum number of changes in a batch.
+        size_t batch = 1000;
+        /// Read the log at least this often (events are not
+        /// delivered while the attachment is lost).
+        std::chrono::nanoseconds poll_interval = std::chrono::seconds(10);
+    };
+
+    /// Stream statistics.
+    struct cdc_stats
+    {
+        /// Changes delivered.
+        size_t changes = 0;
+        /// Batches delivered.
+        size_t batches = 0;
+        /// Rounds failed (reading, callback or deleting).
+        size_t failures = 0;
+    };
+
+    /// Create log table (if not exists) and trigger of a table
+    /// with default settings.
+    ///
+    /// \param[in] db - Connected database.
+    /// \param[in] table - Name of the table.
+    /// \param[in] key - Primary key column of the table.
+    ///
+    /// \throw fb::exception
+    ///
+    static void install(database& db, std::string_view table, std::string_view key)
+    { install(db, table, key, settings{}); }
+
+    /// Create log table (if not exists) and trigger of a table.
+    ///
+    /// \param[in] db - Connected database.
+    /// \param[in] table - Name of the table.
+    /// \param[in] key - Primary key column of the table.
+    /// \param[in] s - Settings with names of the log table and event.
+    ///
+    /// \throw fb::exception
+    ///
+    static void install(database& db, std::string_view table,
+        std::string_view key, const settings& s);
+
+    /// Drop trigger of a table. Log table is kept.
+    ///
+    /// \param[in] db - Connected database.
+    /// \param[in] table - Name of the table.
+    ///
+    /// \throw fb::exception
+    ///
+    static void uninstall(database& db, std::string_view table);
+
+    /// Start stream with default settings.
+    ///
+    /// \param[in] db - Connected database, preferably of its own.
+    /// \param[in] cb - Callback.
+    ///
+    /// \throw fb::exception
+    ///
+    cdc_stream(database db, callback_t cb)
+    : cdc_stream(std::move(db), std::move(cb), settings{})
+    { }
+
+    /// Start stream.
+    ///
+    /// \param[in] db - Connected database, preferably of its own.
+    /// \param[in] cb - Callback.
+    /// \param[in] s - Settings.
+    ///
+    /// \throw fb::exception
+    ///
+    cdc_stream(database db, callback_t cb, const settings& s);
+
+    /// Stop stream.
+    ~cdc_stream() noexcept
+    { stop(); }
+
+    cdc_stream(const cdc_stream&) = delete;
+    cdc_stream& operator=(const cdc_stream&) = delete;
+
+    /// Stop stream. Callback is not called after return.
+    void stop() noexcept;
+
+    /// Read the log now (wakes up the thread).
+    void poll() noexcept;
+
+    /// Get statistics.
+    cdc_stats stats() const noexcept;
+
+private:
+    /// Check that name is a plain identifier, it is put into DDL.
+    static std::string identifier(std::string_view name);
+
+    /// Thread reading the log.
+    void run() noexcept;
+
+    /// Deliver and delete one batch.
+    ///
+    /// \return Number of changes.
+    ///
+    size_t read_batch(int64_t& last);
+
+    database _db;
+    callback_t _cb;
+    settings _settings;
+
+    std::atomic<size_t> _changes = 0;
+    std::atomic<size_t> _batches = 0;
+    std::atomic<size_t> _failures = 0;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _posted = false;
+    bool _stopping = false;
+    std::thread _thread;
+
+    /// Destroyed first, so it does not wake up a gone thread.
+    std::optional<event_listener> _listener;
+};
+
+// Check that name is a plain identifier.
+std::string cdc_stream::identifier(std::string_view name)
+{
+    bool ok = !name.empty() && name.size() <= 63 && std::isalpha(ISC_UCHAR(name[0]));
+    std::string ret;
+    for (char ch : name) {
+        ok = ok && (std::isalnum(ISC_UCHAR(ch)) || ch == '_' || ch == '$');
+        ret += char(std::toupper(ISC_UCHAR(ch)));
+    }
+    if (!ok)
+        throw fb::exception("cdc_stream: bad identifier ") << std::quoted(name);
+    return ret;
+}
+
+// Create log table (if not exists) and trigger of a table.
+void cdc_stream::install(database& db, std::string_view table,
+    std::string_view key, const settings& s)
+{
+    std::string log = identifier(s.log_table);
+    std::string tab = identifier(table);
+    std::string col = identifier(key);
+    if (s.event.empty() || s.event.find('\'') != std::string::npos)
+        throw fb::exception("cdc_stream: bad event name ") << std::quoted(s.event);
+
+    // Metadata must be committed before the trigger refers to it
+    {
+        transaction tr(db);
+        query q(tr, "select count(*) from rdb$relations where rdb$relation_name = ?");
+        q.execute(log);
+        bool exists = false;
+        for (auto& row : q)
+            exists = row[0].value<int64_t>() > 0;
+        if (!exists) {
+            tr.execute_immediate("create sequence " + log + "_SEQ");
+            tr.execute_immediate("create table " + log + " ("
+                "ID bigint not null primary key, "
+                "TABLE_NAME varchar(63) not null, "
+                "KEY_VALUE varchar(255), "
+                "OP char(1) not null, "
+                "TX_ID bigint not null)");
+        }
+        tr.commit();
+    }
+
+    transaction tr(db);
+    tr.execute_immediate(
+        "create or alter trigger " + tab + "_CDC for " + tab + " "
+        "active after insert or update or delete position 32000 as "
+        "begin "
+        "insert into " + log + " (ID, TABLE_NAME, KEY_VALUE, OP, TX_ID) values ("
+        "next value for " + log + "_SEQ, '" + tab + "', "
+        "iif(deleting, old." + col + ", new." + col + "), "
+        "iif(inserting, 'I', iif(updating, 'U', 'D')), current_transaction); "
+        "post_event '" + s.event + "'; "
+        "end");
+    tr.commit();
+}
+
+// Drop trigger of a table.
+void cdc_stream::uninstall(database& db, std::string_view table)
+{
+    transaction tr(db);
+    tr.execute_immediate("drop trigger " + identifier(table) + "_CDC");
+    tr.commit();
+}
+
+// Start stream.
+cdc_stream::cdc_stream(database db, callback_t cb, const settings& s)
+: _db(std::move(db))
+, _cb(std::move(cb))
+, _settings(s)
+{
+    _settings.log_table = identifier(_settings.log_table);
+    _listener.emplace(_db, std::vector<std::string>{ _settings.event },
+        [this](std::string_view, uint32_t) { poll(); });
+    // Read what was logged while not running
+    _posted = true;
+    _thread = std::thread(&cdc_stream::run, this);
+}
+
+// Stop stream.
+void cdc_stream::stop() noexcept
+{
+    if (!_thread.joinable())
+        return;
+    {
+        std::lock_guard lock(_mutex);
+        _stopping = true;
+    }
+    _cv.notify_one();
+    _thread.join();
+    if (_listener)
+        _listener->stop();
+}
+
+// Read the log now.
+void cdc_stream::poll() noexcept
+{
+    {
+        std::lock_guard lock(_mutex);
+        _posted = true;
+    }
+    _cv.notify_one();
+}
+
+// Get statistics.
+cdc_stream::cdc_stats cdc_stream::stats() const noexcept
+{
+    cdc_stats ret;
+    ret.changes = _changes;
+    ret.batches = _batches;
+    ret.failures = _failures;
+    return ret;
+}
+
+// Thread reading the log.
+void cdc_stream::run() noexcept
+{
+    for (;;) {
+        {
+            std::unique_lock lock(_mutex);
+            _cv.wait_for(lock, _settings.poll_interval,
+                [this] { return _posted || _stopping; });
+            if (_stopping)
+                break;
+            _posted = false;
+        }
+
+        // Ids are taken before commit, so a lower id may be committed
+        // after a higher one was read. Consumed rows are deleted, every
+        // round starts from the beginning of the log to find them.
+        int64_t last = 0;
+        try {
+            while (read_batch(last) == _settings.batch) {
+                std::lock_guard lock(_mutex);
+                if (_stopping)
+                    return;
+            }
+        }
+        catch (...) {
+            ++_failures;
+        }
+    }
+}
+
+// Deliver and delete one batch.
+size_t cdc_stream::read_batch(int64_t& last)
+{
+    // Snapshot, so the delete removes only rows that were read
+    transaction tr(_db, { isc_tpb_version3, isc_tpb_write,
+        isc_tpb_concurrency, isc_tpb_wait });
+    const std::string& log = _settings.log_table;
+
+    std::vector<cdc_change> batch;
+    query q(tr, "select first " + std::to_string(_settings.batch) +
+        " ID, TABLE_NAME, KEY_VALUE, OP, TX_ID from " + log +
+        " where ID > ? order by ID");
+    q.execute(last);
+    for (auto& row : q) {
+        cdc_change c;
+        c.id = row[0].value<int64_t>();
+        c.table = row[1].value<std::string>();
+        c.key = row[2].is_null() ? std::string() : row[2].value<std::string>();
+        c.op = cdc_change::op_t(row[3].value<std::string>().at(0));
+        c.transaction = row[4].value<int64_t>();
+        batch.push_back(std::move(c));
+    }
+    if (batch.empty())
+        return 0;
+
+    _cb(batch);
+
+    tr.execute_immediate("delete from " + log + " where ID > ? and ID <= ?",
+        last, batch.back().id);
+    tr.commit();
+
+    last = batch.back().id;
+    _changes += batch.size();
+    ++_batches;
+    return batch.size();
+}
+
+} // namespace fb
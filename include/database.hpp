@@ -1,7 +1,14 @@
 /// \file database.hpp
 
 #pragma once
+#include "stats.hpp"
+#include "dpb.hpp"
+#include "breaker.hpp"
+
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <string>
 #include <string_view>
 #include <variant>
 #include <vector>
@@ -9,6 +16,37 @@
 namespace fb
 {
 
+struct exception;
+
+/// Result of an automatic reconnect, reported to
+/// reconnect_policy::on_reconnect.
+struct reconnect_event
+{
+    /// Error that caused the reconnect.
+    std::string error;
+    /// Error code (gdscode) of the error.
+    ISC_STATUS code = 0;
+    /// Number of attach attempts made.
+    int attempts = 0;
+    /// True if the database is attached again.
+    bool success = false;
+    /// Time spent on reconnecting, including delays.
+    std::chrono::nanoseconds duration{};
+    /// Generation of the attachment after reconnect.
+    uint64_t generation = 0;
+};
+
+/// Settings of automatic reconnect, see database::enable_reconnect().
+struct reconnect_policy
+{
+    /// Number of attach attempts before giving up.
+    int attempts = 3;
+    /// Delay after the first failed attempt, doubled after each next one.
+    std::chrono::milliseconds delay{500};
+    /// Called after every reconnect, successful or not (optional).
+    std::function<void(const reconnect_event&)> on_reconnect;
+};
+
 struct database
 {
     /// Database connection parameter.
@@ -39,11 +77,11 @@ struct database
         , _value(std::move(value))
         { }
 
-        /// Pack parameter into DPB structure.
+        /// Pack parameter into DPB builder.
         ///
-        /// \param[in] dpb - Vector to hold DPB data.
+        /// \param[in] b - DPB builder.
         ///
-        void pack(std::vector<char>& dpb) const noexcept;
+        void pack(dpb& b) const;
 
     private:
         /// Parameter name
@@ -60,6 +98,19 @@ struct database
     database(std::string_view path,
         std::initializer_list<param> params) noexcept;
 
+    /// Construct database with connection parameters.
+    ///
+    /// \code{.cpp}
+    ///     fb::database db("employee", fb::dpb()
+    ///         .user("sysdba").password("masterkey")
+    ///         .apply(fb::dpb::profile::bulk_load));
+    /// \endcode
+    ///
+    /// \param[in] path - DSN connection string.
+    /// \param[in] params - Parameters.
+    ///
+    database(std::string_view path, const dpb& params) noexcept;
+
     /// Construct database for connection with
     /// username and password.
     ///
@@ -87,6 +138,55 @@ struct database
     /// Disconnect from database.
     void disconnect() noexcept;
 
+    /// Enable automatic reconnect. When a query fails because the
+    /// connection is lost (network error or shutdown), the database
+    /// is attached again with the same parameters. Statements of
+    /// existing queries are prepared again on next use and the
+    /// transactions are restarted. Failed SELECT is executed again
+    /// if its transaction has made no changes, otherwise the error
+    /// is thrown since the changes are lost.
+    ///
+    /// \code{.cpp}
+    ///     db.enable_reconnect({ 5, 1s, [](const fb::reconnect_event& ev) {
+    ///         std::clog << "reconnect after " << ev.error
+    ///                   << (ev.success ? " succeeded" : " failed") << std::endl;
+    ///     }});
+    /// \endcode
+    ///
+    /// \param[in] policy - Number of attempts, delay and callback.
+    ///
+    void enable_reconnect(reconnect_policy policy = {});
+
+    /// Disable automatic reconnect.
+    void disable_reconnect() noexcept;
+
+    /// Detach (ignoring errors) and attach database again. Statements
+    /// and transactions of the previous attachment are invalidated.
+    ///
+    /// \throw fb::exception
+    ///
+    void reconnect();
+
+    /// Get generation of the attachment, a number incremented on
+    /// each reconnect. Statements and transactions started in a
+    /// previous generation are prepared or started again.
+    uint64_t generation() const noexcept;
+
+    /// Pass connect and query execution through the circuit breaker
+    /// of the DSN, shared by all database objects with the same DSN.
+    /// While the breaker is open, these calls throw immediately.
+    ///
+    /// \param[in] s - Breaker settings, used if the breaker of
+    ///                the DSN is not created yet.
+    ///
+    void enable_circuit_breaker(const circuit_breaker::settings& s = {});
+
+    /// Stop using circuit breaker.
+    void disable_circuit_breaker() noexcept;
+
+    /// Get circuit breaker (null if not enabled).
+    const std::shared_ptr<circuit_breaker>& breaker() const noexcept;
+
     /// Execute query once and discard it. Calls execute_immediate() of
     /// default transaction.
     ///
@@ -118,6 +218,23 @@ struct database
     /// Get native internal handle.
     isc_db_handle* handle() const noexcept;
 
+    /// Get DSN path (empty if constructed from a handle).
+    const std::string& path() const noexcept;
+
+    /// Get id of the attachment, the same as CURRENT_CONNECTION
+    /// and MON$ATTACHMENT_ID. Requested once per connection.
+    ///
+    /// \throw fb::exception
+    ///
+    int64_t attachment_id() const;
+
+    /// Get performance counters of the attachment: page cache,
+    /// page I/O and memory usage.
+    ///
+    /// \throw fb::exception
+    ///
+    database_info info() const;
+
     /// Default transaction can be used to minimize written code by passing
     /// database object to fb::query directly instead of instantiate new
     /// transaction for each database connection.
@@ -144,9 +261,19 @@ struct database
     void rollback();
 
 private:
+    friend struct query;
+
     struct context_t;
     std::shared_ptr<context_t> _context;
 
+    /// Reconnect if enabled and the error means lost connection.
+    ///
+    /// \param[in] ex - Error of the failed call.
+    ///
+    /// \return true if attached again.
+    ///
+    bool recover(const exception& ex) noexcept;
+
     /// Default transaction.
     transaction _trans;
 
@@ -1,25 +1,21 @@
 #pragma once
 #include "traits.hpp"
+#include "info.hpp"
+
+#include <thread>
 
 // Database methods
 
 namespace fb
 {
 
-// Pack parameter into DPB structure
-void database::param::pack(std::vector<char>& dpb) const noexcept
+// Pack parameter into DPB builder
+void database::param::pack(dpb& b) const
 {
     std::visit(overloaded {
-        [&](none_t) { dpb.push_back(_name); },
-        [&](std::string_view val) {
-            dpb.push_back(_name);
-            dpb.push_back(val.size());
-            std::copy(val.begin(), val.end(), std::back_inserter(dpb));
-        },
-        [&](int val) {
-            dpb.push_back(_name);
-            dpb.push_back(val);
-        },
+        [&](none_t) { b.add(_name); },
+        [&](std::string_view val) { b.add(_name, val); },
+        [&](int val) { b.add(_name, int32_t(val)); },
     }, _value);
 }
 
@@ -32,11 +28,10 @@ struct database::context_t
     { }
 
     /// Construct database for connection.
-    context_t(std::string_view path) noexcept
-    : _path(path)
-    {
-        _params.reserve(64);
-    }
+    context_t(std::string_view path, std::vector<char> params) noexcept
+    : _params(std::move(params))
+    , _path(path)
+    { }
 
     /// Disconnect here since it is shared context.
     ~context_t() noexcept
@@ -47,7 +42,10 @@ struct database::context_t
     /// \note isc_detach_database will set _handle to 0 on success.
     ///
     void disconnect() noexcept
-    { invoke_noexcept(isc_detach_database, &_handle); }
+    {
+        invoke_noexcept<isc_detach_database>(&_handle);
+        _attachment_id = 0;
+    }
 
     /// Database Parameter Buffer (DPB).
     std::vector<char> _params;
@@ -55,19 +53,35 @@ struct database::context_t
     std::string _path;
     /// Native internal handle.
     isc_db_handle _handle = 0;
+    /// Attachment id (0 if not requested yet).
+    int64_t _attachment_id = 0;
+    /// Number of reconnects.
+    uint64_t _generation = 0;
+    /// Reconnect settings (null if disabled).
+    std::shared_ptr<const reconnect_policy> _reconnect;
+    /// Circuit breaker of the DSN (null if disabled).
+    std::shared_ptr<circuit_breaker> _breaker;
 };
 
 // Construct database with connection parameters.
 database::database(
     std::string_view path, std::initializer_list<param> params) noexcept
-: _context(std::make_shared<context_t>(path))
+{
+    dpb b;
+    for (auto& p : params)
+        p.pack(b);
+
+    _context = std::make_shared<context_t>(path, b.build());
+    // Setup default transaction but not use (start) it
+    _trans = *this;
+}
+
+// Construct database with connection parameters.
+database::database(std::string_view path, const dpb& params) noexcept
+: _context(std::make_shared<context_t>(path, params.build()))
 {
     // Setup default transaction but not use (start) it
     _trans = *this;
-    // Append parameters. Begin with a version.
-    param(isc_dpb_version1).pack(_context->_params);
-    for (auto& p : params)
-        p.pack(_context->_params);
 }
 
 // Construct database from handle.
@@ -83,14 +97,108 @@ void database::connect()
     context_t* c = _context.get();
     auto& dpb = c->_params;
 
-    invoke_except(isc_attach_database,
-        0, c->_path.c_str(), &c->_handle, dpb.size(), dpb.data());
+    auto attach = [&] {
+        invoke_except<isc_attach_database>(
+            0, c->_path.c_str(), &c->_handle, dpb.size(), dpb.data());
+    };
+    if (c->_breaker)
+        c->_breaker->call(attach);
+    else
+        attach();
 }
 
 // Disconnect from database.
 void database::disconnect() noexcept
 { _context->disconnect(); }
 
+// Enable automatic reconnect.
+void database::enable_reconnect(reconnect_policy policy)
+{ _context->_reconnect = std::make_shared<const reconnect_policy>(std::move(policy)); }
+
+// Disable automatic reconnect.
+void database::disable_reconnect() noexcept
+{ _context->_reconnect.reset(); }
+
+// Detach and attach database again.
+void database::reconnect()
+{
+    context_t* c = _context.get();
+
+    // Detach fails on a lost connection, handle is
+    // released by the client anyway
+    c->disconnect();
+    c->_handle = 0;
+    // Handles of the old attachment are invalid from now
+    ++c->_generation;
+
+    connect();
+}
+
+// Get generation of the attachment.
+uint64_t database::generation() const noexcept
+{ return _context->_generation; }
+
+// Pass calls through the circuit breaker of the DSN.
+void database::enable_circuit_breaker(const circuit_breaker::settings& s)
+{ _context->_breaker = circuit_breaker::get(_context->_path, s); }
+
+// Stop using circuit breaker.
+void database::disable_circuit_breaker() noexcept
+{ _context->_breaker.reset(); }
+
+// Get circuit breaker.
+const std::shared_ptr<circuit_breaker>& database::breaker() const noexcept
+{ return _context->_breaker; }
+
+// Reconnect if enabled and the error means lost connection.
+bool database::recover(const exception& ex) noexcept
+{
+    // Keep settings alive while callback is running
+    auto policy = _context->_reconnect;
+    if (!policy || !ex.is_connection_lost())
+        return false;
+
+    reconnect_event ev;
+    ev.code = ex.code();
+    auto start = std::chrono::steady_clock::now();
+    auto delay = policy->delay;
+
+    try {
+        ev.error = ex.what();
+        for (;;) {
+            ++ev.attempts;
+            try {
+                reconnect();
+                ev.success = true;
+                break;
+            }
+            catch (const exception&) {
+                if (ev.attempts >= policy->attempts)
+                    break;
+                // No use to wait while the database is known to be down
+                auto& b = _context->_breaker;
+                if (b && b->current() == circuit_breaker::state::open)
+                    break;
+            }
+            std::this_thread::sleep_for(delay);
+            delay *= 2;
+        }
+    }
+    catch (...) { }
+
+    ev.duration = std::chrono::steady_clock::now() - start;
+    ev.generation = _context->_generation;
+
+    if (policy->on_reconnect) {
+        // Reporting must not break recovery
+        try {
+            policy->on_reconnect(ev);
+        }
+        catch (...) { }
+    }
+    return ev.success;
+}
+
 // Execute query once and discard it.
 template <class... Args>
 void database::execute_immediate(std::string_view sql, const Args&... params)
@@ -107,7 +215,7 @@ database database::create(std::string_view sql)
     // to handles whose value is NULL. When isc_dsql_execute_immediate()
     // returns, db_handle is a valid handle, just as though you had made
     // a call to isc_attach_database()
-    invoke_except(isc_dsql_execute_immediate,
+    invoke_except<isc_dsql_execute_immediate>(
         &db_handle, &tr_handle, 0, sql.data(), SQL_DIALECT_CURRENT, nullptr);
 
     return db_handle;
@@ -117,6 +225,59 @@ database database::create(std::string_view sql)
 isc_db_handle* database::handle() const noexcept
 { return &_context->_handle; }
 
+// Get DSN path.
+const std::string& database::path() const noexcept
+{ return _context->_path; }
+
+// Get id of the attachment.
+int64_t database::attachment_id() const
+{
+    context_t* c = _context.get();
+    if (!c->_attachment_id) {
+        const char items[] = { isc_info_attachment_id };
+        auto buf = get_info<isc_database_info>(&c->_handle, { items, sizeof(items) }, 16);
+        for (info_reader r(buf); r.next();) {
+            if (r.item() == isc_info_attachment_id)
+                c->_attachment_id = r.integer();
+        }
+    }
+    return c->_attachment_id;
+}
+
+// Get performance counters of the attachment.
+database_info database::info() const
+{
+    const char items[] = {
+        isc_info_page_size,
+        isc_info_num_buffers,
+        isc_info_reads,
+        isc_info_writes,
+        isc_info_fetches,
+        isc_info_marks,
+        isc_info_current_memory,
+        isc_info_max_memory,
+        isc_info_end
+    };
+
+    database_info ret;
+    ret.taken = std::chrono::steady_clock::now();
+
+    auto buf = get_info<isc_database_info>(&_context->_handle, { items, sizeof(items) });
+    for (info_reader r(buf); r.next();) {
+        switch (r.item()) {
+            case isc_info_page_size:      ret.page_size = r.integer(); break;
+            case isc_info_num_buffers:    ret.num_buffers = r.integer(); break;
+            case isc_info_reads:          ret.reads = r.integer(); break;
+            case isc_info_writes:         ret.writes = r.integer(); break;
+            case isc_info_fetches:        ret.fetches = r.integer(); break;
+            case isc_info_marks:          ret.marks = r.integer(); break;
+            case isc_info_current_memory: ret.current_memory = r.integer(); break;
+            case isc_info_max_memory:     ret.max_memory = r.integer(); break;
+        }
+    }
+    return ret;
+}
+
 // Get default transaction.
 transaction& database::default_transaction() noexcept
 { return _trans; }
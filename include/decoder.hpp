@@ -0,0 +1,222 @@
+/// \file decoder.hpp
+/// This file contains decoders of columns whose SQL type is known at
+/// compile time, and typed fetching of rows described by generated
+/// structs (see tools/fb_codegen.cpp).
+
+#pragma once
+#include "query.hpp"
+
+#include <optional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace fb
+{
+
+namespace detail
+{
+    /// C++ type of a non-null value of SQL type.
+    template <short SqlType, short Scale>
+    struct sql_value_type
+    {
+        static_assert(SqlType != SqlType, "SQL type has no decoder");
+    };
+
+    template <short Scale>
+    struct sql_value_type<SQL_TEXT, Scale> { using type = std::string; };
+    template <short Scale>
+    struct sql_value_type<SQL_VARYING, Scale> { using type = std::string; };
+
+    // Integers with scale are numeric or decimal, kept exact
+    template <short Scale>
+    struct sql_value_type<SQL_SHORT, Scale>
+    { using type = std::conditional_t<Scale == 0, int16_t, scaled_integer<int16_t>>; };
+    template <short Scale>
+    struct sql_value_type<SQL_LONG, Scale>
+    { using type = std::conditional_t<Scale == 0, int32_t, scaled_integer<int32_t>>; };
+    template <short Scale>
+    struct sql_value_type<SQL_INT64, Scale>
+    { using type = std::conditional_t<Scale == 0, int64_t, scaled_integer<int64_t>>; };
+
+    template <short Scale>
+    struct sql_value_type<SQL_FLOAT, Scale> { using type = float; };
+    template <short Scale>
+    struct sql_value_type<SQL_DOUBLE, Scale> { using type = double; };
+    template <short Scale>
+    struct sql_value_type<SQL_D_FLOAT, Scale> { using type = double; };
+    template <short Scale>
+    struct sql_value_type<SQL_TIMESTAMP, Scale> { using type = timestamp_t; };
+    template <short Scale>
+    struct sql_value_type<SQL_TYPE_DATE, Scale> { using type = timestamp_t; };
+    template <short Scale>
+    struct sql_value_type<SQL_TYPE_TIME, Scale> { using type = timestamp_t; };
+    template <short Scale>
+    struct sql_value_type<SQL_BLOB, Scale> { using type = blob_id_t; };
+    #ifdef SQL_BOOLEAN
+    template <short Scale>
+    struct sql_value_type<SQL_BOOLEAN, Scale> { using type = bool; };
+    #endif
+
+    /// Check every field with its decoder.
+    template <class Decoders, size_t... I>
+    void match_fields(const sqlda& fields, bool* ok, std::index_sequence<I...>) noexcept
+    { ((ok[I] = std::tuple_element_t<I, Decoders>::matches(fields[I])), ...); }
+
+} // namespace detail
+
+/// Decoder of a column of SQL type known at compile time. Reads
+/// the value right from the buffer, without conversion through
+/// fb::field_t.
+///
+/// \code{.cpp}
+///     using salary = fb::column_decoder<SQL_INT64, -2, true>;
+///     salary::type s = salary::decode(row[9]);  // std::optional<scaled_integer<int64_t>>
+/// \endcode
+///
+/// \tparam SqlType - SQL type (without null flag), such as SQL_LONG.
+/// \tparam Scale - Scale of integers (negative for numeric and decimal).
+/// \tparam Nullable - Column may be null, value is std::optional.
+///
+template <short SqlType, short Scale = 0, bool Nullable = false>
+struct column_decoder
+{
+    /// Type of a non-null value.
+    using value_type = typename detail::sql_value_type<SqlType, Scale>::type;
+    /// Type of decoded value.
+    using type = std::conditional_t<Nullable, std::optional<value_type>, value_type>;
+
+    static constexpr short sql_type = SqlType;
+    static constexpr short scale = Scale;
+    static constexpr bool nullable = Nullable;
+
+    /// Checks if the column is of this type.
+    static bool matches(const sqlvar& v) noexcept
+    {
+        auto p = v.handle();
+        if (v.sql_datatype() != SqlType)
+            return false;
+        if constexpr (std::is_same_v<value_type, scaled_integer<int16_t>> ||
+                      std::is_same_v<value_type, scaled_integer<int32_t>> ||
+                      std::is_same_v<value_type, scaled_integer<int64_t>> ||
+                      std::is_integral_v<value_type>)
+            return p->sqlscale == Scale;
+        return true;
+    }
+
+    /// Decode value of the column.
+    ///
+    /// \throw fb::exception if null and not nullable.
+    ///
+    static type decode(const sqlvar& v)
+    {
+        if (v.is_null()) {
+            if constexpr (Nullable)
+                return std::nullopt;
+            else
+                throw fb::exception("unexpected null in column ") << std::quoted(v.name());
+        }
+        return read(v.handle());
+    }
+
+private:
+    /// Read non-null value.
+    static value_type read(const XSQLVAR* p) noexcept
+    {
+        const char* data = p->sqldata;
+        if constexpr (SqlType == SQL_TEXT)
+            return std::string(data, p->sqllen);
+        else if constexpr (SqlType == SQL_VARYING) {
+            auto pv = reinterpret_cast<const PARAMVARY*>(data);
+            return std::string(reinterpret_cast<const char*>(pv->vary_string), pv->vary_length);
+        }
+        else if constexpr (SqlType == SQL_TYPE_DATE) {
+            timestamp_t t;
+            t.timestamp_date = *reinterpret_cast<const ISC_DATE*>(data);
+            t.timestamp_time = 0;
+            return t;
+        }
+        else if constexpr (SqlType == SQL_TYPE_TIME) {
+            timestamp_t t;
+            t.timestamp_date = 0;
+            t.timestamp_time = *reinterpret_cast<const ISC_TIME*>(data);
+            return t;
+        }
+        else if constexpr (Scale != 0 && (SqlType == SQL_SHORT ||
+                           SqlType == SQL_LONG || SqlType == SQL_INT64)) {
+            using int_type = decltype(value_type::_value);
+            return value_type(*reinterpret_cast<const int_type*>(data), Scale);
+        }
+        #ifdef SQL_BOOLEAN
+        else if constexpr (SqlType == SQL_BOOLEAN)
+            return *data != 0;
+        #endif
+        else
+            return *reinterpret_cast<const value_type*>(data);
+    }
+};
+
+/// Check that fields of a query match decoders of a row struct,
+/// to find drift between generated code and the schema.
+///
+/// \tparam Row - Struct with `decoders` (tuple of column_decoder)
+///               and `names` (array of column names).
+/// \param[in] fields - Fields of a prepared query.
+///
+/// \throw fb::exception naming the first column that differs.
+///
+template <class Row>
+void check_fields(const sqlda& fields);
+
+/// Fetch all rows of an executed query as structs.
+///
+/// \code{.cpp}
+///     // From fb_codegen output
+///     fb::query q(db, schema::employee::select_all);
+///     for (auto& emp : fb::fetch_all<schema::employee>(q.execute()))
+///         std::cout << emp.first_name << std::endl;
+/// \endcode
+///
+/// \tparam Row - Struct with static `decode(const sqlda&)`.
+/// \param[in] q - Executed query.
+///
+/// \return Rows.
+/// \throw fb::exception
+///
+template <class Row>
+std::vector<Row> fetch_all(query& q);
+
+// Check that fields of a query match decoders of a row struct.
+template <class Row>
+void check_fields(const sqlda& fields)
+{
+    using decoders = typename Row::decoders;
+    constexpr size_t n = std::tuple_size_v<decoders>;
+    if (fields.size() != n)
+        throw fb::exception(type_name<Row>()) << ": query has " << fields.size()
+            << " columns, expected " << n;
+
+    bool ok[n];
+    detail::match_fields<decoders>(fields, ok, std::make_index_sequence<n>());
+
+    for (size_t i = 0; i < n; ++i) {
+        if (!ok[i])
+            throw fb::exception(type_name<Row>()) << ": column " << std::quoted(Row::names[i])
+                << " is (" << fields[i].sql_datatype() << ", scale "
+                << fields[i].handle()->sqlscale << "), regenerate the header";
+    }
+}
+
+// Fetch all rows of an executed query as structs.
+template <class Row>
+std::vector<Row> fetch_all(query& q)
+{
+    check_fields<Row>(q.fields());
+    std::vector<Row> ret;
+    for (auto& row : q)
+        ret.push_back(Row::decode(row));
+    return ret;
+}
+
+} // namespace fb
@@ -0,0 +1,190 @@
+/// \file dpb.hpp
+/// This file contains the builder of Database Parameter Buffer (DPB)
+/// passed in connection request.
+
+#pragma once
+#include <ibase.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace fb
+{
+
+/// Builder of Database Parameter Buffer (DPB). Numbers are encoded
+/// as 4 bytes little endian. Buffer is built in the wide format
+/// (isc_dpb_version2, 4 bytes lengths) when a value is longer than
+/// 255 bytes, otherwise in the traditional one (isc_dpb_version1).
+///
+/// \code{.cpp}
+///     fb::database db("employee", fb::dpb()
+///         .user("sysdba")
+///         .password("masterkey")
+///         .apply(fb::dpb::profile::bulk_load));
+/// \endcode
+///
+struct dpb
+{
+    /// Named sets of parameters tuned for a workload.
+    enum class profile
+    {
+        /// Short transactions: garbage collection on, one worker
+        /// per statement.
+        oltp,
+        /// Loading of large amounts of data: no garbage collection
+        /// and a large page cache. Database triggers stay enabled,
+        /// see no_db_triggers(), and forced writes are unchanged,
+        /// see force_write().
+        bulk_load
+    };
+
+    /// Add parameter without value.
+    dpb& add(uint8_t tag)
+    { return set(tag, {}); }
+
+    /// Add string parameter.
+    dpb& add(uint8_t tag, std::string_view val)
+    { return set(tag, std::string(val)); }
+
+    /// Add numeric parameter.
+    dpb& add(uint8_t tag, int32_t val)
+    {
+        std::string buf;
+        for (size_t i = 0; i < 4; ++i)
+            buf.push_back(char(uint32_t(val) >> (i * 8)));
+        return set(tag, std::move(buf));
+    }
+
+    /// Add line of firebird.conf settings (isc_dpb_config), such as
+    /// "WireCompression", applied to this connection only.
+    dpb& config(std::string_view key, std::string_view val)
+    {
+        for (auto& item : _config) {
+            if (item.first == key) {
+                item.second = val;
+                return *this;
+            }
+        }
+        _config.emplace_back(key, val);
+        return *this;
+    }
+
+    /// User name.
+    dpb& user(std::string_view val)
+    { return add(isc_dpb_user_name, val); }
+
+    /// Password.
+    dpb& password(std::string_view val)
+    { return add(isc_dpb_password, val); }
+
+    /// Character set of the connection, such as "UTF8".
+    dpb& charset(std::string_view val)
+    { return add(isc_dpb_lc_ctype, val); }
+
+    /// SQL dialect.
+    dpb& sql_dialect(int32_t val)
+    { return add(isc_dpb_sql_dialect, val); }
+
+    /// Seconds to wait for connection.
+    dpb& connect_timeout(int32_t val)
+    { return add(isc_dpb_connect_timeout, val); }
+
+    /// Number of pages in page cache of this connection
+    /// (Classic and SuperClassic servers).
+    dpb& num_buffers(int32_t val)
+    { return add(isc_dpb_num_buffers, val); }
+
+    /// Set forced (synchronous) writes.
+    ///
+    /// \note Not part of any profile: this changes the header of the
+    ///       database permanently, not only this connection, and
+    ///       requires owner or administrator rights.
+    ///
+    dpb& force_write(bool val)
+    { return add(isc_dpb_force_write, int32_t(val)); }
+
+    /// Disable garbage collection of this connection.
+    dpb& no_garbage_collect()
+    { return add(isc_dpb_no_garbage_collect); }
+
+    /// Disable database triggers (requires administrator rights).
+    ///
+    /// \note Not part of any profile: ON CONNECT and transaction
+    ///       triggers often enforce security or auditing, so they are
+    ///       only skipped when asked for explicitly.
+    ///
+    dpb& no_db_triggers()
+    { return add(isc_dpb_no_db_triggers, int32_t(1)); }
+
+    /// Compress data sent over the network.
+    dpb& wire_compression(bool val)
+    { return config("WireCompression", val ? "true" : "false"); }
+
+    /// Number of parallel workers of a statement (Firebird 5).
+    dpb& parallel_workers(int32_t val)
+    { return config("ParallelWorkers", std::to_string(val)); }
+
+    /// Add parameters of a profile. Parameters added later
+    /// replace those of the profile.
+    dpb& apply(profile p)
+    {
+        switch (p) {
+            case profile::oltp:
+                parallel_workers(1);
+                break;
+            case profile::bulk_load:
+                no_garbage_collect();
+                num_buffers(32768);
+                break;
+        }
+        return *this;
+    }
+
+    /// Build the buffer.
+    std::vector<char> build() const
+    {
+        auto items = _items;
+        if (!_config.empty()) {
+            std::string conf;
+            for (auto& [key, val] : _config)
+                conf.append(key).append(" = ").append(val).push_back('\n');
+            items.emplace_back(isc_dpb_config, std::move(conf));
+        }
+
+        bool wide = false;
+        for (auto& [tag, val] : items)
+            wide |= val.size() > 255;
+
+        std::vector<char> ret;
+        ret.push_back(wide ? isc_dpb_version2 : isc_dpb_version1);
+        for (auto& [tag, val] : items) {
+            ret.push_back(char(tag));
+            for (size_t i = 0; i < (wide ? 4 : 1); ++i)
+                ret.push_back(char(val.size() >> (i * 8)));
+            ret.insert(ret.end(), val.begin(), val.end());
+        }
+        return ret;
+    }
+
+private:
+    /// Add or replace parameter.
+    dpb& set(uint8_t tag, std::string&& val)
+    {
+        for (auto& item : _items) {
+            if (item.first == tag) {
+                item.second = std::move(val);
+                return *this;
+            }
+        }
+        _items.emplace_back(tag, std::move(val));
+        return *this;
+    }
+
+    std::vector<std::pair<uint8_t, std::string>> _items;
+    /// Settings of isc_dpb_config.
+    std::vector<std::pair<std::string, std::string>> _config;
+};
+
+} // namespace fb
@@ -0,0 +1,208 @@
+/// \file events.hpp
+/// This file contains the listener of database events (POST_EVENT).
+
+#pragma once
+#include "database.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace fb
+{
+
+/// Listens to events posted with POST_EVENT in the database. The
+/// callback is called from a thread of the listener with the name of
+/// the event and how many times it was posted since last call (events
+/// are delivered on commit of the posting transaction).
+///
+/// \code{.cpp}
+///     fb::event_listener l(db, { "config_changed" },
+///         [](std::string_view name, uint32_t count) {
+///             std::clog << name << " posted " << count << " times\n";
+///         });
+/// \endcode
+///
+/// \note Use a database object (attachment) of its own for events,
+///       delivery is slower on attachments busy with statements.
+///
+struct event_listener
+{
+    /// Maximum number of events of one listener.
+    static constexpr size_t max_events = 15;
+
+    /// Callback with name of the event and number of posts.
+    using callback_t = std::function<void(std::string_view name, uint32_t count)>;
+
+    /// Start listening.
+    ///
+    /// \param[in] db - Connected database.
+    /// \param[in] names - Names of events (up to max_events).
+    /// \param[in] cb - Callback.
+    ///
+    /// \throw fb::exception
+    ///
+    event_listener(database db, std::vector<std::string> names, callback_t cb);
+
+    /// Stop listening.
+    ~event_listener() noexcept
+    { stop(); }
+
+    event_listener(const event_listener&) = delete;
+    event_listener& operator=(const event_listener&) = delete;
+
+    /// Stop listening. Callback is not called after return.
+    void stop() noexcept;
+
+private:
+    struct context_t;
+    std::unique_ptr<context_t> _context;
+};
+
+/// Event listener internal data.
+struct event_listener::context_t
+{
+    context_t(database db, std::vector<std::string> names, callback_t cb)
+    : _db(std::move(db))
+    , _names(std::move(names))
+    , _cb(std::move(cb))
+    {
+        // Event parameter buffer: version, then for every event
+        // length, name and 4 bytes of count
+        _events.push_back(EPB_version1);
+        for (auto& n : _names) {
+            if (n.empty() || n.size() > 255)
+                throw fb::exception("bad event name ") << std::quoted(n);
+            _events.push_back(ISC_UCHAR(n.size()));
+            _events.insert(_events.end(), n.begin(), n.end());
+            _events.insert(_events.end(), 4, 0);
+        }
+        _result = _events;
+    }
+
+    /// Called by the client library when events are posted.
+    static void on_event(void* arg, ISC_USHORT length, const ISC_UCHAR* updated)
+    {
+        auto c = static_cast<context_t*>(arg);
+        {
+            std::lock_guard lock(c->_mutex);
+            if (updated)
+                std::copy_n(updated, std::min(size_t(length), c->_result.size()), c->_result.begin());
+            c->_posted = true;
+        }
+        c->_cv.notify_one();
+    }
+
+    /// Ask for notification of the next posts.
+    void queue()
+    {
+        invoke_except<isc_que_events>(_db.handle(), &_id,
+            short(_events.size()), _events.data(), &context_t::on_event, this);
+    }
+
+    /// Thread delivering events.
+    void run() noexcept
+    {
+        std::vector<uint32_t> counts(_names.size());
+        for (;;) {
+            {
+                std::unique_lock lock(_mutex);
+                _cv.wait(lock, [this] { return _posted || _stopping; });
+                if (_stopping)
+                    break;
+                _posted = false;
+
+                // Counts are cumulative, compare with previous ones
+                for (size_t i = 0, pos = 1; i < _names.size(); ++i) {
+                    pos += 1 + _names[i].size();
+                    counts[i] = read_count(_result, pos) - read_count(_events, pos);
+                    pos += 4;
+                }
+                _events = _result;
+            }
+
+            // First notification has counts since start of database
+            if (!_initial) {
+                for (size_t i = 0; i < counts.size(); ++i) {
+                    if (counts[i]) {
+                        try {
+                            _cb(_names[i], counts[i]);
+                        }
+                        catch (...) { }
+                    }
+                }
+            }
+            _initial = false;
+
+            try {
+                queue();
+            }
+            catch (const exception&) {
+                // Connection is gone, nothing more will be posted
+                break;
+            }
+        }
+    }
+
+    /// Read count of an event.
+    static uint32_t read_count(const std::vector<ISC_UCHAR>& buf, size_t pos) noexcept
+    {
+        return uint32_t(buf[pos]) | uint32_t(buf[pos + 1]) << 8 |
+            uint32_t(buf[pos + 2]) << 16 | uint32_t(buf[pos + 3]) << 24;
+    }
+
+    database _db;
+    std::vector<std::string> _names;
+    callback_t _cb;
+
+    /// Event parameter buffer with counts of last notification.
+    std::vector<ISC_UCHAR> _events;
+    /// Buffer updated by the client library.
+    std::vector<ISC_UCHAR> _result;
+    ISC_LONG _id = 0;
+    bool _initial = true;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _posted = false;
+    bool _stopping = false;
+    std::thread _thread;
+};
+
+// Start listening.
+event_listener::event_listener(
+    database db, std::vector<std::string> names, callback_t cb)
+{
+    if (names.empty() || names.size() > max_events)
+        throw fb::exception("event_listener: ") << names.size()
+            << " events, expected 1 to " << max_events;
+
+    _context = std::make_unique<context_t>(std::move(db), std::move(names), std::move(cb));
+    _context->queue();
+    _context->_thread = std::thread(&context_t::run, _context.get());
+}
+
+// Stop listening.
+void event_listener::stop() noexcept
+{
+    context_t* c = _context.get();
+    if (!c || !c->_thread.joinable())
+        return;
+
+    {
+        std::lock_guard lock(c->_mutex);
+        c->_stopping = true;
+    }
+    c->_cv.notify_one();
+    c->_thread.join();
+    invoke_noexcept<isc_cancel_events>(c->_db.handle(), &c->_id);
+}
+
+} // namespace fb
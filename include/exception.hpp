@@ -3,10 +3,18 @@
 /// for error handling in the library.
 
 #pragma once
+#include "api.hpp"
+
 #include <ibase.h>
 #include <stdexcept>
 #include <sstream>
 
+#ifndef FB_API_OBSERVER
+/// Observer of client API calls, see api.hpp. Define it
+/// before including the library to select another one.
+#define FB_API_OBSERVER fb::null_observer
+#endif
+
 namespace fb
 {
 
@@ -51,6 +59,7 @@ struct exception : std::exception
     /// Constructs an exception from an ISC_STATUS array.
     exception(const ISC_STATUS* status)
     : _err(to_string(status))
+    , _code(status[0] == 1 ? status[1] : 0)
     #if 1
     { }
     #else // TODO: Fix so we can see all messages
@@ -82,46 +91,156 @@ struct exception : std::exception
     const char* what() const noexcept override
     { return _err.c_str(); }
 
+    /// Returns the error code (gdscode) of the status array,
+    /// or 0 if the exception is not from the client API.
+    ISC_STATUS code() const noexcept
+    { return _code; }
+
+    /// Checks if the error means that the connection to
+    /// the database is lost (network error or shutdown).
+    bool is_connection_lost() const noexcept
+    {
+        switch (_code) {
+            case isc_network_error:
+            case isc_net_read_err:
+            case isc_net_write_err:
+            case isc_lost_db_connection:
+            case isc_conn_lost:
+            case isc_shutdown:
+            case isc_att_shutdown:
+                return true;
+        }
+        return false;
+    }
+
 private:
     std::string _err;
+    ISC_STATUS _code = 0;
 };
 
+namespace detail
+{
+    /// Run an API method and report the call to the observer.
+    template <class F, class... Args>
+    inline ISC_STATUS observed_call(api_function id, F&& fn, ISC_STATUS* st, Args&&... args) noexcept
+    {
+        using observer = FB_API_OBSERVER;
+
+        if constexpr (!observer::enabled)
+            return fn(st, std::forward<Args>(args)...);
+        else {
+            api_call call;
+            call.function = id;
+
+            auto handle = api_handle(args...);
+            if (handle)
+                call.handle = *handle;
+            call.start = std::chrono::steady_clock::now();
+            observer::before(call);
+
+            call.status = fn(st, std::forward<Args>(args)...);
+
+            call.duration = std::chrono::steady_clock::now() - call.start;
+            call.status_vector = st;
+            if (handle)
+                call.handle = *handle;
+            observer::after(call);
+            return call.status;
+        }
+    }
+
+} // namespace detail
+
+/// Run an API method with given status array. This is the single
+/// point where the client API is called, calls are reported to
+/// the observer selected with FB_API_OBSERVER.
+///
+/// The function is a template argument, so observers get its
+/// api_function resolved at compile time.
+///
+/// \code{.cpp}
+///     ISC_STATUS_ARRAY st;
+///     invoke_api<isc_get_segment>(st, &_handle, &nr_read, buf_length, buf);
+/// \endcode
+///
+/// \tparam Fn - Function to run.
+/// \param[in] st - Status array.
+/// \param[in] args... - Function arguments except the first ISC_STATUS_ARRAY.
+///
+/// \return ISC_STATUS result of the function.
+///
+template <auto Fn, class... Args>
+inline ISC_STATUS invoke_api(ISC_STATUS* st, Args&&... args) noexcept
+{ return detail::observed_call(api_id<Fn>, Fn, st, std::forward<Args>(args)...); }
+
 /// Run an API method and ignore status result (do not throw on error).
 ///
 /// \code{.cpp}
-///     invoke_noexcept(isc_dsql_fetch, &_handle, SQL_DIALECT_CURRENT, _fields);
+///     invoke_noexcept<isc_dsql_fetch>(&_handle, SQL_DIALECT_CURRENT, _fields);
 /// \endcode
 ///
-/// \param[in] fn - Function to run.
+/// \tparam Fn - Function to run.
 /// \param[in] args... - Function arguments except the first ISC_STATUS_ARRAY.
 ///
 /// \return ISC_STATUS result of the function.
 ///
-template <class F, class... Args>
-inline ISC_STATUS invoke_noexcept(F&& fn, Args&&... args) noexcept
+template <auto Fn, class... Args>
+inline ISC_STATUS invoke_noexcept(Args&&... args) noexcept
 {
     ISC_STATUS_ARRAY st;
-    return fn(st, std::forward<Args>(args)...);
+    return invoke_api<Fn>(st, std::forward<Args>(args)...);
 }
 
 /// Run API method and throw exception on error.
 ///
 /// \code{.cpp}
-///     invoke_except(isc_dsql_fetch, &_handle, SQL_DIALECT_CURRENT, _fields);
+///     invoke_except<isc_dsql_fetch>(&_handle, SQL_DIALECT_CURRENT, _fields);
 /// \endcode
 ///
-/// \param[in] fn - Function to run.
+/// \tparam Fn - Function to run.
 /// \param[in] args... - Function arguments except the first ISC_STATUS_ARRAY.
 ///
 /// \return ISC_STATUS result of the function on success.
 /// \throw fb::exception
 ///
+template <auto Fn, class... Args>
+inline ISC_STATUS
+invoke_except(Args&&... args)
+{
+    ISC_STATUS_ARRAY st;
+    ISC_STATUS ret = invoke_api<Fn>(st, std::forward<Args>(args)...);
+    if (st[0] == 1 && st[1])
+        throw fb::exception(st);
+    return ret;
+}
+
+/// Run an API method given as a function argument and ignore status
+/// result. The call is reported to the observer as api_function::unknown.
+///
+/// \deprecated Use invoke_noexcept<Fn>(args...).
+///
+template <class F, class... Args>
+[[deprecated("use invoke_noexcept<Fn>(args...)")]]
+inline ISC_STATUS invoke_noexcept(F&& fn, Args&&... args) noexcept
+{
+    ISC_STATUS_ARRAY st;
+    return detail::observed_call(api_function::unknown, std::forward<F>(fn),
+        st, std::forward<Args>(args)...);
+}
+
+/// Run an API method given as a function argument and throw exception
+/// on error. The call is reported to the observer as api_function::unknown.
+///
+/// \deprecated Use invoke_except<Fn>(args...).
+///
 template <class F, class... Args>
+[[deprecated("use invoke_except<Fn>(args...)")]]
 inline ISC_STATUS
 invoke_except(F&& fn, Args&&... args)
 {
     ISC_STATUS_ARRAY st;
-    ISC_STATUS ret = fn(st, std::forward<Args>(args)...);
+    ISC_STATUS ret = detail::observed_call(api_function::unknown, std::forward<F>(fn),
+        st, std::forward<Args>(args)...);
     if (st[0] == 1 && st[1])
         throw fb::exception(st);
     return ret;
@@ -6,4 +6,20 @@
 #include "transaction.tcc"
 #include "database.tcc"
 #include "query.hpp"
+#include "batcher.hpp"
+#include "transaction_monitor.hpp"
+#include "monitor.hpp"
+#include "services.hpp"
+#include "trace.hpp"
+#include "backup.hpp"
+#include "pool.hpp"
+#include "sharded_pool.hpp"
+#include "routing.hpp"
+#include "sharding.hpp"
+#include "write_behind.hpp"
+#include "events.hpp"
+#include "cache.hpp"
+#include "mirror.hpp"
+#include "cdc.hpp"
+#include "decoder.hpp"
 
@@ -0,0 +1,207 @@
+/// \file info.hpp
+/// This file contains utilities to request and read information
+/// buffers, as returned by isc_dsql_sql_info, isc_database_info
+/// and similar API calls.
+
+#pragma once
+#include "exception.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <ibase.h>
+#include <string>
+#include <string_view>
+
+namespace fb
+{
+
+/// Reader of information buffer. The buffer is a sequence of
+/// clusters, each one is an item (1 byte), length of data
+/// (2 bytes, little endian) and data. The sequence ends with
+/// isc_info_end item. Items not supported by the server are
+/// returned as isc_info_error.
+///
+/// \code{.cpp}
+///     for (fb::info_reader r(buf); r.next();) {
+///         if (r.item() == isc_info_reads)
+///             reads = r.integer();
+///     }
+/// \endcode
+///
+struct info_reader
+{
+    /// Construct reader of a buffer.
+    ///
+    /// \param[in] buf - Information buffer.
+    ///
+    explicit info_reader(std::string_view buf) noexcept
+    : _buf(buf)
+    { }
+
+    /// Reader only views the buffer, a temporary would expire first.
+    explicit info_reader(std::string&&) = delete;
+
+    /// Move to next item.
+    ///
+    /// \return false if no more items available.
+    /// \throw fb::exception if buffer is truncated or malformed.
+    ///
+    bool next();
+
+    /// Get item of current cluster.
+    uint8_t item() const noexcept
+    { return _item; }
+
+    /// Get data of current cluster.
+    std::string_view data() const noexcept
+    { return _data; }
+
+    /// Get data of current cluster as an integer.
+    int64_t integer() const noexcept
+    {
+        return isc_portable_integer(
+            reinterpret_cast<const ISC_UCHAR*>(_data.data()), _data.size());
+    }
+
+    /// Get reader of clusters nested in data of current cluster,
+    /// for example counters of isc_info_sql_records.
+    info_reader nested() const noexcept
+    { return info_reader(_data); }
+
+    /// Checks if top level of the buffer is truncated, i.e.
+    /// the buffer was too small to hold all requested items.
+    static bool is_truncated(std::string_view buf) noexcept;
+
+private:
+    std::string_view _buf;
+    std::string_view _data;
+    uint8_t _item = isc_info_end;
+};
+
+/// Request information items, growing buffer until the result fits.
+///
+/// \code{.cpp}
+///     const char items[] = { isc_info_sql_stmt_type };
+///     auto buf = get_info<isc_dsql_sql_info>(&handle, { items, sizeof(items) });
+/// \endcode
+///
+/// \tparam Fn - Information function, such as isc_dsql_sql_info.
+/// \param[in] handle - Handle of the object to query.
+/// \param[in] items - Requested items.
+/// \param[in] size - Initial size of the buffer (optional, default is 128).
+///
+/// \return Information buffer.
+/// \throw fb::exception
+///
+template <auto Fn, class H>
+std::string get_info(H* handle, std::string_view items, size_t size = 128)
+{
+    // Length of the buffer is passed as short
+    constexpr size_t max_size = 0x7fff;
+
+    std::string buf;
+    for (;;) {
+        buf.assign(std::min(size, max_size), '\0');
+        invoke_except<Fn>(handle,
+            short(items.size()), items.data(), short(buf.size()), buf.data());
+
+        if (!info_reader::is_truncated(buf))
+            return buf;
+        if (size >= max_size)
+            throw fb::exception("information buffer too large");
+        size *= 4;
+    }
+}
+
+// Move to next item.
+bool info_reader::next()
+{
+    if (_buf.empty())
+        return false;
+
+    _item = _buf.front();
+    _buf.remove_prefix(1);
+
+    if (_item == isc_info_end)
+        return false;
+    if (_item == isc_info_truncated)
+        throw fb::exception("information buffer truncated");
+
+    if (_buf.size() < 2)
+        throw fb::exception("malformed information buffer");
+    size_t len = isc_vax_integer(_buf.data(), 2) & 0xffff;
+    _buf.remove_prefix(2);
+
+    if (_buf.size() < len)
+        throw fb::exception("malformed information buffer");
+    _data = _buf.substr(0, len);
+    _buf.remove_prefix(len);
+    return true;
+}
+
+// Checks if top level of the buffer is truncated.
+bool info_reader::is_truncated(std::string_view buf) noexcept
+{
+    while (!buf.empty()) {
+        uint8_t item = buf.front();
+        if (item == isc_info_truncated)
+            return true;
+        if (item == isc_info_end || buf.size() < 3)
+            return false;
+        size_t len = isc_vax_integer(buf.data() + 1, 2) & 0xffff;
+        buf.remove_prefix(std::min(len + 3, buf.size()));
+    }
+    return false;
+}
+
+namespace detail
+{
+    /// Read counters of isc_info_sql_records item of statement
+    /// information buffer.
+    ///
+    /// \throw fb::exception if buffer is malformed.
+    ///
+    inline record_counts read_records(std::string_view buf)
+    {
+        record_counts ret;
+        for (info_reader r(buf); r.next();) {
+            if (r.item() != isc_info_sql_records)
+                continue;
+            for (auto cnt = r.nested(); cnt.next();) {
+                switch (cnt.item()) {
+                case isc_info_req_select_count: ret.selected = cnt.integer(); break;
+                case isc_info_req_insert_count: ret.inserted = cnt.integer(); break;
+                case isc_info_req_update_count: ret.updated = cnt.integer(); break;
+                case isc_info_req_delete_count: ret.deleted = cnt.integer(); break;
+                }
+            }
+        }
+        return ret;
+    }
+
+    /// Read plan of statement information buffer.
+    ///
+    /// \param[in] buf - Information buffer.
+    /// \param[in] item - Item of the plan (isc_info_sql_get_plan
+    ///                   or isc_info_sql_explain_plan).
+    ///
+    /// \return Plan text without leading new lines (empty if
+    ///         there is no plan).
+    /// \throw fb::exception if buffer is malformed.
+    ///
+    inline std::string read_plan(std::string_view buf, uint8_t item)
+    {
+        for (info_reader r(buf); r.next();) {
+            if (r.item() == item) {
+                // Plan begins with a new line
+                auto plan = r.data();
+                plan.remove_prefix(std::min(plan.find_first_not_of('\n'), plan.size()));
+                return std::string(plan);
+            }
+        }
+        return {};
+    }
+
+} // namespace detail
+
+} // namespace fb
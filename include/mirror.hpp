@@ -0,0 +1,401 @@
+/// \file mirror.hpp
+/// This file contains the in-process mirror of a small table.
+
+#pragma once
+#include "routing.hpp"
+#include "events.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fb
+{
+
+namespace detail
+{
+    /// Shift indices of a sequence.
+    template <size_t N, size_t... I>
+    constexpr std::index_sequence<N + I...> offset_sequence(std::index_sequence<I...>) noexcept
+    { return { }; }
+
+    /// Pointer to an immutable object, read without locks and replaced
+    /// by one writer at a time (read-copy-update). Readers enter a read
+    /// section by incrementing the counter of the current epoch. A writer
+    /// swaps the pointer, then flips the epoch twice, waiting each time
+    /// for the counter of the previous epoch to drain, before it frees
+    /// the old object. Readers never wait, the writer waits for readers
+    /// that may still see the old object.
+    ///
+    /// \note Readers of an epoch share one counter, so lookups are
+    ///       lock-free but contend on its cache line under heavy load.
+    ///
+    template <class T>
+    struct rcu_ptr
+    {
+        /// Read section, the object is not freed while it exists.
+        struct reader
+        {
+            reader(const rcu_ptr& p) noexcept
+            : _count(p._readers[p._epoch.load() & 1].count)
+            {
+                _count.fetch_add(1);
+                _ptr = p._ptr.load();
+            }
+
+            ~reader()
+            { _count.fetch_sub(1); }
+
+            reader(const reader&) = delete;
+            reader& operator=(const reader&) = delete;
+
+            /// Get the object (null if not published yet).
+            const T* get() const noexcept
+            { return _ptr; }
+
+        private:
+            std::atomic<size_t>& _count;
+            const T* _ptr = nullptr;
+        };
+
+        rcu_ptr() = default;
+        rcu_ptr(const rcu_ptr&) = delete;
+        rcu_ptr& operator=(const rcu_ptr&) = delete;
+
+        ~rcu_ptr()
+        { delete _ptr.load(); }
+
+        /// Get the object without a read section. Only for the writer.
+        const T* get() const noexcept
+        { return _ptr.load(std::memory_order_relaxed); }
+
+        /// Publish a new object and free the old one when no reader
+        /// sees it. Writers must be serialized.
+        void store(std::unique_ptr<const T> val)
+        {
+            std::unique_ptr<const T> old(_ptr.exchange(val.release()));
+            if (!old)
+                return;
+            // Readers that loaded the old epoch may still enter it
+            // (and see the new object), both epochs must drain once
+            for (int i = 0; i < 2; ++i) {
+                size_t prev = _epoch.fetch_add(1);
+                while (_readers[prev & 1].count.load() != 0)
+                    std::this_thread::yield();
+            }
+        }
+
+    private:
+        struct alignas(64) counter
+        {
+            std::atomic<size_t> count = 0;
+        };
+
+        std::atomic<const T*> _ptr = nullptr;
+        std::atomic<size_t> _epoch = 0;
+        mutable counter _readers[2];
+    };
+
+} // namespace detail
+
+template <class Key, class Row>
+struct table_mirror;
+
+/// Copy of a (reference) table in a hash map. Readers look up rows
+/// without locks and without the database: the map is immutable, and
+/// a refresh builds a new one and swaps the pointer (read-copy-update,
+/// see detail::rcu_ptr). A refresh frees the old map after the lookups
+/// in progress are done. A snapshot stays valid while the reader holds it.
+///
+/// The table is loaded once, then refreshed incrementally with rows
+/// of a version greater than the last one seen. Versions come from
+/// a change-tracking column, or a log table filled by triggers, and
+/// the refresh runs when an event posted by the triggers fires.
+///
+/// Statements of the source:
+/// - load: `key, version, columns...` of all rows.
+/// - changes: `key, version, deleted, columns...` with one parameter,
+///   the last version seen. Deleted is a smallint, columns of deleted
+///   rows (non-zero) are not read and may be null.
+///
+/// \code{.cpp}
+///     // Trigger of currency sets version from a sequence,
+///     // logs deletes and posts event 'currency_changed'
+///     fb::table_mirror<std::string, std::tuple<std::string, double>> currency(db, {
+///         "select code, version, name, rate from currency",
+///         "select code, version, deleted, name, rate from currency_log "
+///             "where version > ? order by version",
+///         "currency_changed" });
+///
+///     if (auto row = currency.find("EUR"))
+///         std::cout << std::get<1>(*row) << std::endl;
+/// \endcode
+///
+/// \note Sequence values are taken before commit, so a version may
+///       be committed after a greater one was already seen. Writers
+///       of the table should be serialized (a lock on the log table),
+///       or the change statement should take rows of some versions
+///       back, they are applied again.
+///
+/// \tparam Key - Type of the key column.
+/// \tparam Cols... - Types of the other columns, use std::optional
+///                   for nullable columns.
+///
+template <class Key, class... Cols>
+struct table_mirror<Key, std::tuple<Cols...>>
+{
+    /// Row without the key.
+    using row_type = std::tuple<Cols...>;
+    /// Immutable map of rows.
+    using map_type = std::unordered_map<Key, row_type>;
+
+    /// Statements and event of the table.
+    struct source
+    {
+        /// Select all rows.
+        std::string load;
+        /// Select rows changed after a version.
+        std::string changes;
+        /// Event triggering refresh (optional).
+        std::string event;
+    };
+
+    /// Mirror statistics.
+    struct mirror_stats
+    {
+        /// Refreshes done.
+        size_t refreshes = 0;
+        /// Refreshes failed.
+        size_t failures = 0;
+        /// Rows changed or deleted by refreshes.
+        size_t changed = 0;
+        /// Last version seen.
+        int64_t version = 0;
+    };
+
+    /// Load the table and start listening to the event.
+    ///
+    /// \param[in] db - Connected database.
+    /// \param[in] src - Source statements and event.
+    ///
+    /// \throw fb::exception
+    ///
+    table_mirror(database db, source src);
+
+    table_mirror(const table_mirror&) = delete;
+    table_mirror& operator=(const table_mirror&) = delete;
+
+    ~table_mirror();
+
+    /// Get current map. It is not changed by refreshes.
+    std::shared_ptr<const map_type> snapshot() const noexcept
+    {
+        typename detail::rcu_ptr<version_t>::reader r(_map);
+        return r.get()->map;
+    }
+
+    /// Find row by key.
+    ///
+    /// \return Copy of the row or nullopt if not found.
+    ///
+    std::optional<row_type> find(const Key& key) const;
+
+    /// Number of rows.
+    size_t size() const noexcept
+    {
+        typename detail::rcu_ptr<version_t>::reader r(_map);
+        return r.get()->map->size();
+    }
+
+    /// Read changes now. Called on the event, or by the user
+    /// when there is no event.
+    ///
+    /// \return Number of rows changed or deleted.
+    /// \throw fb::exception
+    ///
+    size_t refresh();
+
+    /// Get statistics.
+    mirror_stats stats() const noexcept;
+
+private:
+    /// Published map, shared with snapshots.
+    struct version_t
+    {
+        std::shared_ptr<const map_type> map;
+    };
+
+    /// Read all rows.
+    void load();
+
+    /// Publish new map.
+    void publish(std::shared_ptr<const map_type> m);
+
+    database _db;
+    source _src;
+    detail::rcu_ptr<version_t> _map;
+
+    /// Serializes writers.
+    std::mutex _refresh_mutex;
+    std::atomic<int64_t> _version = 0;
+    std::atomic<size_t> _refreshes = 0;
+    std::atomic<size_t> _failures = 0;
+    std::atomic<size_t> _changed = 0;
+
+    /// Last member, so it stops before others are destroyed.
+    std::optional<event_listener> _listener;
+};
+
+// Load the table and start listening to the event.
+template <class Key, class... Cols>
+table_mirror<Key, std::tuple<Cols...>>::table_mirror(database db, source src)
+: _db(std::move(db))
+, _src(std::move(src))
+{
+    // Listen first, so changes committed during the load are not missed
+    if (!_src.event.empty()) {
+        _listener.emplace(_db, std::vector<std::string>{ _src.event },
+            [this](std::string_view, uint32_t) {
+                try {
+                    refresh();
+                }
+                catch (const exception&) {
+                    // Counted, next event will try again
+                }
+            });
+    }
+    load();
+    // Events fired during the load were ignored
+    if (_listener)
+        refresh();
+}
+
+// Stop listening before the map is freed.
+template <class Key, class... Cols>
+table_mirror<Key, std::tuple<Cols...>>::~table_mirror()
+{
+    _listener.reset();
+}
+
+// Find row by key.
+template <class Key, class... Cols>
+auto table_mirror<Key, std::tuple<Cols...>>::find(const Key& key) const
+    -> std::optional<row_type>
+{
+    typename detail::rcu_ptr<version_t>::reader r(_map);
+    auto& m = *r.get()->map;
+    if (auto it = m.find(key); it != m.end())
+        return it->second;
+    return std::nullopt;
+}
+
+// Read all rows.
+template <class Key, class... Cols>
+void table_mirror<Key, std::tuple<Cols...>>::load()
+{
+    auto m = std::make_shared<map_type>();
+    int64_t version = 0;
+
+    transaction tr(_db, { isc_tpb_version3, isc_tpb_read,
+        isc_tpb_read_committed, isc_tpb_rec_version, isc_tpb_wait });
+    query q(tr, _src.load);
+    q.execute();
+    if (q.fields().size() != sizeof...(Cols) + 2)
+        throw fb::exception("wrong number of columns: ") << q.fields().size();
+
+    for (auto& row : q) {
+        version = std::max(version, row[1].template value<int64_t>());
+        m->insert_or_assign(detail::column_reader<Key>::read(row[0]),
+            detail::make_row<Cols...>(row,
+                detail::offset_sequence<2>(std::index_sequence_for<Cols...>())));
+    }
+    tr.commit();
+
+    std::lock_guard lock(_refresh_mutex);
+    publish(std::move(m));
+    _version = version;
+}
+
+// Read changes now.
+template <class Key, class... Cols>
+size_t table_mirror<Key, std::tuple<Cols...>>::refresh()
+{
+    std::lock_guard lock(_refresh_mutex);
+    // Map is not published yet (refresh during load)
+    if (!_map.get())
+        return 0;
+
+    try {
+        int64_t version = _version;
+        std::vector<std::pair<Key, std::optional<row_type>>> changes;
+
+        transaction tr(_db, { isc_tpb_version3, isc_tpb_read,
+            isc_tpb_read_committed, isc_tpb_rec_version, isc_tpb_wait });
+        query q(tr, _src.changes);
+        q.execute(version);
+        if (q.fields().size() != sizeof...(Cols) + 3)
+            throw fb::exception("wrong number of columns: ") << q.fields().size();
+
+        for (auto& row : q) {
+            version = std::max(version, row[1].template value<int64_t>());
+            auto key = detail::column_reader<Key>::read(row[0]);
+            if (row[2].template value<int16_t>())
+                changes.emplace_back(std::move(key), std::nullopt);
+            else {
+                changes.emplace_back(std::move(key), detail::make_row<Cols...>(row,
+                    detail::offset_sequence<3>(std::index_sequence_for<Cols...>())));
+            }
+        }
+        tr.commit();
+
+        if (!changes.empty()) {
+            // Readers keep the old map, changes go to a copy
+            auto m = std::make_shared<map_type>(*_map.get()->map);
+            for (auto& [key, row] : changes) {
+                if (row)
+                    m->insert_or_assign(std::move(key), std::move(*row));
+                else
+                    m->erase(key);
+            }
+            publish(std::move(m));
+        }
+
+        _version = version;
+        _changed += changes.size();
+        ++_refreshes;
+        return changes.size();
+    }
+    catch (const exception&) {
+        ++_failures;
+        throw;
+    }
+}
+
+// Publish new map.
+template <class Key, class... Cols>
+void table_mirror<Key, std::tuple<Cols...>>::publish(std::shared_ptr<const map_type> m)
+{
+    _map.store(std::make_unique<const version_t>(version_t{ std::move(m) }));
+}
+
+// Get statistics.
+template <class Key, class... Cols>
+auto table_mirror<Key, std::tuple<Cols...>>::stats() const noexcept -> mirror_stats
+{
+    mirror_stats ret;
+    ret.refreshes = _refreshes;
+    ret.failures = _failures;
+    ret.changed = _changed;
+    ret.version = _version;
+    return ret;
+}
+
+} // namespace fb
@@ -0,0 +1,465 @@
+/// \file monitor.hpp
+/// This file contains the collector of monitoring snapshots. It reads
+/// MON$ tables of the server into typed structures.
+
+#pragma once
+#include "query.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fb
+{
+
+/// Page I/O counters (MON$IO_STATS).
+struct mon_io
+{
+    int64_t page_reads = 0;
+    int64_t page_writes = 0;
+    int64_t page_fetches = 0;
+    int64_t page_marks = 0;
+
+    mon_io& operator-=(const mon_io& rhs) noexcept
+    {
+        page_reads -= rhs.page_reads;
+        page_writes -= rhs.page_writes;
+        page_fetches -= rhs.page_fetches;
+        page_marks -= rhs.page_marks;
+        return *this;
+    }
+};
+
+/// Record counters (MON$RECORD_STATS).
+struct mon_records
+{
+    int64_t seq_reads = 0;
+    int64_t idx_reads = 0;
+    int64_t inserts = 0;
+    int64_t updates = 0;
+    int64_t deletes = 0;
+    int64_t backouts = 0;
+    int64_t purges = 0;
+    int64_t expunges = 0;
+
+    mon_records& operator-=(const mon_records& rhs) noexcept
+    {
+        seq_reads -= rhs.seq_reads;
+        idx_reads -= rhs.idx_reads;
+        inserts -= rhs.inserts;
+        updates -= rhs.updates;
+        deletes -= rhs.deletes;
+        backouts -= rhs.backouts;
+        purges -= rhs.purges;
+        expunges -= rhs.expunges;
+        return *this;
+    }
+};
+
+/// Memory usage in bytes (MON$MEMORY_USAGE).
+struct mon_memory
+{
+    int64_t used = 0;
+    int64_t allocated = 0;
+    int64_t max_used = 0;
+    int64_t max_allocated = 0;
+};
+
+/// Statement (MON$STATEMENTS).
+struct mon_statement
+{
+    int64_t id = 0;
+    int64_t attachment_id = 0;
+    int64_t transaction_id = 0;
+    /// 0 - idle, 1 - active, 2 - stalled.
+    int state = 0;
+    /// Statement text, truncated to 8191 characters.
+    std::string sql;
+    /// Time since the statement was started (zero if idle).
+    std::chrono::milliseconds elapsed{};
+    mon_io io;
+    mon_records records;
+    mon_memory memory;
+};
+
+/// Attachment (MON$ATTACHMENTS).
+struct mon_attachment
+{
+    int64_t id = 0;
+    int64_t server_pid = 0;
+    /// 0 - idle, 1 - active.
+    int state = 0;
+    std::string name;
+    std::string user;
+    std::string remote_address;
+    std::string remote_process;
+    mon_io io;
+    mon_records records;
+    mon_memory memory;
+};
+
+/// Snapshot of monitoring tables. I/O and record counters are
+/// cumulative, subtract two snapshots to get the activity in between.
+struct mon_snapshot
+{
+    /// Time when the snapshot was taken.
+    std::chrono::steady_clock::time_point taken;
+    /// Time between snapshots (zero unless this is a delta).
+    std::chrono::nanoseconds interval{};
+    std::vector<mon_attachment> attachments;
+    std::vector<mon_statement> statements;
+
+    /// Get difference between two snapshots. Counters of attachments
+    /// and statements found in both are subtracted, others are kept
+    /// as they are. Memory usage is that of the newer snapshot.
+    ///
+    /// \param[in] prev - Older snapshot.
+    ///
+    mon_snapshot operator-(const mon_snapshot& prev) const;
+};
+
+/// Collector of monitoring snapshots. A snapshot is read in one
+/// read-only read committed transaction, so all tables are consistent
+/// with each other. Optionally samples in a background thread and
+/// keeps the top statements by page reads and by elapsed time.
+///
+/// \code{.cpp}
+///     fb::monitor mon(db);
+///     auto before = mon.snapshot();
+///     // ... run workload ...
+///     for (auto& st : (mon.snapshot() - before).statements)
+///         std::cout << st.io.page_reads << ": " << st.sql << std::endl;
+/// \endcode
+///
+/// \note Users other than SYSDBA or database owner see only
+///       their own attachments.
+///
+struct monitor
+{
+    /// Monitor settings.
+    struct settings
+    {
+        /// Time between samples of the background thread.
+        std::chrono::nanoseconds interval = std::chrono::seconds(10);
+        /// Number of top statements to keep.
+        size_t top = 10;
+        /// Read only statements not in idle state.
+        bool active_only = true;
+    };
+
+    /// Construct monitor of a database with default settings.
+    ///
+    /// \param[in] db - Connected database (shared with the monitor).
+    ///
+    explicit monitor(database& db);
+
+    /// Construct monitor of a database.
+    ///
+    /// \param[in] db - Connected database (shared with the monitor).
+    /// \param[in] s - Settings.
+    ///
+    monitor(database& db, const settings& s);
+
+    /// Stop background thread.
+    ~monitor() noexcept;
+
+    monitor(const monitor&) = delete;
+    monitor& operator=(const monitor&) = delete;
+
+    /// Take snapshot of monitoring tables. Statements of the monitor
+    /// itself are excluded, other statements and the attachment of
+    /// the database it shares are included.
+    ///
+    /// \throw fb::exception
+    ///
+    mon_snapshot snapshot();
+
+    /// Start background thread sampling every interval. Errors
+    /// are ignored, next sample is tried again.
+    void start();
+
+    /// Stop background thread.
+    void stop() noexcept;
+
+    /// Get statements with most page reads seen by
+    /// the background thread, most first.
+    std::vector<mon_statement> top_by_reads() const;
+
+    /// Get statements running for the longest time seen by
+    /// the background thread, longest first.
+    std::vector<mon_statement> top_by_elapsed() const;
+
+private:
+    /// Background thread.
+    void run();
+
+    /// Merge statements into top list, keep the largest.
+    template <class Less>
+    void merge_top(std::vector<mon_statement>& top,
+        const std::vector<mon_statement>& statements, Less less);
+
+    database _db;
+    settings _settings;
+
+    std::vector<mon_statement> _top_reads;
+    std::vector<mon_statement> _top_elapsed;
+
+    bool _stop = false;
+    mutable std::mutex _mutex;
+    std::condition_variable _cv;
+    std::thread _thread;
+};
+
+namespace detail
+{
+    /// Read counters of a row joined with stat tables.
+    template <class T>
+    void read_mon_stats(const sqlda& row, T& obj)
+    {
+        auto val = [&](std::string_view name) {
+            return row[name].value_or(int64_t(0));
+        };
+
+        obj.io.page_reads = val("MON$PAGE_READS");
+        obj.io.page_writes = val("MON$PAGE_WRITES");
+        obj.io.page_fetches = val("MON$PAGE_FETCHES");
+        obj.io.page_marks = val("MON$PAGE_MARKS");
+
+        obj.records.seq_reads = val("MON$RECORD_SEQ_READS");
+        obj.records.idx_reads = val("MON$RECORD_IDX_READS");
+        obj.records.inserts = val("MON$RECORD_INSERTS");
+        obj.records.updates = val("MON$RECORD_UPDATES");
+        obj.records.deletes = val("MON$RECORD_DELETES");
+        obj.records.backouts = val("MON$RECORD_BACKOUTS");
+        obj.records.purges = val("MON$RECORD_PURGES");
+        obj.records.expunges = val("MON$RECORD_EXPUNGES");
+
+        obj.memory.used = val("MON$MEMORY_USED");
+        obj.memory.allocated = val("MON$MEMORY_ALLOCATED");
+        obj.memory.max_used = val("MON$MAX_MEMORY_USED");
+        obj.memory.max_allocated = val("MON$MAX_MEMORY_ALLOCATED");
+    }
+
+    /// Columns and joins of stat tables for a table aliased "t".
+    inline constexpr std::string_view mon_stats_columns =
+        "io.MON$PAGE_READS, io.MON$PAGE_WRITES, io.MON$PAGE_FETCHES, io.MON$PAGE_MARKS, "
+        "r.MON$RECORD_SEQ_READS, r.MON$RECORD_IDX_READS, r.MON$RECORD_INSERTS, "
+        "r.MON$RECORD_UPDATES, r.MON$RECORD_DELETES, r.MON$RECORD_BACKOUTS, "
+        "r.MON$RECORD_PURGES, r.MON$RECORD_EXPUNGES, "
+        "m.MON$MEMORY_USED, m.MON$MEMORY_ALLOCATED, "
+        "m.MON$MAX_MEMORY_USED, m.MON$MAX_MEMORY_ALLOCATED ";
+
+    /// Comment starting the statements of the monitor, to exclude
+    /// them (and only them) from snapshots. Other statements of the
+    /// same attachment, which may be the application's, are kept.
+    inline constexpr std::string_view mon_marker = "/* fb::monitor */ ";
+
+    inline constexpr std::string_view mon_stats_joins =
+        "left join MON$IO_STATS io on io.MON$STAT_ID = t.MON$STAT_ID "
+        "left join MON$RECORD_STATS r on r.MON$STAT_ID = t.MON$STAT_ID "
+        "left join MON$MEMORY_USAGE m on m.MON$STAT_ID = t.MON$STAT_ID ";
+
+} // namespace detail
+
+// Get difference between two snapshots.
+mon_snapshot mon_snapshot::operator-(const mon_snapshot& prev) const
+{
+    mon_snapshot ret = *this;
+    ret.interval = taken - prev.taken;
+
+    std::unordered_map<int64_t, const mon_attachment*> att;
+    for (auto& a : prev.attachments)
+        att.emplace(a.id, &a);
+    for (auto& a : ret.attachments) {
+        if (auto it = att.find(a.id); it != att.end()) {
+            a.io -= it->second->io;
+            a.records -= it->second->records;
+        }
+    }
+
+    std::unordered_map<int64_t, const mon_statement*> st;
+    for (auto& s : prev.statements)
+        st.emplace(s.id, &s);
+    for (auto& s : ret.statements) {
+        // Statement id may be reused for another statement
+        if (auto it = st.find(s.id); it != st.end() && it->second->sql == s.sql) {
+            s.io -= it->second->io;
+            s.records -= it->second->records;
+        }
+    }
+    return ret;
+}
+
+// Construct monitor of a database with default settings.
+monitor::monitor(database& db)
+: monitor(db, settings())
+{ }
+
+// Construct monitor of a database.
+monitor::monitor(database& db, const settings& s)
+: _db(db)
+, _settings(s)
+{ }
+
+// Stop background thread.
+monitor::~monitor() noexcept
+{ stop(); }
+
+// Take snapshot of monitoring tables.
+mon_snapshot monitor::snapshot()
+{
+    using namespace detail;
+
+    // Monitoring tables are read once per transaction,
+    // so every snapshot needs a new transaction
+    transaction tr(_db, { isc_tpb_version3, isc_tpb_read,
+        isc_tpb_read_committed, isc_tpb_rec_version, isc_tpb_nowait });
+
+    mon_snapshot ret;
+    ret.taken = std::chrono::steady_clock::now();
+
+    std::string sql(mon_marker);
+    sql.append(
+        "select t.MON$ATTACHMENT_ID, t.MON$SERVER_PID, t.MON$STATE, "
+        "t.MON$ATTACHMENT_NAME, t.MON$USER, t.MON$REMOTE_ADDRESS, "
+        "t.MON$REMOTE_PROCESS, ")
+       .append(mon_stats_columns)
+       .append("from MON$ATTACHMENTS t ")
+       .append(mon_stats_joins);
+
+    query att(tr, sql);
+    for (auto& row : att.execute()) {
+        mon_attachment a;
+        a.id = row["MON$ATTACHMENT_ID"].value_or(int64_t(0));
+        a.server_pid = row["MON$SERVER_PID"].value_or(int64_t(0));
+        a.state = row["MON$STATE"].value_or(0);
+        a.name = row["MON$ATTACHMENT_NAME"].value_or(std::string());
+        a.user = row["MON$USER"].value_or(std::string());
+        a.remote_address = row["MON$REMOTE_ADDRESS"].value_or(std::string());
+        a.remote_process = row["MON$REMOTE_PROCESS"].value_or(std::string());
+        read_mon_stats(row, a);
+        ret.attachments.push_back(std::move(a));
+    }
+
+    sql = mon_marker;
+    sql.append(
+        "select t.MON$STATEMENT_ID, t.MON$ATTACHMENT_ID, t.MON$TRANSACTION_ID, "
+        "t.MON$STATE, cast(substring(t.MON$SQL_TEXT from 1 for 8191) as varchar(8191)) SQL_TEXT, "
+        "datediff(millisecond from t.MON$TIMESTAMP to current_timestamp) ELAPSED, ")
+       .append(mon_stats_columns)
+       .append("from MON$STATEMENTS t ")
+       .append(mon_stats_joins)
+       .append("where coalesce(t.MON$SQL_TEXT, '') not starting with '")
+       .append(mon_marker)
+       .append("'");
+    if (_settings.active_only)
+        sql.append(" and t.MON$STATE <> 0");
+
+    query st(tr, sql);
+    for (auto& row : st.execute()) {
+        mon_statement s;
+        s.id = row["MON$STATEMENT_ID"].value_or(int64_t(0));
+        s.attachment_id = row["MON$ATTACHMENT_ID"].value_or(int64_t(0));
+        s.transaction_id = row["MON$TRANSACTION_ID"].value_or(int64_t(0));
+        s.state = row["MON$STATE"].value_or(0);
+        s.sql = row["SQL_TEXT"].value_or(std::string());
+        if (s.state != 0)
+            s.elapsed = std::chrono::milliseconds(row["ELAPSED"].value_or(int64_t(0)));
+        read_mon_stats(row, s);
+        ret.statements.push_back(std::move(s));
+    }
+
+    tr.commit();
+    return ret;
+}
+
+// Start background thread.
+void monitor::start()
+{
+    if (!_thread.joinable()) {
+        _stop = false;
+        _thread = std::thread(&monitor::run, this);
+    }
+}
+
+// Stop background thread.
+void monitor::stop() noexcept
+{
+    if (_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cv.notify_one();
+        _thread.join();
+    }
+}
+
+// Get statements with most page reads.
+std::vector<mon_statement> monitor::top_by_reads() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _top_reads;
+}
+
+// Get statements running for the longest time.
+std::vector<mon_statement> monitor::top_by_elapsed() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _top_elapsed;
+}
+
+// Merge statements into top list.
+template <class Less>
+void monitor::merge_top(std::vector<mon_statement>& top,
+    const std::vector<mon_statement>& statements, Less less)
+{
+    for (auto& s : statements) {
+        // Same statement seen before, keep the latest values
+        auto it = std::find_if(top.begin(), top.end(), [&](auto& t) {
+            return t.id == s.id && t.attachment_id == s.attachment_id && t.sql == s.sql;
+        });
+        if (it != top.end()) {
+            if (!less(s, *it))
+                *it = s;
+        }
+        else if (top.size() < _settings.top)
+            top.push_back(s);
+        else {
+            auto min = std::min_element(top.begin(), top.end(), less);
+            if (min != top.end() && less(*min, s))
+                *min = s;
+        }
+    }
+    std::sort(top.begin(), top.end(), [&](auto& a, auto& b) { return less(b, a); });
+}
+
+// Background thread.
+void monitor::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stop) {
+        lock.unlock();
+        try {
+            auto snap = snapshot();
+            lock.lock();
+            merge_top(_top_reads, snap.statements, [](auto& a, auto& b) {
+                return a.io.page_reads < b.io.page_reads;
+            });
+            merge_top(_top_elapsed, snap.statements, [](auto& a, auto& b) {
+                return a.elapsed < b.elapsed;
+            });
+            lock.unlock();
+        }
+        catch (const fb::exception&) {
+            // Try again next time
+        }
+        lock.lock();
+        _cv.wait_for(lock, _settings.interval, [this] { return _stop; });
+    }
+}
+
+} // namespace fb
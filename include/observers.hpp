@@ -0,0 +1,331 @@
+/// \file observers.hpp
+/// This file contains ready-made observers of client API calls.
+/// Include it before the library and select one with FB_API_OBSERVER:
+///
+/// \code{.cpp}
+///     #include "observers.hpp"
+///     #define FB_API_OBSERVER fb::timing_observer
+///     #include "firebird.hpp"
+/// \endcode
+///
+/// Observers can be combined by writing an observer
+/// that forwards to several of them.
+
+#pragma once
+#include "api.hpp"
+#include "writer.hpp"
+
+#include <array>
+#include <cstdio>
+#include <ostream>
+#include <random>
+#include <string>
+
+namespace fb
+{
+
+namespace detail
+{
+    /// Counters of an API function updated by observers.
+    struct api_counters
+    {
+        std::atomic<uint64_t> calls = 0;
+        std::atomic<uint64_t> errors = 0;
+    };
+
+    /// Timings of an API function updated by observers (nanoseconds).
+    struct api_timings : api_counters
+    {
+        std::atomic<uint64_t> total = 0;
+        std::atomic<uint64_t> max = 0;
+    };
+
+} // namespace detail
+
+/// Counts calls and errors per API function.
+///
+/// \code{.cpp}
+///     fb::counting_observer::print(std::cout);
+/// \endcode
+///
+struct counting_observer
+{
+    /// Counters of an API function.
+    struct counters
+    {
+        uint64_t calls = 0;
+        uint64_t errors = 0;
+    };
+
+    static constexpr bool enabled = true;
+
+    static void before(const api_call&) noexcept { }
+
+    static void after(const api_call& call) noexcept
+    {
+        auto& c = _counters[size_t(call.function)];
+        c.calls.fetch_add(1, std::memory_order_relaxed);
+        if (call.failed())
+            c.errors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Get counters of an API function.
+    static counters get(api_function fn) noexcept
+    {
+        auto& c = _counters[size_t(fn)];
+        return { c.calls.load(std::memory_order_relaxed),
+                 c.errors.load(std::memory_order_relaxed) };
+    }
+
+    /// Reset all counters.
+    static void reset() noexcept
+    {
+        for (auto& c : _counters) {
+            c.calls = 0;
+            c.errors = 0;
+        }
+    }
+
+    /// Print counters of called functions, one per line.
+    static void print(std::ostream& os)
+    {
+        for (size_t i = 0; i < api_function_count; ++i) {
+            auto c = get(api_function(i));
+            if (c.calls) {
+                os << api_name(api_function(i))
+                   << " calls=" << c.calls << " errors=" << c.errors << '\n';
+            }
+        }
+    }
+
+private:
+    static inline std::array<detail::api_counters, api_function_count> _counters;
+};
+
+/// Measures time spent in each API function, in addition
+/// to counting calls and errors.
+struct timing_observer
+{
+    /// Timings of an API function.
+    struct timings
+    {
+        uint64_t calls = 0;
+        uint64_t errors = 0;
+        std::chrono::nanoseconds total{};
+        std::chrono::nanoseconds max{};
+
+        /// Average duration of a call.
+        std::chrono::nanoseconds average() const noexcept
+        { return calls ? total / int64_t(calls) : std::chrono::nanoseconds(); }
+    };
+
+    static constexpr bool enabled = true;
+
+    static void before(const api_call&) noexcept { }
+
+    static void after(const api_call& call) noexcept
+    {
+        auto& t = _timings[size_t(call.function)];
+        uint64_t ns = call.duration.count();
+
+        t.calls.fetch_add(1, std::memory_order_relaxed);
+        if (call.failed())
+            t.errors.fetch_add(1, std::memory_order_relaxed);
+        t.total.fetch_add(ns, std::memory_order_relaxed);
+
+        uint64_t max = t.max.load(std::memory_order_relaxed);
+        while (ns > max && !t.max.compare_exchange_weak(max, ns, std::memory_order_relaxed));
+    }
+
+    /// Get timings of an API function.
+    static timings get(api_function fn) noexcept
+    {
+        auto& t = _timings[size_t(fn)];
+        return {
+            t.calls.load(std::memory_order_relaxed),
+            t.errors.load(std::memory_order_relaxed),
+            std::chrono::nanoseconds(t.total.load(std::memory_order_relaxed)),
+            std::chrono::nanoseconds(t.max.load(std::memory_order_relaxed))
+        };
+    }
+
+    /// Reset all timings.
+    static void reset() noexcept
+    {
+        for (auto& t : _timings) {
+            t.calls = 0;
+            t.errors = 0;
+            t.total = 0;
+            t.max = 0;
+        }
+    }
+
+    /// Print timings of called functions, one per line.
+    static void print(std::ostream& os)
+    {
+        using us = std::chrono::microseconds;
+        for (size_t i = 0; i < api_function_count; ++i) {
+            auto t = get(api_function(i));
+            if (t.calls) {
+                os << api_name(api_function(i))
+                   << " calls=" << t.calls << " errors=" << t.errors
+                   << " total=" << std::chrono::duration_cast<us>(t.total).count() << "us"
+                   << " avg=" << std::chrono::duration_cast<us>(t.average()).count() << "us"
+                   << " max=" << std::chrono::duration_cast<us>(t.max).count() << "us\n";
+            }
+        }
+    }
+
+private:
+    static inline std::array<detail::api_timings, api_function_count> _timings;
+};
+
+/// Writes every API call as a span to a file, one JSON object
+/// per line, in a form close to OpenTelemetry spans. All calls of
+/// one thread share a trace id. Writing is done by a background
+/// thread, calls only format the span and push it to a queue.
+/// Nothing is written until open() is called.
+///
+/// \code{.cpp}
+///     fb::span_observer::open("spans.jsonl");
+///     // ... use database ...
+///     fb::span_observer::close();
+/// \endcode
+///
+/// Line example:
+///
+/// \code{.unparsed}
+///     {"traceId":"...","spanId":"...","name":"isc_dsql_execute2",
+///      "startTimeUnixNano":...,"endTimeUnixNano":...,
+///      "attributes":{"fb.handle":12},"status":{"code":"OK"}}
+/// \endcode
+///
+struct span_observer
+{
+    static constexpr bool enabled = true;
+
+    static void before(const api_call&) noexcept { }
+
+    static void after(const api_call& call) noexcept
+    {
+        if (!_writer.load(std::memory_order_relaxed))
+            return;
+
+        ++_users;
+        if (auto w = _writer.load()) {
+            try {
+                w->push(format(call));
+            }
+            catch (...) {
+                // Out of memory, span is lost
+            }
+        }
+        --_users;
+    }
+
+    /// Start writing spans to a file (appending).
+    ///
+    /// \param[in] path - Path to the file.
+    /// \param[in] capacity - Maximum number of spans waiting
+    ///                       to be written (optional).
+    ///
+    /// \return false if file can't be opened or spans
+    ///         are already written.
+    ///
+    static bool open(const std::string& path, size_t capacity = 8192)
+    {
+        auto w = new writer_t(path, capacity,
+            [](std::ostream& os, const std::string& s) { os << s << '\n'; });
+
+        writer_t* expected = nullptr;
+        if (!w->is_open() || !_writer.compare_exchange_strong(expected, w)) {
+            delete w;
+            return false;
+        }
+        return true;
+    }
+
+    /// Stop writing spans and write those waiting.
+    static void close() noexcept
+    {
+        auto w = _writer.exchange(nullptr);
+        // Wait for calls that are pushing right now
+        while (_users)
+            std::this_thread::yield();
+        delete w;
+    }
+
+    /// Format call as a span.
+    static std::string format(const api_call& call)
+    {
+        using namespace std::chrono;
+
+        // Map steady clock to wall clock
+        auto end = system_clock::now();
+        auto start = end - duration_cast<system_clock::duration>(
+            steady_clock::now() - call.start);
+
+        std::string ret;
+        ret.reserve(256);
+        ret.append("{\"traceId\":\"").append(trace_id())
+           .append("\",\"spanId\":\"").append(hex(random()))
+           .append("\",\"name\":\"").append(call.name())
+           .append("\",\"startTimeUnixNano\":").append(unix_nano(start))
+           .append(",\"endTimeUnixNano\":").append(unix_nano(start + duration_cast<system_clock::duration>(call.duration)))
+           .append(",\"attributes\":{\"fb.handle\":").append(std::to_string(call.handle));
+
+        if (call.failed()) {
+            char buf[512];
+            const ISC_STATUS* st = call.status_vector;
+            fb_interpret(buf, sizeof(buf), &st);
+
+            ret.append(",\"fb.gdscode\":").append(std::to_string(call.error_code()))
+               .append("},\"status\":{\"code\":\"ERROR\",\"message\":\"");
+            for (const char* p = buf; *p; ++p) {
+                if (*p == '"' || *p == '\\')
+                    ret += '\\';
+                if (static_cast<unsigned char>(*p) >= 0x20)
+                    ret += *p;
+            }
+            ret.append("\"}}");
+        }
+        else
+            ret.append("},\"status\":{\"code\":\"OK\"}}");
+
+        return ret;
+    }
+
+private:
+    using writer_t = background_writer<std::string>;
+
+    static uint64_t random() noexcept
+    {
+        thread_local std::mt19937_64 gen(std::random_device{}());
+        return gen();
+    }
+
+    static std::string hex(uint64_t v)
+    {
+        char buf[17];
+        std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(v));
+        return buf;
+    }
+
+    static const std::string& trace_id()
+    {
+        thread_local const std::string id = hex(random()) + hex(random());
+        return id;
+    }
+
+    static std::string unix_nano(std::chrono::system_clock::time_point tp)
+    {
+        return std::to_string(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            tp.time_since_epoch()).count());
+    }
+
+    static inline std::atomic<writer_t*> _writer = nullptr;
+    /// Number of calls pushing right now.
+    static inline std::atomic<size_t> _users = 0;
+};
+
+} // namespace fb
@@ -0,0 +1,371 @@
+/// \file pool.hpp
+/// This file contains the connection pool with priority lanes and
+/// admission control, isolating workloads from each other.
+
+#pragma once
+#include "database.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fb
+{
+
+/// Pool of database connections shared by lanes. Each lane has
+/// reserved connections no other lane can take, a cap of concurrent
+/// connections, a limit of waiting requests and a wait budget. A
+/// request exceeding the limits is shed with an exception instead
+/// of waiting, so a burst in one lane can't starve the others.
+/// Lanes are in priority order, a free connection goes to the first
+/// lane with waiting requests.
+///
+/// \code{.cpp}
+///     fb::pool pool([] {
+///         fb::database db("employee");
+///         db.connect();
+///         return db;
+///     }, 16, {
+///         { "interactive", 4, 16, 64, std::chrono::milliseconds(50) },
+///         { "batch",       0,  8, 16, std::chrono::seconds(10) },
+///     });
+///
+///     auto conn = pool.acquire("interactive");
+///     fb::query(conn.db(), "select ...").execute();
+/// \endcode
+///
+struct pool
+{
+private:
+    struct context_t;
+
+public:
+    /// Lane settings.
+    struct lane
+    {
+        std::string name;
+        /// Connections reserved for this lane.
+        size_t reserved = 0;
+        /// Maximum number of connections used at once.
+        size_t max_active = SIZE_MAX;
+        /// Maximum number of requests waiting for a connection.
+        size_t max_waiting = SIZE_MAX;
+        /// Maximum time to wait for a connection (zero for no limit).
+        std::chrono::nanoseconds wait_budget{};
+    };
+
+    /// Lane statistics.
+    struct lane_stats
+    {
+        /// Connections in use.
+        size_t active = 0;
+        /// Requests waiting for a connection.
+        size_t waiting = 0;
+        /// Connections acquired.
+        size_t acquired = 0;
+        /// Requests shed because too many were waiting.
+        size_t rejected = 0;
+        /// Requests shed because wait budget was exceeded.
+        size_t timeouts = 0;
+        /// Longest wait for a connection.
+        std::chrono::nanoseconds max_wait{};
+    };
+
+    /// Function creating connected database.
+    using factory_t = std::function<database()>;
+
+    /// Connection leased from the pool. Returned to the
+    /// pool on destruction, after its default transaction is
+    /// rolled back, so uncommitted changes and locks do not
+    /// pass to the next user. Connection failing to roll back
+    /// is disconnected instead.
+    struct lease
+    {
+        lease(lease&& other) noexcept
+        : _pool(std::move(other._pool))
+        , _db(std::move(other._db))
+        , _lane(other._lane)
+        , _broken(other._broken)
+        { }
+
+        lease(const lease&) = delete;
+        lease& operator=(const lease&) = delete;
+        lease& operator=(lease&&) = delete;
+
+        /// Return connection to the pool.
+        ~lease() noexcept;
+
+        /// Get leased connection.
+        database& db() noexcept
+        { return _db; }
+
+        /// Get leased connection.
+        database* operator->() noexcept
+        { return &_db; }
+
+        /// Mark connection as broken, it is disconnected
+        /// instead of returned to the pool.
+        void invalidate() noexcept
+        { _broken = true; }
+
+    private:
+        friend struct pool;
+
+        lease(std::shared_ptr<context_t> p, database&& db, size_t lane) noexcept
+        : _pool(std::move(p))
+        , _db(std::move(db))
+        , _lane(lane)
+        { }
+
+        std::shared_ptr<context_t> _pool;
+        database _db;
+        size_t _lane;
+        bool _broken = false;
+    };
+
+    /// Construct pool with one lane without limits.
+    ///
+    /// \param[in] factory - Function creating connected database.
+    /// \param[in] size - Maximum number of connections.
+    ///
+    pool(factory_t factory, size_t size);
+
+    /// Construct pool with lanes.
+    ///
+    /// \param[in] factory - Function creating connected database.
+    /// \param[in] size - Maximum number of connections.
+    /// \param[in] lanes - Lanes in priority order, highest first.
+    ///
+    /// \throw fb::exception if reserved connections exceed the size.
+    ///
+    pool(factory_t factory, size_t size, std::vector<lane> lanes);
+
+    /// Acquire connection in a lane, waiting if none is available.
+    ///
+    /// \param[in] lane - Lane index.
+    ///
+    /// \return Leased connection.
+    /// \throw fb::exception if the request is shed or connection fails.
+    ///
+    lease acquire(size_t lane = 0);
+
+    /// Acquire connection in a lane by name.
+    ///
+    /// \throw fb::exception if lane is unknown, the request is shed
+    ///        or connection fails.
+    ///
+    lease acquire(std::string_view lane);
+
+    /// Get statistics of a lane.
+    lane_stats stats(size_t lane) const;
+
+    /// Number of connections open (in use and idle).
+    size_t size() const;
+
+private:
+    std::shared_ptr<context_t> _context;
+};
+
+/// Pool internal data.
+struct pool::context_t
+{
+    /// Lane state.
+    struct lane_state
+    {
+        lane settings;
+        lane_stats stats;
+    };
+
+    /// Checks if a lane may take a connection now.
+    bool can_admit(size_t i) const noexcept
+    {
+        auto& l = _lanes[i];
+        if (l.stats.active >= l.settings.max_active || _active >= _size)
+            return false;
+        if (l.stats.active < l.settings.reserved)
+            return true;
+
+        // Connections reserved but not used by other lanes
+        size_t others = 0;
+        for (size_t j = 0; j < _lanes.size(); ++j) {
+            auto& o = _lanes[j];
+            if (j != i && o.stats.active < o.settings.reserved)
+                others += o.settings.reserved - o.stats.active;
+        }
+        return _size - _active > others;
+    }
+
+    /// Checks if a lane may take a connection now, and no
+    /// lane of higher priority is waiting for one.
+    bool is_turn(size_t i) const noexcept
+    {
+        for (size_t j = 0; j < i; ++j) {
+            if (_lanes[j].stats.waiting && can_admit(j))
+                return false;
+        }
+        return can_admit(i);
+    }
+
+    /// Return connection to the pool.
+    void release(size_t lane, database&& db, bool broken) noexcept
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            --_lanes[lane].stats.active;
+            --_active;
+            if (!broken)
+                _idle.push_back(std::move(db));
+        }
+        // Broken connection is disconnected by the lease,
+        // outside the lock
+        _cv.notify_all();
+    }
+
+    factory_t _factory;
+    size_t _size;
+    std::vector<lane_state> _lanes;
+
+    /// Connections not in use.
+    std::vector<database> _idle;
+    /// Connections in use (or being opened).
+    size_t _active = 0;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _cv;
+};
+
+// Return connection to the pool.
+pool::lease::~lease() noexcept
+{
+    if (!_pool)
+        return;
+
+    // Outside the pool lock, rollback is a round trip
+    auto& tr = _db.default_transaction();
+    if (!_broken && *tr.handle()) {
+        try {
+            tr.rollback();
+        }
+        catch (const exception&) {
+            _broken = true;
+        }
+    }
+    _pool->release(_lane, std::move(_db), _broken);
+}
+
+// Construct pool with one lane without limits.
+pool::pool(factory_t factory, size_t size)
+: pool(std::move(factory), size, { lane{ "default" } })
+{ }
+
+// Construct pool with lanes.
+pool::pool(factory_t factory, size_t size, std::vector<lane> lanes)
+: _context(std::make_shared<context_t>())
+{
+    context_t* c = _context.get();
+    c->_factory = std::move(factory);
+    c->_size = size;
+
+    size_t reserved = 0;
+    for (auto& l : lanes) {
+        reserved += l.reserved;
+        c->_lanes.push_back({ std::move(l), {} });
+    }
+    if (reserved > size)
+        throw fb::exception("pool: reserved connections exceed pool size");
+    if (c->_lanes.empty())
+        c->_lanes.push_back({ lane{ "default" }, {} });
+}
+
+// Acquire connection in a lane.
+pool::lease pool::acquire(size_t lane)
+{
+    context_t* c = _context.get();
+    if (lane >= c->_lanes.size())
+        throw fb::exception("pool: no lane ") << lane;
+
+    auto& l = c->_lanes[lane];
+    auto start = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(c->_mutex);
+    if (!c->is_turn(lane)) {
+        // Shed load instead of growing the queue
+        if (l.stats.waiting >= l.settings.max_waiting) {
+            ++l.stats.rejected;
+            throw fb::exception("pool: lane '") << l.settings.name << "' is overloaded";
+        }
+
+        ++l.stats.waiting;
+        auto ready = [&] { return c->is_turn(lane); };
+        bool ok = true;
+        if (l.settings.wait_budget.count() > 0)
+            ok = c->_cv.wait_until(lock, start + l.settings.wait_budget, ready);
+        else
+            c->_cv.wait(lock, ready);
+        --l.stats.waiting;
+
+        if (!ok) {
+            ++l.stats.timeouts;
+            lock.unlock();
+            // Another lane may be admitted now
+            c->_cv.notify_all();
+            throw fb::exception("pool: lane '") << l.settings.name << "' wait budget exceeded";
+        }
+    }
+
+    ++l.stats.active;
+    ++l.stats.acquired;
+    ++c->_active;
+    l.stats.max_wait = std::max<std::chrono::nanoseconds>(l.stats.max_wait,
+        std::chrono::steady_clock::now() - start);
+
+    if (!c->_idle.empty()) {
+        database db = std::move(c->_idle.back());
+        c->_idle.pop_back();
+        return lease(_context, std::move(db), lane);
+    }
+
+    // Open new connection outside the lock
+    lock.unlock();
+    try {
+        return lease(_context, c->_factory(), lane);
+    }
+    catch (...) {
+        lock.lock();
+        --l.stats.active;
+        --c->_active;
+        lock.unlock();
+        c->_cv.notify_all();
+        throw;
+    }
+}
+
+// Acquire connection in a lane by name.
+pool::lease pool::acquire(std::string_view lane)
+{
+    auto& lanes = _context->_lanes;
+    for (size_t i = 0; i < lanes.size(); ++i) {
+        if (lanes[i].settings.name == lane)
+            return acquire(i);
+    }
+    throw fb::exception("pool: no lane ") << std::quoted(lane);
+}
+
+// Get statistics of a lane.
+pool::lane_stats pool::stats(size_t lane) const
+{
+    std::lock_guard<std::mutex> lock(_context->_mutex);
+    return _context->_lanes.at(lane).stats;
+}
+
+// Number of connections open.
+size_t pool::size() const
+{
+    std::lock_guard<std::mutex> lock(_context->_mutex);
+    return _context->_active + _context->_idle.size();
+}
+
+} // namespace fb
@@ -4,10 +4,94 @@
 #include "database.hpp"
 #include "sqlda.hpp"
 #include "blob.hpp"
+#include "info.hpp"
+#include "stats.hpp"
+#include "slow_log.hpp"
+#include "capture.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
 
 namespace fb
 {
 
+/// Type of prepared statement.
+enum class stmt_type
+{
+    unknown         = 0,
+    select          = isc_info_sql_stmt_select,
+    insert          = isc_info_sql_stmt_insert,
+    update          = isc_info_sql_stmt_update,
+    remove          = isc_info_sql_stmt_delete,
+    ddl             = isc_info_sql_stmt_ddl,
+    get_segment     = isc_info_sql_stmt_get_segment,
+    put_segment     = isc_info_sql_stmt_put_segment,
+    exec_procedure  = isc_info_sql_stmt_exec_procedure,
+    start_trans     = isc_info_sql_stmt_start_trans,
+    commit          = isc_info_sql_stmt_commit,
+    rollback        = isc_info_sql_stmt_rollback,
+    select_for_upd  = isc_info_sql_stmt_select_for_upd,
+    set_generator   = isc_info_sql_stmt_set_generator,
+    savepoint       = isc_info_sql_stmt_savepoint,
+};
+
+/// Captures execution plan of any statement slower than a threshold.
+/// Execution is complete when all rows are fetched (or cursor closed)
+/// for SELECT and right after execution for other statements.
+///
+/// \code{.cpp}
+///     using namespace std::chrono_literals;
+///     fb::plan_capture::enable(100ms,
+///         [](std::string_view sql, std::string_view plan, const fb::execution_stats& st) {
+///             std::clog << st.elapsed().count() << " ns: " << sql << plan << std::endl;
+///         });
+/// \endcode
+///
+struct plan_capture
+{
+    /// Callback with statement text, its plan and timings.
+    using callback_t = std::function<
+        void(std::string_view sql, std::string_view plan, const execution_stats&)>;
+
+    /// Enable capture (replaces previous settings).
+    ///
+    /// \param[in] threshold - Capture statements slower than this.
+    /// \param[in] cb - Callback receiving the plan. It is called
+    ///                 from the thread executing the statement.
+    /// \param[in] explained - Capture explained (detailed) plan
+    ///                        instead of legacy one (optional).
+    ///
+    static void enable(std::chrono::nanoseconds threshold,
+        callback_t cb, bool explained = false)
+    {
+        std::atomic_store(&_settings, std::make_shared<const settings>(
+            settings{ threshold, std::move(cb), explained }));
+        _enabled = true;
+    }
+
+    /// Disable capture.
+    static void disable() noexcept
+    {
+        _enabled = false;
+        std::atomic_store(&_settings, std::shared_ptr<const settings>());
+    }
+
+private:
+    friend struct query;
+
+    struct settings
+    {
+        std::chrono::nanoseconds threshold;
+        callback_t cb;
+        bool explained;
+    };
+
+    /// Fast check on every execution
+    static inline std::atomic<bool> _enabled = false;
+    static inline std::shared_ptr<const settings> _settings;
+};
+
 /// Executes SQL query and retrieves data.
 struct query
 {
@@ -83,6 +167,10 @@ struct query
     ///     q.execute(); // using previously set "a" and "b"
     /// \endcode
     ///
+    /// If reconnect is enabled (database::enable_reconnect) and
+    /// the connection is lost, SELECT is executed once more in
+    /// the new attachment.
+    ///
     /// @param[in] args - Parameters to pass to this query
     ///                   (optional). Number of arguments
     ///                   must match required number or none.
@@ -93,11 +181,66 @@ struct query
     template <class... Args>
     query& execute(const Args&... args);
 
+    /// Get type of the prepared statement.
+    ///
+    /// \return Statement type.
+    /// \throw fb::exception
+    ///
+    stmt_type statement_type();
+
+    /// Get number of rows affected by last execution. This is
+    /// the number of inserted, updated and deleted rows for DML
+    /// statements or number of rows fetched so far for SELECT.
+    ///
+    /// \code{.cpp}
+    ///     fb::query q(db, "update employee set salary = salary * 1.05");
+    ///     std::cout << q.execute().affected_rows() << " rows updated\n";
+    /// \endcode
+    ///
+    /// \return Number of rows.
+    /// \throw fb::exception
+    ///
+    size_t affected_rows() const;
+
+    /// Get counters of records selected, inserted, updated and
+    /// deleted by last execution.
+    ///
+    /// \return Record counters.
+    /// \throw fb::exception
+    ///
+    record_counts records() const;
+
+    /// Get execution plan of the prepared statement.
+    ///
+    /// \code{.cpp}
+    ///     fb::query q(db, "select * from employee where emp_no = ?");
+    ///     std::cout << q.plan() << std::endl;
+    ///     // PLAN (EMPLOYEE INDEX (RDB$PRIMARY7))
+    /// \endcode
+    ///
+    /// \param[in] explained - Get explained (detailed) plan
+    ///                        instead of legacy one (optional,
+    ///                        requires Firebird 3 or later).
+    ///
+    /// \return Plan text.
+    /// \throw fb::exception
+    ///
+    std::string plan(bool explained = false);
+
+    /// Get timings and number of fetched rows of last execution.
+    /// Timings are measured only while plan capture, slow query
+    /// log or workload capture is enabled.
+    const execution_stats& stats() const noexcept
+    { return _context->_stats; }
+
     /// Close read cursor. Closing need to be called only
     /// if reading data (from ex. SELECT) need to be cancelled
     /// and new execute invoked.
     void close() noexcept
-    { _context->close(); }
+    {
+        _context->close();
+        _context->finish();
+    }
 
     /// Row begin iterator.
     iterator begin() const noexcept;
@@ -135,6 +278,8 @@ private:
     /// Query internal data
     struct context_t
     {
+        using clock = std::chrono::steady_clock;
+
         /// Construct query context.
         context_t(transaction& tr, std::string_view sql) noexcept
         : _trans(tr)
@@ -154,7 +299,34 @@ private:
         ///                 DSQL_drop - Release query (can't be used anymore).
         ///
         void close(uint16_t op = DSQL_close) noexcept
-        { invoke_noexcept(isc_dsql_free_statement, &_handle, op); }
+        {
+            // Statement of the previous attachment is already released
+            if (is_stale()) {
+                _handle = 0;
+                return;
+            }
+            invoke_noexcept<isc_dsql_free_statement>(&_handle, op);
+        }
+
+        /// Checks if statement was prepared in a previous
+        /// attachment (before reconnect).
+        bool is_stale() noexcept
+        { return _handle && _generation != _trans.db().generation(); }
+
+        /// Checks if failed execution can be repeated after
+        /// reconnect. Only reads are repeated, and only when
+        /// no changes of the transaction were lost.
+        ///
+        /// \param[in] ex - Error of the execution.
+        /// \param[in] executed - Error is from execution (not prepare).
+        ///
+        bool recover(const exception& ex, bool executed) noexcept
+        {
+            bool had_writes = _trans._context->_has_writes;
+            if (!_trans.db().recover(ex))
+                return false;
+            return !had_writes && (!executed || _type == stmt_type::select);
+        }
 
         /// Fetch next row.
         ///
@@ -162,15 +334,175 @@ private:
         ///
         bool fetch() noexcept
         {
+            // Singleton result (ex. EXECUTE PROCEDURE) has no cursor
+            if (!is_cursor())
+                return _is_data_available = false;
+
+            auto start = timer();
             _is_data_available =
-                invoke_noexcept(isc_dsql_fetch, &_handle, SQL_DIALECT_CURRENT, _fields) == 0;
+                invoke_noexcept<isc_dsql_fetch>(&_handle, SQL_DIALECT_CURRENT, _fields) == 0;
+            _stats.fetch += elapsed(start);
+
+            if (_is_data_available) {
+                ++_stats.rows;
+                return true;
+            }
             // Note! The cursor must be closed before next execution
-            return _is_data_available || (close(), false);
+            close();
+            finish();
+            return false;
+        }
+
+        /// Called once when execution is complete.
+        void finish() noexcept
+        {
+            if (!_is_executing)
+                return;
+            _is_executing = false;
+
+            if (plan_capture::_enabled) {
+                auto s = std::atomic_load(&plan_capture::_settings);
+                if (s && _stats.elapsed() >= s->threshold) {
+                    // Observation must not break the execution
+                    try {
+                        s->cb(_sql, request_plan(s->explained), _stats);
+                    }
+                    catch (...) { }
+                }
+            }
+
+            if (_is_captured) {
+                _is_captured = false;
+                if (auto cap = workload_capture::active()) {
+                    _capture.elapsed = cap->offset(clock::now()) - _capture.offset;
+                    _capture.rows = _stats.rows;
+                    cap->push(std::move(_capture));
+                }
+            }
+
+            if (auto log = _is_timed ? slow_query_log::active() : nullptr) {
+                if (log->is_slow(_stats)) {
+                    try {
+                        slow_query_log::entry e;
+                        e.sql = _sql;
+                        // Parameters of cursor are rendered at execution
+                        e.params = is_cursor() ? std::move(_params_text) : log->render(_params);
+                        e.stats = _stats;
+                        if (is_cursor())
+                            e.rows = _stats.rows;
+                        else {
+                            auto cnt = request_records();
+                            e.rows = cnt.inserted + cnt.updated + cnt.deleted;
+                        }
+                        e.attachment_id = _trans.db().attachment_id();
+                        e.finished = std::chrono::system_clock::now();
+                        log->push(std::move(e));
+                    }
+                    catch (...) { }
+                }
+            }
+        }
+
+        /// Start recording execution for workload capture (if active).
+        void capture(clock::time_point start) noexcept
+        {
+            auto cap = workload_capture::active();
+            if (!cap)
+                return;
+            // Capture must not break the execution
+            try {
+                _capture = workload_entry();
+                _capture.session = _trans.db().attachment_id();
+                _capture.transaction = _trans._context->_registry_id;
+                _capture.offset = cap->offset(start);
+                _capture.sql = _sql;
+                // Parameters may expire before all rows of cursor are fetched
+                _capture.params = workload_capture::copy(_params);
+                _is_captured = true;
+            }
+            catch (...) { }
+        }
+
+        /// Checks if execution is to be timed, only when someone
+        /// looks at the timings.
+        static bool is_timed() noexcept
+        {
+            return plan_capture::_enabled.load(std::memory_order_relaxed)
+                || slow_query_log::is_active()
+                || workload_capture::is_active();
+        }
+
+        /// Start of a timed interval (zero if execution is not timed).
+        clock::time_point timer() const noexcept
+        { return _is_timed ? clock::now() : clock::time_point(); }
+
+        /// Time since start of a timed interval (zero if execution
+        /// is not timed).
+        clock::duration elapsed(clock::time_point start) const noexcept
+        { return _is_timed ? clock::now() - start : clock::duration(); }
+
+        /// Checks if statement opens a cursor on execution.
+        bool is_cursor() const noexcept
+        { return _type == stmt_type::select || _type == stmt_type::select_for_upd; }
+
+        /// Request type of prepared statement.
+        ///
+        /// \throw fb::exception
+        ///
+        stmt_type request_type()
+        {
+            const char items[] = { isc_info_sql_stmt_type };
+            auto buf = get_info<isc_dsql_sql_info>(&_handle, { items, sizeof(items) }, 16);
+            for (info_reader r(buf); r.next();) {
+                if (r.item() == isc_info_sql_stmt_type)
+                    return stmt_type(r.integer());
+            }
+            return stmt_type::unknown;
+        }
+
+        /// Request counters of records processed by last execution.
+        ///
+        /// \throw fb::exception
+        ///
+        record_counts request_records()
+        {
+            const char items[] = { isc_info_sql_records };
+            return detail::read_records(
+                get_info<isc_dsql_sql_info>(&_handle, { items, sizeof(items) }, 64));
+        }
+
+        /// Request execution plan of prepared statement.
+        ///
+        /// \throw fb::exception
+        ///
+        std::string request_plan(bool explained)
+        {
+            #ifdef isc_info_sql_explain_plan
+            const char items[] = {
+                char(explained ? isc_info_sql_explain_plan : isc_info_sql_get_plan) };
+            #else
+            const char items[] = { isc_info_sql_get_plan };
+            #endif
+
+            return detail::read_plan(
+                get_info<isc_dsql_sql_info>(&_handle, { items, sizeof(items) }, 1024), items[0]);
         }
 
         isc_stmt_handle _handle = 0;
+        /// Generation of database attachment when prepared.
+        uint64_t _generation = 0;
+        stmt_type _type = stmt_type::unknown;
         bool _is_prepared = false;
+        bool _is_executing = false;
         bool _is_data_available = false;
+        /// Last execution is timed
+        bool _is_timed = false;
+        execution_stats _stats;
+        /// Parameters rendered for slow query log
+        std::string _params_text;
+        /// Execution recorded for workload capture
+        workload_entry _capture;
+        bool _is_captured = false;
         transaction _trans;
         std::string _sql;
 
@@ -180,6 +512,16 @@ private:
         sqlda _fields;
     };
 
+    /// Execute query once, without reconnect.
+    ///
+    /// \param[out] executed - Set when statement is sent for execution.
+    /// \param[in] args - Parameters (optional).
+    ///
+    /// \throw fb::exception
+    ///
+    template <class... Args>
+    void run(bool& executed, const Args&... args);
+
     std::shared_ptr<context_t> _context;
 };
 
@@ -253,11 +595,11 @@ sqlda& query::params(size_t hint_size)
         c->_params.reserve(std::max(hint_size, size_t(1)));
 
         // Prepare input parameters
-        invoke_except(isc_dsql_describe_bind, &c->_handle, SQL_DIALECT_CURRENT, c->_params);
+        invoke_except<isc_dsql_describe_bind>(&c->_handle, SQL_DIALECT_CURRENT, c->_params);
         if (c->_params.capacity() < c->_params.size()) {
             c->_params.reserve(c->_params.size());
             // Reread prepared description
-            invoke_except(isc_dsql_describe_bind, &c->_handle, SQL_DIALECT_CURRENT, c->_params);
+            invoke_except<isc_dsql_describe_bind>(&c->_handle, SQL_DIALECT_CURRENT, c->_params);
         }
     }
     return c->_params;
@@ -268,29 +610,43 @@ void query::prepare()
 {
     context_t* c = _context.get();
 
-    // Run only once
+    // Run only once, or again after reconnect
+    if (c->is_stale()) {
+        c->_handle = 0;
+        c->_is_prepared = false;
+        c->_is_executing = false;
+        c->_is_data_available = false;
+    }
     if (c->_is_prepared)
         return;
 
     // Start transaction if not already
     c->_trans.start();
 
+    auto start = context_t::clock::now();
+    c->_generation = c->_trans.db().generation();
+
     // Allocate handle
-    invoke_except(isc_dsql_allocate_statement, c->_trans.db().handle(), &c->_handle);
+    invoke_except<isc_dsql_allocate_statement>(c->_trans.db().handle(), &c->_handle);
     // Prepare query
-    invoke_except(isc_dsql_prepare,
+    invoke_except<isc_dsql_prepare>(
         c->_trans.handle(), &c->_handle, 0, c->_sql.c_str(), SQL_DIALECT_CURRENT, c->_fields);
 
     // Prepare output fields
     if (c->_fields.capacity() < c->_fields.size()) {
         c->_fields.reserve(c->_fields.size());
         // Reread prepared description
-        invoke_except(isc_dsql_describe, &c->_handle, SQL_DIALECT_CURRENT, c->_fields);
+        invoke_except<isc_dsql_describe>(&c->_handle, SQL_DIALECT_CURRENT, c->_fields);
     }
-    // Allocate buffer for receiving data
-    if (c->_fields.size())
+    // Allocate buffer for receiving data. Type of the statement
+    // tells how to receive it (cursor or singleton), there is
+    // no need to ask for it when there is no output.
+    if (c->_fields.size()) {
         c->_fields.alloc_data();
+        c->_type = c->request_type();
+    }
 
+    c->_stats.prepare = context_t::clock::now() - start;
     c->_is_prepared = true;
 }
 
@@ -300,6 +656,29 @@ query& query::execute(const Args&... args)
 {
     context_t* c = _context.get();
 
+    // Repeat once after reconnect (if enabled)
+    for (bool retried = false;; retried = true) {
+        bool executed = false;
+        try {
+            if (auto& breaker = c->_trans.db().breaker())
+                breaker->call([&] { run(executed, args...); });
+            else
+                run(executed, args...);
+            return *this;
+        }
+        catch (const exception& ex) {
+            if (retried || !c->recover(ex, executed))
+                throw;
+        }
+    }
+}
+
+// Execute query once.
+template <class... Args>
+void query::run(bool& executed, const Args&... args)
+{
+    context_t* c = _context.get();
+
     // All queries must be prepared before execution.
     // Note, prepare runs only once.
     prepare();
@@ -308,17 +687,82 @@ query& query::execute(const Args&... args)
     if constexpr (sizeof...(Args) > 0)
         params(sizeof...(Args)).set(args...);
 
-    // Execute
-    invoke_except(isc_dsql_execute,
-        c->_trans.handle(), &c->_handle, SQL_DIALECT_CURRENT, c->_params);
+    c->_is_timed = context_t::is_timed();
+    c->_stats.fetch = {};
+    c->_stats.rows = 0;
+    c->_stats.started = {};
+    ++c->_stats.executions;
+
+    if (c->_is_timed) {
+        c->_stats.started = std::chrono::system_clock::now();
+        // Parameters may expire before all rows of cursor are fetched
+        if (c->is_cursor()) {
+            if (auto log = slow_query_log::active())
+                c->_params_text = log->render(c->_params);
+        }
+    }
 
-    // If there data to be read we need to make sure
-    // the first entry is present so iterators may
-    // start to read from *begin()
-    if (c->_fields.size())
+    auto start = c->timer();
+    executed = true;
+    if (c->_is_timed)
+        c->capture(start);
+
+    if (c->is_cursor()) {
+        // Execute
+        invoke_except<isc_dsql_execute>(
+            c->_trans.handle(), &c->_handle, SQL_DIALECT_CURRENT, c->_params);
+        c->_stats.execute = c->elapsed(start);
+        c->_is_executing = true;
+
+        // If there data to be read we need to make sure
+        // the first entry is present so iterators may
+        // start to read from *begin()
         c->fetch();
+    }
+    else {
+        // Other statements return at most one row (ex. EXECUTE
+        // PROCEDURE or INSERT ... RETURNING) together with
+        // execution, there is nothing to fetch
+        invoke_except<isc_dsql_execute2>(
+            c->_trans.handle(), &c->_handle, SQL_DIALECT_CURRENT, c->_params,
+            c->_fields.size() ? c->_fields.get() : nullptr);
+        c->_stats.execute = c->elapsed(start);
+        c->_is_data_available = c->_fields.size() > 0;
+        c->_is_executing = true;
+        c->_trans._context->_has_writes = true;
+        c->finish();
+    }
+}
+
+// Get type of the prepared statement.
+stmt_type query::statement_type()
+{
+    context_t* c = _context.get();
 
-    return *this;
+    prepare();
+    if (c->_type == stmt_type::unknown)
+        c->_type = c->request_type();
+    return c->_type;
+}
+
+// Get number of rows affected by last execution.
+size_t query::affected_rows() const
+{
+    auto cnt = records();
+    if (_context->is_cursor())
+        return cnt.selected;
+    return cnt.inserted + cnt.updated + cnt.deleted;
+}
+
+// Get counters of records processed by last execution.
+record_counts query::records() const
+{ return _context->request_records(); }
+
+// Get execution plan of the prepared statement.
+std::string query::plan(bool explained)
+{
+    prepare();
+    return _context->request_plan(explained);
 }
 
 // Get column names.
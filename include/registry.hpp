@@ -0,0 +1,115 @@
+/// \file registry.hpp
+/// This file contains process-wide registries of objects in use,
+/// read by monitors running in other threads.
+
+#pragma once
+#include <ibase.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace fb
+{
+
+/// Transaction started by fb::transaction and not yet
+/// committed or rolled back.
+struct open_transaction
+{
+    /// Unique id of the transaction in this process
+    /// (not the transaction number of the server).
+    uint64_t id = 0;
+    /// Native handle of the transaction.
+    isc_tr_handle handle = 0;
+    /// Native handle of the database.
+    isc_db_handle db = 0;
+    /// Time when the transaction was started.
+    std::chrono::steady_clock::time_point start;
+    /// Wall clock time when the transaction was started.
+    std::chrono::system_clock::time_point started;
+
+    /// Time since the transaction was started.
+    std::chrono::nanoseconds age() const noexcept
+    { return std::chrono::steady_clock::now() - start; }
+};
+
+/// Registry of transactions open in this process. Transactions are
+/// registered only while the registry is watched (by a transaction
+/// monitor), otherwise starting one costs a relaxed atomic load.
+struct transaction_registry
+{
+    /// Start registering transactions. Calls are counted, every
+    /// watch() needs an unwatch().
+    static void watch() noexcept
+    { ++_watchers; }
+
+    /// Stop registering transactions (after the last unwatch()).
+    static void unwatch() noexcept
+    { --_watchers; }
+
+    /// Checks if transactions are registered.
+    static bool is_watched() noexcept
+    { return _watchers.load(std::memory_order_relaxed) > 0; }
+
+    /// Get new unique id without registering a transaction.
+    static uint64_t next_id() noexcept
+    { return ++_seq; }
+
+    /// Register started transaction.
+    ///
+    /// \return Id used to remove the transaction.
+    ///
+    static uint64_t add(isc_tr_handle handle, isc_db_handle db)
+    {
+        open_transaction t;
+        t.id = next_id();
+        t.handle = handle;
+        t.db = db;
+        t.start = std::chrono::steady_clock::now();
+        t.started = std::chrono::system_clock::now();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _open.emplace(t.id, t);
+        return t.id;
+    }
+
+    /// Remove committed or rolled back transaction.
+    static void remove(uint64_t id) noexcept
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _open.erase(id);
+    }
+
+    /// Get transactions open right now, oldest first.
+    static std::vector<open_transaction> snapshot()
+    {
+        std::vector<open_transaction> ret;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ret.reserve(_open.size());
+            for (auto& [id, t] : _open)
+                ret.push_back(t);
+        }
+        std::sort(ret.begin(), ret.end(),
+            [](auto& a, auto& b) { return a.id < b.id; });
+        return ret;
+    }
+
+    /// Number of transactions open right now.
+    static size_t size() noexcept
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _open.size();
+    }
+
+private:
+    static inline std::mutex _mutex;
+    static inline std::unordered_map<uint64_t, open_transaction> _open;
+    static inline std::atomic<uint64_t> _seq = 0;
+    static inline std::atomic<int> _watchers = 0;
+};
+
+} // namespace fb
@@ -0,0 +1,144 @@
+/// \file ring_buffer.hpp
+/// This file contains a bounded lock-free queue used to pass
+/// data between threads without blocking the producers.
+
+#pragma once
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace fb
+{
+
+/// Bounded multi-producer multi-consumer lock-free queue.
+/// Each cell has a sequence number telling whether it is
+/// free for the producer or ready for the consumer of the
+/// current lap, so producers and consumers never wait for
+/// each other.
+///
+/// \code{.cpp}
+///     fb::ring_buffer<std::string> rb(1024);
+///     if (!rb.try_push("entry"))
+///         ++dropped;  // full
+///     std::string s;
+///     while (rb.try_pop(s))
+///         write(s);
+/// \endcode
+///
+/// \tparam T - Value type, must be default constructible
+///             and move assignable.
+///
+/// \see https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+///
+template <class T>
+struct ring_buffer
+{
+    /// Construct queue.
+    ///
+    /// \param[in] capacity - Maximum number of values, rounded
+    ///                       up to a power of two.
+    ///
+    explicit ring_buffer(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+
+        _cells.reset(new cell[size]);
+        _mask = size - 1;
+        for (size_t i = 0; i < size; ++i)
+            _cells[i]._seq.store(i, std::memory_order_relaxed);
+    }
+
+    ring_buffer(const ring_buffer&) = delete;
+    ring_buffer& operator=(const ring_buffer&) = delete;
+
+    /// Add value to the queue.
+    ///
+    /// \param[in] val - Value to add (moved on success).
+    ///
+    /// \return false if queue is full.
+    ///
+    bool try_push(T&& val) noexcept(std::is_nothrow_move_assignable_v<T>)
+    {
+        size_t pos = _head.load(std::memory_order_relaxed);
+        for (;;) {
+            cell& c = _cells[pos & _mask];
+            size_t seq = c._seq.load(std::memory_order_acquire);
+            auto diff = intptr_t(seq) - intptr_t(pos);
+
+            if (diff == 0) {
+                // Cell is free, try to claim it
+                if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    c._value = std::move(val);
+                    c._seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+                return false;  // Full, cell not consumed since last lap
+            else
+                pos = _head.load(std::memory_order_relaxed);
+        }
+    }
+
+    /// Take value from the queue.
+    ///
+    /// \param[out] val - Receives the value.
+    ///
+    /// \return false if queue is empty.
+    ///
+    bool try_pop(T& val) noexcept(std::is_nothrow_move_assignable_v<T>)
+    {
+        size_t pos = _tail.load(std::memory_order_relaxed);
+        for (;;) {
+            cell& c = _cells[pos & _mask];
+            size_t seq = c._seq.load(std::memory_order_acquire);
+            auto diff = intptr_t(seq) - intptr_t(pos + 1);
+
+            if (diff == 0) {
+                // Cell is ready, try to claim it
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    val = std::move(c._value);
+                    // Free the cell for the next lap
+                    c._seq.store(pos + _mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+                return false;  // Empty
+            else
+                pos = _tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    /// Maximum number of values in the queue.
+    size_t capacity() const noexcept
+    { return _mask + 1; }
+
+    /// Approximate number of values in the queue.
+    size_t size() const noexcept
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        return head > tail ? head - tail : 0;
+    }
+
+private:
+    struct cell
+    {
+        std::atomic<size_t> _seq;
+        T _value;
+    };
+
+    std::unique_ptr<cell[]> _cells;
+    size_t _mask;
+
+    // Keep producer and consumer positions on separate cache lines
+    alignas(64) std::atomic<size_t> _head{0};
+    alignas(64) std::atomic<size_t> _tail{0};
+};
+
+} // namespace fb
@@ -0,0 +1,686 @@
+/// \file routing.hpp
+/// This file contains routing of reads to replicas of a database.
+
+#pragma once
+#include "query.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace fb
+{
+
+namespace detail
+{
+    /// Read column of a materialized row. Null is allowed
+    /// only for std::optional.
+    template <class T>
+    struct column_reader
+    {
+        static T read(const sqlvar& v)
+        { return v.value<T>(); }
+    };
+
+    template <class T>
+    struct column_reader<std::optional<T>>
+    {
+        static std::optional<T> read(const sqlvar& v)
+        {
+            if (v.is_null())
+                return std::nullopt;
+            return v.value<T>();
+        }
+    };
+
+    /// Materialize row into a tuple.
+    template <class... T, size_t... I>
+    std::tuple<T...> make_row(const sqlda& row, std::index_sequence<I...>)
+    { return std::tuple<T...>(column_reader<T>::read(row[I])...); }
+
+    /// Execute read in a read-only transaction of its own
+    /// and materialize the result.
+    ///
+    /// \param[in] db - Database.
+    /// \param[in] sql - SELECT statement.
+    /// \param[in] args - Tuple of parameters.
+    ///
+    /// \throw fb::exception
+    ///
+    template <class... T, class ArgsTuple>
+    std::vector<std::tuple<T...>> read_rows(
+        database& db, const std::string& sql, const ArgsTuple& args)
+    {
+        transaction tr(db, { isc_tpb_version3, isc_tpb_read,
+            isc_tpb_read_committed, isc_tpb_rec_version, isc_tpb_wait });
+        query q(tr, sql);
+        std::apply([&](const auto&... a) { q.execute(a...); }, args);
+
+        std::vector<std::tuple<T...>> ret;
+        if (q.fields().size() != sizeof...(T))
+            throw fb::exception("wrong number of columns: ") << q.fields().size();
+        for (auto& row : q)
+            ret.push_back(make_row<T...>(row, std::index_sequence_for<T...>()));
+        tr.commit();
+        return ret;
+    }
+
+    /// Type to keep a parameter of a read that may outlive the
+    /// caller (hedged read). Strings are copied.
+    template <class A, class D = std::decay_t<A>>
+    using owned_arg_t = std::conditional_t<
+        std::is_same_v<D, const char*> || std::is_same_v<D, char*> ||
+        std::is_same_v<D, std::string_view>, std::string, D>;
+
+} // namespace detail
+
+/// Database with a primary and read-only replicas. Writes go to the
+/// primary, reads go to the healthy replica with the least reads in
+/// flight. A replica is unhealthy for a while after a connection
+/// error, or while its circuit breaker is open. When no replica is
+/// healthy, reads go to the primary.
+///
+/// Optionally reads are hedged: the read runs on the calling thread,
+/// and if the replica does not answer within a percentile of its recent
+/// latencies, a worker of the routed database sends it to a second
+/// replica. When the first read fails, the answer of the second one is
+/// returned. Reads are not cancelled, a hedge losing the race completes
+/// on its worker and its result is discarded. Workers are joined when
+/// the last copy of the routed database is destroyed.
+///
+/// \code{.cpp}
+///     fb::routed_database db(fb::database("primary:employee"), {
+///         fb::database("replica1:employee"),
+///         fb::database("replica2:employee"),
+///     });
+///     db.connect();
+///
+///     // Materialized result of a read on a replica
+///     for (auto& [id, name] : db.read<int, std::string>(
+///             "select emp_no, last_name from employee where dept_no = ?", "600"))
+///         std::cout << id << " " << name << std::endl;
+///
+///     // Transaction on the primary
+///     fb::transaction tr = db.begin(fb::routed_database::intent::write);
+/// \endcode
+///
+struct routed_database
+{
+private:
+    struct context_t;
+
+public:
+    /// Kind of work.
+    enum class intent { read, write };
+
+    /// Routing settings.
+    struct settings
+    {
+        /// Hedge reads on a second replica.
+        bool hedge = false;
+        /// Percentile of replica latency to wait before hedging.
+        double hedge_percentile = 0.95;
+        /// Wait before hedging until enough latencies are known.
+        std::chrono::nanoseconds hedge_after = std::chrono::milliseconds(100);
+        /// Minimum wait before hedging.
+        std::chrono::nanoseconds min_hedge_after = std::chrono::milliseconds(1);
+        /// Maximum number of threads running hedges.
+        size_t hedge_workers = 2;
+        /// Number of latencies needed to use the percentile.
+        size_t min_samples = 20;
+        /// Time a replica is not used after a connection error.
+        std::chrono::nanoseconds down_time = std::chrono::seconds(5);
+    };
+
+    /// Replica statistics.
+    struct replica_stats
+    {
+        /// Reads completed (including failed).
+        size_t reads = 0;
+        /// Reads failed.
+        size_t failures = 0;
+        /// Reads sent to this replica as a hedge.
+        size_t hedged = 0;
+        /// Hedges answered first.
+        size_t hedge_wins = 0;
+        /// Reads in flight.
+        size_t in_flight = 0;
+        /// Replica is used for reads.
+        bool healthy = true;
+    };
+
+    /// Rows of a materialized result.
+    template <class... T>
+    using rows = std::vector<std::tuple<T...>>;
+
+    /// Construct with default settings.
+    ///
+    /// \param[in] primary - Primary database.
+    /// \param[in] replicas - Read-only replicas.
+    ///
+    routed_database(database primary, std::vector<database> replicas);
+
+    /// Construct routed database.
+    ///
+    /// \param[in] primary - Primary database.
+    /// \param[in] replicas - Read-only replicas.
+    /// \param[in] s - Settings.
+    ///
+    routed_database(database primary, std::vector<database> replicas, const settings& s);
+
+    /// Connect primary and replicas. Replicas failing to
+    /// connect are marked unhealthy.
+    ///
+    /// \throw fb::exception if primary can't be connected.
+    ///
+    void connect();
+
+    /// Disconnect primary and replicas.
+    void disconnect() noexcept;
+
+    /// Get primary database.
+    database& primary() noexcept;
+
+    /// Get number of replicas.
+    size_t size() const noexcept;
+
+    /// Get replica.
+    ///
+    /// \param[in] index - Replica index.
+    ///
+    database& replica(size_t index);
+
+    /// Choose database for work: primary for writes, least
+    /// loaded healthy replica for reads.
+    database route(intent i);
+
+    /// Start transaction on a routed database. Read transactions
+    /// are read-only and read committed.
+    ///
+    /// \throw fb::exception
+    ///
+    transaction begin(intent i);
+
+    /// Start transaction with parameters. Read-only TPB
+    /// (isc_tpb_read) is started on a replica.
+    ///
+    /// \param[in] tpb - Transaction Parameter Buffer (TPB).
+    ///
+    /// \throw fb::exception
+    ///
+    transaction begin(std::initializer_list<char> tpb);
+
+    /// Execute read on a replica and materialize the result. Every
+    /// column is converted to its type, use std::optional for nullable
+    /// columns. Read is hedged if enabled in settings.
+    ///
+    /// \tparam T... - Column types.
+    /// \param[in] sql - SELECT statement.
+    /// \param[in] args - Parameters (optional).
+    ///
+    /// \return Rows.
+    /// \throw fb::exception
+    ///
+    template <class... T, class... Args>
+    rows<T...> read(std::string_view sql, const Args&... args);
+
+    /// Get statistics of a replica.
+    ///
+    /// \param[in] index - Replica index.
+    ///
+    replica_stats stats(size_t index) const;
+
+    /// Checks if TPB describes a read-only transaction.
+    ///
+    /// \param[in] tpb - Transaction Parameter Buffer (TPB).
+    ///
+    static bool is_read_only(std::string_view tpb) noexcept;
+
+private:
+    /// Value of no replica (primary).
+    static constexpr size_t npos = size_t(-1);
+
+    /// Run read on a replica (or primary) in a read-only transaction.
+    template <class... T, class ArgsTuple>
+    static rows<T...> run(context_t& c, size_t index, const std::string& sql, const ArgsTuple& args);
+
+    /// Read with hedging.
+    template <class... T, class... Args>
+    rows<T...> hedged_read(size_t first, std::string_view sql, const Args&... args);
+
+    std::shared_ptr<context_t> _context;
+};
+
+/// Routed database internal data.
+struct routed_database::context_t
+{
+    using clock = std::chrono::steady_clock;
+
+    /// Number of latencies kept per replica.
+    static constexpr size_t max_samples = 128;
+
+    /// Replica and its load.
+    struct node
+    {
+        node(database d)
+        : db(std::move(d))
+        { }
+
+        database db;
+        std::atomic<size_t> in_flight = 0;
+        std::atomic<size_t> reads = 0;
+        std::atomic<size_t> failures = 0;
+        std::atomic<size_t> hedged = 0;
+        std::atomic<size_t> hedge_wins = 0;
+        /// Not used before this time (clock ticks).
+        std::atomic<clock::rep> down_until = 0;
+
+        /// Recent latencies (ring).
+        std::mutex mutex;
+        std::vector<std::chrono::nanoseconds> samples;
+        size_t next_sample = 0;
+    };
+
+    context_t(database primary, std::vector<database> replicas, const settings& s)
+    : _primary(std::move(primary))
+    , _settings(s)
+    {
+        _nodes.reserve(replicas.size());
+        for (auto& db : replicas)
+            _nodes.push_back(std::make_unique<node>(std::move(db)));
+    }
+
+    /// Wait for running hedges, pending ones are not needed.
+    ~context_t()
+    {
+        {
+            std::lock_guard lock(_hedge_mutex);
+            _stopping = true;
+        }
+        _hedge_cv.notify_all();
+        for (auto& t : _hedge_workers)
+            t.join();
+    }
+
+    /// Checks if replica can be used.
+    bool is_healthy(const node& n) const noexcept
+    {
+        if (clock::now().time_since_epoch().count() < n.down_until.load(std::memory_order_relaxed))
+            return false;
+        auto& b = n.db.breaker();
+        return !b || b->current() != circuit_breaker::state::open;
+    }
+
+    /// Choose healthy replica with least reads in flight.
+    ///
+    /// \param[in] except - Replica to skip (or npos).
+    ///
+    /// \return Replica index or npos.
+    ///
+    size_t pick(size_t except = npos) noexcept
+    {
+        size_t n = _nodes.size();
+        if (!n)
+            return npos;
+        // Start from next replica to spread ties
+        size_t from = _next.fetch_add(1, std::memory_order_relaxed);
+        size_t best = npos, best_load = 0;
+        for (size_t i = 0; i < n; ++i) {
+            size_t idx = (from + i) % n;
+            auto& nd = *_nodes[idx];
+            if (idx == except || !is_healthy(nd))
+                continue;
+            size_t load = nd.in_flight.load(std::memory_order_relaxed);
+            if (best == npos || load < best_load) {
+                best = idx;
+                best_load = load;
+            }
+        }
+        return best;
+    }
+
+    /// Get database of replica or primary (npos).
+    database& db(size_t index) noexcept
+    { return index == npos ? _primary : _nodes[index]->db; }
+
+    /// Remember latency of a read.
+    void add_sample(node& n, std::chrono::nanoseconds elapsed)
+    {
+        std::lock_guard lock(n.mutex);
+        if (n.samples.size() < max_samples)
+            n.samples.push_back(elapsed);
+        else
+            n.samples[n.next_sample] = elapsed;
+        n.next_sample = (n.next_sample + 1) % max_samples;
+    }
+
+    /// Get time to wait for a replica before hedging.
+    std::chrono::nanoseconds hedge_after(node& n)
+    {
+        std::vector<std::chrono::nanoseconds> s;
+        {
+            std::lock_guard lock(n.mutex);
+            if (n.samples.size() < _settings.min_samples)
+                return _settings.hedge_after;
+            s = n.samples;
+        }
+        auto pos = s.begin() + size_t(_settings.hedge_percentile * (s.size() - 1));
+        std::nth_element(s.begin(), pos, s.end());
+        return std::max(*pos, _settings.min_hedge_after);
+    }
+
+    /// Mark replica unhealthy after a connection error.
+    void mark_down(node& n) noexcept
+    {
+        auto until = clock::now() + _settings.down_time;
+        n.down_until.store(until.time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    /// Run hedge on a worker at given time. Workers
+    /// are started on demand, up to the limit.
+    void schedule(clock::time_point due, std::function<void()> fn)
+    {
+        {
+            std::lock_guard lock(_hedge_mutex);
+            _hedges.emplace(due, std::move(fn));
+            if (_hedge_workers.size() < _settings.hedge_workers)
+                _hedge_workers.emplace_back([this] { work(); });
+        }
+        _hedge_cv.notify_all();
+    }
+
+    /// Worker running hedges when they are due.
+    void work()
+    {
+        std::unique_lock lock(_hedge_mutex);
+        while (!_stopping) {
+            if (_hedges.empty()) {
+                _hedge_cv.wait(lock);
+                continue;
+            }
+            auto it = _hedges.begin();
+            if (clock::now() < it->first) {
+                _hedge_cv.wait_until(lock, it->first);
+                continue;
+            }
+            auto fn = std::move(it->second);
+            _hedges.erase(it);
+            lock.unlock();
+            fn();
+            lock.lock();
+        }
+    }
+
+    database _primary;
+    settings _settings;
+    std::vector<std::unique_ptr<node>> _nodes;
+    /// Round robin start for ties.
+    std::atomic<size_t> _next = 0;
+
+    /// Hedges waiting for their time.
+    std::mutex _hedge_mutex;
+    std::condition_variable _hedge_cv;
+    std::multimap<clock::time_point, std::function<void()>> _hedges;
+    std::vector<std::thread> _hedge_workers;
+    bool _stopping = false;
+};
+
+namespace detail
+{
+    /// Shared state of a hedged read.
+    template <class R>
+    struct hedge_state
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        /// Answer of the hedge.
+        std::optional<R> result;
+        /// Replica of the hedge.
+        size_t replica = 0;
+        /// Hedge was started, or is not needed any more.
+        bool started = false;
+        /// Hedge is running.
+        bool running = false;
+    };
+
+} // namespace detail
+
+// Construct with default settings.
+routed_database::routed_database(database primary, std::vector<database> replicas)
+: routed_database(std::move(primary), std::move(replicas), settings{})
+{ }
+
+// Construct routed database.
+routed_database::routed_database(
+    database primary, std::vector<database> replicas, const settings& s)
+: _context(std::make_shared<context_t>(std::move(primary), std::move(replicas), s))
+{ }
+
+// Connect primary and replicas.
+void routed_database::connect()
+{
+    context_t* c = _context.get();
+    c->_primary.connect();
+    for (auto& n : c->_nodes) {
+        try {
+            n->db.connect();
+        }
+        catch (const exception&) {
+            c->mark_down(*n);
+        }
+    }
+}
+
+// Disconnect primary and replicas.
+void routed_database::disconnect() noexcept
+{
+    for (auto& n : _context->_nodes)
+        n->db.disconnect();
+    _context->_primary.disconnect();
+}
+
+// Get primary database.
+database& routed_database::primary() noexcept
+{ return _context->_primary; }
+
+// Get number of replicas.
+size_t routed_database::size() const noexcept
+{ return _context->_nodes.size(); }
+
+// Get replica.
+database& routed_database::replica(size_t index)
+{
+    if (index >= size())
+        throw fb::exception("replica out of range, index ") << index;
+    return _context->_nodes[index]->db;
+}
+
+// Choose database for work.
+database routed_database::route(intent i)
+{
+    return i == intent::write ? _context->_primary : _context->db(_context->pick());
+}
+
+// Start transaction on a routed database.
+transaction routed_database::begin(intent i)
+{
+    if (i == intent::write) {
+        transaction tr(_context->_primary);
+        tr.start();
+        return tr;
+    }
+    return begin({ isc_tpb_version3, isc_tpb_read,
+        isc_tpb_read_committed, isc_tpb_rec_version, isc_tpb_wait });
+}
+
+// Start transaction with parameters.
+transaction routed_database::begin(std::initializer_list<char> tpb)
+{
+    database db = route(is_read_only({ tpb.begin(), tpb.size() })
+        ? intent::read : intent::write);
+    transaction tr(db, tpb);
+    tr.start();
+    return tr;
+}
+
+// Checks if TPB describes a read-only transaction.
+bool routed_database::is_read_only(std::string_view tpb) noexcept
+{
+    // Skip version
+    for (size_t i = 1; i < tpb.size(); ++i) {
+        switch (tpb[i]) {
+            case isc_tpb_read:
+                return true;
+            case isc_tpb_write:
+                return false;
+            // Items with length and value
+            case isc_tpb_lock_read:
+            case isc_tpb_lock_write:
+            case isc_tpb_lock_timeout:
+                if (i + 1 < tpb.size())
+                    i += 1 + uint8_t(tpb[i + 1]);
+                break;
+        }
+    }
+    // Default access mode is write
+    return false;
+}
+
+// Run read on a replica in a read-only transaction.
+template <class... T, class ArgsTuple>
+routed_database::rows<T...> routed_database::run(
+    context_t& c, size_t index, const std::string& sql, const ArgsTuple& args)
+{
+    context_t::node* n = index == npos ? nullptr : c._nodes[index].get();
+    if (n)
+        n->in_flight.fetch_add(1, std::memory_order_relaxed);
+    auto start = context_t::clock::now();
+
+    try {
+        auto ret = detail::read_rows<T...>(c.db(index), sql, args);
+
+        if (n) {
+            c.add_sample(*n, context_t::clock::now() - start);
+            n->reads.fetch_add(1, std::memory_order_relaxed);
+            n->in_flight.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return ret;
+    }
+    catch (const exception& ex) {
+        if (n) {
+            if (circuit_breaker::is_failure(ex))
+                c.mark_down(*n);
+            n->failures.fetch_add(1, std::memory_order_relaxed);
+            n->reads.fetch_add(1, std::memory_order_relaxed);
+            n->in_flight.fetch_sub(1, std::memory_order_relaxed);
+        }
+        throw;
+    }
+}
+
+// Execute read on a replica and materialize the result.
+template <class... T, class... Args>
+routed_database::rows<T...> routed_database::read(std::string_view sql, const Args&... args)
+{
+    context_t* c = _context.get();
+    size_t first = c->pick();
+    if (c->_settings.hedge && first != npos && c->_nodes.size() > 1)
+        return hedged_read<T...>(first, sql, args...);
+
+    return run<T...>(*c, first, std::string(sql), std::tie(args...));
+}
+
+// Read with hedging.
+template <class... T, class... Args>
+routed_database::rows<T...> routed_database::hedged_read(
+    size_t first, std::string_view sql, const Args&... args)
+{
+    using state_t = detail::hedge_state<rows<T...>>;
+
+    // Hedge may run after return, so it owns everything it uses
+    context_t* c = _context.get();
+    auto state = std::make_shared<state_t>();
+    auto shared = std::make_shared<const std::pair<std::string,
+        std::tuple<detail::owned_arg_t<Args>...>>>(sql, std::make_tuple(args...));
+
+    // Run at most once, by a worker or by the caller whose read failed
+    auto hedge = [c, state, shared, first]() noexcept {
+        {
+            std::lock_guard lock(state->mutex);
+            if (state->started)
+                return;
+            state->started = state->running = true;
+        }
+        size_t second = c->pick(first);
+        if (second != npos) {
+            c->_nodes[second]->hedged.fetch_add(1, std::memory_order_relaxed);
+            try {
+                auto r = run<T...>(*c, second, shared->first, shared->second);
+                std::lock_guard lock(state->mutex);
+                state->result = std::move(r);
+                state->replica = second;
+            }
+            catch (...) {
+                // Error of the first read is reported
+            }
+        }
+        {
+            std::lock_guard lock(state->mutex);
+            state->running = false;
+        }
+        state->cv.notify_all();
+    };
+    c->schedule(context_t::clock::now() + c->hedge_after(*c->_nodes[first]), hedge);
+
+    try {
+        auto ret = run<T...>(*c, first, shared->first, shared->second);
+        std::lock_guard lock(state->mutex);
+        state->started = true;
+        if (state->result)
+            c->_nodes[state->replica]->hedge_wins.fetch_add(1, std::memory_order_relaxed);
+        return ret;
+    }
+    catch (...) {
+        // Hedge now if it is not started yet
+        hedge();
+        std::unique_lock lock(state->mutex);
+        state->cv.wait(lock, [&] { return !state->running; });
+        if (!state->result)
+            throw;
+        c->_nodes[state->replica]->hedge_wins.fetch_add(1, std::memory_order_relaxed);
+        return std::move(*state->result);
+    }
+}
+
+// Get statistics of a replica.
+routed_database::replica_stats routed_database::stats(size_t index) const
+{
+    if (index >= size())
+        throw fb::exception("replica out of range, index ") << index;
+
+    auto& n = *_context->_nodes[index];
+    replica_stats ret;
+    ret.reads = n.reads.load(std::memory_order_relaxed);
+    ret.failures = n.failures.load(std::memory_order_relaxed);
+    ret.hedged = n.hedged.load(std::memory_order_relaxed);
+    ret.hedge_wins = n.hedge_wins.load(std::memory_order_relaxed);
+    ret.in_flight = n.in_flight.load(std::memory_order_relaxed);
+    ret.healthy = _context->is_healthy(n);
+    return ret;
+}
+
+} // namespace fb
@@ -0,0 +1,330 @@
+/// \file services.hpp
+/// This file contains the connection to the Services API of the
+/// server, used for tasks such as trace, backup and restore.
+
+#pragma once
+#include "exception.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace fb
+{
+
+/// Connection to the service manager of a server.
+///
+/// \code{.cpp}
+///     fb::service svc("localhost");
+///     svc.connect();
+///     svc.start(fb::service::request(isc_action_svc_...)
+///         .add(isc_spb_dbname, "employee"));
+///     svc.wait([](std::string_view line) { std::cout << line << '\n'; });
+/// \endcode
+///
+struct service
+{
+    /// Service request buffer (SPB) passed to start().
+    struct request
+    {
+        /// Construct request of an action.
+        ///
+        /// \param[in] action - Action, such as isc_action_svc_backup.
+        ///
+        explicit request(uint8_t action)
+        { _buf.push_back(char(action)); }
+
+        /// Add a tag without value.
+        request& add(uint8_t tag)
+        {
+            _buf.push_back(char(tag));
+            return *this;
+        }
+
+        /// Add a string argument (2 bytes length).
+        request& add(uint8_t tag, std::string_view val)
+        {
+            _buf.push_back(char(tag));
+            put(val.size(), 2);
+            _buf.append(val);
+            return *this;
+        }
+
+        /// Add an integer argument (4 bytes).
+        request& add(uint8_t tag, uint32_t val)
+        {
+            _buf.push_back(char(tag));
+            put(val, 4);
+            return *this;
+        }
+
+        /// Get the buffer.
+        std::string_view data() const noexcept
+        { return _buf; }
+
+    private:
+        /// Append little endian integer.
+        void put(size_t val, size_t bytes)
+        {
+            for (size_t i = 0; i < bytes; ++i)
+                _buf.push_back(char(val >> (i * 8)));
+        }
+
+        std::string _buf;
+    };
+
+    /// Output of the service, as returned by query().
+    struct output
+    {
+        /// Text or data received (isc_info_svc_line or isc_info_svc_to_eof).
+        std::string data;
+        /// Number of bytes the service wants to read from stdin.
+        uint32_t stdin_request = 0;
+        /// Query timed out before the service produced output.
+        bool timeout = false;
+        /// More data is available than fitted in the buffer.
+        bool truncated = false;
+
+        /// Checks if the service has finished (no more output).
+        bool is_finished() const noexcept
+        { return data.empty() && !timeout && !truncated && !stdin_request; }
+    };
+
+    /// Callback receiving lines of the service output.
+    using line_callback = std::function<void(std::string_view)>;
+
+    /// Construct connection to the service manager.
+    ///
+    /// \param[in] host - Server host, optionally with port such as
+    ///                   "localhost/3051". Empty for embedded server.
+    /// \param[in] user_name - User name, optional, default is "sysdba".
+    /// \param[in] passwd - Password, optional, default is "masterkey".
+    ///
+    explicit service(
+        std::string_view host,
+        std::string_view user_name = "sysdba",
+        std::string_view passwd = "masterkey");
+
+    /// Attach to the service manager.
+    ///
+    /// \throw fb::exception
+    ///
+    void connect();
+
+    /// Detach from the service manager.
+    void disconnect() noexcept;
+
+    /// Start an action. Output of the action is read with query()
+    /// or wait(). Only one action can run at a time.
+    ///
+    /// \param[in] req - Action request.
+    ///
+    /// \throw fb::exception
+    ///
+    void start(const request& req);
+
+    /// Query service output.
+    ///
+    /// \param[in] send - Items sent to the service, such as timeout
+    ///                   or data for stdin.
+    /// \param[in] items - Requested items, such as isc_info_svc_line.
+    /// \param[in] size - Size of the receive buffer (optional).
+    ///
+    /// \return Received output.
+    /// \throw fb::exception
+    ///
+    output query(std::string_view send, std::string_view items, size_t size = 16384);
+
+    /// Read output of the started action line by line until
+    /// the action is finished.
+    ///
+    /// \param[in] cb - Callback receiving lines (optional).
+    ///
+    /// \throw fb::exception
+    ///
+    void wait(const line_callback& cb = nullptr);
+
+    /// Get native internal handle.
+    isc_svc_handle* handle() const noexcept;
+
+    /// Build the send item for query timeout.
+    ///
+    /// \param[in] seconds - Timeout in seconds.
+    ///
+    static std::string timeout(uint32_t seconds);
+
+    /// Build the send item with data for stdin of the service,
+    /// requested by isc_info_svc_stdin. Empty data tells end of input.
+    ///
+    /// \param[in] data - Data, at most 65535 bytes.
+    ///
+    /// \throw fb::exception if data is too long.
+    ///
+    static std::string stdin_data(std::string_view data);
+
+    /// Parse buffer received by query().
+    ///
+    /// \throw fb::exception if buffer is malformed.
+    ///
+    static output parse(std::string_view buf);
+
+private:
+    struct context_t;
+    std::shared_ptr<context_t> _context;
+};
+
+/// Service internal data.
+struct service::context_t
+{
+    /// Detach here since it is shared context.
+    ~context_t() noexcept
+    { disconnect(); }
+
+    /// Detach from the service manager.
+    void disconnect() noexcept
+    { invoke_noexcept<isc_service_detach>(&_handle); }
+
+    /// Service name, such as "localhost:service_mgr".
+    std::string _name;
+    /// Service Parameter Buffer (SPB) for attach.
+    std::string _params;
+    /// Native internal handle.
+    isc_svc_handle _handle = 0;
+};
+
+// Construct connection to the service manager.
+service::service(std::string_view host, std::string_view user_name, std::string_view passwd)
+: _context(std::make_shared<context_t>())
+{
+    context_t* c = _context.get();
+
+    c->_name = host;
+    if (!c->_name.empty())
+        c->_name += ':';
+    c->_name += "service_mgr";
+
+    auto add = [c](char tag, std::string_view val) {
+        c->_params.push_back(tag);
+        c->_params.push_back(char(val.size()));
+        c->_params.append(val);
+    };
+
+    c->_params.push_back(isc_spb_version);
+    c->_params.push_back(isc_spb_current_version);
+    add(isc_spb_user_name, user_name);
+    add(isc_spb_password, passwd);
+}
+
+// Attach to the service manager.
+void service::connect()
+{
+    context_t* c = _context.get();
+    invoke_except<isc_service_attach>(0, c->_name.c_str(), &c->_handle,
+        (unsigned short)c->_params.size(), c->_params.data());
+}
+
+// Detach from the service manager.
+void service::disconnect() noexcept
+{ _context->disconnect(); }
+
+// Start an action.
+void service::start(const request& req)
+{
+    auto spb = req.data();
+    invoke_except<isc_service_start>(&_context->_handle, nullptr,
+        (unsigned short)spb.size(), spb.data());
+}
+
+// Query service output.
+service::output service::query(std::string_view send, std::string_view items, size_t size)
+{
+    std::string buf(std::min<size_t>(size, 0xffff), '\0');
+    invoke_except<isc_service_query>(&_context->_handle, nullptr,
+        (unsigned short)send.size(), send.data(),
+        (unsigned short)items.size(), items.data(),
+        (unsigned short)buf.size(), buf.data());
+    return parse(buf);
+}
+
+// Parse buffer received by query().
+service::output service::parse(std::string_view buf)
+{
+    // Values are little endian
+    auto get = [&](size_t pos, size_t bytes) {
+        if (pos + bytes > buf.size())
+            throw fb::exception("service output is malformed");
+        return uint32_t(isc_portable_integer(
+            reinterpret_cast<const ISC_UCHAR*>(buf.data() + pos), short(bytes)));
+    };
+
+    output ret;
+    for (size_t pos = 0; pos < buf.size();) {
+        switch (uint8_t item = buf[pos++]) {
+            case isc_info_end:
+                return ret;
+            case isc_info_svc_line:
+            case isc_info_svc_to_eof: {
+                size_t len = get(pos, 2);
+                get(pos + 2, len);  // Check bounds
+                ret.data.append(buf.substr(pos + 2, len));
+                pos += 2 + len;
+                break;
+            }
+            case isc_info_svc_stdin:
+                ret.stdin_request = get(pos, 4);
+                pos += 4;
+                break;
+            case isc_info_svc_timeout:
+            case isc_info_data_not_ready:
+                ret.timeout = true;
+                break;
+            case isc_info_truncated:
+                ret.truncated = true;
+                break;
+            default:
+                throw fb::exception("unexpected service output item ") << int(item);
+        }
+    }
+    return ret;
+}
+
+// Read output of the started action line by line.
+void service::wait(const line_callback& cb)
+{
+    const char items[] = { isc_info_svc_line };
+    for (;;) {
+        auto out = query({}, { items, sizeof(items) });
+        if (out.is_finished())
+            break;
+        if (cb && !out.timeout)
+            cb(out.data);
+    }
+}
+
+// Get native internal handle.
+isc_svc_handle* service::handle() const noexcept
+{ return &_context->_handle; }
+
+// Build the send item for query timeout.
+std::string service::timeout(uint32_t seconds)
+{
+    std::string ret = { char(isc_info_svc_timeout), 4, 0 };
+    for (size_t i = 0; i < 4; ++i)
+        ret.push_back(char(seconds >> (i * 8)));
+    return ret;
+}
+
+// Build the send item with data for stdin of the service.
+std::string service::stdin_data(std::string_view data)
+{
+    if (data.size() > 0xffff)
+        throw fb::exception("service stdin data too long: ") << data.size();
+
+    std::string ret = { char(isc_info_svc_line), char(data.size()), char(data.size() >> 8) };
+    ret.append(data);
+    return ret;
+}
+
+} // namespace fb
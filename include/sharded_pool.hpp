@@ -0,0 +1,362 @@
+/// \file sharded_pool.hpp
+/// This file contains the connection pool for many threads doing
+/// short requests. Connections are cached per shard and taken
+/// without locks.
+
+#pragma once
+#include "database.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace fb
+{
+
+/// Connection pool without locks. Every thread is assigned a shard
+/// with a small cache of connections. Acquire takes a connection
+/// from the own shard, then from the global free list, and then
+/// steals from other shards. Release puts it back to the own shard,
+/// or to the global free list if the shard is full. Connections are
+/// opened on first use.
+///
+/// \code{.cpp}
+///     fb::sharded_pool pool([] {
+///         fb::database db("employee");
+///         db.connect();
+///         return db;
+///     }, 64);
+///
+///     auto conn = pool.acquire();
+///     fb::query(conn.db(), "select ...").execute();
+/// \endcode
+///
+/// \note Acquire waits (spinning, then sleeping) only when all
+///       connections are in use.
+///
+struct sharded_pool
+{
+private:
+    struct context_t;
+
+public:
+    /// Pool settings.
+    struct settings
+    {
+        /// Number of shards (0 for number of hardware threads).
+        size_t shards = 0;
+        /// Connections cached per shard.
+        size_t shard_cache = 4;
+        /// Maximum time to wait when all connections are in use.
+        std::chrono::nanoseconds timeout = std::chrono::seconds(1);
+    };
+
+    /// Pool statistics.
+    struct pool_stats
+    {
+        /// Acquired from the own shard.
+        size_t local = 0;
+        /// Acquired from the global free list.
+        size_t global = 0;
+        /// Acquired from another shard.
+        size_t stolen = 0;
+        /// Had to wait for a connection.
+        size_t waits = 0;
+    };
+
+    /// Function creating connected database.
+    using factory_t = std::function<database()>;
+
+    /// Connection leased from the pool. Returned to the
+    /// pool on destruction, after its default transaction is
+    /// rolled back, so uncommitted changes and locks do not
+    /// pass to the next user. Connection failing to roll back
+    /// is disconnected and opened again on next use.
+    struct lease
+    {
+        lease(lease&& other) noexcept
+        : _pool(std::move(other._pool))
+        , _index(other._index)
+        { }
+
+        lease(const lease&) = delete;
+        lease& operator=(const lease&) = delete;
+        lease& operator=(lease&&) = delete;
+
+        /// Return connection to the pool.
+        ~lease() noexcept;
+
+        /// Get leased connection.
+        database& db() noexcept;
+
+        /// Get leased connection.
+        database* operator->() noexcept
+        { return &db(); }
+
+        /// Mark connection as broken, it is disconnected
+        /// and opened again on next use.
+        void invalidate() noexcept;
+
+    private:
+        friend struct sharded_pool;
+
+        lease(std::shared_ptr<context_t> p, uint32_t index) noexcept
+        : _pool(std::move(p))
+        , _index(index)
+        { }
+
+        std::shared_ptr<context_t> _pool;
+        uint32_t _index;
+    };
+
+    /// Construct pool with default settings.
+    ///
+    /// \param[in] factory - Function creating connected database.
+    /// \param[in] size - Maximum number of connections.
+    ///
+    sharded_pool(factory_t factory, size_t size);
+
+    /// Construct pool.
+    ///
+    /// \param[in] factory - Function creating connected database.
+    /// \param[in] size - Maximum number of connections.
+    /// \param[in] s - Settings.
+    ///
+    sharded_pool(factory_t factory, size_t size, const settings& s);
+
+    /// Acquire connection.
+    ///
+    /// \return Leased connection.
+    /// \throw fb::exception on timeout or if connection fails.
+    ///
+    lease acquire();
+
+    /// Maximum number of connections.
+    size_t capacity() const noexcept;
+
+    /// Get statistics (sum of all shards).
+    pool_stats stats() const noexcept;
+
+private:
+    std::shared_ptr<context_t> _context;
+};
+
+/// Pool internal data.
+struct sharded_pool::context_t
+{
+    /// No connection index.
+    static constexpr uint32_t empty = UINT32_MAX;
+
+    /// Cache of a shard, on its own cache line.
+    struct alignas(64) shard
+    {
+        std::unique_ptr<std::atomic<uint32_t>[]> slots;
+        std::atomic<size_t> local = 0;
+        std::atomic<size_t> stolen = 0;
+    };
+
+    context_t(factory_t factory, size_t size, const settings& s)
+    : _factory(std::move(factory))
+    , _settings(s)
+    , _dbs(size)
+    , _next(new std::atomic<uint32_t>[size])
+    {
+        if (!_settings.shards)
+            _settings.shards = std::max(1u, std::thread::hardware_concurrency());
+        _shards.reset(new shard[_settings.shards]);
+        for (size_t i = 0; i < _settings.shards; ++i) {
+            _shards[i].slots.reset(new std::atomic<uint32_t>[_settings.shard_cache]);
+            for (size_t j = 0; j < _settings.shard_cache; ++j)
+                _shards[i].slots[j] = empty;
+        }
+        // All connections are free (not opened yet)
+        for (size_t i = size; i-- > 0;)
+            push(uint32_t(i));
+    }
+
+    /// Get shard of current thread.
+    shard& own() noexcept
+    {
+        static std::atomic<size_t> next_thread = 0;
+        thread_local size_t thread = next_thread++;
+        return _shards[thread % _settings.shards];
+    }
+
+    /// Take connection from a shard.
+    static uint32_t take(shard& s, size_t cache) noexcept
+    {
+        for (size_t i = 0; i < cache; ++i) {
+            if (s.slots[i].load(std::memory_order_relaxed) != empty) {
+                uint32_t idx = s.slots[i].exchange(empty, std::memory_order_acquire);
+                if (idx != empty)
+                    return idx;
+            }
+        }
+        return empty;
+    }
+
+    /// Put connection to a shard.
+    static bool put(shard& s, size_t cache, uint32_t idx) noexcept
+    {
+        for (size_t i = 0; i < cache; ++i) {
+            uint32_t expected = empty;
+            if (s.slots[i].load(std::memory_order_relaxed) == empty
+                && s.slots[i].compare_exchange_strong(expected, idx, std::memory_order_release))
+                return true;
+        }
+        return false;
+    }
+
+    /// Push to global free list (Treiber stack). Head holds
+    /// index and a tag changed on every update against ABA.
+    void push(uint32_t idx) noexcept
+    {
+        uint64_t head = _head.load(std::memory_order_relaxed);
+        do {
+            _next[idx].store(uint32_t(head), std::memory_order_relaxed);
+        } while (!_head.compare_exchange_weak(head,
+            ((head >> 32) + 1) << 32 | idx, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    /// Pop from global free list.
+    uint32_t pop() noexcept
+    {
+        uint64_t head = _head.load(std::memory_order_acquire);
+        for (;;) {
+            uint32_t idx = uint32_t(head);
+            if (idx == empty)
+                return empty;
+            uint32_t next = _next[idx].load(std::memory_order_relaxed);
+            if (_head.compare_exchange_weak(head,
+                ((head >> 32) + 1) << 32 | next, std::memory_order_acquire))
+                return idx;
+        }
+    }
+
+    /// Take free connection from anywhere.
+    uint32_t find(shard& mine) noexcept
+    {
+        uint32_t idx = take(mine, _settings.shard_cache);
+        if (idx != empty) {
+            mine.local.fetch_add(1, std::memory_order_relaxed);
+            return idx;
+        }
+        if ((idx = pop()) != empty) {
+            _global.fetch_add(1, std::memory_order_relaxed);
+            return idx;
+        }
+        for (size_t i = 0; i < _settings.shards; ++i) {
+            if (&_shards[i] != &mine && (idx = take(_shards[i], _settings.shard_cache)) != empty) {
+                mine.stolen.fetch_add(1, std::memory_order_relaxed);
+                return idx;
+            }
+        }
+        return empty;
+    }
+
+    /// Return connection.
+    void release(uint32_t idx) noexcept
+    {
+        if (!put(own(), _settings.shard_cache, idx))
+            push(idx);
+    }
+
+    factory_t _factory;
+    settings _settings;
+    /// Connections, opened on first use. Only the holder
+    /// of an index accesses its connection.
+    std::vector<std::optional<database>> _dbs;
+
+    std::unique_ptr<shard[]> _shards;
+    std::unique_ptr<std::atomic<uint32_t>[]> _next;
+    alignas(64) std::atomic<uint64_t> _head = empty;
+    std::atomic<size_t> _global = 0;
+    std::atomic<size_t> _waits = 0;
+};
+
+// Return connection to the pool.
+sharded_pool::lease::~lease() noexcept
+{
+    if (!_pool)
+        return;
+
+    auto& db = _pool->_dbs[_index];
+    if (db && *db->default_transaction().handle()) {
+        try {
+            db->default_transaction().rollback();
+        }
+        catch (const exception&) {
+            db.reset();
+        }
+    }
+    _pool->release(_index);
+}
+
+// Get leased connection.
+database& sharded_pool::lease::db() noexcept
+{ return *_pool->_dbs[_index]; }
+
+// Mark connection as broken.
+void sharded_pool::lease::invalidate() noexcept
+{ _pool->_dbs[_index].reset(); }
+
+// Construct pool with default settings.
+sharded_pool::sharded_pool(factory_t factory, size_t size)
+: sharded_pool(std::move(factory), size, settings())
+{ }
+
+// Construct pool.
+sharded_pool::sharded_pool(factory_t factory, size_t size, const settings& s)
+: _context(std::make_shared<context_t>(std::move(factory), size, s))
+{ }
+
+// Acquire connection.
+sharded_pool::lease sharded_pool::acquire()
+{
+    context_t* c = _context.get();
+    auto& mine = c->own();
+
+    uint32_t idx = c->find(mine);
+    if (idx == context_t::empty) {
+        // All in use, back off until one is released
+        c->_waits.fetch_add(1, std::memory_order_relaxed);
+        auto deadline = std::chrono::steady_clock::now() + c->_settings.timeout;
+        for (unsigned n = 0; (idx = c->find(mine)) == context_t::empty; ++n) {
+            if (std::chrono::steady_clock::now() >= deadline)
+                throw fb::exception("sharded_pool: no connection available");
+            if (n < 64)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    lease ret(_context, idx);
+    if (!c->_dbs[idx])
+        c->_dbs[idx] = c->_factory();  // Released by lease on failure
+    return ret;
+}
+
+// Maximum number of connections.
+size_t sharded_pool::capacity() const noexcept
+{ return _context->_dbs.size(); }
+
+// Get statistics.
+sharded_pool::pool_stats sharded_pool::stats() const noexcept
+{
+    context_t* c = _context.get();
+    pool_stats ret;
+    for (size_t i = 0; i < c->_settings.shards; ++i) {
+        ret.local += c->_shards[i].local.load(std::memory_order_relaxed);
+        ret.stolen += c->_shards[i].stolen.load(std::memory_order_relaxed);
+    }
+    ret.global = c->_global.load(std::memory_order_relaxed);
+    ret.waits = c->_waits.load(std::memory_order_relaxed);
+    return ret;
+}
+
+} // namespace fb
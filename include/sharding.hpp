@@ -0,0 +1,446 @@
+/// \file sharding.hpp
+/// This file contains routing of queries to shards of data split
+/// over several databases.
+
+#pragma once
+#include "routing.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <future>
+#include <initializer_list>
+#include <iterator>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <variant>
+#include <vector>
+
+namespace fb
+{
+
+/// Key of sharded data, for example tenant id.
+using shard_key = std::variant<int64_t, std::string_view>;
+
+/// Map of keys to shards, by hash or by range of the key.
+///
+/// \code{.cpp}
+///     // Tenants 0..999 on shard 0, 1000..4999 on shard 1, rest on shard 2
+///     auto by_range = fb::shard_map::range({ 1000, 5000 });
+///     // Tenant names spread over 4 shards
+///     auto by_hash = fb::shard_map::hash(4);
+/// \endcode
+///
+struct shard_map
+{
+    /// Construct map spreading keys over shards by hash of the key.
+    /// Note that all keys move when number of shards changes.
+    ///
+    /// \param[in] shards - Number of shards.
+    ///
+    static shard_map hash(size_t shards);
+
+    /// Construct map of integer key ranges. Shard i holds keys less
+    /// than bounds[i] (and not less than bounds[i-1]), the last shard
+    /// holds the rest.
+    ///
+    /// \param[in] bounds - Ascending bounds, one less than shards.
+    ///
+    /// \throw fb::exception
+    ///
+    static shard_map range(std::vector<int64_t> bounds);
+
+    /// Construct map of integer key ranges, see above.
+    ///
+    /// \param[in] bounds - Ascending bounds, one less than shards.
+    ///
+    /// \throw fb::exception
+    ///
+    static shard_map range(std::initializer_list<int64_t> bounds)
+    { return range(std::vector<int64_t>(bounds)); }
+
+    /// Construct map of string key ranges, see range() of integers.
+    ///
+    /// \param[in] bounds - Ascending bounds, one less than shards.
+    ///
+    /// \throw fb::exception
+    ///
+    static shard_map range(std::vector<std::string> bounds);
+
+    /// Get shard of a key.
+    ///
+    /// \param[in] key - Key.
+    ///
+    /// \return Shard index.
+    /// \throw fb::exception if key type doesn't match range bounds.
+    ///
+    size_t operator()(const shard_key& key) const;
+
+    /// Get number of shards.
+    size_t size() const noexcept
+    { return _shards; }
+
+private:
+    shard_map(size_t shards) noexcept
+    : _shards(shards)
+    { }
+
+    /// Get shard of a key in bounds.
+    template <class T, class K>
+    static size_t find(const std::vector<T>& bounds, const K& key) noexcept
+    { return std::upper_bound(bounds.begin(), bounds.end(), key) - bounds.begin(); }
+
+    size_t _shards;
+    /// Range bounds (none for hash).
+    std::variant<std::monostate, std::vector<int64_t>, std::vector<std::string>> _bounds;
+};
+
+/// Compare rows of materialized result by column, for
+/// shard_router::scatter_merge().
+///
+/// \tparam I - Column index.
+///
+template <size_t I>
+struct by_column
+{
+    template <class Row>
+    bool operator()(const Row& a, const Row& b) const
+    { return std::get<I>(a) < std::get<I>(b); }
+};
+
+/// Router of queries to shards. Keyed queries run on the shard of
+/// the key. Unkeyed reads are scattered to all shards in parallel,
+/// and the results gathered into one: concatenated in shard order,
+/// or merged on the ORDER BY key of the statement.
+///
+/// \code{.cpp}
+///     fb::shard_router router({
+///         fb::database("db1:tenants"),
+///         fb::database("db2:tenants"),
+///     }, fb::shard_map::range({ 1000 }));
+///     router.connect();
+///
+///     // Only the shard of tenant 1234
+///     router.prepare(1234, "update account set active = 0 where tenant_id = ?")
+///         .execute(1234);
+///
+///     // All shards, merged by creation time
+///     auto rows = router.scatter_merge<int64_t, std::string>(fb::by_column<0>{},
+///         "select created, name from account order by created");
+/// \endcode
+///
+/// \note Scattered reads use a transaction of their own per shard,
+///       so each shard sees its own snapshot.
+///
+struct shard_router
+{
+    /// Rows of a materialized result.
+    template <class... T>
+    using rows = std::vector<std::tuple<T...>>;
+
+    /// Construct router.
+    ///
+    /// \param[in] shards - Databases, one per shard.
+    /// \param[in] map - Map of keys to shards.
+    ///
+    /// \throw fb::exception if number of shards doesn't match.
+    ///
+    shard_router(std::vector<database> shards, shard_map map);
+
+    /// Connect all shards.
+    ///
+    /// \throw fb::exception
+    ///
+    void connect();
+
+    /// Disconnect all shards.
+    void disconnect() noexcept;
+
+    /// Get number of shards.
+    size_t size() const noexcept
+    { return _shards.size(); }
+
+    /// Get shard by index.
+    ///
+    /// \param[in] index - Shard index.
+    ///
+    /// \throw fb::exception
+    ///
+    database& shard(size_t index);
+
+    /// Get shard of a key.
+    ///
+    /// \param[in] key - Key.
+    ///
+    /// \throw fb::exception
+    ///
+    database& shard_for(const shard_key& key);
+
+    /// Create query on the shard of a key, in default
+    /// transaction of the shard.
+    ///
+    /// \param[in] key - Key.
+    /// \param[in] sql - SQL query.
+    ///
+    /// \throw fb::exception
+    ///
+    query prepare(const shard_key& key, std::string_view sql)
+    { return query(shard_for(key), sql); }
+
+    /// Execute read on the shard of a key and materialize the
+    /// result. Use std::optional for nullable columns.
+    ///
+    /// \tparam T... - Column types.
+    /// \param[in] key - Key.
+    /// \param[in] sql - SELECT statement.
+    /// \param[in] args - Parameters (optional).
+    ///
+    /// \throw fb::exception
+    ///
+    template <class... T, class... Args>
+    rows<T...> read(const shard_key& key, std::string_view sql, const Args&... args);
+
+    /// Execute read on all shards in parallel. Results are
+    /// concatenated in shard order.
+    ///
+    /// \tparam T... - Column types.
+    /// \param[in] sql - SELECT statement.
+    /// \param[in] args - Parameters (optional).
+    ///
+    /// \throw fb::exception (the first error, after all shards completed)
+    ///
+    template <class... T, class... Args>
+    rows<T...> scatter(std::string_view sql, const Args&... args);
+
+    /// Execute read on all shards in parallel and merge results
+    /// sorted by the same order. Rows of equal order keep order of
+    /// shards.
+    ///
+    /// \tparam T... - Column types.
+    /// \param[in] less - Order of rows as in ORDER BY of the statement,
+    ///                   for example by_column<0>.
+    /// \param[in] sql - SELECT statement with ORDER BY.
+    /// \param[in] args - Parameters (optional).
+    ///
+    /// \throw fb::exception (the first error, after all shards completed)
+    ///
+    template <class... T, class Less, class... Args>
+    rows<T...> scatter_merge(Less less, std::string_view sql, const Args&... args);
+
+private:
+    /// Execute read on all shards in parallel.
+    template <class... T, class... Args>
+    std::vector<rows<T...>> gather(std::string_view sql, const Args&... args);
+
+    std::vector<database> _shards;
+    shard_map _map;
+};
+
+namespace detail
+{
+
+/// Merge sorted parts into one sorted sequence. Equal
+/// elements keep the order of parts.
+///
+/// \param[in] parts - Sorted parts.
+/// \param[in] less - Order of elements.
+///
+template <class Row, class Less>
+std::vector<Row> merge_sorted(std::vector<std::vector<Row>> parts, Less less)
+{
+    // Heap of next row of every part, lowest on top
+    using cursor = std::pair<size_t, size_t>;   // part, row
+    auto greater = [&](const cursor& a, const cursor& b) {
+        auto& ra = parts[a.first][a.second];
+        auto& rb = parts[b.first][b.second];
+        if (less(rb, ra))
+            return true;
+        return !less(ra, rb) && a.first > b.first;
+    };
+    std::priority_queue<cursor, std::vector<cursor>, decltype(greater)> heap(greater);
+
+    size_t total = 0;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        total += parts[i].size();
+        if (!parts[i].empty())
+            heap.emplace(i, 0);
+    }
+
+    std::vector<Row> ret;
+    ret.reserve(total);
+    while (!heap.empty()) {
+        auto [part, row] = heap.top();
+        heap.pop();
+        ret.push_back(std::move(parts[part][row]));
+        if (++row < parts[part].size())
+            heap.emplace(part, row);
+    }
+    return ret;
+}
+
+} // namespace detail
+
+// Construct map spreading keys over shards by hash of the key.
+shard_map shard_map::hash(size_t shards)
+{
+    if (!shards)
+        throw fb::exception("no shards");
+    return shard_map(shards);
+}
+
+// Construct map of integer key ranges.
+shard_map shard_map::range(std::vector<int64_t> bounds)
+{
+    if (!std::is_sorted(bounds.begin(), bounds.end()))
+        throw fb::exception("range bounds not sorted");
+    shard_map ret(bounds.size() + 1);
+    ret._bounds = std::move(bounds);
+    return ret;
+}
+
+// Construct map of string key ranges.
+shard_map shard_map::range(std::vector<std::string> bounds)
+{
+    if (!std::is_sorted(bounds.begin(), bounds.end()))
+        throw fb::exception("range bounds not sorted");
+    shard_map ret(bounds.size() + 1);
+    ret._bounds = std::move(bounds);
+    return ret;
+}
+
+// Get shard of a key.
+size_t shard_map::operator()(const shard_key& key) const
+{
+    if (auto b = std::get_if<std::vector<int64_t>>(&_bounds)) {
+        if (auto k = std::get_if<int64_t>(&key))
+            return find(*b, *k);
+        throw fb::exception("string key in integer ranges");
+    }
+    if (auto b = std::get_if<std::vector<std::string>>(&_bounds)) {
+        if (auto k = std::get_if<std::string_view>(&key))
+            return find(*b, *k);
+        throw fb::exception("integer key in string ranges");
+    }
+
+    // FNV-1a of key bytes (integers little-endian)
+    uint64_t h = 14695981039346656037ull;
+    auto mix = [&](unsigned char ch) {
+        h ^= ch;
+        h *= 1099511628211ull;
+    };
+    if (auto k = std::get_if<int64_t>(&key)) {
+        for (int i = 0; i < 8; ++i)
+            mix(uint64_t(*k) >> (i * 8));
+    }
+    else {
+        for (unsigned char ch : std::get<std::string_view>(key))
+            mix(ch);
+    }
+    return h % _shards;
+}
+
+// Construct router.
+shard_router::shard_router(std::vector<database> shards, shard_map map)
+: _shards(std::move(shards))
+, _map(std::move(map))
+{
+    if (_shards.size() != _map.size())
+        throw fb::exception("shard map of ") << _map.size()
+            << " shards for " << _shards.size() << " databases";
+}
+
+// Connect all shards.
+void shard_router::connect()
+{
+    for (auto& db : _shards)
+        db.connect();
+}
+
+// Disconnect all shards.
+void shard_router::disconnect() noexcept
+{
+    for (auto& db : _shards)
+        db.disconnect();
+}
+
+// Get shard by index.
+database& shard_router::shard(size_t index)
+{
+    if (index >= _shards.size())
+        throw fb::exception("shard out of range, index ") << index;
+    return _shards[index];
+}
+
+// Get shard of a key.
+database& shard_router::shard_for(const shard_key& key)
+{ return _shards[_map(key)]; }
+
+// Execute read on the shard of a key.
+template <class... T, class... Args>
+shard_router::rows<T...> shard_router::read(
+    const shard_key& key, std::string_view sql, const Args&... args)
+{
+    return detail::read_rows<T...>(shard_for(key), std::string(sql), std::tie(args...));
+}
+
+// Execute read on all shards in parallel.
+template <class... T, class... Args>
+std::vector<shard_router::rows<T...>> shard_router::gather(
+    std::string_view sql, const Args&... args)
+{
+    std::string text(sql);
+    auto params = std::tie(args...);
+
+    std::vector<std::future<rows<T...>>> results;
+    results.reserve(_shards.size());
+    for (auto& db : _shards) {
+        results.push_back(std::async(std::launch::async, [&db, &text, &params] {
+            return detail::read_rows<T...>(db, text, params);
+        }));
+    }
+
+    // Wait for all shards before throwing, they use the parameters
+    std::vector<rows<T...>> ret;
+    ret.reserve(results.size());
+    std::exception_ptr error;
+    for (auto& r : results) {
+        try {
+            ret.push_back(r.get());
+        }
+        catch (...) {
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+    return ret;
+}
+
+// Execute read on all shards and concatenate results.
+template <class... T, class... Args>
+shard_router::rows<T...> shard_router::scatter(std::string_view sql, const Args&... args)
+{
+    auto parts = gather<T...>(sql, args...);
+
+    size_t total = 0;
+    for (auto& p : parts)
+        total += p.size();
+
+    rows<T...> ret;
+    ret.reserve(total);
+    for (auto& p : parts)
+        std::move(p.begin(), p.end(), std::back_inserter(ret));
+    return ret;
+}
+
+// Execute read on all shards and merge sorted results.
+template <class... T, class Less, class... Args>
+shard_router::rows<T...> shard_router::scatter_merge(
+    Less less, std::string_view sql, const Args&... args)
+{
+    return detail::merge_sorted(gather<T...>(sql, args...), less);
+}
+
+} // namespace fb
@@ -0,0 +1,251 @@
+/// \file slow_log.hpp
+/// This file contains the slow query log. Statements exceeding
+/// time thresholds are recorded with their parameters and timings
+/// and written to a file by a background thread.
+
+#pragma once
+#include "sqlda.hpp"
+#include "stats.hpp"
+#include "writer.hpp"
+
+#include <string>
+
+namespace fb
+{
+
+/// Slow query log. While an instance exists, every fb::query
+/// whose prepare, execute or fetch time exceeds a threshold is
+/// recorded. Recording is a push to a lock-free ring buffer,
+/// entries are written to the file by a background thread.
+/// Entries are dropped (and counted) when the buffer is full.
+///
+/// \code{.cpp}
+///     fb::slow_query_log::settings s;
+///     s.execute = std::chrono::milliseconds(50);
+///     fb::slow_query_log log("slow.log", s);
+///     // ... run queries ...
+/// \endcode
+///
+/// \note Parameters of SELECT statements are rendered at execution,
+///       since parameter values may expire before all rows are
+///       fetched. This is done for every SELECT while the log exists.
+///
+struct slow_query_log
+{
+    /// Log settings.
+    struct settings
+    {
+        /// Thresholds, statement is logged if any of them is
+        /// exceeded. Prepare time counts on first execution only.
+        std::chrono::nanoseconds prepare = std::chrono::milliseconds(100);
+        std::chrono::nanoseconds execute = std::chrono::milliseconds(100);
+        std::chrono::nanoseconds fetch = std::chrono::milliseconds(100);
+        /// Maximum number of entries waiting to be written.
+        size_t capacity = 4096;
+        /// Maximum length of a rendered parameter value.
+        size_t max_param_length = 256;
+    };
+
+    /// Recorded statement.
+    struct entry
+    {
+        std::string sql;
+        /// Rendered input parameters.
+        std::string params;
+        execution_stats stats;
+        /// Fetched rows for SELECT, affected rows otherwise.
+        size_t rows = 0;
+        int64_t attachment_id = 0;
+        /// Wall clock time when execution completed.
+        std::chrono::system_clock::time_point finished;
+    };
+
+    /// Guard of the active log. Keeps the log from being
+    /// destroyed while in use.
+    struct guard
+    {
+        guard(slow_query_log* log) noexcept
+        : _log(log)
+        { }
+
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+
+        ~guard() noexcept
+        { if (_log) --_users; }
+
+        slow_query_log* operator->() const noexcept
+        { return _log; }
+
+        explicit operator bool() const noexcept
+        { return _log; }
+
+    private:
+        slow_query_log* _log;
+    };
+
+    /// Open log file (for appending) with default settings and
+    /// make it the active log.
+    ///
+    /// \param[in] path - Path to the log file.
+    ///
+    /// \throw fb::exception if file can't be opened or another
+    ///        log is already active.
+    ///
+    explicit slow_query_log(const std::string& path);
+
+    /// Open log file (for appending) and make it the active log.
+    ///
+    /// \param[in] path - Path to the log file.
+    /// \param[in] s - Settings.
+    ///
+    /// \throw fb::exception if file can't be opened or another
+    ///        log is already active.
+    ///
+    slow_query_log(const std::string& path, const settings& s);
+
+    /// Deactivate and write all recorded entries.
+    ~slow_query_log() noexcept;
+
+    slow_query_log(const slow_query_log&) = delete;
+    slow_query_log& operator=(const slow_query_log&) = delete;
+
+    /// Checks if a log is active, without using it. Costs
+    /// a relaxed atomic load.
+    static bool is_active() noexcept
+    { return _active.load(std::memory_order_relaxed); }
+
+    /// Get the active log, if any.
+    static guard active() noexcept
+    {
+        if (!_active.load(std::memory_order_relaxed))
+            return nullptr;
+        ++_users;
+        slow_query_log* log = _active;
+        if (!log)
+            --_users;
+        return log;
+    }
+
+    /// Checks if any of thresholds is exceeded.
+    bool is_slow(const execution_stats& st) const noexcept
+    {
+        return (st.executions == 1 && st.prepare > _settings.prepare)
+            || st.execute > _settings.execute
+            || st.fetch > _settings.fetch;
+    }
+
+    /// Record an entry (never blocks).
+    void push(entry&& e) noexcept
+    { _writer.push(std::move(e)); }
+
+    /// Render input parameters as text, for example "[42, 'shipped']".
+    std::string render(const sqlda& params) const;
+
+    /// Format entry as a line of the log file.
+    static std::string format(const entry& e);
+
+    /// Number of entries dropped due to full buffer.
+    size_t dropped() const noexcept
+    { return _writer.dropped(); }
+
+    /// Number of entries written to the file.
+    size_t written() const noexcept
+    { return _writer.written(); }
+
+private:
+    settings _settings;
+    background_writer<entry> _writer;
+
+    static inline std::atomic<slow_query_log*> _active = nullptr;
+    /// Number of guards in use.
+    static inline std::atomic<size_t> _users = 0;
+};
+
+// Open log file with default settings.
+slow_query_log::slow_query_log(const std::string& path)
+: slow_query_log(path, settings())
+{ }
+
+// Open log file and make it the active log.
+slow_query_log::slow_query_log(const std::string& path, const settings& s)
+: _settings(s)
+, _writer(path, s.capacity, [](std::ostream& os, const entry& e) { os << format(e) << '\n'; })
+{
+    if (!_writer.is_open())
+        throw fb::exception("slow_query_log: can't open ") << std::quoted(path);
+
+    slow_query_log* expected = nullptr;
+    if (!_active.compare_exchange_strong(expected, this))
+        throw fb::exception("slow_query_log: another log is already active");
+}
+
+// Deactivate and write all recorded entries.
+slow_query_log::~slow_query_log() noexcept
+{
+    _active = nullptr;
+    // Wait for queries that are recording right now
+    while (_users)
+        std::this_thread::yield();
+    // Writer drains remaining entries on destruction
+}
+
+// Render input parameters as text.
+std::string slow_query_log::render(const sqlda& params) const
+{
+    std::string ret = "[";
+    for (auto& var : params) {
+        if (ret.size() > 1)
+            ret += ", ";
+        try {
+            auto val = var.to_string();
+            if (val.size() > _settings.max_param_length) {
+                val.resize(_settings.max_param_length);
+                val += "...";
+            }
+            ret += val;
+        }
+        catch (const fb::exception&) {
+            ret += "<unknown>";
+        }
+    }
+    return ret += "]";
+}
+
+// Format entry as a line of the log file.
+std::string slow_query_log::format(const entry& e)
+{
+    using namespace std::chrono;
+
+    auto ms = [](nanoseconds ns) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.3fms", ns.count() / 1e6);
+        return std::string(buf);
+    };
+    auto time = [](system_clock::time_point tp) {
+        std::time_t t = system_clock::to_time_t(tp);
+        std::tm tm;
+        char buf[48];
+        size_t len = std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", gmtime_r(&t, &tm));
+        auto us = duration_cast<microseconds>(tp.time_since_epoch()).count() % 1'000'000;
+        std::snprintf(buf + len, sizeof(buf) - len, ".%06ldZ", long(us));
+        return std::string(buf);
+    };
+
+    std::string ret = time(e.finished);
+    ret.append(" started=").append(time(e.stats.started))
+       .append(" attachment=").append(std::to_string(e.attachment_id))
+       .append(" prepare=").append(e.stats.executions == 1 ? ms(e.stats.prepare) : "-")
+       .append(" execute=").append(ms(e.stats.execute))
+       .append(" fetch=").append(ms(e.stats.fetch))
+       .append(" rows=").append(std::to_string(e.rows))
+       .append(" params=").append(e.params)
+       .append(" sql=");
+
+    // One line per entry
+    for (char ch : e.sql)
+        ret += (ch == '\n' || ch == '\r' || ch == '\t') ? ' ' : ch;
+    return ret;
+}
+
+} // namespace fb
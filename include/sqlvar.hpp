@@ -207,6 +207,18 @@ struct sqlvar
     ///
     field_t as_variant() const;
 
+    /// Gets the value as text, for example to log parameters
+    /// of a statement. Strings are quoted as SQL literals.
+    ///
+    /// \code{.cpp}
+    ///     q.params()[0].to_string(); // "'shipped'"
+    /// \endcode
+    ///
+    /// \return Value as text ("?" for parameter not set yet).
+    /// \throw fb::exception
+    ///
+    std::string to_string() const;
+
 private:
     /// Internal pointer to XSQLVAR
     pointer _ptr;
@@ -297,5 +309,45 @@ field_t sqlvar::as_variant() const
     }
 }
 
+// Gets the value as text.
+std::string sqlvar::to_string() const
+{
+    // Parameter set to null or not set at all
+    if (sql_datatype() == SQL_NULL)
+        return "NULL";
+    if (!_ptr->sqldata || ((_ptr->sqltype & 1) && !_ptr->sqlind))
+        return "?";
+
+    return std::visit([](const auto& val) -> std::string
+    {
+        using T = std::decay_t<decltype(val)>;
+
+        if constexpr (std::is_same_v<T, std::nullptr_t>)
+            return "NULL";
+        else if constexpr (std::is_same_v<T, std::string_view>) {
+            std::string ret = "'";
+            for (char ch : val) {
+                if (ch == '\'')
+                    ret += ch;
+                ret += ch;
+            }
+            return ret += '\'';
+        }
+        else if constexpr (std::is_arithmetic_v<T>)
+            return std::to_string(val);
+        else if constexpr (std::is_same_v<T, timestamp_t>) {
+            std::tm tm;
+            char buf[32];
+            size_t len = std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", val.to_tm(&tm));
+            std::snprintf(buf + len, sizeof(buf) - len, ".%04u", unsigned(val.timestamp_time % 10'000));
+            return std::string("'") + buf + "'";
+        }
+        else if constexpr (std::is_same_v<T, blob_id_t>)
+            return "<blob>";
+        else
+            return val.to_string();
+    }, as_variant());
+}
+
 } // namespace fb
 
@@ -0,0 +1,634 @@
+/// \file srp.hpp
+/// This file contains the client side of SRP authentication and
+/// the Arc4 wire encryption of the Firebird remote protocol, used
+/// by the wire backend (see wire.hpp).
+
+#pragma once
+#include "exception.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fb
+{
+
+namespace detail
+{
+    /// Rotate 32 bit value left.
+    inline constexpr uint32_t rotl(uint32_t v, int n) noexcept
+    { return (v << n) | (v >> (32 - n)); }
+
+    /// Rotate 32 bit value right.
+    inline constexpr uint32_t rotr(uint32_t v, int n) noexcept
+    { return (v >> n) | (v << (32 - n)); }
+
+    /// Common part of SHA-1 and SHA-256: 64 byte blocks and big
+    /// endian length in the padding.
+    ///
+    /// \tparam Hash - Hash with state `_h` and `transform(block)`.
+    /// \tparam N - Size of digest in bytes.
+    ///
+    template <class Hash, size_t N>
+    struct block_hash
+    {
+        using digest_t = std::array<uint8_t, N>;
+
+        /// Add data to the hash.
+        Hash& update(const void* data, size_t len) noexcept
+        {
+            auto p = static_cast<const uint8_t*>(data);
+            _total += len;
+            while (len) {
+                size_t n = std::min(len, sizeof(_block) - _used);
+                std::memcpy(_block + _used, p, n);
+                _used += n;
+                p += n;
+                len -= n;
+                if (_used == sizeof(_block)) {
+                    static_cast<Hash*>(this)->transform(_block);
+                    _used = 0;
+                }
+            }
+            return static_cast<Hash&>(*this);
+        }
+
+        /// Add bytes of a string to the hash.
+        Hash& update(std::string_view s) noexcept
+        { return update(s.data(), s.size()); }
+
+        /// Finish the hash.
+        digest_t digest() noexcept
+        {
+            uint64_t bits = _total * 8;
+            uint8_t pad = 0x80;
+            update(&pad, 1);
+            pad = 0;
+            while (_used != 56)
+                update(&pad, 1);
+            uint8_t len[8];
+            for (int i = 0; i < 8; ++i)
+                len[i] = uint8_t(bits >> (56 - i * 8));
+            update(len, 8);
+
+            digest_t ret;
+            auto& h = static_cast<Hash*>(this)->_h;
+            for (size_t i = 0; i < N; ++i)
+                ret[i] = uint8_t(h[i / 4] >> (24 - (i % 4) * 8));
+            return ret;
+        }
+
+    protected:
+        /// Read big endian word of a block.
+        static uint32_t word(const uint8_t* p) noexcept
+        { return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3]; }
+
+    private:
+        uint8_t _block[64];
+        size_t _used = 0;
+        uint64_t _total = 0;
+    };
+
+    /// SHA-1 hash.
+    struct sha1 : block_hash<sha1, 20>
+    {
+        uint32_t _h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+        /// Process a block.
+        void transform(const uint8_t* block) noexcept
+        {
+            uint32_t w[80];
+            for (int i = 0; i < 16; ++i)
+                w[i] = word(block + i * 4);
+            for (int i = 16; i < 80; ++i)
+                w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+            uint32_t a = _h[0], b = _h[1], c = _h[2], d = _h[3], e = _h[4];
+            for (int i = 0; i < 80; ++i) {
+                uint32_t f, k;
+                if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+                else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+                else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+                else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+                uint32_t t = rotl(a, 5) + f + e + k + w[i];
+                e = d;
+                d = c;
+                c = rotl(b, 30);
+                b = a;
+                a = t;
+            }
+            _h[0] += a; _h[1] += b; _h[2] += c; _h[3] += d; _h[4] += e;
+        }
+    };
+
+    /// SHA-256 hash.
+    struct sha256 : block_hash<sha256, 32>
+    {
+        uint32_t _h[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+        };
+
+        /// Process a block.
+        void transform(const uint8_t* block) noexcept
+        {
+            static constexpr uint32_t k[64] = {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+            };
+
+            uint32_t w[64];
+            for (int i = 0; i < 16; ++i)
+                w[i] = word(block + i * 4);
+            for (int i = 16; i < 64; ++i) {
+                uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+
+            uint32_t v[8];
+            std::memcpy(v, _h, sizeof(v));
+            for (int i = 0; i < 64; ++i) {
+                uint32_t s1 = rotr(v[4], 6) ^ rotr(v[4], 11) ^ rotr(v[4], 25);
+                uint32_t ch = (v[4] & v[5]) ^ (~v[4] & v[6]);
+                uint32_t t1 = v[7] + s1 + ch + k[i] + w[i];
+                uint32_t s0 = rotr(v[0], 2) ^ rotr(v[0], 13) ^ rotr(v[0], 22);
+                uint32_t maj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+                std::memmove(v + 1, v, sizeof(uint32_t) * 7);
+                v[4] += t1;
+                v[0] = t1 + s0 + maj;
+            }
+            for (int i = 0; i < 8; ++i)
+                _h[i] += v[i];
+        }
+    };
+
+    /// Arc4 stream cipher, the wire encryption every server
+    /// supports. Each direction has a cipher of its own.
+    struct arc4
+    {
+        /// Initialize with a key.
+        arc4(const uint8_t* key, size_t len) noexcept
+        {
+            for (int i = 0; i < 256; ++i)
+                _s[i] = uint8_t(i);
+            for (int i = 0, j = 0; i < 256; ++i) {
+                j = (j + _s[i] + key[i % len]) & 0xFF;
+                std::swap(_s[i], _s[j]);
+            }
+        }
+
+        /// Encrypt or decrypt in place.
+        void apply(char* data, size_t len) noexcept
+        {
+            for (size_t n = 0; n < len; ++n) {
+                _i = uint8_t(_i + 1);
+                _j = uint8_t(_j + _s[_i]);
+                std::swap(_s[_i], _s[_j]);
+                data[n] ^= char(_s[uint8_t(_s[_i] + _s[_j])]);
+            }
+        }
+
+    private:
+        uint8_t _s[256];
+        uint8_t _i = 0;
+        uint8_t _j = 0;
+    };
+
+    /// Unsigned integer of arbitrary size, enough for the 1024 bit
+    /// group of SRP.
+    struct bigint
+    {
+        bigint(uint32_t v = 0)
+        { if (v) _limbs.push_back(v); }
+
+        /// From big endian bytes.
+        static bigint from_bytes(const uint8_t* p, size_t len)
+        {
+            bigint ret;
+            ret._limbs.assign((len + 3) / 4, 0);
+            for (size_t i = 0; i < len; ++i)
+                ret._limbs[i / 4] |= uint32_t(p[len - 1 - i]) << ((i % 4) * 8);
+            ret.trim();
+            return ret;
+        }
+
+        /// From hexadecimal text.
+        ///
+        /// \throw fb::exception
+        ///
+        static bigint from_hex(std::string_view hex)
+        {
+            std::vector<uint8_t> bytes((hex.size() + 1) / 2);
+            for (size_t i = 0; i < hex.size(); ++i) {
+                char ch = hex[hex.size() - 1 - i];
+                int v = ch >= '0' && ch <= '9' ? ch - '0' :
+                        ch >= 'a' && ch <= 'f' ? ch - 'a' + 10 :
+                        ch >= 'A' && ch <= 'F' ? ch - 'A' + 10 : -1;
+                if (v < 0)
+                    throw fb::exception("bad hexadecimal number");
+                bytes[bytes.size() - 1 - i / 2] |= uint8_t(v << ((i % 2) * 4));
+            }
+            return from_bytes(bytes.data(), bytes.size());
+        }
+
+        /// Big endian bytes without leading zeros.
+        std::vector<uint8_t> bytes() const
+        {
+            std::vector<uint8_t> ret;
+            for (size_t i = _limbs.size() * 4; i-- > 0;) {
+                uint8_t b = uint8_t(_limbs[i / 4] >> ((i % 4) * 8));
+                if (b || !ret.empty())
+                    ret.push_back(b);
+            }
+            return ret;
+        }
+
+        /// Hexadecimal text (upper case) without leading zeros.
+        std::string hex() const
+        {
+            static constexpr char digits[] = "0123456789ABCDEF";
+            std::string ret;
+            for (uint8_t b : bytes()) {
+                ret += digits[b >> 4];
+                ret += digits[b & 15];
+            }
+            if (!ret.empty() && ret[0] == '0')
+                ret.erase(0, 1);
+            return ret;
+        }
+
+        bool is_zero() const noexcept
+        { return _limbs.empty(); }
+
+        /// Number of significant bits.
+        size_t bits() const noexcept
+        {
+            if (_limbs.empty())
+                return 0;
+            size_t n = _limbs.size() * 32;
+            for (uint32_t top = _limbs.back(); !(top & 0x80000000); top <<= 1)
+                --n;
+            return n;
+        }
+
+        bool bit(size_t i) const noexcept
+        { return i / 32 < _limbs.size() && (_limbs[i / 32] >> (i % 32)) & 1; }
+
+        /// Compare, returns -1, 0 or 1.
+        static int compare(const bigint& a, const bigint& b) noexcept
+        {
+            if (a._limbs.size() != b._limbs.size())
+                return a._limbs.size() < b._limbs.size() ? -1 : 1;
+            for (size_t i = a._limbs.size(); i-- > 0;) {
+                if (a._limbs[i] != b._limbs[i])
+                    return a._limbs[i] < b._limbs[i] ? -1 : 1;
+            }
+            return 0;
+        }
+
+        friend bool operator==(const bigint& a, const bigint& b) noexcept
+        { return compare(a, b) == 0; }
+
+        friend bigint operator+(const bigint& a, const bigint& b)
+        {
+            bigint ret;
+            ret._limbs.resize(std::max(a._limbs.size(), b._limbs.size()) + 1);
+            uint64_t carry = 0;
+            for (size_t i = 0; i < ret._limbs.size(); ++i) {
+                carry += uint64_t(a.limb(i)) + b.limb(i);
+                ret._limbs[i] = uint32_t(carry);
+                carry >>= 32;
+            }
+            ret.trim();
+            return ret;
+        }
+
+        /// Subtract, a must not be less than b.
+        friend bigint operator-(const bigint& a, const bigint& b)
+        {
+            bigint ret;
+            ret._limbs.resize(a._limbs.size());
+            int64_t borrow = 0;
+            for (size_t i = 0; i < a._limbs.size(); ++i) {
+                int64_t d = int64_t(a._limbs[i]) - b.limb(i) - borrow;
+                borrow = d < 0;
+                ret._limbs[i] = uint32_t(d + (borrow << 32));
+            }
+            ret.trim();
+            return ret;
+        }
+
+        friend bigint operator*(const bigint& a, const bigint& b)
+        {
+            bigint ret;
+            if (a.is_zero() || b.is_zero())
+                return ret;
+            ret._limbs.assign(a._limbs.size() + b._limbs.size(), 0);
+            for (size_t i = 0; i < a._limbs.size(); ++i) {
+                uint64_t carry = 0;
+                for (size_t j = 0; j < b._limbs.size(); ++j) {
+                    carry += uint64_t(a._limbs[i]) * b._limbs[j] + ret._limbs[i + j];
+                    ret._limbs[i + j] = uint32_t(carry);
+                    carry >>= 32;
+                }
+                ret._limbs[i + b._limbs.size()] = uint32_t(carry);
+            }
+            ret.trim();
+            return ret;
+        }
+
+        /// Remainder of division (Knuth, algorithm D).
+        friend bigint operator%(const bigint& a, const bigint& m)
+        {
+            if (m.is_zero())
+                throw fb::exception("division by zero");
+            if (compare(a, m) < 0)
+                return a;
+
+            size_t n = m._limbs.size();
+            if (n == 1) {
+                uint64_t r = 0;
+                for (size_t i = a._limbs.size(); i-- > 0;)
+                    r = ((r << 32) | a._limbs[i]) % m._limbs[0];
+                return bigint(uint32_t(r));
+            }
+
+            // Normalize so the top bit of the divisor is set
+            int s = 0;
+            for (uint32_t top = m._limbs.back(); !(top & 0x80000000); top <<= 1)
+                ++s;
+            std::vector<uint32_t> v = m.shifted(s), u = a.shifted(s);
+            u.push_back(0);
+            if (v.size() > n)
+                v.pop_back();
+
+            for (size_t j = u.size() - n - 1; j + 1 > 0; --j) {
+                uint64_t num = (uint64_t(u[j + n]) << 32) | u[j + n - 1];
+                uint64_t qhat = num / v[n - 1];
+                uint64_t rhat = num % v[n - 1];
+                while (qhat >> 32 || qhat * v[n - 2] > ((rhat << 32) | u[j + n - 2])) {
+                    --qhat;
+                    rhat += v[n - 1];
+                    if (rhat >> 32)
+                        break;
+                }
+
+                // u[j..j+n] -= qhat * v
+                int64_t borrow = 0;
+                uint64_t carry = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    carry += qhat * v[i];
+                    int64_t d = int64_t(u[i + j]) - int64_t(uint32_t(carry)) - borrow;
+                    carry >>= 32;
+                    borrow = d < 0;
+                    u[i + j] = uint32_t(d + (borrow << 32));
+                }
+                int64_t d = int64_t(u[j + n]) - int64_t(carry) - borrow;
+                u[j + n] = uint32_t(d);
+
+                // Estimate was one too large, add back
+                if (d < 0) {
+                    uint64_t c = 0;
+                    for (size_t i = 0; i < n; ++i) {
+                        c += uint64_t(u[i + j]) + v[i];
+                        u[i + j] = uint32_t(c);
+                        c >>= 32;
+                    }
+                    u[j + n] += uint32_t(c);
+                }
+            }
+
+            // Remainder is in the low n limbs, shift back
+            bigint ret;
+            ret._limbs.assign(u.begin(), u.begin() + n);
+            if (s) {
+                for (size_t i = 0; i < n; ++i) {
+                    ret._limbs[i] >>= s;
+                    if (i + 1 < n)
+                        ret._limbs[i] |= ret._limbs[i + 1] << (32 - s);
+                }
+            }
+            ret.trim();
+            return ret;
+        }
+
+        /// Modular exponentiation.
+        static bigint pow_mod(const bigint& base, const bigint& exp, const bigint& m)
+        {
+            bigint ret(1), b = base % m;
+            for (size_t i = exp.bits(); i-- > 0;) {
+                ret = ret * ret % m;
+                if (exp.bit(i))
+                    ret = ret * b % m;
+            }
+            return ret % m;
+        }
+
+    private:
+        uint32_t limb(size_t i) const noexcept
+        { return i < _limbs.size() ? _limbs[i] : 0; }
+
+        /// Limbs shifted left by less than 32 bits.
+        std::vector<uint32_t> shifted(int s) const
+        {
+            std::vector<uint32_t> ret(_limbs.size() + 1, 0);
+            for (size_t i = 0; i < _limbs.size(); ++i) {
+                ret[i] |= _limbs[i] << s;
+                if (s)
+                    ret[i + 1] = _limbs[i] >> (32 - s);
+            }
+            if (!ret.back())
+                ret.pop_back();
+            return ret;
+        }
+
+        /// Remove leading zero limbs.
+        void trim() noexcept
+        {
+            while (!_limbs.empty() && !_limbs.back())
+                _limbs.pop_back();
+        }
+
+        /// Little endian limbs.
+        std::vector<uint32_t> _limbs;
+    };
+
+    /// Hash big integers and strings, returning a big integer.
+    template <class Hash>
+    struct int_hash
+    {
+        int_hash& operator<<(const bigint& v)
+        {
+            auto b = v.bytes();
+            _hash.update(b.data(), b.size());
+            return *this;
+        }
+
+        int_hash& operator<<(std::string_view s)
+        {
+            _hash.update(s);
+            return *this;
+        }
+
+        template <size_t N>
+        int_hash& operator<<(const std::array<uint8_t, N>& d)
+        {
+            _hash.update(d.data(), d.size());
+            return *this;
+        }
+
+        auto digest()
+        { return _hash.digest(); }
+
+        bigint value()
+        {
+            auto d = _hash.digest();
+            return bigint::from_bytes(d.data(), d.size());
+        }
+
+    private:
+        Hash _hash;
+    };
+
+} // namespace detail
+
+/// Client side of Firebird SRP authentication (SRP-6a over the 1024
+/// bit group of the server). The plugin "Srp" hashes the proof with
+/// SHA-1, "Srp256" with SHA-256, the session key is SHA-1 in both.
+///
+/// \code{.cpp}
+///     fb::srp_client srp;
+///     send_connect(srp.public_key());           // CNCT_specific_data
+///     auto proof = srp.proof("SYSDBA", password, salt, server_key, true);
+///     send_cont_auth(proof);                    // op_cont_auth
+///     enable_arc4(srp.session_key());           // op_crypt
+/// \endcode
+///
+struct srp_client
+{
+    /// Create with a random private key.
+    srp_client();
+
+    /// Create with a given private key (for tests).
+    ///
+    /// \param[in] private_key - Private key as hexadecimal text.
+    ///
+    explicit srp_client(std::string_view private_key);
+
+    /// Public key (A) as hexadecimal text.
+    std::string public_key() const
+    { return _public.hex(); }
+
+    /// Compute the proof of the password (M), sent to the server.
+    ///
+    /// \param[in] user - User name (upper case unless quoted).
+    /// \param[in] password - Password.
+    /// \param[in] salt - Salt sent by the server.
+    /// \param[in] server_key - Public key of the server (B) as
+    ///                         hexadecimal text.
+    /// \param[in] sha256 - Plugin Srp256 (or Srp with SHA-1).
+    ///
+    /// \return Proof as hexadecimal text.
+    /// \throw fb::exception
+    ///
+    std::string proof(std::string_view user, std::string_view password,
+        std::string_view salt, std::string_view server_key, bool sha256);
+
+    /// Session key (K) after proof(), the key of wire encryption.
+    const std::array<uint8_t, 20>& session_key() const noexcept
+    { return _session_key; }
+
+    /// Prime of the group (N).
+    static const detail::bigint& prime();
+
+    /// Multiplier parameter, k = H(N, pad(g)).
+    static const detail::bigint& multiplier();
+
+private:
+    detail::bigint _private;
+    detail::bigint _public;
+    std::array<uint8_t, 20> _session_key = {};
+};
+
+// Prime of the group.
+const detail::bigint& srp_client::prime()
+{
+    static const auto n = detail::bigint::from_hex(
+        "E67D2E994B2F900C3F41F08F5BB2627ED0D49EE1FE767A52EFCD565CD6E76881"
+        "2C3E1E9CE8F0A8BEA6CB13CD29DDEBF7A96D4A93B55D488DF099A15C89DCB064"
+        "0738EB2CBDD9A8F7BAB561AB1B0DC1C6CDABF303264A08D1BCA932D1F1EE428B"
+        "619D970F342ABA9A65793B8B2F041AE5364350C16F735F56ECBCA87BD57B29E7");
+    return n;
+}
+
+// Multiplier parameter.
+const detail::bigint& srp_client::multiplier()
+{
+    static const auto k = [] {
+        // Generator is padded to the size of the prime
+        std::string g(128, '\0');
+        g.back() = 2;
+        return (detail::int_hash<detail::sha1>() << prime() << g).value();
+    }();
+    return k;
+}
+
+// Create with a random private key.
+srp_client::srp_client()
+{
+    std::random_device rd;
+    uint8_t key[32];
+    for (auto& b : key)
+        b = uint8_t(rd());
+    _private = detail::bigint::from_bytes(key, sizeof(key));
+    _public = detail::bigint::pow_mod(2, _private, prime());
+}
+
+// Create with a given private key.
+srp_client::srp_client(std::string_view private_key)
+: _private(detail::bigint::from_hex(private_key))
+, _public(detail::bigint::pow_mod(2, _private, prime()))
+{ }
+
+// Compute the proof of the password.
+std::string srp_client::proof(std::string_view user, std::string_view password,
+    std::string_view salt, std::string_view server_key, bool sha256)
+{
+    using detail::bigint;
+    using sha1_int = detail::int_hash<detail::sha1>;
+    const bigint& n = prime();
+
+    bigint b = bigint::from_hex(server_key);
+    if ((b % n).is_zero())
+        throw fb::exception("srp: bad server key");
+
+    // Session key, K = H((B - kg^x) ^ (a + ux))
+    bigint u = (sha1_int() << _public << b).value();
+    auto hash1 = (detail::int_hash<detail::sha1>() << user << ":" << password).digest();
+    bigint x = (sha1_int() << salt << hash1).value();
+    bigint kgx = multiplier() * bigint::pow_mod(2, x, n) % n;
+    bigint diff = (b % n + n - kgx) % n;
+    bigint aux = (_private + u * x % n) % n;
+    _session_key = (sha1_int() << bigint::pow_mod(diff, aux, n)).digest();
+
+    // M = H(H(N) ^ H(g), H(I), s, A, B, K)
+    bigint n1 = bigint::pow_mod((sha1_int() << n).value(), (sha1_int() << bigint(2)).value(), n);
+    bigint n2 = (sha1_int() << user).value();
+    auto prove = [&](auto hash) {
+        return (hash << n1 << n2 << salt << _public << b << _session_key).value().hex();
+    };
+    return sha256 ? prove(detail::int_hash<detail::sha256>()) : prove(sha1_int());
+}
+
+} // namespace fb
@@ -0,0 +1,118 @@
+/// \file stats.hpp
+/// This file contains counters and timings of statement execution
+/// and performance counters of a database.
+
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace fb
+{
+
+/// Number of records processed by one execution of a statement.
+struct record_counts
+{
+    size_t selected = 0;
+    size_t inserted = 0;
+    size_t updated = 0;
+    size_t deleted = 0;
+};
+
+/// Timings of a statement. Prepare time is measured once,
+/// other values are of the last execution. Execution and fetch
+/// times (and start time) are measured only while fb::plan_capture,
+/// fb::slow_query_log or fb::workload_capture is enabled, otherwise
+/// they are zero.
+struct execution_stats
+{
+    std::chrono::nanoseconds prepare{};
+    std::chrono::nanoseconds execute{};
+    /// Time spent in fetch calls (all rows fetched so far).
+    std::chrono::nanoseconds fetch{};
+    /// Number of rows fetched so far.
+    size_t rows = 0;
+    /// Number of executions since prepare.
+    size_t executions = 0;
+    /// Wall clock time when last execution started.
+    std::chrono::system_clock::time_point started;
+
+    /// Time of execution including fetch of all rows.
+    std::chrono::nanoseconds elapsed() const noexcept
+    { return execute + fetch; }
+};
+
+/// Performance counters of a database attachment, as returned
+/// by database::info(). I/O counters are cumulative since connect,
+/// subtract two snapshots to get the activity in between.
+///
+/// \code{.cpp}
+///     auto before = db.info();
+///     // ... run workload ...
+///     auto d = db.info() - before;
+///     std::cout << "hit ratio " << d.hit_ratio()
+///               << ", reads/s " << d.per_second(d.reads) << std::endl;
+/// \endcode
+///
+struct database_info
+{
+    /// Page size in bytes.
+    int64_t page_size = 0;
+    /// Number of pages in the page cache.
+    int64_t num_buffers = 0;
+    /// Pages read from disk.
+    int64_t reads = 0;
+    /// Pages written to disk.
+    int64_t writes = 0;
+    /// Pages read from the page cache.
+    int64_t fetches = 0;
+    /// Pages changed in the page cache.
+    int64_t marks = 0;
+    /// Server memory in use, in bytes.
+    int64_t current_memory = 0;
+    /// Maximum server memory in use since start, in bytes.
+    int64_t max_memory = 0;
+    /// Time when the snapshot was taken.
+    std::chrono::steady_clock::time_point taken;
+    /// Time between snapshots (zero unless this is a delta).
+    std::chrono::nanoseconds interval{};
+
+    /// Get fraction of page fetches served from the page
+    /// cache without reading from disk, between 0 and 1.
+    double hit_ratio() const noexcept
+    {
+        return fetches > 0 ? 1.0 - double(reads) / double(fetches) : 1.0;
+    }
+
+    /// Get rate of a counter of a delta, per second.
+    ///
+    /// \param[in] count - Counter, for example reads.
+    ///
+    /// \return Rate or 0 if this is not a delta.
+    ///
+    double per_second(int64_t count) const noexcept
+    {
+        using seconds = std::chrono::duration<double>;
+        return interval.count() > 0
+            ? double(count) / std::chrono::duration_cast<seconds>(interval).count()
+            : 0.0;
+    }
+
+    /// Get difference between two snapshots. Cumulative counters
+    /// are subtracted, other values are those of the newer snapshot.
+    ///
+    /// \param[in] prev - Older snapshot.
+    ///
+    database_info operator-(const database_info& prev) const noexcept
+    {
+        database_info ret = *this;
+        ret.reads -= prev.reads;
+        ret.writes -= prev.writes;
+        ret.fetches -= prev.fetches;
+        ret.marks -= prev.marks;
+        ret.interval = taken - prev.taken;
+        return ret;
+    }
+};
+
+} // namespace fb
@@ -0,0 +1,656 @@
+/// \file trace.hpp
+/// This file contains the trace session of the server, its output
+/// parser and the aggregation of traced statements by fingerprint.
+
+#pragma once
+#include "services.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fb
+{
+
+/// Event of a trace session.
+struct trace_event
+{
+    /// Time of the event as printed by the server.
+    std::string time;
+    /// Event type, such as EXECUTE_STATEMENT_FINISH.
+    std::string type;
+    /// Event is of a failed operation.
+    bool failed = false;
+    int64_t attachment_id = 0;
+    int64_t transaction_id = 0;
+    int64_t statement_id = 0;
+    /// Statement text (if any).
+    std::string sql;
+    /// Number of records fetched or affected.
+    int64_t records = 0;
+    /// Performance counters (if any).
+    std::chrono::milliseconds elapsed{};
+    int64_t reads = 0;
+    int64_t writes = 0;
+    int64_t fetches = 0;
+    int64_t marks = 0;
+};
+
+/// Normalize statement text so that statements differing only in
+/// literals, case, comments and spacing are the same. Literals are
+/// replaced with '?' and lists of them are collapsed.
+///
+/// \code{.cpp}
+///     fb::fingerprint("SELECT * FROM t WHERE id IN (1, 2, 3)");
+///     // "select * from t where id in (?)"
+/// \endcode
+///
+std::string fingerprint(std::string_view sql);
+
+/// Get hash of normalized statement text (FNV-1a).
+inline uint64_t fingerprint_hash(std::string_view normalized) noexcept
+{
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char ch : normalized) {
+        h ^= ch;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/// Incremental parser of trace output. Lines are fed as they
+/// arrive, an event is reported when the next one begins or
+/// on flush().
+struct trace_parser
+{
+    /// Callback receiving parsed events.
+    using callback = std::function<void(trace_event&&)>;
+
+    /// Construct parser.
+    ///
+    /// \param[in] cb - Callback receiving parsed events.
+    ///
+    explicit trace_parser(callback cb)
+    : _cb(std::move(cb))
+    { }
+
+    /// Feed one line of output (without line terminator).
+    void feed(std::string_view line);
+
+    /// Report the event parsed so far.
+    void flush();
+
+private:
+    /// Section of the event being parsed.
+    enum class section { none, header, sql, tail };
+
+    /// Checks if line begins an event, like
+    /// "2024-01-31T10:00:00.1230 (1234:0x7f1a) EXECUTE_STATEMENT_FINISH".
+    static bool is_event(std::string_view line) noexcept
+    {
+        return line.size() > 20 && line[4] == '-' && line[7] == '-'
+            && line[10] == 'T' && line[13] == ':' && std::isdigit((unsigned char)line[0]);
+    }
+
+    /// Checks if line consists of given char only.
+    static bool is_line_of(std::string_view line, char ch) noexcept
+    { return line.size() >= 10 && line.find_first_not_of(ch) == line.npos; }
+
+    /// Get number after a prefix, like "ATT_" in "(ATT_12, ...".
+    static int64_t number_after(std::string_view line, std::string_view prefix) noexcept
+    {
+        auto pos = line.find(prefix);
+        return pos == line.npos ? 0 : std::strtoll(line.data() + pos + prefix.size(), nullptr, 10);
+    }
+
+    /// Parse performance line, like "3 ms, 2 read(s), 10 fetch(es)".
+    void parse_perf(std::string_view line);
+
+    callback _cb;
+    trace_event _event;
+    section _section = section::none;
+};
+
+/// Aggregated statistics of statements with the same fingerprint.
+struct trace_profile
+{
+    /// Normalized statement text.
+    std::string sql;
+    uint64_t hash = 0;
+    size_t count = 0;
+    size_t failed = 0;
+    std::chrono::milliseconds total{};
+    std::chrono::milliseconds max{};
+    int64_t records = 0;
+    int64_t reads = 0;
+    int64_t writes = 0;
+    int64_t fetches = 0;
+    int64_t marks = 0;
+};
+
+/// Aggregation of statement events by fingerprint (thread safe).
+struct trace_aggregator
+{
+    /// Add statement event. Events without statement text are ignored.
+    void add(const trace_event& ev);
+
+    /// Get profiles with most total time, most first.
+    ///
+    /// \param[in] n - Maximum number of profiles (optional, default all).
+    ///
+    std::vector<trace_profile> top(size_t n = SIZE_MAX) const;
+
+    /// Remove all profiles.
+    void clear();
+
+private:
+    mutable std::mutex _mutex;
+    std::unordered_map<uint64_t, trace_profile> _profiles;
+};
+
+/// User trace session on the server. Statements finished in the
+/// traced databases are parsed into events and aggregated by
+/// fingerprint. Output is read by a background thread.
+///
+/// \code{.cpp}
+///     fb::trace_session trace("localhost");
+///     trace.on_event([](const fb::trace_event& ev) { ... });
+///     trace.start();
+///     // ... later ...
+///     trace.stop();
+///     for (auto& p : trace.profiles().top(10))
+///         std::cout << p.total.count() << " ms " << p.count << "x " << p.sql << '\n';
+/// \endcode
+///
+/// \note Users other than SYSDBA see only their own attachments.
+///
+struct trace_session
+{
+    /// Session settings.
+    struct settings
+    {
+        /// Session name.
+        std::string name = "fb-cpp";
+        /// Database file pattern (empty for all databases).
+        std::string database;
+        /// Trace only statements taking longer (milliseconds).
+        uint32_t time_threshold = 0;
+        /// Maximum length of statement text.
+        uint32_t max_sql_length = 8192;
+        /// Trace failed statements too.
+        bool log_errors = true;
+        /// Regular expression of statements to include (optional).
+        std::string include_filter;
+        /// Regular expression of statements to exclude (optional).
+        std::string exclude_filter;
+    };
+
+    /// Callback receiving events (called from the reader thread).
+    using callback = std::function<void(const trace_event&)>;
+
+    /// Construct session with default settings.
+    ///
+    /// \param[in] host - Server host, see fb::service.
+    /// \param[in] user_name - User name, optional, default is "sysdba".
+    /// \param[in] passwd - Password, optional, default is "masterkey".
+    ///
+    explicit trace_session(
+        std::string_view host,
+        std::string_view user_name = "sysdba",
+        std::string_view passwd = "masterkey");
+
+    /// Construct session.
+    ///
+    /// \param[in] host - Server host, see fb::service.
+    /// \param[in] user_name - User name.
+    /// \param[in] passwd - Password.
+    /// \param[in] s - Settings.
+    ///
+    trace_session(std::string_view host, std::string_view user_name,
+        std::string_view passwd, const settings& s);
+
+    /// Stop session.
+    ~trace_session() noexcept;
+
+    trace_session(const trace_session&) = delete;
+    trace_session& operator=(const trace_session&) = delete;
+
+    /// Set callback for events (before start()).
+    void on_event(callback cb)
+    { _cb = std::move(cb); }
+
+    /// Start session and reader thread.
+    ///
+    /// \throw fb::exception
+    ///
+    void start();
+
+    /// Stop session from another service connection
+    /// and wait for the reader thread.
+    ///
+    /// \throw fb::exception
+    ///
+    void stop();
+
+    /// Get session id on the server (0 if not started).
+    int64_t id() const noexcept
+    { return _id; }
+
+    /// Get aggregated statements.
+    const trace_aggregator& profiles() const noexcept
+    { return _profiles; }
+
+    /// Get error that ended the reader thread (if any).
+    std::string error() const;
+
+    /// Generate session configuration.
+    static std::string config(const settings& s);
+
+private:
+    /// Reader thread.
+    void run();
+
+    std::string _host;
+    std::string _user;
+    std::string _passwd;
+    settings _settings;
+    callback _cb;
+
+    service _svc;
+    std::atomic<int64_t> _id = 0;
+    trace_aggregator _profiles;
+
+    mutable std::mutex _mutex;
+    std::string _error;
+    std::thread _thread;
+};
+
+// Normalize statement text.
+std::string fingerprint(std::string_view sql)
+{
+    std::string ret;
+    ret.reserve(sql.size());
+
+    auto is_ident = [](char ch) {
+        return std::isalnum((unsigned char)ch) || ch == '_' || ch == '$';
+    };
+    auto add_space = [&] {
+        if (!ret.empty() && ret.back() != ' ')
+            ret += ' ';
+    };
+
+    for (size_t i = 0; i < sql.size();) {
+        char ch = sql[i];
+        if (std::isspace((unsigned char)ch)) {
+            add_space();
+            ++i;
+        }
+        else if (sql.compare(i, 2, "--") == 0) {
+            i = sql.find('\n', i);
+            add_space();
+        }
+        else if (sql.compare(i, 2, "/*") == 0) {
+            auto end = sql.find("*/", i + 2);
+            i = end == sql.npos ? sql.size() : end + 2;
+            add_space();
+        }
+        else if (ch == '\'') {
+            // String literal, quotes are escaped by doubling
+            for (++i; i < sql.size(); ++i) {
+                if (sql[i] == '\'' && (++i >= sql.size() || sql[i] != '\''))
+                    break;
+            }
+            ret += '?';
+        }
+        else if (ch == '"') {
+            // Quoted identifier, keep as is
+            auto end = sql.find('"', i + 1);
+            end = end == sql.npos ? sql.size() : end + 1;
+            ret.append(sql, i, end - i);
+            i = end;
+        }
+        else if (std::isdigit((unsigned char)ch) && (ret.empty() || !is_ident(ret.back()))) {
+            // Number, including decimals and exponent
+            while (i < sql.size() && (is_ident(sql[i]) || sql[i] == '.'))
+                ++i;
+            ret += '?';
+        }
+        else if (is_ident(ch)) {
+            for (; i < sql.size() && is_ident(sql[i]); ++i)
+                ret += std::tolower((unsigned char)sql[i]);
+        }
+        else {
+            // Operators and punctuation, no space before
+            // comma and closing bracket
+            if ((ch == ',' || ch == ')') && !ret.empty() && ret.back() == ' ')
+                ret.pop_back();
+            ret += ch;
+            ++i;
+        }
+        if (i == sql.npos)
+            break;
+    }
+
+    // Collapse lists of literals
+    for (size_t pos; (pos = ret.find("?, ?")) != ret.npos || (pos = ret.find("?,?")) != ret.npos;)
+        ret.replace(pos, ret[pos + 2] == ' ' ? 4 : 3, "?");
+
+    while (!ret.empty() && ret.back() == ' ')
+        ret.pop_back();
+    return ret;
+}
+
+// Feed one line of output.
+void trace_parser::feed(std::string_view line)
+{
+    if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+
+    if (is_event(line)) {
+        flush();
+        _section = section::header;
+
+        auto sp = line.find(' ');
+        _event.time = line.substr(0, sp);
+        // Event type follows the process and thread ids
+        auto br = line.find(") ");
+        auto type = br == line.npos ? std::string_view() : line.substr(br + 2);
+        if (type.substr(0, 7) == "FAILED ") {
+            _event.failed = true;
+            type.remove_prefix(7);
+        }
+        else if (type.substr(0, 13) == "UNAUTHORIZED ") {
+            _event.failed = true;
+            type.remove_prefix(13);
+        }
+        _event.type = type;
+        return;
+    }
+
+    switch (_section) {
+        case section::none:
+            break;
+
+        case section::header:
+            if (is_line_of(line, '-')) {
+                _section = section::sql;
+                break;
+            }
+            if (!_event.attachment_id)
+                _event.attachment_id = number_after(line, "(ATT_");
+            if (!_event.transaction_id)
+                _event.transaction_id = number_after(line, "(TRA_");
+            if (line.substr(0, 10) == "Statement ")
+                _event.statement_id = number_after(line, "Statement ");
+            break;
+
+        case section::sql: {
+            // Statement text ends with plan separator, parameters,
+            // records or performance lines
+            auto trimmed = line.substr(std::min(line.find_first_not_of(' '), line.size()));
+            bool is_param = trimmed.substr(0, 5) == "param" && trimmed.find(" = ") != trimmed.npos;
+            if (is_line_of(line, '^') || is_param
+                || trimmed.find(" records fetched") != trimmed.npos
+                || (!trimmed.empty() && std::isdigit((unsigned char)trimmed[0])
+                    && trimmed.find(" ms") != trimmed.npos))
+            {
+                while (!_event.sql.empty() && _event.sql.back() == '\n')
+                    _event.sql.pop_back();
+                _section = section::tail;
+                feed(line);
+                break;
+            }
+            _event.sql.append(line).push_back('\n');
+            break;
+        }
+
+        case section::tail: {
+            auto trimmed = line.substr(std::min(line.find_first_not_of(' '), line.size()));
+            if (trimmed.empty())
+                break;
+            if (auto pos = trimmed.find(" records fetched"); pos != trimmed.npos)
+                _event.records = std::strtoll(trimmed.data(), nullptr, 10);
+            else if (std::isdigit((unsigned char)trimmed[0]) && trimmed.find(" ms") != trimmed.npos)
+                parse_perf(trimmed);
+            break;
+        }
+    }
+}
+
+// Report the event parsed so far.
+void trace_parser::flush()
+{
+    if (_section != section::none) {
+        while (!_event.sql.empty() && _event.sql.back() == '\n')
+            _event.sql.pop_back();
+        _cb(std::move(_event));
+    }
+    _event = trace_event();
+    _section = section::none;
+}
+
+// Parse performance line.
+void trace_parser::parse_perf(std::string_view line)
+{
+    // Comma separated list of "<number> <unit>"
+    while (!line.empty()) {
+        auto end = std::min(line.find(','), line.size());
+        auto part = line.substr(0, end);
+        line.remove_prefix(std::min(end + 1, line.size()));
+
+        part.remove_prefix(std::min(part.find_first_not_of(' '), part.size()));
+        auto sp = part.find(' ');
+        if (sp == part.npos)
+            continue;
+        int64_t val = std::strtoll(part.data(), nullptr, 10);
+        auto unit = part.substr(sp + 1);
+
+        if (unit == "ms")
+            _event.elapsed = std::chrono::milliseconds(val);
+        else if (unit == "read(s)")
+            _event.reads = val;
+        else if (unit == "write(s)")
+            _event.writes = val;
+        else if (unit == "fetch(es)")
+            _event.fetches = val;
+        else if (unit == "mark(s)")
+            _event.marks = val;
+    }
+}
+
+// Add statement event.
+void trace_aggregator::add(const trace_event& ev)
+{
+    if (ev.sql.empty())
+        return;
+
+    auto sql = fingerprint(ev.sql);
+    auto hash = fingerprint_hash(sql);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto& p = _profiles[hash];
+    if (!p.count) {
+        p.sql = std::move(sql);
+        p.hash = hash;
+    }
+    ++p.count;
+    p.failed += ev.failed;
+    p.total += ev.elapsed;
+    p.max = std::max(p.max, ev.elapsed);
+    p.records += ev.records;
+    p.reads += ev.reads;
+    p.writes += ev.writes;
+    p.fetches += ev.fetches;
+    p.marks += ev.marks;
+}
+
+// Get profiles with most total time.
+std::vector<trace_profile> trace_aggregator::top(size_t n) const
+{
+    std::vector<trace_profile> ret;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ret.reserve(_profiles.size());
+        for (auto& [hash, p] : _profiles)
+            ret.push_back(p);
+    }
+    auto by_total = [](auto& a, auto& b) { return a.total > b.total; };
+    if (n < ret.size()) {
+        std::partial_sort(ret.begin(), ret.begin() + n, ret.end(), by_total);
+        ret.resize(n);
+    }
+    else
+        std::sort(ret.begin(), ret.end(), by_total);
+    return ret;
+}
+
+// Remove all profiles.
+void trace_aggregator::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _profiles.clear();
+}
+
+// Construct session with default settings.
+trace_session::trace_session(std::string_view host, std::string_view user_name, std::string_view passwd)
+: trace_session(host, user_name, passwd, settings())
+{ }
+
+// Construct session.
+trace_session::trace_session(std::string_view host, std::string_view user_name,
+    std::string_view passwd, const settings& s)
+: _host(host)
+, _user(user_name)
+, _passwd(passwd)
+, _settings(s)
+, _svc(host, user_name, passwd)
+{ }
+
+// Stop session.
+trace_session::~trace_session() noexcept
+{
+    try {
+        stop();
+    }
+    catch (const fb::exception&) {
+        // Session ends with the connection anyway
+        _svc.disconnect();
+        if (_thread.joinable())
+            _thread.join();
+    }
+}
+
+// Start session and reader thread.
+void trace_session::start()
+{
+    if (_thread.joinable())
+        return;
+
+    _svc.connect();
+    _svc.start(service::request(isc_action_svc_trace_start)
+        .add(isc_spb_trc_name, _settings.name)
+        .add(isc_spb_trc_cfg, config(_settings)));
+
+    // First line is "Trace session ID <n> started"
+    const char items[] = { isc_info_svc_line };
+    auto out = _svc.query({}, { items, sizeof(items) });
+    auto pos = out.data.find("ID ");
+    if (pos == out.data.npos) {
+        _svc.disconnect();
+        throw fb::exception("trace not started: ") << out.data;
+    }
+    _id = std::strtoll(out.data.c_str() + pos + 3, nullptr, 10);
+
+    _thread = std::thread(&trace_session::run, this);
+}
+
+// Stop session from another service connection.
+void trace_session::stop()
+{
+    if (!_thread.joinable())
+        return;
+
+    // Reading connection is busy, so stop from another one
+    service svc(_host, _user, _passwd);
+    svc.connect();
+    svc.start(service::request(isc_action_svc_trace_stop)
+        .add(isc_spb_trc_id, uint32_t(_id)));
+    svc.wait();
+
+    _thread.join();
+    _svc.disconnect();
+    _id = 0;
+}
+
+// Get error that ended the reader thread.
+std::string trace_session::error() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _error;
+}
+
+// Generate session configuration.
+std::string trace_session::config(const settings& s)
+{
+    std::string ret = "database";
+    if (!s.database.empty())
+        ret.append(" = ").append(s.database);
+    ret.append("\n{\n"
+               "\tenabled = true\n"
+               "\tlog_statement_finish = true\n"
+               "\tprint_perf = true\n");
+    ret.append("\tlog_errors = ").append(s.log_errors ? "true" : "false").append("\n")
+       .append("\ttime_threshold = ").append(std::to_string(s.time_threshold)).append("\n")
+       .append("\tmax_sql_length = ").append(std::to_string(s.max_sql_length)).append("\n");
+    if (!s.include_filter.empty())
+        ret.append("\tinclude_filter = ").append(s.include_filter).append("\n");
+    if (!s.exclude_filter.empty())
+        ret.append("\texclude_filter = ").append(s.exclude_filter).append("\n");
+    return ret.append("}\n");
+}
+
+// Reader thread.
+void trace_session::run()
+{
+    trace_parser parser([this](trace_event&& ev) {
+        _profiles.add(ev);
+        if (_cb)
+            _cb(ev);
+    });
+
+    // Output comes in chunks, not necessarily of whole lines
+    const char items[] = { isc_info_svc_to_eof };
+    const auto send = service::timeout(1);
+    std::string pending;
+
+    try {
+        for (;;) {
+            auto out = _svc.query(send, { items, sizeof(items) }, 0xffff);
+            if (out.is_finished())
+                break;
+
+            pending += out.data;
+            size_t begin = 0;
+            for (size_t end; (end = pending.find('\n', begin)) != pending.npos; begin = end + 1)
+                parser.feed(std::string_view(pending).substr(begin, end - begin));
+            pending.erase(0, begin);
+
+            // Event is complete if nothing more arrived
+            if (out.timeout && pending.empty())
+                parser.flush();
+        }
+        if (!pending.empty())
+            parser.feed(pending);
+        parser.flush();
+    }
+    catch (const std::exception& ex) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _error = ex.what();
+    }
+}
+
+} // namespace fb
@@ -2,6 +2,7 @@
 
 #pragma once
 #include <ibase.h>
+#include <initializer_list>
 #include <memory>
 #include <string_view>
 
@@ -24,6 +25,27 @@ struct transaction
     ///
     transaction(database& db) noexcept;
 
+    /// Construct and attach database object, with transaction
+    /// parameters.
+    ///
+    /// \code{.cpp}
+    ///     fb::transaction tr(db, { isc_tpb_version3, isc_tpb_read,
+    ///         isc_tpb_read_committed, isc_tpb_rec_version, isc_tpb_nowait });
+    /// \endcode
+    ///
+    /// \param[in] db - Reference to database object.
+    /// \param[in] tpb - Transaction Parameter Buffer (TPB).
+    ///
+    transaction(database& db, std::initializer_list<char> tpb);
+
+    /// Construct and attach database object, with transaction
+    /// parameters built at run time (for example, replayed ones).
+    ///
+    /// \param[in] db - Reference to database object.
+    /// \param[in] tpb - Transaction Parameter Buffer (TPB).
+    ///
+    transaction(database& db, std::string_view tpb);
+
     /// Start transaction (if not started yet).
     ///
     /// \note Normally there is no need to call this method. Most
@@ -66,6 +88,8 @@ struct transaction
     database& db() const noexcept;
 
 private:
+    friend struct query;
+
     struct context_t;
     std::shared_ptr<context_t> _context;
 };
@@ -1,6 +1,8 @@
 #pragma once
 #include "exception.hpp"
 #include "sqlda.hpp"
+#include "registry.hpp"
+#include "capture.hpp"
 
 // Transaction methods
 
@@ -14,8 +16,95 @@ struct transaction::context_t
     : _db(db)
     { }
 
+    /// Remove from registry if not committed or rolled back.
+    ~context_t() noexcept
+    { unregister(); }
+
+    /// Remove from registry of open transactions.
+    void unregister() noexcept
+    {
+        if (_is_registered)
+            transaction_registry::remove(_registry_id);
+        _is_registered = false;
+        _registry_id = 0;
+    }
+
+    /// Add to registry of open transactions if watched by a monitor,
+    /// otherwise only get an id for the workload capture (if active).
+    void do_register()
+    {
+        unregister();
+        if (transaction_registry::is_watched()) {
+            _registry_id = transaction_registry::add(_handle, *_db.handle());
+            _is_registered = true;
+        }
+        else if (workload_capture::is_active())
+            _registry_id = transaction_registry::next_id();
+    }
+
     isc_tr_handle _handle = 0;
     database _db;
+    /// Transaction Parameter Buffer (TPB), empty for defaults.
+    std::vector<char> _tpb;
+    /// Id in registry of open transactions (0 if not started, or
+    /// neither monitored nor captured).
+    uint64_t _registry_id = 0;
+    /// Transaction is in the registry.
+    bool _is_registered = false;
+    /// Generation of database attachment when started.
+    uint64_t _generation = 0;
+    /// Statements that may change data were executed.
+    bool _has_writes = false;
+
+    /// Checks if transaction was started in a previous
+    /// attachment (before reconnect).
+    bool is_stale() noexcept
+    { return _handle && _generation != _db.generation(); }
+
+    /// Get start time of an operation for the workload capture,
+    /// the clock is read only while a capture is active.
+    static std::chrono::steady_clock::time_point capture_start() noexcept
+    {
+        if (!workload_capture::is_active())
+            return {};
+        return std::chrono::steady_clock::now();
+    }
+
+    /// Record operation in the workload capture (if active).
+    void capture(workload_entry::kind_t kind, std::chrono::steady_clock::time_point start,
+        std::string_view sql = {}, const sqlda* params = nullptr) noexcept
+    {
+        // Capture began during the operation
+        if (start == std::chrono::steady_clock::time_point())
+            return;
+        auto cap = workload_capture::active();
+        if (!cap)
+            return;
+        // Capture must not break the operation
+        try {
+            workload_entry e;
+            e.kind = kind;
+            e.session = _db.attachment_id();
+            e.transaction = _registry_id;
+            e.offset = cap->offset(start);
+            e.elapsed = std::chrono::steady_clock::now() - start;
+            if (kind == workload_entry::start)
+                e.tpb = _tpb;
+            e.sql = sql;
+            if (params)
+                e.params = workload_capture::copy(*params);
+            cap->push(std::move(e));
+        }
+        catch (...) { }
+    }
+
+    /// Forget handle of a transaction lost with the previous attachment.
+    void reset() noexcept
+    {
+        _handle = 0;
+        _has_writes = false;
+        unregister();
+    }
 };
 
 // Construct and attach database object.
@@ -23,21 +112,58 @@ transaction::transaction(database& db) noexcept
 : _context(std::make_shared<context_t>(db))
 { }
 
+// Construct and attach database object, with transaction parameters.
+transaction::transaction(database& db, std::initializer_list<char> tpb)
+: _context(std::make_shared<context_t>(db))
+{ _context->_tpb.assign(tpb); }
+
+// Construct and attach database object, with transaction parameters built at run time.
+transaction::transaction(database& db, std::string_view tpb)
+: _context(std::make_shared<context_t>(db))
+{ _context->_tpb.assign(tpb.begin(), tpb.end()); }
+
 // Start transaction (if not started yet).
 void transaction::start()
 {
     context_t* c = _context.get();
-    if (!c->_handle)
-        invoke_except(isc_start_transaction, &c->_handle, 1, c->_db.handle(), 0, nullptr);
+    if (c->is_stale())
+        c->reset();
+    if (!c->_handle) {
+        auto start = context_t::capture_start();
+        invoke_except<isc_start_transaction>(&c->_handle, 1, c->_db.handle(),
+            int(c->_tpb.size()), c->_tpb.empty() ? nullptr : c->_tpb.data());
+        c->do_register();
+        c->_generation = c->_db.generation();
+        c->_has_writes = false;
+        c->capture(workload_entry::start, start);
+    }
 }
 
 // Commit (apply) pending changes.
 void transaction::commit()
-{ invoke_except(isc_commit_transaction, &_context->_handle); }
+{
+    auto start = context_t::capture_start();
+    invoke_except<isc_commit_transaction>(&_context->_handle);
+    _context->capture(workload_entry::commit, start);
+    _context->unregister();
+    _context->_has_writes = false;
+}
 
 // Rollback (cancel) pending changes.
 void transaction::rollback()
-{ invoke_except(isc_rollback_transaction, &_context->_handle); }
+{
+    // Transaction of the previous attachment is already
+    // rolled back by the server
+    if (_context->is_stale()) {
+        _context->reset();
+        return;
+    }
+    auto start = context_t::capture_start();
+    invoke_except<isc_rollback_transaction>(&_context->_handle);
+    _context->capture(workload_entry::rollback, start);
+    _context->unregister();
+    _context->_has_writes = false;
+}
 
 // Get internal pointer to isc_tr_handle.
 isc_tr_handle* transaction::handle() const noexcept
@@ -64,8 +190,11 @@ void transaction::execute_immediate(std::string_view sql, const Args&... args)
     }
 
     // Execute
-    invoke_except(isc_dsql_execute_immediate, _context->_db.handle(),
+    auto start = context_t::capture_start();
+    invoke_except<isc_dsql_execute_immediate>(_context->_db.handle(),
         &_context->_handle, 0, sql.data(), SQL_DIALECT_CURRENT, params.get());
+    _context->_has_writes = true;
+    _context->capture(workload_entry::execute, start, sql, &params);
 }
 
 } // namespace fb
@@ -0,0 +1,256 @@
+/// \file transaction_monitor.hpp
+/// This file contains the transaction monitor, watching the gap
+/// between oldest and next transactions of a database and the age
+/// of transactions open in this process.
+
+#pragma once
+#include "database.hpp"
+#include "registry.hpp"
+#include "info.hpp"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace fb
+{
+
+/// Transaction counters of a database. Growing gaps between them
+/// mean that old record versions can't be garbage collected.
+struct transaction_counters
+{
+    /// Oldest interesting transaction (OIT).
+    int64_t oldest_interesting = 0;
+    /// Oldest active transaction (OAT).
+    int64_t oldest_active = 0;
+    /// Oldest snapshot transaction (OST), record versions
+    /// older than this may be garbage collected.
+    int64_t oldest_snapshot = 0;
+    /// Next transaction.
+    int64_t next = 0;
+
+    /// Gap between next and oldest active transaction. Grows
+    /// while a transaction stays open.
+    int64_t active_gap() const noexcept
+    { return next - oldest_active; }
+
+    /// Gap between oldest snapshot and oldest interesting
+    /// transaction. Grows with rolled back transactions until
+    /// sweep is done.
+    int64_t sweep_gap() const noexcept
+    { return oldest_snapshot - oldest_interesting; }
+};
+
+/// Monitor of transaction gaps and of transactions open too long.
+/// Transactions of the monitored database started while a monitor
+/// exists are tracked for their age. Checks are done by a background
+/// thread every interval, or by calling check() directly. Callbacks
+/// are called from the thread doing the check.
+///
+/// \code{.cpp}
+///     fb::transaction_monitor::settings s;
+///     s.max_age = std::chrono::minutes(5);
+///     fb::transaction_monitor mon(db, s);
+///     mon.on_gap([](const fb::transaction_counters& c) {
+///         log("transaction gap", c.active_gap());
+///     });
+///     mon.on_age([](const fb::open_transaction& t) {
+///         log("transaction open since", t.started);
+///     });
+///     mon.start();
+/// \endcode
+///
+struct transaction_monitor
+{
+    /// Monitor settings.
+    struct settings
+    {
+        /// Time between checks of the background thread.
+        std::chrono::nanoseconds interval = std::chrono::seconds(10);
+        /// Maximum gap, for either active_gap() or sweep_gap().
+        int64_t max_gap = 100'000;
+        /// Maximum age of a transaction open in this process.
+        std::chrono::nanoseconds max_age = std::chrono::minutes(10);
+    };
+
+    /// Called with current counters while a gap exceeds max_gap.
+    using gap_callback = std::function<void(const transaction_counters&)>;
+    /// Called once for each transaction older than max_age.
+    using age_callback = std::function<void(const open_transaction&)>;
+
+    /// Construct monitor of a database with default settings.
+    ///
+    /// \param[in] db - Connected database (shared with the monitor).
+    ///
+    explicit transaction_monitor(database& db);
+
+    /// Construct monitor of a database.
+    ///
+    /// \param[in] db - Connected database (shared with the monitor).
+    /// \param[in] s - Settings.
+    ///
+    transaction_monitor(database& db, const settings& s);
+
+    /// Stop background thread.
+    ~transaction_monitor() noexcept;
+
+    transaction_monitor(const transaction_monitor&) = delete;
+    transaction_monitor& operator=(const transaction_monitor&) = delete;
+
+    /// Set callback for exceeded gap (before start()).
+    void on_gap(gap_callback cb)
+    { _on_gap = std::move(cb); }
+
+    /// Set callback for transaction exceeding maximum age (before start()).
+    void on_age(age_callback cb)
+    { _on_age = std::move(cb); }
+
+    /// Start background thread checking every interval. Errors
+    /// of the checks are ignored, next check is tried again.
+    void start();
+
+    /// Stop background thread.
+    void stop() noexcept;
+
+    /// Read transaction counters and check thresholds once.
+    ///
+    /// \return Current counters.
+    /// \throw fb::exception
+    ///
+    transaction_counters check();
+
+    /// Read transaction counters of a database.
+    ///
+    /// \throw fb::exception
+    ///
+    static transaction_counters read(database& db);
+
+private:
+    /// Background thread.
+    void run();
+
+    database _db;
+    settings _settings;
+    gap_callback _on_gap;
+    age_callback _on_age;
+
+    /// Serializes checks of the background thread and of callers.
+    std::mutex _check_mutex;
+    /// Transactions already reported as too old (under _check_mutex).
+    std::set<uint64_t> _reported;
+
+    bool _stop = false;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::thread _thread;
+};
+
+// Construct monitor of a database with default settings.
+transaction_monitor::transaction_monitor(database& db)
+: transaction_monitor(db, settings())
+{ }
+
+// Construct monitor of a database.
+transaction_monitor::transaction_monitor(database& db, const settings& s)
+: _db(db)
+, _settings(s)
+{ transaction_registry::watch(); }
+
+// Stop background thread.
+transaction_monitor::~transaction_monitor() noexcept
+{
+    stop();
+    transaction_registry::unwatch();
+}
+
+// Start background thread.
+void transaction_monitor::start()
+{
+    if (!_thread.joinable()) {
+        _stop = false;
+        _thread = std::thread(&transaction_monitor::run, this);
+    }
+}
+
+// Stop background thread.
+void transaction_monitor::stop() noexcept
+{
+    if (_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cv.notify_one();
+        _thread.join();
+    }
+}
+
+// Read transaction counters and check thresholds once.
+transaction_counters transaction_monitor::check()
+{
+    std::lock_guard<std::mutex> lock(_check_mutex);
+    auto c = read(_db);
+    if (_on_gap && (c.active_gap() > _settings.max_gap || c.sweep_gap() > _settings.max_gap))
+        _on_gap(c);
+
+    // Forget finished transactions, report new old ones
+    // of this database
+    std::set<uint64_t> reported;
+    isc_db_handle db = *_db.handle();
+    for (auto& t : transaction_registry::snapshot()) {
+        if (t.age() <= _settings.max_age)
+            break;  // Sorted oldest first
+        if (t.db != db)
+            continue;
+        reported.insert(t.id);
+        if (_on_age && !_reported.count(t.id))
+            _on_age(t);
+    }
+    _reported.swap(reported);
+    return c;
+}
+
+// Read transaction counters of a database.
+transaction_counters transaction_monitor::read(database& db)
+{
+    const char items[] = {
+        isc_info_oldest_transaction,
+        isc_info_oldest_active,
+        isc_info_oldest_snapshot,
+        isc_info_next_transaction,
+        isc_info_end
+    };
+
+    transaction_counters ret;
+    auto buf = get_info<isc_database_info>(db.handle(), { items, sizeof(items) });
+    for (info_reader r(buf); r.next();) {
+        switch (r.item()) {
+            case isc_info_oldest_transaction: ret.oldest_interesting = r.integer(); break;
+            case isc_info_oldest_active:      ret.oldest_active = r.integer(); break;
+            case isc_info_oldest_snapshot:    ret.oldest_snapshot = r.integer(); break;
+            case isc_info_next_transaction:   ret.next = r.integer(); break;
+        }
+    }
+    return ret;
+}
+
+// Background thread.
+void transaction_monitor::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stop) {
+        lock.unlock();
+        try {
+            check();
+        }
+        catch (const fb::exception&) {
+            // Try again next time
+        }
+        lock.lock();
+        _cv.wait_for(lock, _settings.interval, [this] { return _stop; });
+    }
+}
+
+} // namespace fb
@@ -0,0 +1,443 @@
+/// \file udr.hpp
+/// This file contains typed access to messages of UDR (external
+/// functions, procedures and triggers) running inside the server.
+///
+/// Optional, not included by firebird.hpp. Include it after
+/// firebird/UdrCppEngine.h in the plugin, the OO API types are
+/// template parameters here.
+
+#pragma once
+#include "sqlda.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace fb
+{
+
+namespace detail
+{
+    /// Check if type is std::optional.
+    template <class T>
+    struct is_optional : std::false_type { };
+
+    template <class T>
+    struct is_optional<std::optional<T>> : std::true_type { };
+
+    /// Change scale of an integer value.
+    ///
+    /// \throw fb::exception on overflow.
+    ///
+    inline int64_t rescale(int64_t val, short from, short to)
+    {
+        constexpr int64_t max = std::numeric_limits<int64_t>::max() / 10;
+        for (; from > to; --from) {
+            if (val > max || val < -max)
+                throw fb::exception("numeric overflow");
+            val *= 10;
+        }
+        for (; from < to; ++from)
+            val /= 10;
+        return val;
+    }
+
+    /// Value as integer of a scale.
+    ///
+    /// \throw fb::exception
+    ///
+    inline int64_t to_scaled(const field_t& val, short scale)
+    {
+        return std::visit(overloaded {
+            [scale](auto v) -> decltype(v.template get<int64_t>()) {
+                return rescale(v._value, v._scale, scale);
+            },
+            [scale](double v) -> int64_t {
+                double r = std::round(v * std::pow(10, -scale));
+                if (!(std::abs(r) < 9.2e18))
+                    throw fb::exception("numeric overflow");
+                return int64_t(r);
+            },
+            [scale](std::string_view v) -> int64_t {
+                return rescale(type_converter<int64_t>{}(v), 0, scale);
+            },
+            [](...) -> int64_t {
+                throw fb::exception("can't convert to number");
+            }
+        }, val);
+    }
+
+    /// Store integer into a field of type T.
+    template <class T>
+    void store_integer(char* data, int64_t val)
+    {
+        if (val < std::numeric_limits<T>::min() || val > std::numeric_limits<T>::max())
+            throw fb::exception("value ") << val << " does not fit into " << type_name<T>();
+        T v = T(val);
+        std::memcpy(data, &v, sizeof(T));
+    }
+
+    /// Write value into the buffer of a field, converting to the
+    /// type of the field.
+    ///
+    /// \throw fb::exception
+    ///
+    void write_field(XSQLVAR* p, const field_t& val);
+
+} // namespace detail
+
+/// View of a UDR message: the buffer and metadata the server
+/// passes to the routine. Fields are read as fb::sqlvar (same
+/// conversions as rows of a query) and written with set(),
+/// converting to the type of the field.
+///
+/// Layout is read from the metadata once, at construction of the
+/// routine, and every call binds the buffer.
+///
+/// \code{.cpp}
+///     #include <firebird/UdrCppEngine.h>
+///     #include "udr.hpp"
+///
+///     // create function net_price(price numeric(18, 2), vat numeric(5, 2))
+///     //     returns numeric(18, 2)
+///     //     external name 'myudr!net_price' engine udr;
+///     FB_UDR_BEGIN_FUNCTION(net_price)
+///         FB_UDR_CONSTRUCTOR
+///         , input(status, metadata, fb::udr_message::input)
+///         , output(status, metadata, fb::udr_message::output)
+///         { }
+///
+///         fb::udr_message input, output;
+///
+///         FB_UDR_EXECUTE_FUNCTION
+///         {
+///             auto& i = input.bind(in);
+///             auto& o = output.bind(out);
+///             if (i[0].is_null() || i[1].is_null())
+///                 return o.set(0, nullptr);
+///             auto price = i[0].value<double>();
+///             o.set(0, price / (1 + i[1].value<double>() / 100));
+///         }
+///     FB_UDR_END_FUNCTION
+///
+///     FB_UDR_IMPLEMENT_ENTRY_POINT
+/// \endcode
+///
+struct udr_message
+{
+    /// Part of the routine metadata.
+    enum part_t { input, output, trigger };
+
+    /// Read layout of a message.
+    ///
+    /// \tparam Status - Status wrapper, such as Firebird::ThrowStatusWrapper.
+    /// \tparam Metadata - Message metadata, Firebird::IMessageMetadata.
+    /// \param[in] status - Status of the call.
+    /// \param[in] meta - Metadata of the message (not retained).
+    ///
+    template <class Status, class Metadata>
+    udr_message(Status* status, Metadata* meta)
+    { read_layout(status, meta); }
+
+    /// Read layout of a message of the routine.
+    ///
+    /// \tparam Status - Status wrapper, such as Firebird::ThrowStatusWrapper.
+    /// \tparam Routine - Routine metadata, Firebird::IRoutineMetadata.
+    /// \param[in] status - Status of the call.
+    /// \param[in] metadata - Metadata of the routine.
+    /// \param[in] part - Input or output message, or fields of the
+    ///                   table for old and new values of a trigger.
+    ///
+    template <class Status, class Routine>
+    udr_message(Status* status, Routine* metadata, part_t part);
+
+    udr_message(const udr_message&) = delete;
+    udr_message& operator=(const udr_message&) = delete;
+
+    /// Bind to the message buffer of this call.
+    ///
+    /// \param[in] buffer - Message buffer (in, out, oldFields or newFields).
+    ///
+    /// \return Reference to this message.
+    ///
+    udr_message& bind(void* buffer) noexcept;
+
+    /// Gets the number of fields.
+    size_t size() const noexcept
+    { return _fields.size(); }
+
+    /// Gets the fields, for example to use as_tuple().
+    const sqlda& fields() const noexcept
+    { return _fields; }
+
+    /// Access field by index without range check.
+    template <class T>
+    sqlvar operator[](index_castable<T> pos) const noexcept
+    { return _fields[pos]; }
+
+    /// Access field by name.
+    ///
+    /// \throw fb::exception
+    ///
+    sqlvar operator[](std::string_view name) const
+    { return _fields.at(name); }
+
+    /// Set field, converting the value to the type of the field.
+    /// Null (nullptr or empty std::optional) sets null.
+    ///
+    /// \code{.cpp}
+    ///     out.set(0, fb::scaled_integer<int64_t>(1999, -2));
+    ///     out.set("TOTAL", 42);
+    ///     out.set(1, in[1]);  // copy a field
+    /// \endcode
+    ///
+    /// \tparam Pos - Type of index (integral, enum or name).
+    /// \tparam V - Type of the value.
+    /// \param[in] pos - Index or name of the field.
+    /// \param[in] val - Value.
+    ///
+    /// \throw fb::exception if the value does not convert.
+    ///
+    template <class Pos, class V>
+    void set(const Pos& pos, const V& val);
+
+    /// Set all fields in order.
+    ///
+    /// \throw fb::exception
+    ///
+    template <class... V>
+    void set_all(const V&... vals)
+    {
+        if (sizeof...(V) != size())
+            throw fb::exception("udr_message: ") << sizeof...(V)
+                << " values for " << size() << " fields";
+        size_t i = 0;
+        (set(i++, vals), ...);
+    }
+
+private:
+    /// Read offsets, types and names from the metadata.
+    template <class Status, class Metadata>
+    void read_layout(Status* status, Metadata* meta);
+
+    /// Access field for writing (with range check).
+    XSQLVAR* at(size_t pos) const
+    { return _fields.at(pos).handle(); }
+
+    /// Access field for writing by name.
+    XSQLVAR* at(std::string_view name) const
+    { return _fields.at(name).handle(); }
+
+    sqlda _fields;
+    /// Offsets of the data and the null flag of every field.
+    std::vector<std::pair<unsigned, unsigned>> _offsets;
+    char* _buffer = nullptr;
+};
+
+// Write value into the buffer of a field.
+void detail::write_field(XSQLVAR* p, const field_t& val)
+{
+    if (std::holds_alternative<std::nullptr_t>(val)) {
+        *p->sqlind = -1;
+        return;
+    }
+
+    char* data = p->sqldata;
+    short dtype = p->sqltype & ~1;
+    switch (dtype) {
+
+    case SQL_TEXT:
+    case SQL_VARYING:
+    {
+        std::string s = std::visit(overloaded {
+            type_converter<std::string>{},
+            [](...) -> std::string {
+                throw fb::exception("can't convert to string");
+            }
+        }, val);
+        if (s.size() > size_t(p->sqllen))
+            throw fb::exception("string of ") << s.size()
+                << " bytes too long for field of " << p->sqllen;
+        if (dtype == SQL_TEXT) {
+            std::memcpy(data, s.data(), s.size());
+            std::memset(data + s.size(), ' ', p->sqllen - s.size());
+        }
+        else {
+            auto pv = reinterpret_cast<PARAMVARY*>(data);
+            pv->vary_length = s.size();
+            std::memcpy(pv->vary_string, s.data(), s.size());
+        }
+        break;
+    }
+
+    case SQL_SHORT:
+        store_integer<int16_t>(data, to_scaled(val, p->sqlscale));
+        break;
+
+    case SQL_LONG:
+        store_integer<int32_t>(data, to_scaled(val, p->sqlscale));
+        break;
+
+    case SQL_INT64:
+        store_integer<int64_t>(data, to_scaled(val, p->sqlscale));
+        break;
+
+    case SQL_FLOAT:
+    case SQL_DOUBLE:
+    case SQL_D_FLOAT:
+    {
+        double d = std::visit(overloaded {
+            type_converter<double>{},
+            [](double v) { return v; },
+            [](...) -> double { throw fb::exception("can't convert to double"); }
+        }, val);
+        if (dtype == SQL_FLOAT) {
+            float f = float(d);
+            std::memcpy(data, &f, sizeof(f));
+        }
+        else
+            std::memcpy(data, &d, sizeof(d));
+        break;
+    }
+
+    case SQL_TIMESTAMP:
+    case SQL_TYPE_DATE:
+    case SQL_TYPE_TIME:
+    {
+        auto t = std::get_if<timestamp_t>(&val);
+        if (!t)
+            throw fb::exception("can't convert to timestamp");
+        if (dtype == SQL_TIMESTAMP)
+            std::memcpy(data, t, sizeof(ISC_TIMESTAMP));
+        else if (dtype == SQL_TYPE_DATE)
+            std::memcpy(data, &t->timestamp_date, sizeof(ISC_DATE));
+        else
+            std::memcpy(data, &t->timestamp_time, sizeof(ISC_TIME));
+        break;
+    }
+
+    case SQL_BLOB:
+    {
+        auto b = std::get_if<blob_id_t>(&val);
+        if (!b)
+            throw fb::exception("can't convert to blob");
+        std::memcpy(data, b, sizeof(blob_id_t));
+        break;
+    }
+
+    #ifdef SQL_BOOLEAN
+    case SQL_BOOLEAN:
+        *data = to_scaled(val, 0) != 0;
+        break;
+    #endif
+
+    default:
+        throw fb::exception("type (") << dtype << ") not implemented";
+    }
+    *p->sqlind = 0;
+}
+
+// Read layout of a message of the routine.
+template <class Status, class Routine>
+udr_message::udr_message(Status* status, Routine* metadata, part_t part)
+{
+    auto meta = part == input ? metadata->getInputMetadata(status) :
+                part == output ? metadata->getOutputMetadata(status) :
+                metadata->getTriggerMetadata(status);
+    try {
+        read_layout(status, meta);
+    }
+    catch (...) {
+        meta->release();
+        throw;
+    }
+    meta->release();
+}
+
+// Read offsets, types and names from the metadata.
+template <class Status, class Metadata>
+void udr_message::read_layout(Status* status, Metadata* meta)
+{
+    unsigned count = meta->getCount(status);
+    if (!count)
+        return;
+
+    _fields.resize(count);
+    _offsets.resize(count);
+    for (unsigned i = 0; i < count; ++i) {
+        XSQLVAR* p = _fields[i].handle();
+        // Null flag is in every message, nullable or not
+        p->sqltype = short((meta->getType(status, i) & ~1) | 1);
+        p->sqlsubtype = short(meta->getSubType(status, i));
+        p->sqlscale = short(meta->getScale(status, i));
+        // Like sqllen, length of varying excludes the length word
+        p->sqllen = short(meta->getLength(status, i));
+
+        std::string_view name = meta->getField(status, i);
+        p->sqlname_length = short(std::min(name.size(), sizeof(p->sqlname)));
+        std::memcpy(p->sqlname, name.data(), p->sqlname_length);
+
+        _offsets[i] = { meta->getOffset(status, i), meta->getNullOffset(status, i) };
+    }
+}
+
+// Bind to the message buffer of this call.
+udr_message& udr_message::bind(void* buffer) noexcept
+{
+    if (buffer == _buffer)
+        return *this;
+
+    _buffer = static_cast<char*>(buffer);
+    for (size_t i = 0; i < _offsets.size(); ++i) {
+        XSQLVAR* p = _fields[i].handle();
+        p->sqldata = _buffer + _offsets[i].first;
+        p->sqlind = reinterpret_cast<ISC_SHORT*>(_buffer + _offsets[i].second);
+    }
+    return *this;
+}
+
+// Set field, converting the value to the type of the field.
+template <class Pos, class V>
+void udr_message::set(const Pos& pos, const V& val)
+{
+    XSQLVAR* p;
+    if constexpr (std::is_convertible_v<Pos, std::string_view>)
+        p = at(std::string_view(pos));
+    else
+        p = at(static_cast<size_t>(pos));
+
+    if constexpr (std::is_same_v<V, field_t>)
+        detail::write_field(p, val);
+    else if constexpr (std::is_same_v<V, sqlvar>)
+        detail::write_field(p, val.as_variant());
+    else if constexpr (std::is_same_v<V, std::nullptr_t>)
+        *p->sqlind = -1;
+    else if constexpr (std::is_same_v<V, bool>)
+        detail::write_field(p, scaled_integer<int64_t>(val));
+    else if constexpr (std::is_integral_v<V>)
+        detail::write_field(p, scaled_integer<int64_t>(int64_t(val)));
+    else if constexpr (std::is_floating_point_v<V>)
+        detail::write_field(p, double(val));
+    else if constexpr (std::is_convertible_v<V, std::string_view>)
+        detail::write_field(p, std::string_view(val));
+    else if constexpr (std::is_same_v<V, scaled_integer<int16_t>> ||
+                       std::is_same_v<V, scaled_integer<int32_t>>)
+        detail::write_field(p, scaled_integer<int64_t>(val._value, val._scale));
+    else if constexpr (detail::is_optional<V>::value) {
+        if (val)
+            set(pos, *val);
+        else
+            *p->sqlind = -1;
+    }
+    else
+        detail::write_field(p, field_t(val));
+}
+
+} // namespace fb
@@ -0,0 +1,1958 @@
+/// \file wire.hpp
+/// This file contains the asynchronous backend speaking the Firebird
+/// remote protocol directly over non-blocking sockets driven by
+/// epoll, so one thread can drive many connections and pipeline
+/// requests on each of them.
+///
+/// Optional, not included by firebird.hpp (Linux only). Rows and
+/// parameters use the types of the library (fb::sqlda, fb::sqlvar).
+///
+/// \note This is a standalone API, separate from fb::database,
+///       fb::transaction and fb::query. It does not use the client
+///       library, so features built on those classes (reconnect,
+///       circuit breaker, pools, routing, cache, slow query log,
+///       workload capture and API observers) do not apply to it.
+
+#pragma once
+#include "dpb.hpp"
+#include "sqlda.hpp"
+#include "srp.hpp"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace fb
+{
+
+namespace detail
+{
+namespace wire
+{
+    /// Operations of the protocol.
+    enum op : int32_t
+    {
+        op_connect = 1,
+        op_accept = 3,
+        op_reject = 4,
+        op_response = 9,
+        op_attach = 19,
+        op_detach = 21,
+        op_transaction = 29,
+        op_commit = 30,
+        op_rollback = 31,
+        op_allocate_statement = 62,
+        op_execute = 63,
+        op_fetch = 65,
+        op_fetch_response = 66,
+        op_free_statement = 67,
+        op_prepare_statement = 68,
+        op_info_sql = 70,
+        op_dummy = 71,
+        op_cont_auth = 92,
+        op_accept_data = 94,
+        op_crypt = 96,
+        op_cond_accept = 98
+    };
+
+    /// Tags of the user identification in op_connect.
+    enum cnct : uint8_t
+    {
+        cnct_user = 1,
+        cnct_host = 4,
+        cnct_user_verification = 6,
+        cnct_specific_data = 7,
+        cnct_plugin_name = 8,
+        cnct_login = 9,
+        cnct_plugin_list = 10,
+        cnct_client_crypt = 11
+    };
+
+    /// Codes of message descriptions (BLR).
+    enum blr : uint8_t
+    {
+        blr_short = 7,
+        blr_long = 8,
+        blr_quad = 9,
+        blr_float = 10,
+        blr_d_float = 11,
+        blr_sql_date = 12,
+        blr_sql_time = 13,
+        blr_text = 14,
+        blr_text2 = 15,
+        blr_int64 = 16,
+        blr_bool = 23,
+        blr_double = 27,
+        blr_timestamp = 35,
+        blr_varying2 = 38,
+        blr_version5 = 5,
+        blr_begin = 2,
+        blr_message = 4,
+        blr_end = 255,
+        blr_eoc = 76
+    };
+
+    /// Protocol version 13 (Firebird 3), the flag makes it negative
+    /// as a short and it is sent sign extended.
+    inline constexpr int32_t protocol_version13 = int16_t(0x8000 | 13);
+    inline constexpr int32_t arch_generic = 1;
+    inline constexpr int32_t ptype_lazy_send = 5;
+    inline constexpr int32_t connect_version3 = 3;
+    /// Statement handle meaning the last allocated (lazy mode).
+    inline constexpr int32_t invalid_object = 0xFFFF;
+    inline constexpr int32_t dsql_drop = 2;
+    /// End of cursor in op_fetch_response.
+    inline constexpr int32_t fetch_eof = 100;
+    /// Size of info buffers requested from the server.
+    inline constexpr int32_t info_buffer = 32767;
+
+    /// Thrown by the reader when a packet is not complete yet.
+    struct need_more { };
+
+    /// Writer of XDR (big endian, padded to 4 bytes).
+    struct writer
+    {
+        explicit writer(std::vector<char>& buf) noexcept
+        : _buf(buf) { }
+
+        writer& put_int(int32_t v)
+        {
+            for (int i = 3; i >= 0; --i)
+                _buf.push_back(char(uint32_t(v) >> (i * 8)));
+            return *this;
+        }
+
+        writer& put_int64(int64_t v)
+        {
+            put_int(int32_t(uint64_t(v) >> 32));
+            return put_int(int32_t(v));
+        }
+
+        /// Data without length, padded.
+        writer& put_opaque(const void* data, size_t len)
+        {
+            auto p = static_cast<const char*>(data);
+            _buf.insert(_buf.end(), p, p + len);
+            _buf.insert(_buf.end(), (4 - len % 4) % 4, '\0');
+            return *this;
+        }
+
+        /// Data with length, padded.
+        writer& put_bytes(const void* data, size_t len)
+        {
+            put_int(int32_t(len));
+            return put_opaque(data, len);
+        }
+
+        writer& put_bytes(std::string_view s)
+        { return put_bytes(s.data(), s.size()); }
+
+        template <class T>
+        writer& put_bytes(const std::vector<T>& v)
+        { return put_bytes(v.data(), v.size()); }
+
+    private:
+        std::vector<char>& _buf;
+    };
+
+    /// Reader of XDR from a receive buffer.
+    struct reader
+    {
+        reader(const char* data, size_t len) noexcept
+        : _begin(data), _pos(data), _commit(data), _end(data + len) { }
+
+        int32_t get_int()
+        {
+            auto p = reinterpret_cast<const uint8_t*>(take(4));
+            return int32_t(uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3]);
+        }
+
+        int64_t get_int64()
+        {
+            uint64_t hi = uint32_t(get_int());
+            return int64_t(hi << 32 | uint32_t(get_int()));
+        }
+
+        /// Data without length, padded.
+        std::string_view get_opaque(size_t len)
+        {
+            const char* p = take(len);
+            take((4 - len % 4) % 4);
+            return { p, len };
+        }
+
+        /// Data with length, padded.
+        std::string_view get_bytes()
+        {
+            int32_t len = get_int();
+            // Garbage, not a packet of this protocol
+            if (len < 0 || len > (64 << 20))
+                throw fb::exception("wire: bad length ") << len;
+            return get_opaque(size_t(len));
+        }
+
+        /// Peek next integer without reading it.
+        std::optional<int32_t> peek_int() const noexcept
+        {
+            if (_end - _pos < 4)
+                return std::nullopt;
+            reader r(_pos, 4);
+            return r.get_int();
+        }
+
+        /// Mark data read so far as consumed.
+        void commit() noexcept
+        { _commit = _pos; }
+
+        size_t position() const noexcept
+        { return _pos - _begin; }
+
+        size_t committed() const noexcept
+        { return _commit - _begin; }
+
+    private:
+        const char* take(size_t n)
+        {
+            if (size_t(_end - _pos) < n)
+                throw need_more();
+            const char* p = _pos;
+            _pos += n;
+            return p;
+        }
+
+        const char* _begin;
+        const char* _pos;
+        const char* _commit;
+        const char* _end;
+    };
+
+    /// Response to an operation (op_response).
+    struct response
+    {
+        int32_t object = 0;
+        std::string data;
+        std::exception_ptr error;
+    };
+
+    /// Read status vector, returns the error or null.
+    inline std::exception_ptr read_status(reader& in)
+    {
+        std::vector<ISC_STATUS> status;
+        std::deque<std::string> strings;
+        bool warnings = false;
+        for (;;) {
+            int32_t arg = in.get_int();
+            if (arg == isc_arg_end)
+                break;
+            switch (arg) {
+                case isc_arg_gds:
+                case isc_arg_number:
+                case isc_arg_warning:
+                    warnings |= arg == isc_arg_warning;
+                    if (!warnings) {
+                        status.push_back(arg);
+                        status.push_back(in.get_int());
+                    }
+                    else
+                        in.get_int();
+                    break;
+                case isc_arg_string:
+                case isc_arg_interpreted:
+                case isc_arg_sql_state:
+                    strings.emplace_back(in.get_bytes());
+                    if (!warnings) {
+                        status.push_back(arg);
+                        status.push_back(ISC_STATUS(strings.back().c_str()));
+                    }
+                    break;
+                default:
+                    throw fb::exception("wire: bad status argument ") << arg;
+            }
+        }
+        status.push_back(isc_arg_end);
+        if (status.size() < 3 || status[0] != isc_arg_gds || status[1] == 0)
+            return nullptr;
+        return std::make_exception_ptr(fb::exception(status.data()));
+    }
+
+    /// Read op_response.
+    inline response read_response(reader& in)
+    {
+        int32_t op = in.get_int();
+        if (op != op_response)
+            throw fb::exception("wire: unexpected operation ") << op;
+        response ret;
+        ret.object = in.get_int();
+        in.get_int64();  // blob id
+        ret.data = in.get_bytes();
+        ret.error = read_status(in);
+        return ret;
+    }
+
+    /// Read little endian integer of info buffers.
+    inline int32_t info_int(const char* p, size_t len) noexcept
+    {
+        uint32_t v = 0;
+        for (size_t i = 0; i < len && i < 4; ++i)
+            v |= uint32_t(uint8_t(p[i])) << (i * 8);
+        // Sign extend short values (scale)
+        if (len == 2)
+            return int16_t(v);
+        return int32_t(v);
+    }
+
+    /// Items describing the columns of a statement.
+    inline constexpr char describe_items[] = {
+        isc_info_sql_select, isc_info_sql_describe_vars,
+        isc_info_sql_sqlda_seq, isc_info_sql_type, isc_info_sql_sub_type,
+        isc_info_sql_scale, isc_info_sql_length, isc_info_sql_field,
+        isc_info_sql_relation, isc_info_sql_owner, isc_info_sql_alias,
+        isc_info_sql_describe_end
+    };
+
+} // namespace wire
+} // namespace detail
+
+/// Transaction of a wire connection.
+struct wire_transaction
+{
+    /// Handle of the transaction on the server.
+    int32_t handle = -1;
+
+    /// Checks if the transaction was started.
+    explicit operator bool() const noexcept
+    { return handle >= 0; }
+};
+
+/// Input parameters of a statement, encoded when constructed. Values
+/// are described by their own types, the server converts them to the
+/// types of the parameters.
+///
+/// \code{.cpp}
+///     fb::wire_params p(42, "shipped", nullptr, fb::scaled_integer<int64_t>(1999, -2));
+/// \endcode
+///
+struct wire_params
+{
+    /// No parameters.
+    wire_params() = default;
+
+    /// Encode parameters.
+    ///
+    /// \param[in] args... - Numbers, strings, nullptr, std::optional,
+    ///                      scaled_integer, timestamp_t or blob_id_t.
+    ///
+    /// \throw fb::exception
+    ///
+    template <class... Args>
+    explicit wire_params(const Args&... args)
+    {
+        (add(args), ...);
+    }
+
+    /// Gets the number of parameters.
+    size_t size() const noexcept
+    { return _nulls.size(); }
+
+    /// Message description (BLR).
+    std::vector<char> blr() const;
+
+    /// Message data in XDR, null bitmap first.
+    std::vector<char> message() const;
+
+private:
+    /// Add parameter.
+    template <class T>
+    void add(const T& val);
+
+    /// Add optional parameter, null if empty.
+    template <class T>
+    void add(const std::optional<T>& val)
+    { val ? add(*val) : add(nullptr); }
+
+    /// Add description of a parameter.
+    void describe(std::initializer_list<uint8_t> blr)
+    { _blr.insert(_blr.end(), blr.begin(), blr.end()); }
+
+    std::vector<char> _blr;
+    std::vector<char> _values;
+    std::vector<bool> _nulls;
+};
+
+/// Result of a statement. Rows are read through fb::sqlda bound to
+/// a row, the same way as rows of fb::query.
+///
+/// \code{.cpp}
+///     for (auto& row : result)
+///         std::cout << row["NAME"].value<std::string>() << '\n';
+/// \endcode
+///
+struct wire_result
+{
+    /// Row iterator.
+    struct iterator
+    {
+        const sqlda& operator*() const
+        { return _res->row(_idx); }
+
+        const sqlda* operator->() const
+        { return &_res->row(_idx); }
+
+        iterator& operator++() noexcept
+        { ++_idx; return *this; }
+
+        bool operator==(const iterator& other) const noexcept
+        { return _idx == other._idx; }
+
+        bool operator!=(const iterator& other) const noexcept
+        { return _idx != other._idx; }
+
+        wire_result* _res;
+        size_t _idx;
+    };
+
+    /// Gets the description of columns (not bound to a row).
+    const sqlda& fields() const noexcept
+    { return _fields; }
+
+    /// Gets the number of rows.
+    size_t size() const noexcept
+    { return _row_size ? _rows.size() / _row_size : 0; }
+
+    bool empty() const noexcept
+    { return !size(); }
+
+    /// Gets a row. Fields are bound to the row until the next call.
+    const sqlda& row(size_t idx);
+
+    iterator begin() noexcept
+    { return { this, 0 }; }
+
+    iterator end() noexcept
+    { return { this, size() }; }
+
+private:
+    friend struct wire_connection;
+
+    /// Read description of columns from an info buffer.
+    ///
+    /// \return True if complete, false if truncated.
+    ///
+    bool describe(std::string_view info, int32_t& stmt_type, int32_t& last_seq);
+
+    /// Compute layout of rows and the message description (BLR).
+    std::vector<char> layout();
+
+    /// Decode a row of op_fetch_response.
+    void read_row(detail::wire::reader& in);
+
+    sqlda _fields;
+    /// Offsets of the data and the null flag of every field in a row.
+    std::vector<std::pair<size_t, size_t>> _offsets;
+    size_t _row_size = 0;
+    /// Rows, aligned to 8 bytes.
+    std::vector<char> _rows;
+    size_t _bound = size_t(-1);
+};
+
+struct wire_connection;
+
+/// Event loop of wire connections. Connections and their callbacks
+/// run in the thread calling run().
+///
+/// \code{.cpp}
+///     fb::wire_loop loop;
+///     auto conn = fb::wire_connection::create(loop, "localhost:employee", "sysdba", "masterkey");
+///     conn->connect([&](std::exception_ptr err) {
+///         conn->execute(tr, "select ...", [&](std::exception_ptr err, fb::wire_result& res) {
+///             ...
+///             loop.stop();
+///         });
+///     });
+///     loop.run();
+/// \endcode
+///
+struct wire_loop
+{
+    /// Create the loop.
+    ///
+    /// \throw fb::exception
+    ///
+    wire_loop();
+
+    ~wire_loop() noexcept;
+
+    wire_loop(const wire_loop&) = delete;
+    wire_loop& operator=(const wire_loop&) = delete;
+
+    /// Handle events until stop() is called.
+    void run();
+
+    /// Wait for events and handle them.
+    ///
+    /// \param[in] timeout_ms - Time to wait, -1 to wait until an event.
+    ///
+    /// \return Number of events handled.
+    ///
+    size_t run_once(int timeout_ms = -1);
+
+    /// Make run() return. Thread safe.
+    void stop() noexcept;
+
+    /// Call function in the thread of the loop. Thread safe.
+    void post(std::function<void()> fn);
+
+private:
+    friend struct wire_connection;
+
+    /// Watch socket of a connection.
+    void add(int fd, wire_connection* c, bool write);
+
+    /// Change events of a socket.
+    void modify(int fd, bool write) noexcept;
+
+    /// Stop watching a socket.
+    void remove(int fd) noexcept;
+
+    /// Wake up epoll_wait.
+    void wake() noexcept;
+
+    int _epoll = -1;
+    int _event = -1;
+    std::atomic<bool> _stopping = false;
+    std::mutex _mutex;
+    std::vector<std::function<void()>> _posted;
+    std::unordered_map<int, wire_connection*> _connections;
+};
+
+/// Connection speaking the remote protocol (version 13, Firebird 3
+/// and later) without the client library. Authenticates with SRP
+/// (Srp256 or Srp) and encrypts the wire with Arc4.
+///
+/// Requests are pipelined: they are sent without waiting for the
+/// responses of earlier ones, and the responses are matched in order.
+/// Allocation, preparation and execution of a statement go out in one
+/// write (lazy packets), rows are fetched in batches of fetch_size
+/// and the statement is freed by a deferred packet sent with the next
+/// request.
+///
+/// All methods must be called in the thread of the loop (or before
+/// it runs), use wire_loop::post() from other threads.
+///
+/// \note Types of Firebird 4 (int128, decfloat, time zones) are not
+///       decoded, the statement fails with an error.
+///
+struct wire_connection : std::enable_shared_from_this<wire_connection>
+{
+    /// Callback of an operation, null error on success.
+    using handler_t = std::function<void(std::exception_ptr)>;
+    /// Callback of a started transaction.
+    using transaction_handler_t = std::function<void(std::exception_ptr, wire_transaction)>;
+    /// Callback of an executed statement.
+    using result_handler_t = std::function<void(std::exception_ptr, wire_result&)>;
+
+    /// Connection settings.
+    struct settings
+    {
+        std::string host = "localhost";
+        uint16_t port = 3050;
+        /// Path or alias of the database.
+        std::string database;
+        std::string user = "sysdba";
+        std::string password = "masterkey";
+        std::string charset = "UTF8";
+        /// Other parameters of the attachment.
+        fb::dpb params;
+        /// Encrypt the wire (servers require it by default).
+        bool wire_crypt = true;
+        /// Rows in a fetch request.
+        int32_t fetch_size = 400;
+    };
+
+    /// Create a connection.
+    ///
+    /// \param[in] loop - Event loop driving the connection.
+    /// \param[in] dsn - Database as "[host[/port]:]path".
+    /// \param[in] user - User name.
+    /// \param[in] password - Password.
+    ///
+    static std::shared_ptr<wire_connection> create(wire_loop& loop, std::string_view dsn,
+        std::string_view user = "sysdba", std::string_view password = "masterkey");
+
+    /// Create a connection.
+    ///
+    /// \param[in] loop - Event loop driving the connection.
+    /// \param[in] s - Settings.
+    ///
+    static std::shared_ptr<wire_connection> create(wire_loop& loop, const settings& s)
+    { return std::shared_ptr<wire_connection>(new wire_connection(loop, s)); }
+
+    /// Close the socket without detaching.
+    ~wire_connection() noexcept;
+
+    wire_connection(const wire_connection&) = delete;
+    wire_connection& operator=(const wire_connection&) = delete;
+
+    /// Connect, authenticate and attach the database.
+    ///
+    /// \param[in] cb - Called when attached or failed.
+    ///
+    /// \throw fb::exception if the address is not resolved.
+    ///
+    void connect(handler_t cb);
+
+    /// Start a transaction with default parameters.
+    void start(transaction_handler_t cb)
+    { start({}, std::move(cb)); }
+
+    /// Start a transaction.
+    ///
+    /// \param[in] tpb - Transaction Parameter Buffer (TPB).
+    /// \param[in] cb - Called with the transaction.
+    ///
+    /// \throw fb::exception if not connected.
+    ///
+    void start(std::string_view tpb, transaction_handler_t cb);
+
+    /// Commit a transaction.
+    void commit(wire_transaction tr, handler_t cb)
+    { end_transaction(detail::wire::op_commit, tr, std::move(cb)); }
+
+    /// Roll back a transaction.
+    void rollback(wire_transaction tr, handler_t cb)
+    { end_transaction(detail::wire::op_rollback, tr, std::move(cb)); }
+
+    /// Execute a statement without parameters.
+    void execute(wire_transaction tr, std::string_view sql, result_handler_t cb)
+    { execute(tr, sql, wire_params(), std::move(cb)); }
+
+    /// Execute a statement. Rows of a select are fetched before the
+    /// callback is called. Outputs of execute procedure are not
+    /// returned, select from the procedure instead.
+    ///
+    /// \param[in] tr - Transaction.
+    /// \param[in] sql - Statement.
+    /// \param[in] params - Input parameters.
+    /// \param[in] cb - Called with the result.
+    ///
+    /// \throw fb::exception if not connected.
+    ///
+    void execute(wire_transaction tr, std::string_view sql,
+        const wire_params& params, result_handler_t cb);
+
+    /// Detach and close.
+    ///
+    /// \param[in] cb - Called when closed (optional).
+    ///
+    void close(handler_t cb = {});
+
+    /// Checks if attached.
+    bool is_connected() const noexcept
+    { return _state == state::ready; }
+
+    /// Gets the number of requests waiting for responses.
+    size_t pending() const noexcept
+    { return _pending.size(); }
+
+private:
+    friend struct wire_loop;
+
+    enum class state { idle, connecting, handshake, ready, closed };
+
+    /// Parser of a response and the completion called after it.
+    struct pending_t
+    {
+        /// Read the response, sets error of the server.
+        std::function<void(detail::wire::reader&, std::exception_ptr&)> parse;
+        /// Called after the response is read.
+        std::function<void(std::exception_ptr)> complete;
+    };
+
+    /// Statement being executed.
+    struct statement_t
+    {
+        result_handler_t cb;
+        wire_result result;
+        std::exception_ptr error;
+        int32_t handle = detail::wire::invalid_object;
+        int32_t type = 0;
+        int32_t last_seq = 0;
+        std::vector<char> blr;
+        bool finished = false;
+    };
+    using statement_ptr = std::shared_ptr<statement_t>;
+
+    wire_connection(wire_loop& loop, const settings& s)
+    : _loop(loop), _settings(s) { }
+
+    /// Handle events of the socket.
+    void on_events(uint32_t events);
+
+    /// Queue a packet with its response.
+    void send(const std::vector<char>& packet, pending_t p, bool defer = false);
+
+    /// Queue a packet with an op_response.
+    void send(const std::vector<char>& packet,
+        std::function<void(detail::wire::response&)> on_response, bool defer = false);
+
+    /// Write queued data.
+    void flush();
+
+    /// Read and dispatch responses.
+    void read();
+
+    /// Parse responses in the receive buffer.
+    void dispatch();
+
+    /// Fail all requests and close.
+    void fail(std::exception_ptr err);
+
+    /// Close the socket.
+    void close_socket() noexcept;
+
+    /// Throw if not attached.
+    void check_ready() const;
+
+    /// Append data to the output, encrypted if enabled.
+    void append(const std::vector<char>& data);
+
+    /// Handshake steps.
+    void send_connect();
+    void authenticate(int32_t op, std::string_view data, std::string_view plugin);
+    void send_crypt(std::string auth_data);
+    void attach(std::string_view auth_data);
+    void connected(std::exception_ptr err);
+
+    /// Commit or roll back.
+    void end_transaction(int32_t op, wire_transaction tr, handler_t cb);
+
+    /// Statement steps.
+    void on_prepared(const statement_ptr& st, detail::wire::response& r);
+    void describe_more(const statement_ptr& st);
+    void fetch(const statement_ptr& st);
+    void finish(const statement_ptr& st);
+
+    wire_loop& _loop;
+    settings _settings;
+    state _state = state::idle;
+    int _fd = -1;
+    handler_t _on_connect;
+
+    std::unique_ptr<srp_client> _srp;
+    bool _lazy = false;
+    int32_t _db = -1;
+
+    std::string _login;
+
+    std::vector<char> _out;
+    bool _want_write = false;
+    std::vector<char> _in;
+    size_t _consumed = 0;
+    std::optional<detail::arc4> _send_cipher;
+    std::optional<detail::arc4> _recv_cipher;
+
+    std::deque<pending_t> _pending;
+    /// Packets sent with the next request.
+    std::vector<char> _deferred;
+    std::deque<pending_t> _deferred_pending;
+};
+
+// Message description (BLR).
+std::vector<char> wire_params::blr() const
+{
+    using namespace detail::wire;
+    size_t n = size() * 2;
+    std::vector<char> ret = { char(blr_version5), char(blr_begin), char(blr_message), 0,
+        char(n & 0xFF), char(n >> 8) };
+    ret.insert(ret.end(), _blr.begin(), _blr.end());
+    ret.push_back(char(blr_end));
+    ret.push_back(char(blr_eoc));
+    return ret;
+}
+
+// Message data in XDR, null bitmap first.
+std::vector<char> wire_params::message() const
+{
+    std::vector<char> bitmap((size() + 7) / 8, 0);
+    for (size_t i = 0; i < size(); ++i) {
+        if (_nulls[i])
+            bitmap[i / 8] |= char(1 << (i % 8));
+    }
+    std::vector<char> ret;
+    detail::wire::writer(ret).put_opaque(bitmap.data(), bitmap.size());
+    ret.insert(ret.end(), _values.begin(), _values.end());
+    return ret;
+}
+
+// Add parameter.
+template <class T>
+void wire_params::add(const T& val)
+{
+    using namespace detail::wire;
+    writer w(_values);
+    bool is_null = false;
+
+    if constexpr (std::is_same_v<T, std::nullptr_t>) {
+        describe({ blr_text, 0, 0 });
+        is_null = true;
+    }
+    else if constexpr (std::is_same_v<T, bool>) {
+        describe({ blr_bool });
+        char b = val;
+        w.put_opaque(&b, 1);
+    }
+    else if constexpr (std::is_integral_v<T>) {
+        describe({ blr_int64, 0 });
+        w.put_int64(int64_t(val));
+    }
+    else if constexpr (std::is_floating_point_v<T>) {
+        describe({ blr_double });
+        double d = val;
+        int64_t bits;
+        std::memcpy(&bits, &d, sizeof(d));
+        w.put_int64(bits);
+    }
+    else if constexpr (std::is_convertible_v<T, std::string_view>) {
+        std::string_view s = val;
+        if (s.size() > 32767)
+            throw fb::exception("wire_params: string of ") << s.size() << " bytes is too long";
+        describe({ blr_text, uint8_t(s.size()), uint8_t(s.size() >> 8) });
+        w.put_opaque(s.data(), s.size());
+    }
+    else if constexpr (std::is_same_v<T, scaled_integer<int16_t>> ||
+                       std::is_same_v<T, scaled_integer<int32_t>> ||
+                       std::is_same_v<T, scaled_integer<int64_t>>) {
+        describe({ blr_int64, uint8_t(val._scale) });
+        w.put_int64(val._value);
+    }
+    else if constexpr (std::is_same_v<T, timestamp_t>) {
+        describe({ blr_timestamp });
+        w.put_int(val.timestamp_date).put_int(int32_t(val.timestamp_time));
+    }
+    else if constexpr (std::is_same_v<T, blob_id_t>) {
+        describe({ blr_quad, 0 });
+        w.put_int(val.gds_quad_high).put_int(int32_t(val.gds_quad_low));
+    }
+    else
+        static_assert(!sizeof(T), "wire_params: type is not supported");
+
+    // Null indicator
+    describe({ blr_short, 0 });
+    _nulls.push_back(is_null);
+}
+
+// Gets a row.
+const sqlda& wire_result::row(size_t idx)
+{
+    if (idx >= size())
+        throw fb::exception("wire_result: row ") << idx << " >= size " << size();
+    if (idx != _bound) {
+        char* base = _rows.data() + idx * _row_size;
+        for (size_t i = 0; i < _offsets.size(); ++i) {
+            XSQLVAR* p = _fields[i].handle();
+            p->sqldata = base + _offsets[i].first;
+            p->sqlind = reinterpret_cast<ISC_SHORT*>(base + _offsets[i].second);
+        }
+        _bound = idx;
+    }
+    return _fields;
+}
+
+// Read description of columns from an info buffer.
+bool wire_result::describe(std::string_view info, int32_t& stmt_type, int32_t& last_seq)
+{
+    auto copy_name = [](char* dst, short& dst_len, size_t cap, std::string_view s) {
+        dst_len = short(std::min(s.size(), cap));
+        std::memcpy(dst, s.data(), dst_len);
+    };
+
+    XSQLVAR* var = nullptr;
+    for (size_t i = 0; i < info.size();) {
+        uint8_t item = uint8_t(info[i++]);
+        switch (item) {
+            case isc_info_end:
+                return true;
+            case isc_info_truncated:
+                return false;
+            case isc_info_sql_select:
+            case isc_info_sql_describe_end:
+                continue;
+        }
+
+        if (i + 2 > info.size())
+            throw fb::exception("wire: truncated info item ") << int(item);
+        size_t len = uint16_t(detail::wire::info_int(info.data() + i, 2));
+        i += 2;
+        if (i + len > info.size())
+            throw fb::exception("wire: truncated info item ") << int(item);
+        const char* p = info.data() + i;
+        i += len;
+        int32_t v = detail::wire::info_int(p, len);
+
+        switch (item) {
+            case isc_info_sql_stmt_type:
+                stmt_type = v;
+                break;
+            case isc_info_sql_describe_vars:
+                if (v > 0 && size_t(v) != _fields.size())
+                    _fields.resize(size_t(v));
+                break;
+            case isc_info_sql_sqlda_seq:
+                if (v < 1 || size_t(v) > _fields.size())
+                    throw fb::exception("wire: bad column index ") << v;
+                last_seq = v;
+                var = _fields[v - 1].handle();
+                break;
+            default:
+                if (!var)
+                    throw fb::exception("wire: info item ") << int(item) << " before column index";
+                switch (item) {
+                    case isc_info_sql_type: var->sqltype = short(v); break;
+                    case isc_info_sql_sub_type: var->sqlsubtype = short(v); break;
+                    case isc_info_sql_scale: var->sqlscale = short(v); break;
+                    case isc_info_sql_length: var->sqllen = short(v); break;
+                    case isc_info_sql_field:
+                        copy_name(var->sqlname, var->sqlname_length, sizeof(var->sqlname), { p, len });
+                        break;
+                    case isc_info_sql_relation:
+                        copy_name(var->relname, var->relname_length, sizeof(var->relname), { p, len });
+                        break;
+                    case isc_info_sql_owner:
+                        copy_name(var->ownname, var->ownname_length, sizeof(var->ownname), { p, len });
+                        break;
+                    case isc_info_sql_alias:
+                        copy_name(var->aliasname, var->aliasname_length, sizeof(var->aliasname), { p, len });
+                        break;
+                }
+        }
+    }
+    return true;
+}
+
+// Compute layout of rows and the message description.
+std::vector<char> wire_result::layout()
+{
+    using namespace detail::wire;
+    size_t n = _fields.size() * 2;
+    std::vector<char> blr = { char(blr_version5), char(blr_begin), char(blr_message), 0,
+        char(n & 0xFF), char(n >> 8) };
+    auto put_short = [&](int v) {
+        blr.push_back(char(v & 0xFF));
+        blr.push_back(char((v >> 8) & 0xFF));
+    };
+
+    _offsets.clear();
+    _row_size = 0;
+    for (size_t i = 0; i < _fields.size(); ++i) {
+        XSQLVAR* p = _fields[i].handle();
+        size_t len;
+        switch (p->sqltype & ~1) {
+            case SQL_TEXT:
+                blr.push_back(char(blr_text2));
+                put_short(p->sqlsubtype);
+                put_short(p->sqllen);
+                len = p->sqllen;
+                break;
+            case SQL_VARYING:
+                blr.push_back(char(blr_varying2));
+                put_short(p->sqlsubtype);
+                put_short(p->sqllen);
+                len = p->sqllen + sizeof(ISC_USHORT);
+                break;
+            case SQL_SHORT:
+                blr.insert(blr.end(), { char(blr_short), char(p->sqlscale) });
+                len = 2;
+                break;
+            case SQL_LONG:
+                blr.insert(blr.end(), { char(blr_long), char(p->sqlscale) });
+                len = 4;
+                break;
+            case SQL_INT64:
+                blr.insert(blr.end(), { char(blr_int64), char(p->sqlscale) });
+                len = 8;
+                break;
+            case SQL_FLOAT:
+                blr.push_back(char(blr_float));
+                len = 4;
+                break;
+            case SQL_DOUBLE:
+                blr.push_back(char(blr_double));
+                len = 8;
+                break;
+            case SQL_D_FLOAT:
+                blr.push_back(char(blr_d_float));
+                len = 8;
+                break;
+            case SQL_TIMESTAMP:
+                blr.push_back(char(blr_timestamp));
+                len = 8;
+                break;
+            case SQL_TYPE_DATE:
+                blr.push_back(char(blr_sql_date));
+                len = 4;
+                break;
+            case SQL_TYPE_TIME:
+                blr.push_back(char(blr_sql_time));
+                len = 4;
+                break;
+            case SQL_BLOB:
+            case SQL_ARRAY:
+                blr.insert(blr.end(), { char(blr_quad), 0 });
+                len = 8;
+                break;
+            #ifdef SQL_BOOLEAN
+            case SQL_BOOLEAN:
+                blr.push_back(char(blr_bool));
+                len = 1;
+                break;
+            #endif
+            default:
+                throw fb::exception("wire: column ") << std::quoted(_fields[i].name())
+                    << " of type (" << (p->sqltype & ~1) << ") is not supported";
+        }
+        blr.insert(blr.end(), { char(blr_short), 0 });
+
+        // Null flag first, the data aligned to 8 bytes
+        size_t null_offset = _row_size;
+        size_t data_offset = (_row_size + sizeof(ISC_SHORT) + 7) & ~size_t(7);
+        _offsets.emplace_back(data_offset, null_offset);
+        _row_size = data_offset + len;
+    }
+    _row_size = (_row_size + 7) & ~size_t(7);
+
+    blr.push_back(char(blr_end));
+    blr.push_back(char(blr_eoc));
+    return blr;
+}
+
+// Decode a row of op_fetch_response.
+void wire_result::read_row(detail::wire::reader& in)
+{
+    size_t n = _fields.size();
+    auto bitmap = in.get_opaque((n + 7) / 8);
+
+    size_t at = _rows.size();
+    _rows.resize(at + _row_size);
+    _bound = size_t(-1);
+    char* row = _rows.data() + at;
+
+    // Partial row is dropped, read again with the rest of the packet
+    try {
+        for (size_t i = 0; i < n; ++i) {
+            XSQLVAR* p = _fields[i].handle();
+            auto ind = reinterpret_cast<ISC_SHORT*>(row + _offsets[i].second);
+            char* data = row + _offsets[i].first;
+            if (bitmap[i / 8] & (1 << (i % 8))) {
+                *ind = -1;
+                continue;
+            }
+            *ind = 0;
+
+            auto store = [&](auto v) { std::memcpy(data, &v, sizeof(v)); };
+            switch (p->sqltype & ~1) {
+                case SQL_TEXT: {
+                    auto s = in.get_opaque(p->sqllen);
+                    std::memcpy(data, s.data(), s.size());
+                    break;
+                }
+                case SQL_VARYING: {
+                    auto s = in.get_bytes();
+                    if (s.size() > size_t(p->sqllen))
+                        throw fb::exception("wire: string longer than column");
+                    store(ISC_USHORT(s.size()));
+                    std::memcpy(data + sizeof(ISC_USHORT), s.data(), s.size());
+                    break;
+                }
+                case SQL_SHORT:
+                    store(int16_t(in.get_int()));
+                    break;
+                case SQL_LONG:
+                    store(int32_t(in.get_int()));
+                    break;
+                case SQL_INT64:
+                    store(int64_t(in.get_int64()));
+                    break;
+                case SQL_FLOAT: {
+                    uint32_t bits = uint32_t(in.get_int());
+                    float f;
+                    std::memcpy(&f, &bits, sizeof(f));
+                    store(f);
+                    break;
+                }
+                case SQL_DOUBLE:
+                case SQL_D_FLOAT: {
+                    uint64_t bits = uint64_t(in.get_int64());
+                    double d;
+                    std::memcpy(&d, &bits, sizeof(d));
+                    store(d);
+                    break;
+                }
+                case SQL_TIMESTAMP: {
+                    ISC_TIMESTAMP t;
+                    t.timestamp_date = in.get_int();
+                    t.timestamp_time = ISC_TIME(in.get_int());
+                    store(t);
+                    break;
+                }
+                case SQL_TYPE_DATE:
+                    store(ISC_DATE(in.get_int()));
+                    break;
+                case SQL_TYPE_TIME:
+                    store(ISC_TIME(in.get_int()));
+                    break;
+                case SQL_BLOB:
+                case SQL_ARRAY: {
+                    ISC_QUAD q;
+                    q.gds_quad_high = in.get_int();
+                    q.gds_quad_low = ISC_ULONG(in.get_int());
+                    store(q);
+                    break;
+                }
+                #ifdef SQL_BOOLEAN
+                case SQL_BOOLEAN:
+                    *data = in.get_opaque(1)[0];
+                    break;
+                #endif
+            }
+        }
+    }
+    catch (...) {
+        _rows.resize(at);
+        throw;
+    }
+}
+
+// Create the loop.
+wire_loop::wire_loop()
+{
+    _epoll = epoll_create1(EPOLL_CLOEXEC);
+    _event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_epoll < 0 || _event < 0) {
+        int err = errno;
+        if (_epoll >= 0)
+            ::close(_epoll);
+        if (_event >= 0)
+            ::close(_event);
+        throw fb::exception("wire_loop: ") << std::strerror(err);
+    }
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = _event;
+    epoll_ctl(_epoll, EPOLL_CTL_ADD, _event, &ev);
+}
+
+// Destroy the loop.
+wire_loop::~wire_loop() noexcept
+{
+    if (_event >= 0)
+        ::close(_event);
+    if (_epoll >= 0)
+        ::close(_epoll);
+    _event = _epoll = -1;
+}
+
+// Handle events until stop() is called.
+void wire_loop::run()
+{
+    _stopping = false;
+    while (!_stopping)
+        run_once(-1);
+}
+
+// Wait for events and handle them.
+size_t wire_loop::run_once(int timeout_ms)
+{
+    epoll_event events[64];
+    int n = epoll_wait(_epoll, events, 64, timeout_ms);
+    if (n < 0) {
+        if (errno == EINTR)
+            return 0;
+        throw fb::exception("wire_loop: ") << std::strerror(errno);
+    }
+
+    for (int i = 0; i < n; ++i) {
+        int fd = events[i].data.fd;
+        if (fd == _event) {
+            uint64_t cnt;
+            while (::read(_event, &cnt, sizeof(cnt)) > 0);
+
+            std::vector<std::function<void()>> posted;
+            {
+                std::lock_guard lock(_mutex);
+                posted.swap(_posted);
+            }
+            for (auto& fn : posted)
+                fn();
+            continue;
+        }
+
+        // Connection may be closed by a callback of an earlier event
+        auto it = _connections.find(fd);
+        if (it != _connections.end())
+            it->second->on_events(events[i].events);
+    }
+    return size_t(n);
+}
+
+// Make run() return.
+void wire_loop::stop() noexcept
+{
+    _stopping = true;
+    wake();
+}
+
+// Call function in the thread of the loop.
+void wire_loop::post(std::function<void()> fn)
+{
+    {
+        std::lock_guard lock(_mutex);
+        _posted.push_back(std::move(fn));
+    }
+    wake();
+}
+
+// Wake up epoll_wait.
+void wire_loop::wake() noexcept
+{
+    uint64_t one = 1;
+    [[maybe_unused]] auto rc = ::write(_event, &one, sizeof(one));
+}
+
+// Watch socket of a connection.
+void wire_loop::add(int fd, wire_connection* c, bool write)
+{
+    epoll_event ev = {};
+    ev.events = EPOLLIN | (write ? uint32_t(EPOLLOUT) : 0);
+    ev.data.fd = fd;
+    if (epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev) < 0)
+        throw fb::exception("wire_loop: ") << std::strerror(errno);
+    _connections[fd] = c;
+}
+
+// Change events of a socket.
+void wire_loop::modify(int fd, bool write) noexcept
+{
+    epoll_event ev = {};
+    ev.events = EPOLLIN | (write ? uint32_t(EPOLLOUT) : 0);
+    ev.data.fd = fd;
+    epoll_ctl(_epoll, EPOLL_CTL_MOD, fd, &ev);
+}
+
+// Stop watching a socket.
+void wire_loop::remove(int fd) noexcept
+{
+    epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+    _connections.erase(fd);
+}
+
+// Create a connection.
+std::shared_ptr<wire_connection> wire_connection::create(wire_loop& loop,
+    std::string_view dsn, std::string_view user, std::string_view password)
+{
+    settings s;
+    s.user = user;
+    s.password = password;
+
+    // [host[/port]:]path, a drive letter is not a host
+    auto colon = dsn.find(':');
+    if (colon != std::string_view::npos && colon > 1) {
+        std::string_view host = dsn.substr(0, colon);
+        auto slash = host.find('/');
+        if (slash != std::string_view::npos) {
+            s.port = uint16_t(std::atoi(std::string(host.substr(slash + 1)).c_str()));
+            host = host.substr(0, slash);
+        }
+        s.host = host;
+        dsn.remove_prefix(colon + 1);
+    }
+    s.database = dsn;
+    return create(loop, s);
+}
+
+// Close the socket without detaching.
+wire_connection::~wire_connection() noexcept
+{ close_socket(); }
+
+// Connect, authenticate and attach the database.
+void wire_connection::connect(handler_t cb)
+{
+    if (_state != state::idle)
+        throw fb::exception("wire_connection: connect called twice");
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* ai = nullptr;
+    std::string port = std::to_string(_settings.port);
+    if (int rc = getaddrinfo(_settings.host.c_str(), port.c_str(), &hints, &ai); rc)
+        throw fb::exception("wire_connection: ") << _settings.host << ": " << gai_strerror(rc);
+
+    _fd = socket(ai->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int rc = _fd < 0 ? -1 : ::connect(_fd, ai->ai_addr, ai->ai_addrlen);
+    int err = errno;
+    freeaddrinfo(ai);
+    if (_fd < 0 || (rc < 0 && err != EINPROGRESS)) {
+        close_socket();
+        throw fb::exception("wire_connection: ") << _settings.host << ": " << std::strerror(err);
+    }
+    int one = 1;
+    setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    _on_connect = std::move(cb);
+    _state = state::connecting;
+    _loop.add(_fd, this, true);
+    _want_write = true;
+    send_connect();
+}
+
+// Start a transaction.
+void wire_connection::start(std::string_view tpb, transaction_handler_t cb)
+{
+    check_ready();
+    std::vector<char> pkt;
+    detail::wire::writer(pkt).put_int(detail::wire::op_transaction).put_int(_db).put_bytes(tpb);
+    send(pkt, [cb = std::move(cb)](detail::wire::response& r) {
+        cb(r.error, r.error ? wire_transaction() : wire_transaction{ r.object });
+    });
+}
+
+// Commit or roll back.
+void wire_connection::end_transaction(int32_t op, wire_transaction tr, handler_t cb)
+{
+    check_ready();
+    std::vector<char> pkt;
+    detail::wire::writer(pkt).put_int(op).put_int(tr.handle);
+    send(pkt, [cb = std::move(cb)](detail::wire::response& r) {
+        if (cb)
+            cb(r.error);
+    });
+}
+
+// Execute a statement.
+void wire_connection::execute(wire_transaction tr, std::string_view sql,
+    const wire_params& params, result_handler_t cb)
+{
+    using namespace detail::wire;
+    check_ready();
+    auto st = std::make_shared<statement_t>();
+    st->cb = std::move(cb);
+
+    auto first_error = [st](detail::wire::response& r) {
+        if (r.error && !st->error)
+            st->error = r.error;
+    };
+
+    std::vector<char> pkt;
+    writer(pkt).put_int(op_allocate_statement).put_int(_db);
+    send(pkt, [this, st, first_error](response& r) {
+        first_error(r);
+        st->handle = r.error ? invalid_object : r.object;
+    });
+
+    // Without lazy packets the handle is needed first
+    auto prepare = [this, st, tr, sql = std::string(sql), params] {
+        std::vector<char> items = { isc_info_sql_stmt_type };
+        items.insert(items.end(), std::begin(describe_items), std::end(describe_items));
+
+        std::vector<char> pkt;
+        writer(pkt).put_int(op_prepare_statement).put_int(tr.handle).put_int(st->handle)
+            .put_int(3).put_bytes(sql).put_bytes(items).put_int(info_buffer);
+        send(pkt, [this, st](response& r) { on_prepared(st, r); });
+
+        pkt.clear();
+        writer w(pkt);
+        w.put_int(op_execute).put_int(st->handle).put_int(tr.handle);
+        if (params.size()) {
+            auto msg = params.message();
+            w.put_bytes(params.blr()).put_int(0).put_int(1);
+            pkt.insert(pkt.end(), msg.begin(), msg.end());
+        }
+        else
+            w.put_bytes(nullptr, 0).put_int(0).put_int(0);
+        send(pkt, [this, st](response& r) {
+            if (r.error && !st->error)
+                st->error = r.error;
+            // Select ends with its last fetch
+            if (st->error || (st->type != isc_info_sql_stmt_select &&
+                              st->type != isc_info_sql_stmt_select_for_upd))
+                finish(st);
+        });
+    };
+
+    if (_lazy)
+        prepare();
+    else {
+        // Queue behind the allocation
+        _pending.back().complete = [this, prepare, next = _pending.back().complete, st](std::exception_ptr err) {
+            next(err);
+            if (!err && !st->error && _state == state::ready)
+                prepare();
+            else
+                finish(st);
+        };
+    }
+}
+
+// Statement prepared, read the description of columns.
+void wire_connection::on_prepared(const statement_ptr& st, detail::wire::response& r)
+{
+    if (st->error)
+        return;
+    if (r.error) {
+        st->error = r.error;
+        return;
+    }
+    try {
+        if (!st->result.describe(r.data, st->type, st->last_seq))
+            return describe_more(st);
+        if (st->type == isc_info_sql_stmt_select || st->type == isc_info_sql_stmt_select_for_upd) {
+            st->blr = st->result.layout();
+            fetch(st);
+        }
+    }
+    catch (...) {
+        st->error = std::current_exception();
+    }
+}
+
+// Request the rest of a truncated description.
+void wire_connection::describe_more(const statement_ptr& st)
+{
+    using namespace detail::wire;
+    std::vector<char> items = { isc_info_sql_sqlda_start, 2,
+        char(st->last_seq & 0xFF), char(st->last_seq >> 8) };
+    items.insert(items.end(), std::begin(describe_items), std::end(describe_items));
+
+    std::vector<char> pkt;
+    writer(pkt).put_int(op_info_sql).put_int(st->handle).put_int(0)
+        .put_bytes(items).put_int(info_buffer);
+    send(pkt, [this, st](response& r) { on_prepared(st, r); });
+}
+
+// Fetch a batch of rows.
+void wire_connection::fetch(const statement_ptr& st)
+{
+    using namespace detail::wire;
+    std::vector<char> pkt;
+    writer(pkt).put_int(op_fetch).put_int(st->handle).put_bytes(st->blr)
+        .put_int(0).put_int(_settings.fetch_size);
+
+    auto eof = std::make_shared<bool>(false);
+    pending_t p;
+    p.parse = [st, eof](reader& in, std::exception_ptr& err) {
+        for (;;) {
+            auto op = in.peek_int();
+            if (op == op_response) {
+                err = read_response(in).error;
+                return;
+            }
+            if (op == op_dummy) {
+                in.get_int();
+                continue;
+            }
+            if (op != op_fetch_response) {
+                in.get_int();
+                throw fb::exception("wire: unexpected operation ") << *op;
+            }
+            in.get_int();
+            int32_t status = in.get_int();
+            int32_t count = in.get_int();
+            if (!count) {
+                *eof = status == fetch_eof;
+                return;
+            }
+            st->result.read_row(in);
+            in.commit();
+        }
+    };
+    p.complete = [this, st, eof](std::exception_ptr err) {
+        if (err && !st->error)
+            st->error = err;
+        if (st->error || *eof)
+            finish(st);
+        else if (_state == state::ready)
+            fetch(st);
+        else
+            finish(st);
+    };
+    send(pkt, std::move(p));
+}
+
+// Free the statement and call back.
+void wire_connection::finish(const statement_ptr& st)
+{
+    if (st->finished)
+        return;
+    st->finished = true;
+
+    using namespace detail::wire;
+    if (st->handle != invalid_object && _state == state::ready) {
+        std::vector<char> pkt;
+        writer(pkt).put_int(op_free_statement).put_int(st->handle).put_int(dsql_drop);
+        send(pkt, [](response&) { }, true);
+    }
+    st->cb(st->error, st->result);
+}
+
+
+// Detach and close.
+void wire_connection::close(handler_t cb)
+{
+    if (_state != state::ready) {
+        fail(std::make_exception_ptr(fb::exception("wire_connection: closed")));
+        if (cb)
+            cb(nullptr);
+        return;
+    }
+
+    std::vector<char> pkt;
+    detail::wire::writer(pkt).put_int(detail::wire::op_detach).put_int(_db);
+    send(pkt, [this, cb = std::move(cb)](detail::wire::response& r) {
+        fail(std::make_exception_ptr(fb::exception("wire_connection: closed")));
+        if (cb)
+            cb(r.error);
+    });
+}
+
+// Handle events of the socket.
+void wire_connection::on_events(uint32_t events)
+{
+    // Callbacks may release the last reference
+    auto self = shared_from_this();
+
+    if (_state == state::connecting) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err) {
+            fail(std::make_exception_ptr(fb::exception("wire_connection: ")
+                << _settings.host << ": " << std::strerror(err)));
+            return;
+        }
+        if (!(events & EPOLLOUT))
+            return;
+        _state = state::handshake;
+    }
+    if (events & EPOLLOUT)
+        flush();
+    if (_state != state::closed && (events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+        read();
+}
+
+// Append data to the output.
+void wire_connection::append(const std::vector<char>& data)
+{
+    size_t at = _out.size();
+    _out.insert(_out.end(), data.begin(), data.end());
+    if (_send_cipher)
+        _send_cipher->apply(_out.data() + at, data.size());
+}
+
+// Queue a packet with its response.
+void wire_connection::send(const std::vector<char>& packet, pending_t p, bool defer)
+{
+    if (defer) {
+        _deferred.insert(_deferred.end(), packet.begin(), packet.end());
+        _deferred_pending.push_back(std::move(p));
+        return;
+    }
+
+    // Deferred packets go first, responses keep the order
+    if (!_deferred.empty()) {
+        append(_deferred);
+        _deferred.clear();
+        for (auto& d : _deferred_pending)
+            _pending.push_back(std::move(d));
+        _deferred_pending.clear();
+    }
+    append(packet);
+    _pending.push_back(std::move(p));
+
+    // Written when the loop sees the socket writable, packets queued
+    // by the same callback go out in one write
+    if (!_want_write && _fd >= 0) {
+        _loop.modify(_fd, true);
+        _want_write = true;
+    }
+}
+
+// Queue a packet with an op_response.
+void wire_connection::send(const std::vector<char>& packet,
+    std::function<void(detail::wire::response&)> on_response, bool defer)
+{
+    auto r = std::make_shared<detail::wire::response>();
+    pending_t p;
+    p.parse = [r](detail::wire::reader& in, std::exception_ptr& err) {
+        *r = detail::wire::read_response(in);
+        err = r->error;
+    };
+    p.complete = [r, on_response = std::move(on_response)](std::exception_ptr err) {
+        if (!r->error)
+            r->error = err;
+        on_response(*r);
+    };
+    send(packet, std::move(p), defer);
+}
+
+// Write queued data.
+void wire_connection::flush()
+{
+    size_t sent = 0;
+    while (sent < _out.size()) {
+        ssize_t n = ::send(_fd, _out.data() + sent, _out.size() - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            _out.clear();
+            fail(std::make_exception_ptr(fb::exception("wire_connection: ") << std::strerror(errno)));
+            return;
+        }
+        sent += size_t(n);
+    }
+    _out.erase(_out.begin(), _out.begin() + sent);
+
+    if (_out.empty() && _want_write) {
+        _loop.modify(_fd, false);
+        _want_write = false;
+    }
+}
+
+// Read and dispatch responses.
+void wire_connection::read()
+{
+    if (_consumed) {
+        _in.erase(_in.begin(), _in.begin() + _consumed);
+        _consumed = 0;
+    }
+
+    constexpr size_t chunk = 64 * 1024;
+    for (;;) {
+        size_t at = _in.size();
+        _in.resize(at + chunk);
+        ssize_t n = ::recv(_fd, _in.data() + at, chunk, 0);
+        _in.resize(at + std::max<ssize_t>(n, 0));
+        if (n > 0) {
+            if (_recv_cipher)
+                _recv_cipher->apply(_in.data() + at, size_t(n));
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        // Responses received before the close are still handled
+        dispatch();
+        fail(std::make_exception_ptr(fb::exception("wire_connection: ")
+            << (n ? std::strerror(errno) : "connection closed by server")));
+        return;
+    }
+    dispatch();
+}
+
+// Parse responses in the receive buffer.
+void wire_connection::dispatch()
+{
+    using namespace detail::wire;
+    while (!_pending.empty() && _state != state::closed) {
+        reader in(_in.data() + _consumed, _in.size() - _consumed);
+
+        // Keepalive of the server
+        if (in.peek_int() == op_dummy) {
+            _consumed += 4;
+            continue;
+        }
+
+        std::exception_ptr err;
+        try {
+            _pending.front().parse(in, err);
+        }
+        catch (const need_more&) {
+            _consumed += in.committed();
+            return;
+        }
+        catch (...) {
+            _consumed = _in.size();
+            fail(std::current_exception());
+            return;
+        }
+        _consumed += in.position();
+
+        auto p = std::move(_pending.front());
+        _pending.pop_front();
+        p.complete(err);
+    }
+}
+
+// Fail all requests and close.
+void wire_connection::fail(std::exception_ptr err)
+{
+    if (_state == state::closed)
+        return;
+    _state = state::closed;
+    close_socket();
+    _out.clear();
+    _deferred.clear();
+
+    auto pending = std::move(_pending);
+    _pending.clear();
+    for (auto& p : _deferred_pending)
+        pending.push_back(std::move(p));
+    _deferred_pending.clear();
+
+    for (auto& p : pending)
+        p.complete(err);
+    connected(err);
+}
+
+// Close the socket.
+void wire_connection::close_socket() noexcept
+{
+    if (_fd >= 0) {
+        _loop.remove(_fd);
+        ::close(_fd);
+        _fd = -1;
+    }
+    _want_write = false;
+}
+
+// Throw if not attached.
+void wire_connection::check_ready() const
+{
+    if (_state != state::ready)
+        throw fb::exception("wire_connection: not connected");
+}
+
+// Send op_connect with the public key of SRP.
+void wire_connection::send_connect()
+{
+    using namespace detail::wire;
+
+    // Names are stored in upper case unless quoted
+    std::string_view user = _settings.user;
+    if (user.size() >= 2 && user.front() == '"' && user.back() == '"')
+        _login = user.substr(1, user.size() - 2);
+    else {
+        _login = user;
+        for (auto& c : _login)
+            c = char(std::toupper(uint8_t(c)));
+    }
+    _srp = std::make_unique<srp_client>();
+
+    std::vector<char> uid;
+    auto put = [&uid](uint8_t tag, std::string_view val) {
+        uid.push_back(char(tag));
+        uid.push_back(char(std::min<size_t>(val.size(), 255)));
+        uid.insert(uid.end(), val.begin(), val.begin() + std::min<size_t>(val.size(), 255));
+    };
+    put(cnct_login, _login);
+    put(cnct_plugin_name, "Srp256");
+    put(cnct_plugin_list, "Srp256, Srp");
+
+    // Public key in parts prefixed with a sequence number
+    std::string key = _srp->public_key();
+    for (size_t i = 0, seq = 0; i < key.size(); i += 254, ++seq) {
+        std::string part(1, char(seq));
+        part += key.substr(i, 254);
+        put(cnct_specific_data, part);
+    }
+
+    const char crypt[4] = { char(_settings.wire_crypt), 0, 0, 0 };
+    put(cnct_client_crypt, { crypt, sizeof(crypt) });
+    const char* os_user = std::getenv("USER");
+    put(cnct_user, os_user ? os_user : "");
+    char host[256] = {};
+    gethostname(host, sizeof(host) - 1);
+    put(cnct_host, host);
+    put(cnct_user_verification, "");
+
+    std::vector<char> pkt;
+    writer(pkt).put_int(op_connect).put_int(op_attach).put_int(connect_version3)
+        .put_int(arch_generic).put_bytes(_settings.database).put_int(1).put_bytes(uid)
+        .put_int(protocol_version13).put_int(arch_generic).put_int(0)
+        .put_int(ptype_lazy_send).put_int(1);
+
+    struct accept_t
+    {
+        int32_t op = 0;
+        std::string data;
+        std::string plugin;
+        bool authenticated = false;
+    };
+    auto acc = std::make_shared<accept_t>();
+
+    pending_t p;
+    p.parse = [this, acc](reader& in, std::exception_ptr& err) {
+        if (in.peek_int() == op_response) {
+            err = read_response(in).error;
+            return;
+        }
+        acc->op = in.get_int();
+        if (acc->op == op_reject) {
+            err = std::make_exception_ptr(fb::exception("wire_connection: connection rejected"));
+            return;
+        }
+        if (acc->op != op_accept && acc->op != op_cond_accept && acc->op != op_accept_data)
+            throw fb::exception("wire: unexpected operation ") << acc->op;
+        in.get_int();  // version
+        in.get_int();  // architecture
+        _lazy = (in.get_int() & 0xFF) == ptype_lazy_send;
+        if (acc->op != op_accept) {
+            acc->data = in.get_bytes();
+            acc->plugin = in.get_bytes();
+            acc->authenticated = in.get_int();
+            in.get_bytes();  // keys
+        }
+    };
+    p.complete = [this, acc](std::exception_ptr err) {
+        if (err)
+            return fail(err);
+        try {
+            // Trusted or without authentication
+            if (acc->op == op_accept || acc->authenticated)
+                return attach({});
+            authenticate(acc->op, acc->data, acc->plugin);
+        }
+        catch (...) {
+            fail(std::current_exception());
+        }
+    };
+    send(pkt, std::move(p));
+}
+
+// Prove the password to the server.
+void wire_connection::authenticate(int32_t op, std::string_view data, std::string_view plugin)
+{
+    using namespace detail::wire;
+    if (plugin != "Srp256" && plugin != "Srp")
+        throw fb::exception("wire_connection: authentication plugin ") << plugin << " is not supported";
+
+    // Server asks for the public key again for another plugin
+    if (data.empty()) {
+        std::vector<char> pkt;
+        writer(pkt).put_int(op_cont_auth).put_bytes(_srp->public_key())
+            .put_bytes(plugin).put_bytes("Srp256, Srp").put_bytes("");
+
+        auto acc = std::make_shared<std::pair<std::string, std::string>>();
+        pending_t p;
+        p.parse = [acc](reader& in, std::exception_ptr& err) {
+            if (in.peek_int() == op_response) {
+                err = read_response(in).error;
+                return;
+            }
+            if (int32_t code = in.get_int(); code != op_cont_auth)
+                throw fb::exception("wire: unexpected operation ") << code;
+            acc->first = in.get_bytes();
+            acc->second = in.get_bytes();
+            in.get_bytes();  // plugin list
+            in.get_bytes();  // keys
+        };
+        p.complete = [this, op, acc](std::exception_ptr err) {
+            if (err)
+                return fail(err);
+            try {
+                authenticate(op, acc->first, acc->second);
+            }
+            catch (...) {
+                fail(std::current_exception());
+            }
+        };
+        return send(pkt, std::move(p));
+    }
+
+    // Salt and public key (hexadecimal) with little endian lengths
+    if (data.size() < 4)
+        throw fb::exception("wire_connection: bad authentication data");
+    size_t salt_len = uint16_t(info_int(data.data(), 2));
+    if (data.size() < salt_len + 4)
+        throw fb::exception("wire_connection: bad authentication data");
+    std::string_view salt = data.substr(2, salt_len);
+    std::string_view key = data.substr(salt_len + 4);
+    std::string proof = _srp->proof(_login, _settings.password, salt, key, plugin == "Srp256");
+
+    if (op == op_cond_accept) {
+        std::vector<char> pkt;
+        writer(pkt).put_int(op_cont_auth).put_bytes(proof)
+            .put_bytes(plugin).put_bytes("Srp256, Srp").put_bytes("");
+        send(pkt, [this](response& r) {
+            if (r.error)
+                return fail(r.error);
+            _settings.wire_crypt ? send_crypt({}) : attach({});
+        });
+    }
+    // Proof goes with the attachment, encrypted if the wire is
+    else if (_settings.wire_crypt)
+        send_crypt(std::move(proof));
+    else
+        attach(proof);
+}
+
+// Encrypt the wire with the session key, then attach.
+void wire_connection::send_crypt(std::string auth_data)
+{
+    using namespace detail::wire;
+    std::vector<char> pkt;
+    writer(pkt).put_int(op_crypt).put_bytes("Arc4").put_bytes("Symmetric");
+    send(pkt, [this, auth_data = std::move(auth_data)](response& r) {
+        if (r.error)
+            return fail(r.error);
+        attach(auth_data);
+    });
+
+    // Everything after op_crypt is encrypted in both directions
+    auto& key = _srp->session_key();
+    _send_cipher.emplace(key.data(), key.size());
+    _recv_cipher.emplace(key.data(), key.size());
+}
+
+// Attach the database.
+void wire_connection::attach(std::string_view auth_data)
+{
+    using namespace detail::wire;
+    fb::dpb params = _settings.params;
+    params.user(_settings.user).charset(_settings.charset);
+    if (!auth_data.empty())
+        params.add(isc_dpb_specific_auth_data, auth_data);
+
+    std::vector<char> pkt;
+    writer(pkt).put_int(op_attach).put_int(0).put_bytes(_settings.database)
+        .put_bytes(params.build());
+    send(pkt, [this](response& r) {
+        if (r.error)
+            return fail(r.error);
+        _db = r.object;
+        connected(nullptr);
+    });
+}
+
+// Report the end of connect().
+void wire_connection::connected(std::exception_ptr err)
+{
+    if (!err && _state != state::closed)
+        _state = state::ready;
+    if (auto cb = std::exchange(_on_connect, nullptr))
+        cb(err);
+}
+
+} // namespace fb
@@ -0,0 +1,391 @@
+/// \file write_behind.hpp
+/// This file contains the write-behind queue executing DML statements
+/// from a background thread, so producers never wait for the database.
+
+#pragma once
+#include "batcher.hpp"
+#include "ring_buffer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace fb
+{
+
+/// Queue of rows of a DML statement written by a background thread.
+/// Producers push rows to a lock-free ring buffer. The thread executes
+/// them with statement_batcher in blocks, and commits a transaction
+/// after a number of rows or an interval. Rows pushed before
+/// destruction are written before it returns.
+///
+/// When the queue is full, push() waits for space up to a timeout
+/// (backpressure) and try_push() fails at once. Rows of a failed
+/// transaction are passed to the failure callback.
+///
+/// \code{.cpp}
+///     fb::write_behind<int64_t, double> w(db,
+///         "insert into metric (ts, val) values (?, ?)");
+///     w.on_failure([](const fb::exception& ex, auto& rows) {
+///         std::clog << rows.size() << " rows lost: " << ex.what() << std::endl;
+///     });
+///     w.push(std::time(nullptr), 0.5);
+/// \endcode
+///
+/// \tparam Args... - Types of parameters in one row, must be
+///                   default constructible and move assignable.
+///
+template <class... Args>
+struct write_behind
+{
+    /// Row of parameters.
+    using row_type = std::tuple<Args...>;
+
+    /// Callback receiving the error and the rows of a failed
+    /// transaction. Called from the background thread.
+    using failure_t = std::function<void(const exception&, std::vector<row_type>&)>;
+
+    /// Queue settings.
+    struct settings
+    {
+        /// Maximum number of rows waiting (rounded up to power of two).
+        size_t capacity = 4096;
+        /// Maximum number of rows per EXECUTE BLOCK (0 for as
+        /// many as fits in the limits).
+        size_t block_rows = 0;
+        /// Commit after this number of rows.
+        size_t commit_rows = 10000;
+        /// Commit at least this often when there are rows.
+        std::chrono::nanoseconds commit_interval = std::chrono::milliseconds(100);
+        /// Maximum wait for space in push().
+        std::chrono::nanoseconds push_timeout = std::chrono::seconds(1);
+    };
+
+    /// Queue statistics.
+    struct write_stats
+    {
+        /// Rows accepted.
+        size_t pushed = 0;
+        /// Rows rejected because the queue was full.
+        size_t dropped = 0;
+        /// Rows committed.
+        size_t written = 0;
+        /// Rows of failed transactions.
+        size_t failed = 0;
+        /// Transactions committed.
+        size_t commits = 0;
+    };
+
+    /// Construct queue with default settings and start
+    /// background thread.
+    ///
+    /// \param[in] db - Connected database.
+    /// \param[in] sql - DML statement with one placeholder per argument.
+    ///
+    write_behind(database db, std::string_view sql)
+    : write_behind(std::move(db), sql, settings{})
+    { }
+
+    /// Construct queue and start background thread.
+    ///
+    /// \param[in] db - Connected database.
+    /// \param[in] sql - DML statement with one placeholder per argument.
+    /// \param[in] s - Settings.
+    ///
+    write_behind(database db, std::string_view sql, const settings& s)
+    : _db(std::move(db))
+    , _sql(sql)
+    , _settings(s)
+    , _queue(s.capacity)
+    {
+        _thread = std::thread(&write_behind::run, this);
+    }
+
+    /// Write all pushed rows and stop.
+    ~write_behind() noexcept
+    {
+        {
+            std::lock_guard lock(_mutex);
+            _stop = true;
+        }
+        _cv.notify_one();
+        _thread.join();
+    }
+
+    write_behind(const write_behind&) = delete;
+    write_behind& operator=(const write_behind&) = delete;
+
+    /// Set failure callback. Should be called before pushing rows.
+    ///
+    /// \param[in] cb - Callback.
+    ///
+    void on_failure(failure_t cb)
+    {
+        std::lock_guard lock(_mutex);
+        _on_failure = std::move(cb);
+    }
+
+    /// Push row, waiting for space if the queue is full.
+    ///
+    /// \return false if the row is dropped (no space within
+    ///         settings::push_timeout).
+    ///
+    bool push(const Args&... args);
+
+    /// Push row if there is space (never blocks).
+    ///
+    /// \return false if the row is dropped.
+    ///
+    bool try_push(const Args&... args);
+
+    /// Commit rows pushed so far and wait until done
+    /// (written or failed).
+    void flush();
+
+    /// Number of rows waiting in the queue.
+    size_t size() const noexcept
+    { return _queue.size(); }
+
+    /// Get statistics.
+    write_stats stats() const noexcept;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    /// Add row to the queue (moved on success).
+    bool enqueue(row_type&& row) noexcept;
+
+    /// Background thread.
+    void run() noexcept;
+
+    /// Execute and commit pending rows.
+    void commit(transaction& tr,
+        std::optional<statement_batcher<Args...>>& batch, std::vector<row_type>& rows) noexcept;
+
+    /// Report rows of a failed transaction.
+    void fail(const exception& ex, transaction& tr,
+        std::optional<statement_batcher<Args...>>& batch, std::vector<row_type>& rows) noexcept;
+
+    database _db;
+    std::string _sql;
+    settings _settings;
+    ring_buffer<row_type> _queue;
+    failure_t _on_failure;
+
+    std::atomic<size_t> _pushed = 0;
+    std::atomic<size_t> _dropped = 0;
+    std::atomic<size_t> _written = 0;
+    std::atomic<size_t> _failed = 0;
+    std::atomic<size_t> _commits = 0;
+
+    /// Guards flags and wakes up the thread, flush() and push().
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::condition_variable _done_cv;
+    std::condition_variable _space_cv;
+    bool _stop = false;
+    /// Number of flush() calls waiting.
+    size_t _flush_requests = 0;
+
+    std::thread _thread;
+};
+
+// Push row, waiting for space if the queue is full.
+template <class... Args>
+bool write_behind<Args...>::push(const Args&... args)
+{
+    row_type row(args...);
+    if (enqueue(std::move(row)))
+        return true;
+
+    // Backpressure, the thread signals when it takes rows
+    auto until = clock::now() + _settings.push_timeout;
+    std::unique_lock lock(_mutex);
+    while (!enqueue(std::move(row))) {
+        if (_space_cv.wait_until(lock, until) == std::cv_status::timeout) {
+            // Last chance, space may be freed without notify
+            if (enqueue(std::move(row)))
+                return true;
+            ++_dropped;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Push row if there is space.
+template <class... Args>
+bool write_behind<Args...>::try_push(const Args&... args)
+{
+    if (!enqueue(row_type(args...))) {
+        ++_dropped;
+        return false;
+    }
+    return true;
+}
+
+// Add row to the queue.
+template <class... Args>
+bool write_behind<Args...>::enqueue(row_type&& row) noexcept
+{
+    if (!_queue.try_push(std::move(row)))
+        return false;
+    ++_pushed;
+    // Thread wakes up on its own on commit interval,
+    // notify only when a batch is ready or queue fills up
+    size_t n = _queue.size();
+    if (n >= _settings.commit_rows || n >= _queue.capacity() / 2)
+        _cv.notify_one();
+    return true;
+}
+
+// Commit rows pushed so far and wait until done.
+template <class... Args>
+void write_behind<Args...>::flush()
+{
+    size_t target = _pushed;
+    std::unique_lock lock(_mutex);
+    ++_flush_requests;
+    _cv.notify_one();
+    _done_cv.wait(lock, [&] { return _written + _failed >= target; });
+    --_flush_requests;
+}
+
+// Get statistics.
+template <class... Args>
+typename write_behind<Args...>::write_stats write_behind<Args...>::stats() const noexcept
+{
+    write_stats ret;
+    ret.pushed = _pushed;
+    ret.dropped = _dropped;
+    ret.written = _written;
+    ret.failed = _failed;
+    ret.commits = _commits;
+    return ret;
+}
+
+// Background thread.
+template <class... Args>
+void write_behind<Args...>::run() noexcept
+{
+    transaction tr(_db);
+    std::optional<statement_batcher<Args...>> batch;
+    std::vector<row_type> rows;
+    // Time when first row of the transaction was taken
+    auto first_row = clock::now();
+    row_type row;
+
+    for (;;) {
+        // Read stop flag before draining so the last
+        // rows are written too
+        bool stop, flush;
+        {
+            std::lock_guard lock(_mutex);
+            stop = _stop;
+            flush = _flush_requests > 0;
+        }
+
+        bool taken = false;
+        while (rows.size() < _settings.commit_rows && _queue.try_pop(row)) {
+            taken = true;
+            if (rows.empty())
+                first_row = clock::now();
+            rows.push_back(std::move(row));
+            try {
+                if (!batch)
+                    batch.emplace(tr, _sql, _settings.block_rows);
+                // Prepared blocks are kept, transaction
+                // is started again after commit
+                tr.start();
+                std::apply([&](const auto&... a) { batch->add(a...); }, rows.back());
+            }
+            catch (const exception& ex) {
+                fail(ex, tr, batch, rows);
+            }
+        }
+        if (taken) {
+            // Lock so a producer going to wait does not miss it
+            { std::lock_guard lock(_mutex); }
+            _space_cv.notify_all();
+        }
+
+        // Rows of a slow producer are collected for commit interval
+        bool due = flush || stop || rows.size() >= _settings.commit_rows
+            || clock::now() - first_row >= _settings.commit_interval;
+        if (!rows.empty() && due)
+            commit(tr, batch, rows);
+
+        if (stop && rows.empty() && !_queue.size())
+            break;
+        if (_queue.size() && rows.size() < _settings.commit_rows)
+            continue;
+
+        std::unique_lock lock(_mutex);
+        _cv.wait_for(lock, _settings.commit_interval, [&] {
+            size_t n = _queue.size();
+            return _stop || _flush_requests > 0
+                || n >= _settings.commit_rows || n >= _queue.capacity() / 2;
+        });
+    }
+}
+
+// Execute and commit pending rows.
+template <class... Args>
+void write_behind<Args...>::commit(transaction& tr,
+    std::optional<statement_batcher<Args...>>& batch, std::vector<row_type>& rows) noexcept
+{
+    try {
+        batch->flush();
+        tr.commit();
+        _written += rows.size();
+        ++_commits;
+        rows.clear();
+    }
+    catch (const exception& ex) {
+        fail(ex, tr, batch, rows);
+        return;
+    }
+
+    std::lock_guard lock(_mutex);
+    _done_cv.notify_all();
+}
+
+// Report rows of a failed transaction.
+template <class... Args>
+void write_behind<Args...>::fail(const exception& ex, transaction& tr,
+    std::optional<statement_batcher<Args...>>& batch, std::vector<row_type>& rows) noexcept
+{
+    try {
+        tr.rollback();
+    }
+    catch (...) { }
+    // Batcher keeps rows that failed, start over
+    batch.reset();
+
+    failure_t cb;
+    {
+        std::lock_guard lock(_mutex);
+        cb = _on_failure;
+    }
+    if (cb) {
+        // Reporting must not stop the thread
+        try {
+            cb(ex, rows);
+        }
+        catch (...) { }
+    }
+    _failed += rows.size();
+    rows.clear();
+
+    std::lock_guard lock(_mutex);
+    _done_cv.notify_all();
+}
+
+} // namespace fb
@@ -0,0 +1,132 @@
+/// \file writer.hpp
+/// This file contains a writer of entries to a file from a background
+/// thread, so producers never wait for file I/O.
+
+#pragma once
+#include "ring_buffer.hpp"
+
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace fb
+{
+
+/// Writes entries to a file from a background thread. Producers
+/// push entries to a lock-free ring buffer and never block. Entries
+/// are dropped (and counted) when the buffer is full. All pushed
+/// entries are written before destruction.
+///
+/// \code{.cpp}
+///     fb::background_writer<std::string> w("out.log", 1024,
+///         [](std::ostream& os, const std::string& s) { os << s << '\n'; });
+///     w.push("first line");
+/// \endcode
+///
+/// \tparam T - Entry type, must be default constructible
+///             and move assignable.
+///
+template <class T>
+struct background_writer
+{
+    /// Function writing one entry to the file.
+    using format_t = std::function<void(std::ostream&, const T&)>;
+
+    /// Open the file and start writer thread. Check is_open()
+    /// for the result.
+    ///
+    /// \param[in] path - Path to the file.
+    /// \param[in] capacity - Maximum number of entries waiting.
+    /// \param[in] format - Function writing one entry.
+    /// \param[in] mode - File open mode (optional, default is append).
+    ///
+    background_writer(const std::string& path, size_t capacity, format_t format,
+        std::ios::openmode mode = std::ios::app)
+    : _file(path, mode)
+    , _queue(capacity)
+    , _format(std::move(format))
+    {
+        if (_file)
+            _thread = std::thread(&background_writer::run, this);
+    }
+
+    /// Write all pushed entries and stop.
+    ~background_writer() noexcept
+    {
+        _stop = true;
+        _cv.notify_one();
+        if (_thread.joinable())
+            _thread.join();
+    }
+
+    background_writer(const background_writer&) = delete;
+    background_writer& operator=(const background_writer&) = delete;
+
+    /// Checks if file was opened.
+    bool is_open() const noexcept
+    { return _file.is_open(); }
+
+    /// Push entry for writing (never blocks).
+    ///
+    /// \return false if entry is dropped (buffer full).
+    ///
+    bool push(T&& entry) noexcept
+    {
+        if (_queue.try_push(std::move(entry))) {
+            _cv.notify_one();
+            return true;
+        }
+        ++_dropped;
+        return false;
+    }
+
+    /// Number of entries dropped due to full buffer.
+    size_t dropped() const noexcept
+    { return _dropped; }
+
+    /// Number of entries written to the file.
+    size_t written() const noexcept
+    { return _written; }
+
+private:
+    /// Background thread.
+    void run()
+    {
+        T entry;
+        for (;;) {
+            // Read stop flag before draining so the last
+            // entries are written too
+            bool stop = _stop;
+            while (_queue.try_pop(entry)) {
+                _format(_file, entry);
+                ++_written;
+            }
+            _file.flush();
+            if (stop)
+                break;
+
+            // Producers notify without lock, so the wake up
+            // may be missed, wait with timeout
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cv.wait_for(lock, std::chrono::milliseconds(100),
+                [this] { return _stop || _queue.size(); });
+        }
+    }
+
+    std::ofstream _file;
+    ring_buffer<T> _queue;
+    format_t _format;
+
+    std::atomic<size_t> _dropped = 0;
+    std::atomic<size_t> _written = 0;
+    std::atomic<bool> _stop = false;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::thread _thread;
+};
+
+} // namespace fb
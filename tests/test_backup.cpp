@@ -0,0 +1,127 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "firebird.hpp"
+
+using namespace std::literals;
+
+// Requests are built without a server, service is not connected
+static fb::service svc("localhost");
+
+
+TEST_CASE("testing backup request")
+{
+    fb::backup_service bs(svc);
+    CHECK   (bs.backup_request("employee").data() ==
+             "\x01"
+             "\x6a\x08\x00" "employee"
+             "\x05\x06\x00" "stdout"sv);
+
+    fb::backup_service::settings s;
+    s.backup_options = 0x20;
+    CHECK   (fb::backup_service(svc, s).backup_request("employee").data() ==
+             "\x01"
+             "\x6a\x08\x00" "employee"
+             "\x05\x06\x00" "stdout"
+             "\x6c\x20\x00\x00\x00"sv);
+}
+
+TEST_CASE("testing restore request")
+{
+    fb::backup_service bs(svc);
+    CHECK   (bs.restore_request("employee").data() ==
+             "\x02"
+             "\x05\x05\x00" "stdin"
+             "\x6a\x08\x00" "employee"
+             "\x6c\x00\x20\x00\x00"sv);
+
+    fb::backup_service::settings s;
+    s.restore_options = isc_spb_res_replace;
+    s.page_size = 8192;
+    s.buffers = 2048;
+    s.verbose = true;
+    CHECK   (fb::backup_service(svc, s).restore_request("employee").data() ==
+             "\x02"
+             "\x05\x05\x00" "stdin"
+             "\x6a\x08\x00" "employee"
+             "\x6c\x00\x10\x00\x00"
+             "\x0a\x00\x20\x00\x00"
+             "\x09\x00\x08\x00\x00"
+             "\x6b"sv);
+}
+
+TEST_CASE("testing parallel workers")
+{
+    fb::backup_service::settings s;
+    s.parallel_workers = 4;
+    fb::backup_service bs(svc, s);
+
+    #ifdef isc_spb_bkp_parallel_workers
+    auto req = bs.backup_request("employee").data();
+    CHECK   (req.substr(req.size() - 5) ==
+             std::string{ char(isc_spb_bkp_parallel_workers), 4, 0, 0, 0 });
+    req = bs.restore_request("employee").data();
+    CHECK   (req.substr(req.size() - 5) ==
+             std::string{ char(isc_spb_res_parallel_workers), 4, 0, 0, 0 });
+    #else
+    // Client library older than Firebird 5
+    CHECK_THROWS_AS(bs.backup_request("employee"), fb::exception);
+    CHECK_THROWS_AS(bs.restore_request("employee"), fb::exception);
+    #endif
+}
+
+TEST_CASE("testing nbackup request")
+{
+    CHECK   (fb::backup_service::nbackup_request("employee", "/b/e.nbk", 1).data() ==
+             "\x14"
+             "\x6a\x08\x00" "employee"
+             "\x06\x08\x00" "/b/e.nbk"
+             "\x05\x01\x00\x00\x00"sv);
+
+    CHECK   (fb::backup_service::nrestore_request("employee", { "a.nbk", "b.nbk" }).data() ==
+             "\x15"
+             "\x6a\x08\x00" "employee"
+             "\x06\x05\x00" "a.nbk"
+             "\x06\x05\x00" "b.nbk"sv);
+}
+
+TEST_CASE("testing stdin send buffer")
+{
+    CHECK   (fb::service::stdin_data("abc") == "\x3e\x03\x00" "abc"sv);
+    // End of data
+    CHECK   (fb::service::stdin_data({}) == "\x3e\x00\x00"sv);
+
+    // Length is 2 bytes little endian
+    std::string chunk(32000, 'x');
+    auto send = fb::service::stdin_data(chunk);
+    CHECK   (send.size() == 3 + 32000);
+    CHECK   (send.substr(0, 3) == "\x3e\x00\x7d"sv);
+    CHECK_THROWS_AS(fb::service::stdin_data(std::string(0x10000, 'x')), fb::exception);
+
+    CHECK   (fb::service::timeout(1) == "\x40\x04\x00\x01\x00\x00\x00"sv);
+}
+
+TEST_CASE("testing service output")
+{
+    // Server asks for data of its stdin
+    auto out = fb::service::parse("\x4e\x00\x7d\x00\x00" "\x01"sv);
+    CHECK   (out.stdin_request == 32000);
+    CHECK   (!out.is_finished());
+
+    // Verbose line of restore
+    out = fb::service::parse("\x3e\x05\x00" "hello" "\x01"sv);
+    CHECK   (out.data == "hello");
+    CHECK   (out.stdin_request == 0);
+
+    // Backup data
+    out = fb::service::parse("\x3f\x03\x00" "\x00\x01\x02" "\x01"sv);
+    CHECK   (out.data == "\x00\x01\x02"sv);
+
+    CHECK   (fb::service::parse("\x40\x01"sv).timeout);
+    CHECK   (fb::service::parse("\x3f\x00\x00\x02"sv).truncated);
+    CHECK   (fb::service::parse("\x3e\x00\x00\x01"sv).is_finished());
+
+    // Length beyond the buffer
+    CHECK_THROWS_AS(fb::service::parse("\x3e\x10\x00" "ab"sv), fb::exception);
+    CHECK_THROWS_AS(fb::service::parse("\x4e\x00"sv), fb::exception);
+}
@@ -0,0 +1,85 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "breaker.hpp"
+
+using namespace std::chrono_literals;
+using state = fb::circuit_breaker::state;
+
+
+TEST_CASE("testing open on failures")
+{
+    fb::circuit_breaker::settings s;
+    s.window = 4;
+    s.min_calls = 4;
+    s.failure_ratio = 0.5;
+    s.open_time = 1h;
+    fb::circuit_breaker b(s, "employee");
+
+    // Not enough calls to decide
+    for (int i = 0; i < 3; ++i) {
+        CHECK   (b.allow());
+        b.record(i == 0, 1ms);
+    }
+    CHECK   (b.current() == state::closed);
+
+    // Successes push failures out of window
+    for (int i = 0; i < 4; ++i) {
+        CHECK   (b.allow());
+        b.record(false, 1ms);
+    }
+    CHECK   (b.stats().failure_ratio == 0);
+
+    CHECK   (b.allow());
+    b.record(true, 1ms);
+    CHECK   (b.allow());
+    b.record(true, 1ms);
+    CHECK   (b.current() == state::open);
+
+    // Fail fast
+    CHECK   (!b.allow());
+    CHECK_THROWS_WITH   (b.call([] { return 1; }), "circuit breaker is open: employee");
+
+    auto st = b.stats();
+    CHECK   (st.opened == 1);
+    CHECK   (st.rejected == 2);
+    CHECK   (st.calls == 9);
+    CHECK   (st.failures == 3);
+}
+
+
+TEST_CASE("testing half-open probes")
+{
+    fb::circuit_breaker::settings s;
+    s.window = 2;
+    s.min_calls = 2;
+    s.open_time = 0s;
+    s.probes = 2;
+    fb::circuit_breaker b(s);
+
+    const ISC_STATUS lost[] = { 1, isc_network_error, 0 };
+    for (int i = 0; i < 2; ++i)
+        CHECK_THROWS    (b.call([&] { throw fb::exception(lost); }));
+    CHECK   (b.current() == state::open);
+
+    // Failed probe opens again
+    CHECK_THROWS    (b.call([&] { throw fb::exception(lost); }));
+    CHECK   (b.current() == state::open);
+    CHECK   (b.stats().opened == 2);
+
+    // Only given number of probes in flight
+    CHECK   (b.allow());
+    CHECK   (b.current() == state::half_open);
+    CHECK   (b.allow());
+    CHECK   (!b.allow());
+    b.record(false, 1ms);
+    b.record(false, 1ms);
+    CHECK   (b.current() == state::closed);
+
+    // Other errors mean the database is healthy
+    const ISC_STATUS deadlock[] = { 1, isc_deadlock, 0 };
+    for (int i = 0; i < 4; ++i)
+        CHECK_THROWS    (b.call([&] { throw fb::exception(deadlock); }));
+    CHECK   (b.current() == state::closed);
+    CHECK   (b.call([] { return 42; }) == 42);
+}
@@ -0,0 +1,120 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "firebird.hpp"
+#include <thread>
+
+using namespace std::chrono_literals;
+
+
+TEST_CASE("testing hits and misses")
+{
+    fb::query_cache cache;
+    CHECK   (cache.get<int>("a") == nullptr);
+
+    cache.put("a", std::make_shared<const int>(1));
+    auto v = cache.get<int>("a");
+    REQUIRE (v);
+    CHECK   (*v == 1);
+
+    // Replaced value
+    cache.put("a", std::make_shared<const int>(2));
+    CHECK   (*cache.get<int>("a") == 2);
+
+    auto st = cache.stats();
+    CHECK   (st.hits == 2);
+    CHECK   (st.misses == 1);
+    CHECK   (st.size == 1);
+
+    cache.clear();
+    CHECK   (cache.get<int>("a") == nullptr);
+    CHECK   (cache.stats().size == 0);
+}
+
+TEST_CASE("testing least recently used is evicted")
+{
+    fb::query_cache::settings s;
+    s.shards = 1;
+    s.capacity = 2;
+    fb::query_cache cache(s);
+
+    cache.put("a", std::make_shared<const int>(1));
+    cache.put("b", std::make_shared<const int>(2));
+    // Use "a", so "b" is the oldest
+    CHECK   (cache.get<int>("a"));
+    cache.put("c", std::make_shared<const int>(3));
+
+    CHECK   (cache.get<int>("a"));
+    CHECK   (cache.get<int>("b") == nullptr);
+    CHECK   (cache.get<int>("c"));
+    CHECK   (cache.stats().evictions == 1);
+    CHECK   (cache.stats().size == 2);
+}
+
+TEST_CASE("testing entries expire")
+{
+    fb::query_cache::settings s;
+    s.ttl = 20ms;
+    fb::query_cache cache(s);
+
+    cache.put("a", std::make_shared<const int>(1));
+    CHECK   (cache.get<int>("a"));
+    std::this_thread::sleep_for(30ms);
+    CHECK   (cache.get<int>("a") == nullptr);
+    CHECK   (cache.stats().expired == 1);
+    CHECK   (cache.stats().size == 0);
+}
+
+TEST_CASE("testing invalidation by tag")
+{
+    fb::query_cache cache;
+    cache.put("a", std::make_shared<const int>(1), { "country" });
+    cache.put("b", std::make_shared<const int>(2), { "country", "city" });
+    cache.put("c", std::make_shared<const int>(3), { "city" });
+
+    cache.invalidate("country");
+    CHECK   (cache.get<int>("a") == nullptr);
+    CHECK   (cache.get<int>("b") == nullptr);
+    CHECK   (cache.get<int>("c"));
+    CHECK   (cache.stats().invalidated == 2);
+
+    // Stored after invalidation is valid
+    cache.put("a", std::make_shared<const int>(4), { "country" });
+    CHECK   (*cache.get<int>("a") == 4);
+}
+
+TEST_CASE("testing cache key of parameters")
+{
+    std::string a, b, c;
+    fb::detail::append_key(a, 12);
+    fb::detail::append_key(a, "3");
+    fb::detail::append_key(b, 1);
+    fb::detail::append_key(b, "23");
+    CHECK   (a != b);
+
+    // Null is not an empty string
+    fb::detail::append_key(a, nullptr);
+    fb::detail::append_key(c, 12);
+    fb::detail::append_key(c, std::string("3"));
+    fb::detail::append_key(c, std::string());
+    CHECK   (a != c);
+
+    // Doubles are not rounded
+    std::string d1, d2, d3;
+    fb::detail::append_key(d1, 0.1234561);
+    fb::detail::append_key(d2, 0.1234564);
+    fb::detail::append_key(d3, 0.1234561);
+    CHECK   (d1 != d2);
+    CHECK   (d1 == d3);
+}
+
+// Database is not connected, failure is not cached
+TEST_CASE("testing failed query is not cached")
+{
+    fb::query_cache cache;
+    fb::cached_query<int, std::string> q(cache, fb::database("employee"),
+        "select id, name from country where id = ?");
+    CHECK_THROWS_AS(q.execute(1), fb::exception);
+    CHECK   (cache.stats().size == 0);
+    CHECK   (cache.stats().misses == 1);
+}
@@ -0,0 +1,131 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "firebird.hpp"
+#include <cstdio>
+
+using namespace std::chrono_literals;
+
+// Remove files created by a test, also when it fails
+struct temp_files
+{
+    ~temp_files()
+    {
+        for (auto& p : paths)
+            std::remove(p.c_str());
+    }
+
+    std::vector<std::string> paths;
+};
+
+static bool exists(const std::string& path)
+{ return std::ifstream(path).is_open(); }
+
+
+TEST_CASE("testing varint")
+{
+    std::stringstream ss;
+    for (uint64_t v : { 0ull, 127ull, 128ull, 300ull, ~0ull })
+        fb::detail::write_varint(ss, v);
+    CHECK   (ss.str().size() == 1 + 1 + 2 + 2 + 10);
+
+    uint64_t v;
+    for (uint64_t expected : { 0ull, 127ull, 128ull, 300ull, ~0ull }) {
+        REQUIRE (fb::detail::read_varint(ss, v));
+        CHECK   (v == expected);
+    }
+    CHECK_FALSE(fb::detail::read_varint(ss, v));
+}
+
+TEST_CASE("testing log round trip")
+{
+    const std::string path = "test_capture.fbwl";
+    temp_files files{ { path, path + "2" } };
+    {
+        fb::workload_capture cap(path);
+        // Rejected capture creates no file
+        CHECK_THROWS_AS(fb::workload_capture(path + "2"), fb::exception);
+        CHECK_FALSE(exists(path + "2"));
+        CHECK   (bool(fb::workload_capture::active()));
+        CHECK   (fb::workload_capture::is_active());
+
+        fb::workload_entry e;
+        e.kind = fb::workload_entry::start;
+        e.session = 7;
+        e.transaction = 1;
+        e.tpb = { isc_tpb_version3, isc_tpb_read };
+        cap.push(std::move(e));
+
+        for (int i = 0; i < 2; ++i) {
+            fb::workload_entry x;
+            x.session = 7;
+            x.transaction = 1;
+            x.offset = 10ms + i * 1ms;
+            x.elapsed = 250us;
+            x.sql = "select name from country where id = ?";
+            x.rows = 1;
+            x.params.resize(2);
+            x.params[0].type = SQL_LONG;
+            x.params[0].data = std::string("\x2a\0\0\0", 4);
+            cap.push(std::move(x));
+        }
+
+        fb::workload_entry c;
+        c.kind = fb::workload_entry::commit;
+        c.session = 7;
+        c.transaction = 1;
+        c.offset = 20ms;
+        cap.push(std::move(c));
+
+        // Nor truncates the log of the active one
+        std::this_thread::sleep_for(50ms);
+        CHECK_THROWS_AS(fb::workload_capture{ path }, fb::exception);
+    }
+    CHECK_FALSE(bool(fb::workload_capture::active()));
+    CHECK_FALSE(fb::workload_capture::is_active());
+
+    fb::workload_reader r(path);
+    fb::workload_entry e;
+    REQUIRE (r.next(e));
+    CHECK   (e.kind == fb::workload_entry::start);
+    CHECK   (e.session == 7);
+    CHECK   (e.tpb == std::vector<char>{ isc_tpb_version3, isc_tpb_read });
+
+    for (int i = 0; i < 2; ++i) {
+        REQUIRE (r.next(e));
+        CHECK   (e.kind == fb::workload_entry::execute);
+        CHECK   (e.sql == "select name from country where id = ?");
+        CHECK   (e.offset == 10ms + i * 1ms);
+        CHECK   (e.elapsed == 250us);
+        CHECK   (e.rows == 1);
+        REQUIRE (e.params.size() == 2);
+        CHECK   (e.params[0].type == SQL_LONG);
+        CHECK   (e.params[0].data.size() == 4);
+        CHECK   (e.params[1].is_null());
+    }
+
+    REQUIRE (r.next(e));
+    CHECK   (e.kind == fb::workload_entry::commit);
+    CHECK   (e.offset == 20ms);
+    CHECK_FALSE(r.next(e));
+}
+
+TEST_CASE("testing bad log")
+{
+    CHECK_THROWS_AS(fb::workload_reader("no_such_file.fbwl"), fb::exception);
+
+    const std::string path = "test_capture_bad.fbwl";
+    temp_files files{ { path } };
+    {
+        std::ofstream f(path);
+        f << "not a log";
+    }
+    CHECK_THROWS_WITH(fb::workload_reader{ path }, doctest::Contains("not a workload log"));
+    {
+        std::ofstream f(path, std::ios::binary);
+        f << "FBWL\x01\x04\x01";
+    }
+    fb::workload_reader r(path);
+    fb::workload_entry e;
+    CHECK_THROWS_WITH(r.next(e), doctest::Contains("corrupted"));
+}
@@ -0,0 +1,36 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "firebird.hpp"
+
+
+// Names are checked before database is used
+TEST_CASE("testing identifiers of install")
+{
+    fb::database db("employee");
+    CHECK_THROWS_WITH(fb::cdc_stream::install(db, "customer; drop table x", "id"),
+        doctest::Contains("bad identifier"));
+    CHECK_THROWS_WITH(fb::cdc_stream::install(db, "customer", "1id"),
+        doctest::Contains("bad identifier"));
+    CHECK_THROWS_WITH(fb::cdc_stream::uninstall(db, ""),
+        doctest::Contains("bad identifier"));
+
+    fb::cdc_stream::settings s;
+    s.event = "it's";
+    CHECK_THROWS_WITH(fb::cdc_stream::install(db, "customer", "cust_no", s),
+        doctest::Contains("bad event name"));
+
+    // Valid names, database is not connected
+    CHECK_THROWS_AS(fb::cdc_stream::install(db, "customer", "cust_no"), fb::exception);
+}
+
+TEST_CASE("testing stream needs connected database")
+{
+    CHECK_THROWS_AS(fb::cdc_stream(fb::database("employee"),
+        [](const std::vector<fb::cdc_change>&) { }), fb::exception);
+
+    fb::cdc_stream::settings s;
+    s.log_table = "log table";
+    CHECK_THROWS_WITH(fb::cdc_stream(fb::database("employee"),
+        [](const std::vector<fb::cdc_change>&) { }, s), doctest::Contains("bad identifier"));
+}
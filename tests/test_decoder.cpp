@@ -0,0 +1,113 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "firebird.hpp"
+#include "decoder.hpp"
+
+// As generated by fb_codegen
+struct country
+{
+    enum column : size_t
+    {
+        COUNTRY,
+        CURRENCY,
+        RATE,
+        POPULATION,
+    };
+
+    static constexpr std::array<std::string_view, 4> names = {
+        "COUNTRY",
+        "CURRENCY",
+        "RATE",
+        "POPULATION",
+    };
+
+    using decoders = std::tuple<
+        fb::column_decoder<SQL_VARYING, 0, false>,
+        fb::column_decoder<SQL_TEXT, 0, true>,
+        fb::column_decoder<SQL_INT64, -2, false>,
+        fb::column_decoder<SQL_LONG, 0, true>>;
+
+    std::string country_{};
+    std::optional<std::string> currency{};
+    fb::scaled_integer<int64_t> rate{ 0, -2 };
+    std::optional<int32_t> population{};
+
+    static country decode(const fb::sqlda& row)
+    {
+        country r;
+        r.country_ = std::tuple_element_t<COUNTRY, decoders>::decode(row[COUNTRY]);
+        r.currency = std::tuple_element_t<CURRENCY, decoders>::decode(row[CURRENCY]);
+        r.rate = std::tuple_element_t<RATE, decoders>::decode(row[RATE]);
+        r.population = std::tuple_element_t<POPULATION, decoders>::decode(row[POPULATION]);
+        return r;
+    }
+};
+
+// Row buffers as filled by the client library
+struct fake_row
+{
+    fake_row()
+    : da(4)
+    {
+        da.resize(4);
+        auto set = [&](size_t i, short type, void* data, short len, short scale = 0) {
+            auto v = da[i].handle();
+            v->sqltype = type | 1;
+            v->sqldata = static_cast<char*>(data);
+            v->sqllen = len;
+            v->sqlscale = scale;
+            v->sqlind = &nulls[i];
+        };
+        set(0, SQL_VARYING, &name, 10);
+        set(1, SQL_TEXT, currency, 3);
+        set(2, SQL_INT64, &rate, 8, -2);
+        set(3, SQL_LONG, &population, 4);
+    }
+
+    fb::sqlda da;
+    struct { short len = 6; char str[10] = "Sweden"; } name;
+    char currency[3] = { 'S', 'E', 'K' };
+    int64_t rate = 1234;
+    int32_t population = 10'000'000;
+    short nulls[4] = { 0, 0, 0, 0 };
+};
+
+
+TEST_CASE("testing decoders")
+{
+    fake_row row;
+    auto c = country::decode(row.da);
+    CHECK   (c.country_ == "Sweden");
+    CHECK   (c.currency == "SEK");
+    CHECK   (c.rate.get<double>() == doctest::Approx(12.34));
+    CHECK   (c.population == 10'000'000);
+
+    row.nulls[1] = row.nulls[3] = -1;
+    c = country::decode(row.da);
+    CHECK_FALSE(c.currency);
+    CHECK_FALSE(c.population);
+
+    // Not nullable
+    row.nulls[0] = -1;
+    CHECK_THROWS_WITH(country::decode(row.da), doctest::Contains("unexpected null"));
+}
+
+TEST_CASE("testing schema drift")
+{
+    fake_row row;
+    CHECK_NOTHROW(fb::check_fields<country>(row.da));
+
+    // Scale changed from NUMERIC(18, 2) to NUMERIC(18, 4)
+    row.da[2].handle()->sqlscale = -4;
+    CHECK_THROWS_WITH(fb::check_fields<country>(row.da), doctest::Contains("\"RATE\""));
+    row.da[2].handle()->sqlscale = -2;
+
+    // Type changed from INTEGER to BIGINT
+    row.da[3].handle()->sqltype = SQL_INT64 | 1;
+    CHECK_THROWS_WITH(fb::check_fields<country>(row.da), doctest::Contains("\"POPULATION\""));
+
+    // Column dropped
+    row.da.resize(3);
+    CHECK_THROWS_WITH(fb::check_fields<country>(row.da), doctest::Contains("3 columns"));
+}
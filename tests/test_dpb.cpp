@@ -0,0 +1,66 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "dpb.hpp"
+
+using namespace std::literals;
+
+
+static std::string build(const fb::dpb& b)
+{
+    auto buf = b.build();
+    return std::string(buf.begin(), buf.end());
+}
+
+
+TEST_CASE("testing dpb encoding")
+{
+    auto buf = build(fb::dpb()
+        .user("sysdba")
+        .num_buffers(50000)
+        .no_garbage_collect());
+
+    CHECK   (buf ==
+        "\x01"
+        "\x1c\x06sysdba"
+        "\x05\x04\x50\xc3\x00\x00"
+        "\x10\x00"sv);
+
+    // Later value replaces earlier one
+    buf = build(fb::dpb().num_buffers(1).num_buffers(2));
+    CHECK   (buf == "\x01\x05\x04\x02\x00\x00\x00"sv);
+}
+
+
+TEST_CASE("testing dpb config and wide format")
+{
+    auto buf = build(fb::dpb()
+        .parallel_workers(4)
+        .wire_compression(true)
+        .parallel_workers(2));
+    CHECK   (buf == "\x01\x57\x2b"
+        "ParallelWorkers = 2\nWireCompression = true\n"sv);
+
+    // Values longer than 255 bytes need 4 bytes lengths
+    std::string role(300, 'r');
+    buf = build(fb::dpb().user("u").add(isc_dpb_password, role));
+    REQUIRE (buf.size() == 1 + 5 + 1 + 5 + 300);
+    CHECK   (buf.substr(0, 7) == "\x02\x1c\x01\x00\x00\x00u"sv);
+    CHECK   (buf.substr(7, 5) == "\x1d\x2c\x01\x00\x00"sv);
+}
+
+
+TEST_CASE("testing dpb profiles")
+{
+    auto buf = build(fb::dpb().apply(fb::dpb::profile::bulk_load));
+    CHECK   (buf.find("\x10\x00"sv) != buf.npos);
+    // Forced writes change the database, set only explicitly
+    CHECK   (buf.find("\x18\x04"sv) == buf.npos);
+    CHECK   (build(fb::dpb().apply(fb::dpb::profile::oltp)).find("\x18\x04"sv) == buf.npos);
+    buf = build(fb::dpb().apply(fb::dpb::profile::bulk_load).force_write(false));
+    CHECK   (buf.find("\x18\x04\x00\x00\x00\x00"sv) != buf.npos);
+    // Triggers are disabled only explicitly
+    CHECK   (buf.find(char(isc_dpb_no_db_triggers)) == buf.npos);
+    buf = build(fb::dpb().apply(fb::dpb::profile::bulk_load).no_db_triggers());
+    CHECK   (buf.find(char(isc_dpb_no_db_triggers)) != buf.npos);
+}
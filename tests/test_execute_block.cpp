@@ -0,0 +1,106 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "firebird.hpp"
+
+// Described parameters as returned by isc_dsql_describe_bind
+static fb::sqlda make_params(std::initializer_list<XSQLVAR> vars)
+{
+    fb::sqlda da(vars.size());
+    da.resize(vars.size());
+    auto it = da.begin();
+    for (auto& v : vars)
+        *(it++)->handle() = v;
+    return da;
+}
+
+static XSQLVAR var(short type, short len, short scale = 0, short subtype = 0)
+{
+    XSQLVAR v = { };
+    v.sqltype = type | 1;
+    v.sqllen = len;
+    v.sqlscale = scale;
+    v.sqlsubtype = subtype;
+    return v;
+}
+
+
+TEST_CASE("testing type declarations")
+{
+    auto decl = [](XSQLVAR v) {
+        return fb::execute_block::type_decl(fb::sqlvar(&v));
+    };
+
+    CHECK   (decl(var(SQL_SHORT, 2)) == "SMALLINT");
+    CHECK   (decl(var(SQL_LONG, 4)) == "INTEGER");
+    CHECK   (decl(var(SQL_INT64, 8)) == "BIGINT");
+    CHECK   (decl(var(SQL_INT64, 8, -2)) == "NUMERIC(18, 2)");
+    CHECK   (decl(var(SQL_LONG, 4, -3)) == "NUMERIC(9, 3)");
+    CHECK   (decl(var(SQL_TEXT, 3)) == "CHAR(3) CHARACTER SET NONE");
+    CHECK   (decl(var(SQL_VARYING, 20)) == "VARCHAR(20) CHARACTER SET NONE");
+    CHECK   (decl(var(SQL_VARYING, 16, 0, 1)) == "VARCHAR(16) CHARACTER SET OCTETS");
+    // Length in characters, collation in high byte of subtype
+    CHECK   (decl(var(SQL_VARYING, 80, 0, 4)) == "VARCHAR(20) CHARACTER SET UTF8");
+    CHECK   (decl(var(SQL_TEXT, 30, 0, 3 | 0x100)) == "CHAR(10) CHARACTER SET UNICODE_FSS");
+    CHECK   (decl(var(SQL_TEXT, 5, 0, 52)) == "CHAR(5) CHARACTER SET WIN1251");
+    CHECK   (decl(var(SQL_DOUBLE, 8)) == "DOUBLE PRECISION");
+    CHECK   (decl(var(SQL_TIMESTAMP, 8)) == "TIMESTAMP");
+    CHECK   (decl(var(SQL_BLOB, 8, 4, 1)) == "BLOB SUB_TYPE 1 CHARACTER SET UTF8");
+    CHECK   (decl(var(SQL_BLOB, 8, 0, 0)) == "BLOB SUB_TYPE 0");
+
+    CHECK_THROWS    (decl(var(SQL_ARRAY, 8)));
+    CHECK_THROWS    (decl(var(SQL_VARYING, 8, 0, 250)));
+}
+
+
+TEST_CASE("testing block generation")
+{
+    auto params = make_params({ var(SQL_LONG, 4), var(SQL_VARYING, 20) });
+    fb::execute_block block("insert into t (a, b) values (?, ?);", params);
+
+    CHECK   (block.columns() == 2);
+    // 255 parameters limit
+    CHECK   (block.max_rows() == 127);
+
+    // Single row is the statement itself
+    CHECK   (block.sql(1) == "insert into t (a, b) values (?, ?)");
+
+    CHECK   (block.sql(2) ==
+        "EXECUTE BLOCK (P0_0 INTEGER = ?, P0_1 VARCHAR(20) CHARACTER SET NONE = ?, "
+        "P1_0 INTEGER = ?, P1_1 VARCHAR(20) CHARACTER SET NONE = ?)\n"
+        "AS BEGIN\n"
+        "insert into t (a, b) values (:P0_0, :P0_1);\n"
+        "insert into t (a, b) values (:P1_0, :P1_1);\n"
+        "END");
+
+    // Every generated statement fits in the limits
+    CHECK   (block.sql(block.max_rows()).size() <= fb::execute_block::max_length);
+}
+
+
+TEST_CASE("testing placeholders")
+{
+    auto params = make_params({ var(SQL_LONG, 4) });
+
+    // Question marks in literals, quoted names and comments are not placeholders
+    fb::execute_block block(
+        "update \"T?\" set a = 'it''s?' /* ? */ where id = ? -- ?", params);
+    CHECK   (block.sql(2).find(
+        "update \"T?\" set a = 'it''s?' /* ? */ where id = :P0_0 -- ?") != std::string::npos);
+
+    // Wrong number of placeholders
+    CHECK_THROWS    (fb::execute_block("delete from t", params));
+    CHECK_THROWS    (fb::execute_block("delete from t where a = ? or b = ?", params));
+}
+
+
+TEST_CASE("testing limits")
+{
+    // Large parameters are limited by message size
+    auto params = make_params({ var(SQL_VARYING, 8000), var(SQL_LONG, 4) });
+    fb::execute_block block("insert into t values (?, ?)", params);
+    CHECK   (block.max_rows() == 8);
+
+    // Explicit limit
+    CHECK   (fb::execute_block("insert into t values (?, ?)", params, 3).max_rows() == 3);
+}
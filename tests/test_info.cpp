@@ -0,0 +1,130 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "info.hpp"
+#include "stats.hpp"
+
+using namespace std::literals;
+
+
+TEST_CASE("testing info_reader")
+{
+    // Statement type (4 bytes) and nested record counters
+    auto buf =
+        "\x15\x04\x00\x03\x00\x00\x00"
+        "\x17\x0f\x00"
+            "\x0d\x04\x00\x00\x00\x00\x00"
+            "\x0f\x04\x00\x2a\x01\x00\x00"
+            "\x01"
+        "\x01"sv;
+
+    fb::info_reader r(buf);
+
+    REQUIRE (r.next());
+    CHECK   (r.item() == isc_info_sql_stmt_type);
+    CHECK   (r.integer() == isc_info_sql_stmt_update);
+
+    REQUIRE (r.next());
+    CHECK   (r.item() == isc_info_sql_records);
+
+    auto cnt = r.nested();
+    REQUIRE (cnt.next());
+    CHECK   (cnt.item() == isc_info_req_select_count);
+    CHECK   (cnt.integer() == 0);
+    REQUIRE (cnt.next());
+    CHECK   (cnt.item() == isc_info_req_update_count);
+    CHECK   (cnt.integer() == 298);
+    CHECK   (!cnt.next());
+
+    CHECK   (!r.next());
+}
+
+
+TEST_CASE("testing truncated buffer")
+{
+    auto truncated = "\x15\x04\x00\x03\x00\x00\x00\x02"sv;
+    CHECK   (fb::info_reader::is_truncated(truncated));
+    CHECK   (!fb::info_reader::is_truncated("\x15\x04\x00\x03\x00\x00\x00\x01"sv));
+
+    fb::info_reader r(truncated);
+    CHECK   (r.next());
+    CHECK_THROWS    (r.next());
+
+    // Length beyond the buffer
+    CHECK_THROWS    (fb::info_reader("\x16\x10\x00\x01"sv).next());
+}
+
+
+TEST_CASE("testing records buffer")
+{
+    // As returned for an update of 3 rows which read 5
+    auto buf =
+        "\x17\x1d\x00"
+            "\x0d\x04\x00\x05\x00\x00\x00"
+            "\x0e\x04\x00\x00\x00\x00\x00"
+            "\x0f\x04\x00\x03\x00\x00\x00"
+            "\x10\x04\x00\x00\x00\x00\x00"
+            "\x01"
+        "\x01"sv;
+
+    auto cnt = fb::detail::read_records(buf);
+    CHECK   (cnt.selected == 5);
+    CHECK   (cnt.inserted == 0);
+    CHECK   (cnt.updated == 3);
+    CHECK   (cnt.deleted == 0);
+
+    // No counters
+    cnt = fb::detail::read_records("\x01"sv);
+    CHECK   (cnt.selected + cnt.inserted + cnt.updated + cnt.deleted == 0);
+    CHECK_THROWS    (fb::detail::read_records("\x17\x1d\x00\x0d"sv));
+}
+
+
+TEST_CASE("testing plan buffer")
+{
+    auto plan = "\nPLAN (EMPLOYEE INDEX (RDB$PRIMARY7))"sv;
+    std::string buf = { isc_info_sql_get_plan, char(plan.size()), 0 };
+    buf.append(plan).push_back(isc_info_end);
+
+    CHECK   (fb::detail::read_plan(buf, isc_info_sql_get_plan) ==
+             "PLAN (EMPLOYEE INDEX (RDB$PRIMARY7))");
+    // Other plan not requested
+    CHECK   (fb::detail::read_plan(buf, isc_info_sql_explain_plan).empty());
+
+    // Explained plan has several lines
+    plan = "\nSelect Expression\n    -> Table \"EMPLOYEE\" Full Scan"sv;
+    buf = { isc_info_sql_explain_plan, char(plan.size()), 0 };
+    buf.append(plan).push_back(isc_info_end);
+    CHECK   (fb::detail::read_plan(buf, isc_info_sql_explain_plan) ==
+             "Select Expression\n    -> Table \"EMPLOYEE\" Full Scan");
+
+    // Truncated plan
+    CHECK_THROWS    (fb::detail::read_plan("\x16\x10\x00\nPLAN"sv, isc_info_sql_get_plan));
+}
+
+
+TEST_CASE("testing database_info delta")
+{
+    fb::database_info a;
+    a.page_size = 8192;
+    a.reads = 100;
+    a.fetches = 1000;
+    a.writes = 10;
+
+    fb::database_info b = a;
+    b.reads = 150;
+    b.fetches = 2000;
+    b.writes = 30;
+    b.taken = a.taken + std::chrono::seconds(2);
+
+    auto d = b - a;
+    CHECK   (d.page_size == 8192);
+    CHECK   (d.reads == 50);
+    CHECK   (d.fetches == 1000);
+    CHECK   (d.hit_ratio() == doctest::Approx(0.95));
+    CHECK   (d.per_second(d.writes) == doctest::Approx(10.0));
+
+    // Not a delta
+    CHECK   (a.per_second(a.writes) == 0.0);
+    CHECK   (fb::database_info().hit_ratio() == 1.0);
+}
@@ -0,0 +1,72 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "firebird.hpp"
+#include <thread>
+
+using currency_mirror = fb::table_mirror<std::string, std::tuple<std::string, double>>;
+
+
+TEST_CASE("testing column offsets")
+{
+    CHECK   ((std::is_same_v<
+        decltype(fb::detail::offset_sequence<2>(std::index_sequence_for<int, int>())),
+        std::index_sequence<2, 3>>));
+    CHECK   ((std::is_same_v<
+        decltype(fb::detail::offset_sequence<3>(std::index_sequence<>())),
+        std::index_sequence<>>));
+}
+
+TEST_CASE("testing rcu pointer")
+{
+    struct value
+    {
+        ~value() { alive = false; }
+        std::atomic<bool> alive = true;
+        int n;
+    };
+
+    fb::detail::rcu_ptr<value> ptr;
+    {
+        fb::detail::rcu_ptr<value>::reader r(ptr);
+        CHECK   (r.get() == nullptr);
+    }
+    ptr.store(std::unique_ptr<const value>(new value{ true, 0 }));
+
+    // Readers never see a freed value, writer publishes new ones
+    std::atomic<bool> stop = false;
+    std::atomic<int> freed = 0, last = 0;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&] {
+            while (!stop) {
+                fb::detail::rcu_ptr<value>::reader r(ptr);
+                if (!r.get()->alive)
+                    ++freed;
+                last = r.get()->n;
+            }
+        });
+    }
+    for (int n = 1; n <= 1000; ++n)
+        ptr.store(std::unique_ptr<const value>(new value{ true, n }));
+    stop = true;
+    for (auto& t : readers)
+        t.join();
+
+    CHECK   (freed == 0);
+    CHECK   (ptr.get()->n == 1000);
+}
+
+// Database is not connected
+TEST_CASE("testing failed load")
+{
+    currency_mirror::source src {
+        "select code, version, name, rate from currency",
+        "select code, version, deleted, name, rate from currency_log where version > ?",
+        "" };
+    CHECK_THROWS_AS(currency_mirror(fb::database("employee"), src), fb::exception);
+
+    // Listener fails first
+    src.event = "currency_changed";
+    CHECK_THROWS_AS(currency_mirror(fb::database("employee"), src), fb::exception);
+}
@@ -0,0 +1,38 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "firebird.hpp"
+
+
+TEST_CASE("testing monitoring snapshot delta")
+{
+    fb::mon_snapshot a;
+    a.attachments.resize(1);
+    a.attachments[0].id = 7;
+    a.attachments[0].io.page_reads = 100;
+    a.statements.resize(2);
+    a.statements[0].id = 1;
+    a.statements[0].sql = "select 1 from rdb$database";
+    a.statements[0].io.page_fetches = 10;
+    a.statements[1].id = 2;
+    a.statements[1].sql = "select 2 from rdb$database";
+    a.statements[1].records.idx_reads = 5;
+
+    fb::mon_snapshot b = a;
+    b.taken = a.taken + std::chrono::seconds(1);
+    b.attachments[0].io.page_reads = 150;
+    b.attachments[0].memory.used = 4096;
+    b.statements[0].io.page_fetches = 25;
+    // Statement id reused for another statement
+    b.statements[1].sql = "select 3 from rdb$database";
+    b.statements[1].records.idx_reads = 8;
+
+    auto d = b - a;
+    CHECK   (d.interval == std::chrono::seconds(1));
+    REQUIRE (d.attachments.size() == 1);
+    CHECK   (d.attachments[0].io.page_reads == 50);
+    CHECK   (d.attachments[0].memory.used == 4096);
+    REQUIRE (d.statements.size() == 2);
+    CHECK   (d.statements[0].io.page_fetches == 15);
+    CHECK   (d.statements[1].records.idx_reads == 8);
+}
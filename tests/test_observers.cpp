@@ -0,0 +1,120 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "observers.hpp"
+
+// Forwards calls to both observers under test
+struct test_observer
+{
+    static constexpr bool enabled = true;
+
+    static void before(const fb::api_call& call) noexcept
+    {
+        fb::counting_observer::before(call);
+        fb::timing_observer::before(call);
+    }
+
+    static void after(const fb::api_call& call) noexcept
+    {
+        fb::counting_observer::after(call);
+        fb::timing_observer::after(call);
+    }
+};
+
+#define FB_API_OBSERVER test_observer
+#include "firebird.hpp"
+
+#include <sstream>
+
+using namespace std::chrono_literals;
+using namespace std::literals;
+
+// Completed call of a function
+static fb::api_call call(fb::api_function fn, std::chrono::nanoseconds duration,
+    const ISC_STATUS* status)
+{
+    fb::api_call ret;
+    ret.function = fn;
+    ret.duration = duration;
+    ret.status_vector = status;
+    return ret;
+}
+
+static const ISC_STATUS ok[] = { 1, 0, 0 };
+static const ISC_STATUS failed[] = { 1, 335544721, 0 };
+
+
+TEST_CASE("testing api function identity")
+{
+    static_assert(fb::api_id<isc_dsql_fetch> == fb::api_function::isc_dsql_fetch);
+    static_assert(fb::api_id<isc_service_start> == fb::api_function::isc_service_start);
+    static_assert(fb::api_id<fb_cancel_operation> == fb::api_function::fb_cancel_operation);
+    static_assert(fb::api_name(fb::api_id<isc_service_attach>) == "isc_service_attach"sv);
+    static_assert(fb::api_name(fb::api_function::unknown) == "unknown"sv);
+
+    CHECK   (call(fb::api_function::isc_dsql_fetch, 0ns, failed).error_code() == 335544721);
+    CHECK   (call(fb::api_function::isc_dsql_fetch, 0ns, ok).error_code() == 0);
+    CHECK   (!fb::api_call().failed());
+}
+
+TEST_CASE("testing counting observer")
+{
+    fb::counting_observer::reset();
+
+    fb::counting_observer::after(call(fb::api_function::isc_dsql_fetch, 0ns, ok));
+    fb::counting_observer::after(call(fb::api_function::isc_dsql_fetch, 0ns, ok));
+    fb::counting_observer::after(call(fb::api_function::isc_dsql_fetch, 0ns, failed));
+
+    auto c = fb::counting_observer::get(fb::api_function::isc_dsql_fetch);
+    CHECK   (c.calls == 3);
+    CHECK   (c.errors == 1);
+    CHECK   (fb::counting_observer::get(fb::api_function::isc_dsql_execute).calls == 0);
+
+    // Only called functions are printed
+    std::ostringstream os;
+    fb::counting_observer::print(os);
+    CHECK   (os.str() == "isc_dsql_fetch calls=3 errors=1\n");
+
+    fb::counting_observer::reset();
+    CHECK   (fb::counting_observer::get(fb::api_function::isc_dsql_fetch).calls == 0);
+}
+
+TEST_CASE("testing timing observer")
+{
+    fb::timing_observer::reset();
+
+    fb::timing_observer::after(call(fb::api_function::isc_dsql_execute, 10us, ok));
+    fb::timing_observer::after(call(fb::api_function::isc_dsql_execute, 30us, failed));
+    fb::timing_observer::after(call(fb::api_function::isc_dsql_execute, 20us, ok));
+
+    auto t = fb::timing_observer::get(fb::api_function::isc_dsql_execute);
+    CHECK   (t.calls == 3);
+    CHECK   (t.errors == 1);
+    CHECK   (t.total == 60us);
+    CHECK   (t.max == 30us);
+    CHECK   (t.average() == 20us);
+    CHECK   (fb::timing_observer::get(fb::api_function::isc_dsql_fetch).average() == 0ns);
+
+    std::ostringstream os;
+    fb::timing_observer::print(os);
+    CHECK   (os.str() == "isc_dsql_execute calls=3 errors=1 total=60us avg=20us max=30us\n");
+
+    fb::timing_observer::reset();
+    CHECK   (fb::timing_observer::get(fb::api_function::isc_dsql_execute).max == 0ns);
+}
+
+// Database is not connected, the failed call is observed
+TEST_CASE("testing observed api call")
+{
+    fb::counting_observer::reset();
+    fb::timing_observer::reset();
+
+    CHECK_THROWS_AS(fb::database("employee").connect(), fb::exception);
+
+    auto c = fb::counting_observer::get(fb::api_function::isc_attach_database);
+    CHECK   (c.calls == 1);
+    CHECK   (c.errors == 1);
+    auto t = fb::timing_observer::get(fb::api_function::isc_attach_database);
+    CHECK   (t.calls == 1);
+    CHECK   (t.total > 0ns);
+}
@@ -0,0 +1,80 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "firebird.hpp"
+
+#include <optional>
+
+using namespace std::chrono_literals;
+
+
+// Connections are not opened, the pool does not use them
+static fb::database make_db()
+{ return fb::database("employee"); }
+
+
+TEST_CASE("testing connection failing rollback is discarded")
+{
+    size_t opened = 0;
+    fb::pool pool([&] { ++opened; return make_db(); }, 1);
+
+    // Not started transaction is not rolled back
+    pool.acquire();
+    pool.acquire();
+    CHECK   (opened == 1);
+    CHECK   (pool.size() == 1);
+
+    // Invalid transaction handle, rollback fails
+    {
+        auto conn = pool.acquire();
+        *conn.db().default_transaction().handle() = 1;
+    }
+    CHECK   (pool.size() == 0);
+    pool.acquire();
+    CHECK   (opened == 2);
+}
+
+
+TEST_CASE("testing reserved connections")
+{
+    fb::pool pool(make_db, 3, {
+        { "interactive", 1, 3, 4, 10ms },
+        { "batch",       0, 3, 1, 10ms },
+    });
+
+    // Batch can't take the connection reserved for interactive
+    auto b1 = pool.acquire("batch");
+    auto b2 = pool.acquire("batch");
+    CHECK_THROWS    (pool.acquire("batch"));
+    CHECK   (pool.stats(1).timeouts == 1);
+
+    auto i1 = pool.acquire("interactive");
+    CHECK   (pool.stats(0).active == 1);
+    CHECK   (pool.size() == 3);
+}
+
+
+TEST_CASE("testing load shedding and reuse")
+{
+    fb::pool pool(make_db, 1, {
+        { "batch", 0, 1, 1, 500ms },
+    });
+
+    std::optional<fb::pool::lease> l1(pool.acquire(0));
+
+    // One request may wait, the next one is rejected at once
+    std::thread waiter([&] { auto l = pool.acquire(0); });
+    while (pool.stats(0).waiting == 0)
+        std::this_thread::yield();
+    CHECK_THROWS    (pool.acquire(0));
+    CHECK   (pool.stats(0).rejected == 1);
+
+    l1.reset();
+    waiter.join();
+
+    auto s = pool.stats(0);
+    CHECK   (s.acquired == 2);
+    CHECK   (s.active == 0);
+    // Connection is reused
+    CHECK   (pool.size() == 1);
+}
@@ -0,0 +1,32 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "firebird.hpp"
+
+
+TEST_CASE("testing lost connection errors")
+{
+    const ISC_STATUS lost[] = { 1, isc_network_error, 0 };
+    fb::exception ex(lost);
+    CHECK   (ex.code() == isc_network_error);
+    CHECK   (ex.is_connection_lost());
+
+    const ISC_STATUS deadlock[] = { 1, isc_deadlock, 0 };
+    CHECK   (fb::exception(deadlock).code() == isc_deadlock);
+    CHECK   (!fb::exception(deadlock).is_connection_lost());
+
+    // Errors of the library itself have no code
+    CHECK   (fb::exception().code() == 0);
+}
+
+
+TEST_CASE("testing generation of attachment")
+{
+    fb::database db("/nonexistent/reconnect.fdb");
+    CHECK   (db.generation() == 0);
+
+    // Old handles are invalid even if attach fails
+    CHECK_THROWS    (db.reconnect());
+    CHECK   (db.generation() == 1);
+    CHECK   (*db.handle() == 0);
+}
@@ -0,0 +1,47 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "registry.hpp"
+
+
+TEST_CASE("testing transaction registry")
+{
+    auto a = fb::transaction_registry::add(10, 1);
+    auto b = fb::transaction_registry::add(11, 1);
+    CHECK   (a != b);
+    CHECK   (fb::transaction_registry::size() == 2);
+
+    // Oldest first
+    auto open = fb::transaction_registry::snapshot();
+    REQUIRE (open.size() == 2);
+    CHECK   (open[0].handle == 10);
+    CHECK   (open[1].handle == 11);
+    CHECK   (open[0].age() >= open[1].age());
+
+    fb::transaction_registry::remove(a);
+    open = fb::transaction_registry::snapshot();
+    REQUIRE (open.size() == 1);
+    CHECK   (open[0].id == b);
+
+    // Removing twice is harmless
+    fb::transaction_registry::remove(a);
+    fb::transaction_registry::remove(b);
+    CHECK   (fb::transaction_registry::size() == 0);
+}
+
+TEST_CASE("testing transaction registry is watched")
+{
+    CHECK_FALSE(fb::transaction_registry::is_watched());
+    fb::transaction_registry::watch();
+    fb::transaction_registry::watch();
+    fb::transaction_registry::unwatch();
+    CHECK   (fb::transaction_registry::is_watched());
+    fb::transaction_registry::unwatch();
+    CHECK_FALSE(fb::transaction_registry::is_watched());
+
+    // Ids are unique with or without registration
+    auto a = fb::transaction_registry::next_id();
+    auto b = fb::transaction_registry::add(12, 1);
+    CHECK   (a != b);
+    fb::transaction_registry::remove(b);
+}
@@ -0,0 +1,78 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "ring_buffer.hpp"
+
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+
+TEST_CASE("testing push and pop")
+{
+    // Capacity is rounded up to power of two
+    fb::ring_buffer<std::string> rb(3);
+    CHECK   (rb.capacity() == 4);
+
+    std::string val;
+    CHECK   (!rb.try_pop(val));
+
+    CHECK   (rb.try_push("a"));
+    CHECK   (rb.try_push("b"));
+    CHECK   (rb.try_push("c"));
+    CHECK   (rb.try_push("d"));
+    // Full
+    CHECK   (!rb.try_push("e"));
+    CHECK   (rb.size() == 4);
+
+    // First in, first out
+    CHECK   ((rb.try_pop(val) && val == "a"));
+    CHECK   (rb.try_push("e"));
+    CHECK   ((rb.try_pop(val) && val == "b"));
+    CHECK   ((rb.try_pop(val) && val == "c"));
+    CHECK   ((rb.try_pop(val) && val == "d"));
+    CHECK   ((rb.try_pop(val) && val == "e"));
+    CHECK   (!rb.try_pop(val));
+    CHECK   (rb.size() == 0);
+}
+
+
+TEST_CASE("testing multiple producers")
+{
+    constexpr int nr_threads = 4;
+    constexpr int per_thread = 10'000;
+
+    fb::ring_buffer<int> rb(64);
+    std::vector<std::thread> producers;
+    for (int t = 0; t < nr_threads; ++t) {
+        producers.emplace_back([&, t] {
+            for (int i = 0; i < per_thread; ++i) {
+                while (!rb.try_push(t * per_thread + i))
+                    std::this_thread::yield();
+            }
+        });
+    }
+
+    // Every value is received exactly once, and values
+    // of one producer are received in order
+    std::vector<int> last(nr_threads, -1);
+    std::vector<bool> seen(nr_threads * per_thread);
+    bool in_order = true;
+    for (int received = 0; received < nr_threads * per_thread;) {
+        int val;
+        if (!rb.try_pop(val))
+            continue;
+        in_order &= val > last[val / per_thread];
+        last[val / per_thread] = val;
+        seen[val] = true;
+        ++received;
+    }
+    for (auto& p : producers)
+        p.join();
+
+    CHECK   (in_order);
+    CHECK   (std::find(seen.begin(), seen.end(), false) == seen.end());
+    int val;
+    CHECK   (!rb.try_pop(val));
+}
@@ -0,0 +1,65 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "firebird.hpp"
+
+using namespace std::literals;
+
+
+TEST_CASE("testing read-only TPB")
+{
+    using fb::routed_database;
+
+    CHECK   (routed_database::is_read_only("\x03\x08\x0f\x11"sv));
+    CHECK   (!routed_database::is_read_only("\x03\x09\x0f\x11"sv));
+    // Default access mode is write
+    CHECK   (!routed_database::is_read_only("\x03\x02"sv));
+    // Table name of reserved table is skipped
+    CHECK   (!routed_database::is_read_only("\x03\x0a\x02\x08\x08\x09"sv));
+}
+
+
+TEST_CASE("testing routing")
+{
+    // Connections are not opened
+    fb::routed_database db(fb::database("primary"), {
+        fb::database("replica1"),
+        fb::database("replica2"),
+    });
+    CHECK   (db.size() == 2);
+    CHECK_THROWS    (db.replica(2));
+
+    using intent = fb::routed_database::intent;
+    CHECK   (*db.route(intent::write).handle() == *db.primary().handle());
+
+    // Reads are spread over idle replicas
+    auto r1 = db.route(intent::read).handle();
+    auto r2 = db.route(intent::read).handle();
+    CHECK   (r1 != r2);
+    CHECK   (r1 != db.primary().handle());
+    CHECK   (r2 != db.primary().handle());
+
+    auto st = db.stats(0);
+    CHECK   (st.healthy);
+    CHECK   (st.reads == 0);
+    CHECK   (st.in_flight == 0);
+}
+
+
+TEST_CASE("testing hedged read")
+{
+    fb::routed_database::settings s;
+    s.hedge = true;
+    s.hedge_after = 1h;
+    // Connections are not opened, reads fail
+    fb::routed_database db(fb::database("primary"), {
+        fb::database("replica1"),
+        fb::database("replica2"),
+    }, s);
+
+    // Failed read is hedged at once, on the calling thread
+    CHECK_THROWS_AS(db.read<int>("select 1 from rdb$database"), fb::exception);
+    CHECK   (db.stats(0).reads + db.stats(1).reads == 2);
+    CHECK   (db.stats(0).hedged + db.stats(1).hedged == 1);
+    CHECK   (db.stats(0).hedge_wins + db.stats(1).hedge_wins == 0);
+}
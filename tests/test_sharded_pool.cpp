@@ -0,0 +1,86 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "firebird.hpp"
+
+#include <set>
+
+using namespace std::chrono_literals;
+
+
+// Connections are not opened, the pool does not use them
+static fb::database make_db()
+{ return fb::database("employee"); }
+
+
+TEST_CASE("testing local cache and stealing")
+{
+    fb::sharded_pool::settings s;
+    s.shards = 2;
+    s.shard_cache = 2;
+    s.timeout = 10ms;
+    fb::sharded_pool pool(make_db, 3, s);
+
+    {
+        auto a = pool.acquire();
+        auto b = pool.acquire();
+        auto c = pool.acquire();
+        // All in use
+        CHECK_THROWS    (pool.acquire());
+        CHECK   (a->handle() != b->handle());
+    }
+    // Two returned to the own shard, one to the global list
+    { auto a = pool.acquire(); }
+    CHECK   (pool.stats().local == 1);
+
+    // Another thread (shard) takes from the global list, then steals
+    std::thread([&] {
+        auto a = pool.acquire();
+        auto b = pool.acquire();
+    }).join();
+    auto st = pool.stats();
+    CHECK   (st.global == 4);
+    CHECK   (st.stolen == 1);
+}
+
+
+TEST_CASE("testing connection failing rollback is reopened")
+{
+    size_t opened = 0;
+    fb::sharded_pool pool([&] { ++opened; return make_db(); }, 1);
+
+    // Not started transaction is not rolled back
+    pool.acquire();
+    pool.acquire();
+    CHECK   (opened == 1);
+
+    // Invalid transaction handle, rollback fails
+    {
+        auto conn = pool.acquire();
+        *conn->default_transaction().handle() = 1;
+    }
+    pool.acquire();
+    CHECK   (opened == 2);
+}
+
+
+TEST_CASE("testing many threads")
+{
+    fb::sharded_pool pool(make_db, 4);
+
+    std::atomic<int> in_use = 0;
+    std::atomic<bool> overused = false;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 2000; ++i) {
+                auto conn = pool.acquire();
+                overused = overused || ++in_use > 4;
+                --in_use;
+            }
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+    CHECK   (!overused);
+}
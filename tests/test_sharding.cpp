@@ -0,0 +1,74 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "firebird.hpp"
+
+
+TEST_CASE("testing shard map by range")
+{
+    auto by_int = fb::shard_map::range({ 1000, 5000 });
+    CHECK   (by_int.size() == 3);
+    CHECK   (by_int(-1) == 0);
+    CHECK   (by_int(999) == 0);
+    CHECK   (by_int(1000) == 1);
+    CHECK   (by_int(4999) == 1);
+    CHECK   (by_int(5000) == 2);
+    CHECK_THROWS    (by_int("acme"));
+
+    auto by_name = fb::shard_map::range(std::vector<std::string>{ "m" });
+    CHECK   (by_name("acme") == 0);
+    CHECK   (by_name("zeta") == 1);
+    CHECK_THROWS    (by_name(42));
+
+    CHECK_THROWS    (fb::shard_map::range({ 5000, 1000 }));
+}
+
+
+TEST_CASE("testing shard map by hash")
+{
+    auto m = fb::shard_map::hash(4);
+    CHECK   (m.size() == 4);
+
+    // Same key always on same shard, keys spread over all shards
+    std::vector<int> used(4);
+    for (int64_t key = 0; key < 100; ++key) {
+        CHECK   (m(key) == m(key));
+        ++used[m(key)];
+    }
+    CHECK   (std::count(used.begin(), used.end(), 0) == 0);
+    CHECK   (m("acme") == m(std::string("acme")));
+    CHECK_THROWS    (fb::shard_map::hash(0));
+}
+
+
+TEST_CASE("testing shard router")
+{
+    // Connections are not opened
+    CHECK_THROWS    (fb::shard_router({ fb::database("db1") }, fb::shard_map::hash(2)));
+
+    fb::shard_router router({ fb::database("db1"), fb::database("db2") },
+        fb::shard_map::range({ 1000 }));
+    CHECK   (router.size() == 2);
+    CHECK   (router.shard_for(10).handle() == router.shard(0).handle());
+    CHECK   (router.shard_for(1000).handle() == router.shard(1).handle());
+    CHECK_THROWS    (router.shard(2));
+}
+
+
+TEST_CASE("testing merge of sorted shards")
+{
+    using row = std::tuple<int, std::string>;
+    std::vector<std::vector<row>> parts = {
+        { { 1, "a1" }, { 4, "a4" }, { 4, "a4'" } },
+        { },
+        { { 2, "c2" }, { 4, "c4" }, { 9, "c9" } },
+    };
+
+    auto merged = fb::detail::merge_sorted(parts, fb::by_column<0>{});
+    std::vector<std::string> names;
+    for (auto& [id, name] : merged)
+        names.push_back(name);
+
+    // Equal keys keep order of shards
+    CHECK   (names == std::vector<std::string>{ "a1", "c2", "a4", "a4'", "c4", "c9" });
+}
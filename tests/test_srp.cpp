@@ -0,0 +1,83 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "firebird.hpp"
+#include "srp.hpp"
+
+template <class Hash>
+std::string hex_digest(std::string_view s)
+{
+    Hash h;
+    h.update(s);
+    auto d = h.digest();
+    return fb::detail::bigint::from_bytes(d.data(), d.size()).hex();
+}
+
+static const char* private_key =
+    "1234567890ABCDEF1234567890ABCDEF1234567890ABCDEF1234567890ABCDEF";
+static const char* server_key =
+    "82D232F552B489536A5D5B41BFF0B9D58053B570416597F87ABF0B39BF9C2E5D"
+    "B8C6E7AD7AFB2F532F1C141C6EB3DE269AEF02C6F23322DFBC282D1C1D638B2E"
+    "6BE3E70AC07BDEC1A6D7B02166B895122F451AA680D96E03B8B6AF273A0DC0C9"
+    "6783AE00D32E44E947B7450E64FEC521D9A7A02C02CE92E21A963EC0E1A46163";
+static const char* salt = "0123456789abcdef0123456789abcdef";
+
+
+TEST_CASE("testing srp primitives")
+{
+    using namespace fb::detail;
+    CHECK   (hex_digest<sha1>("abc") == "A9993E364706816ABA3E25717850C26C9CD0D89D");
+    CHECK   (hex_digest<sha256>("abc") ==
+             "BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD");
+    // Two blocks
+    CHECK   (hex_digest<sha1>(std::string(100, 'a')) == "7F9000257A4918D7072655EA468540CDCBD42E0C");
+
+    auto r = bigint::pow_mod(bigint::from_hex("123456789ABCDEF"),
+        bigint::from_hex("FEDCBA987654321"), fb::srp_client::prime());
+    CHECK   (r.hex().substr(0, 16) == "D1F0C3FAA5BFCB0F");
+    CHECK   (r.hex().substr(240) == "B1D084403DD93862");
+    CHECK   (bigint::from_hex("00FF").hex() == "FF");
+
+    char text[] = "Plaintext";
+    arc4 rc4(reinterpret_cast<const uint8_t*>("Key"), 3);
+    rc4.apply(text, 9);
+    CHECK   (bigint::from_bytes(reinterpret_cast<uint8_t*>(text), 9).hex() == "BBF316E8D940AF0AD3");
+}
+
+TEST_CASE("testing srp client proof")
+{
+    fb::srp_client srp(private_key);
+    CHECK   (srp.public_key().substr(0, 16) == "3E9E9625EA8A533C");
+
+    auto m = srp.proof("SYSDBA", "masterkey", salt, server_key, false);
+    CHECK   (m == "9DAC65B25A7316CAB881EDB4A5F69AA94A6FF757");
+    auto& k = srp.session_key();
+    CHECK   (fb::detail::bigint::from_bytes(k.data(), k.size()).hex() ==
+             "71EEEC02E31CD0A83D2E4DF956BAD619AD8013DC");
+
+    CHECK   (srp.proof("SYSDBA", "masterkey", salt, server_key, true) ==
+             "91D74AAA4B272A3B3A0BE07B3D8651E1E7991FC7841E4B62827479CD26982FB9");
+
+    CHECK_THROWS_WITH(srp.proof("SYSDBA", "masterkey", salt, "0", true),
+                      doctest::Contains("bad server key"));
+}
+
+TEST_CASE("testing srp session key agrees with server")
+{
+    using namespace fb::detail;
+    using sha1_int = int_hash<sha1>;
+    const bigint& n = fb::srp_client::prime();
+
+    // Server side, S = (A * v^u) ^ b
+    fb::srp_client srp;
+    bigint x = (sha1_int() << salt << (sha1_int() << "ALICE:secret").digest()).value();
+    bigint v = bigint::pow_mod(2, x, n);
+    bigint b = bigint::from_hex("C0FFEE");
+    bigint pub = (fb::srp_client::multiplier() * v + bigint::pow_mod(2, b, n)) % n;
+    bigint a = bigint::from_hex(srp.public_key());
+    bigint u = (sha1_int() << a << pub).value();
+    auto key = (sha1_int() << bigint::pow_mod(a * bigint::pow_mod(v, u, n) % n, b, n)).digest();
+
+    srp.proof("ALICE", "secret", salt, pub.hex(), true);
+    CHECK   (srp.session_key() == key);
+}
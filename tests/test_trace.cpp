@@ -0,0 +1,80 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "trace.hpp"
+
+#include <vector>
+
+
+TEST_CASE("testing fingerprint")
+{
+    CHECK   (fb::fingerprint("SELECT *\n  FROM t WHERE id IN (1, 2, 3)") ==
+             "select * from t where id in (?)");
+    CHECK   (fb::fingerprint("select a from t where s = 'it''s' -- comment\n and x = 1.5e3") ==
+             "select a from t where s = ? and x = ?");
+    CHECK   (fb::fingerprint("select \"Mixed\" from t2 /* c */ where b = ?") ==
+             "select \"Mixed\" from t2 where b = ?");
+
+    // Same fingerprint for different literals
+    CHECK   (fb::fingerprint_hash(fb::fingerprint("select 1 from rdb$database")) ==
+             fb::fingerprint_hash(fb::fingerprint("select 42 from RDB$DATABASE")));
+}
+
+
+TEST_CASE("testing trace parser")
+{
+    std::vector<fb::trace_event> events;
+    fb::trace_parser p([&](fb::trace_event&& ev) { events.push_back(std::move(ev)); });
+
+    const char* lines[] = {
+        "2024-01-31T10:00:00.1230 (1234:0x7f1a00) EXECUTE_STATEMENT_FINISH",
+        "\t/data/employee.fdb (ATT_12, SYSDBA:NONE, UTF8, TCPv4:127.0.0.1/50000)",
+        "\t\t(TRA_345, READ_COMMITTED | REC_VERSION | WAIT | READ_WRITE)",
+        "",
+        "Statement 56:",
+        "-------------------------------------------------------------------------------",
+        "select *",
+        "from country where currency = ?",
+        "^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^",
+        "param0 = varchar(10), \"Euro\"",
+        "",
+        "5 records fetched",
+        "      3 ms, 2 read(s), 20 fetch(es), 1 mark(s)",
+        "",
+        "2024-01-31T10:00:01.0000 (1234:0x7f1a00) FAILED EXECUTE_STATEMENT_FINISH",
+        "\t/data/employee.fdb (ATT_12, SYSDBA:NONE, UTF8, TCPv4:127.0.0.1/50000)",
+        "-------------------------------------------------------------------------------",
+        "delete from t",
+    };
+    for (auto line : lines)
+        p.feed(line);
+    CHECK   (events.size() == 1);
+    p.flush();
+    REQUIRE (events.size() == 2);
+
+    auto& ev = events[0];
+    CHECK   (ev.type == "EXECUTE_STATEMENT_FINISH");
+    CHECK   (!ev.failed);
+    CHECK   (ev.attachment_id == 12);
+    CHECK   (ev.transaction_id == 345);
+    CHECK   (ev.statement_id == 56);
+    CHECK   (ev.sql == "select *\nfrom country where currency = ?");
+    CHECK   (ev.records == 5);
+    CHECK   (ev.elapsed.count() == 3);
+    CHECK   (ev.reads == 2);
+    CHECK   (ev.fetches == 20);
+    CHECK   (ev.marks == 1);
+
+    CHECK   (events[1].failed);
+    CHECK   (events[1].sql == "delete from t");
+
+    fb::trace_aggregator agg;
+    agg.add(events[0]);
+    agg.add(events[0]);
+    agg.add(events[1]);
+    auto top = agg.top(1);
+    REQUIRE (top.size() == 1);
+    CHECK   (top[0].count == 2);
+    CHECK   (top[0].total.count() == 6);
+    CHECK   (top[0].sql == "select * from country where currency = ?");
+}
@@ -0,0 +1,114 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "firebird.hpp"
+#include "udr.hpp"
+
+// Subset of Firebird::IMessageMetadata used by udr_message
+struct fake_metadata
+{
+    struct field
+    {
+        const char* name;
+        unsigned type;
+        int scale;
+        unsigned length;
+        unsigned offset;
+        unsigned null_offset;
+    };
+
+    unsigned getCount(void*) const { return unsigned(fields.size()); }
+    const char* getField(void*, unsigned i) const { return fields[i].name; }
+    unsigned getType(void*, unsigned i) const { return fields[i].type; }
+    int getSubType(void*, unsigned) const { return 0; }
+    int getScale(void*, unsigned i) const { return fields[i].scale; }
+    unsigned getLength(void*, unsigned i) const { return fields[i].length; }
+    unsigned getOffset(void*, unsigned i) const { return fields[i].offset; }
+    unsigned getNullOffset(void*, unsigned i) const { return fields[i].null_offset; }
+
+    std::vector<field> fields;
+};
+
+// Message of (name varchar(10), price numeric(18, 2), qty integer, total double precision)
+struct fake_message
+{
+    fake_message()
+    {
+        meta.fields = {
+            { "NAME", SQL_VARYING, 0, 10, 0, 12 },
+            { "PRICE", SQL_INT64 | 1, -2, 8, 16, 24 },
+            { "QTY", SQL_LONG | 1, 0, 4, 28, 32 },
+            { "TOTAL", SQL_DOUBLE | 1, 0, 8, 40, 48 },
+        };
+    }
+
+    template <class T>
+    T& at(size_t offset)
+    { return *reinterpret_cast<T*>(buf + offset); }
+
+    fake_metadata meta;
+    alignas(8) char buf[56] = {};
+};
+
+
+TEST_CASE("testing udr message read")
+{
+    fake_message m;
+    fb::udr_message msg((void*)nullptr, &m.meta);
+    REQUIRE (msg.size() == 4);
+    msg.bind(m.buf);
+
+    m.at<short>(0) = 5;
+    std::memcpy(m.buf + 2, "apple", 5);
+    m.at<int64_t>(16) = 1250;
+    m.at<int32_t>(28) = 3;
+    m.at<short>(48) = -1;
+
+    CHECK   (msg[0].value<std::string>() == "apple");
+    CHECK   (msg["PRICE"].value<double>() == doctest::Approx(12.5));
+    CHECK   (msg[1].value<std::string>() == "12.50");
+    CHECK   (msg[2].value<int>() == 3);
+    CHECK   (msg[3].is_null());
+    CHECK   (msg[3].value_or(0.0) == 0.0);
+}
+
+TEST_CASE("testing udr message write")
+{
+    fake_message m;
+    fb::udr_message msg((void*)nullptr, &m.meta);
+    msg.bind(m.buf);
+    m.at<short>(32) = m.at<short>(48) = -1;
+
+    // Converted to the type and scale of the field
+    msg.set("NAME", "pear");
+    msg.set(1, 7.255);
+    msg.set(2, std::optional<int>(4));
+    msg.set(3, fb::scaled_integer<int64_t>(2903, -2));
+    CHECK   (m.at<short>(0) == 4);
+    CHECK   (std::string_view(m.buf + 2, 4) == "pear");
+    CHECK   (m.at<int64_t>(16) == 726);
+    CHECK   (m.at<int32_t>(28) == 4);
+    CHECK   (m.at<short>(32) == 0);
+    CHECK   (m.at<double>(40) == doctest::Approx(29.03));
+
+    msg.set_all("plum", fb::scaled_integer<int32_t>(3, 0), "12", nullptr);
+    CHECK   (m.at<int64_t>(16) == 300);
+    CHECK   (m.at<int32_t>(28) == 12);
+    CHECK   (m.at<short>(48) == -1);
+
+    // Copy a field of another message
+    fake_message m2;
+    fb::udr_message msg2((void*)nullptr, &m2.meta);
+    msg2.bind(m2.buf);
+    msg2.set(1, msg[1]);
+    CHECK   (m2.at<int64_t>(16) == 300);
+
+    // Declared length fits, one more byte does not
+    msg.set(0, "strawberry");
+    CHECK   (m.at<short>(0) == 10);
+    CHECK   (std::string_view(m.buf + 2, 10) == "strawberry");
+    CHECK   (msg[0].value<std::string>() == "strawberry");
+    CHECK_THROWS_WITH(msg.set(0, "watermelons"), doctest::Contains("too long"));
+    CHECK_THROWS_WITH(msg.set(2, int64_t(1) << 40), doctest::Contains("does not fit"));
+    CHECK_THROWS_WITH(msg.set_all(1, 2), doctest::Contains("2 values for 4 fields"));
+}
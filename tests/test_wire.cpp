@@ -0,0 +1,588 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "firebird.hpp"
+#include "wire.hpp"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdlib>
+#include <optional>
+#include <thread>
+
+using namespace fb::detail::wire;
+
+// Blocking end of a scripted server
+struct peer
+{
+    int32_t get_int()
+    {
+        auto s = read(4);
+        return reader(s.data(), 4).get_int();
+    }
+
+    std::string get_bytes()
+    {
+        int32_t len = get_int();
+        auto s = read(size_t(len) + (4 - len % 4) % 4);
+        return s.substr(0, size_t(len));
+    }
+
+    std::string read(size_t n)
+    {
+        std::string ret(n, '\0');
+        for (size_t at = 0; at < n;) {
+            ssize_t r = ::recv(fd, ret.data() + at, n - at, 0);
+            if (r <= 0)
+                throw std::runtime_error("peer closed");
+            at += size_t(r);
+        }
+        if (in_cipher)
+            in_cipher->apply(ret.data(), n);
+        return ret;
+    }
+
+    void send(std::vector<char> buf)
+    {
+        if (out_cipher)
+            out_cipher->apply(buf.data(), buf.size());
+        ::send(fd, buf.data(), buf.size(), MSG_NOSIGNAL);
+    }
+
+    // Everything after op_crypt is encrypted
+    void encrypt(const std::array<uint8_t, 20>& key)
+    {
+        in_cipher.emplace(key.data(), key.size());
+        out_cipher.emplace(key.data(), key.size());
+    }
+
+    void respond(int32_t object, std::string_view data = {})
+    {
+        std::vector<char> buf;
+        writer(buf).put_int(op_response).put_int(object).put_int64(0)
+            .put_bytes(data).put_int(isc_arg_end);
+        send(buf);
+    }
+
+    int fd = -1;
+    std::optional<fb::detail::arc4> in_cipher;
+    std::optional<fb::detail::arc4> out_cipher;
+};
+
+// Info item with a little endian value
+static std::string item(uint8_t code, int32_t v)
+{
+    std::string s = { char(code), 4, 0 };
+    for (int i = 0; i < 4; ++i)
+        s.push_back(char(uint32_t(v) >> (i * 8)));
+    return s;
+}
+
+static std::string item(uint8_t code, std::string_view v)
+{
+    std::string s = { char(code), char(v.size()), 0 };
+    return s.append(v);
+}
+
+static std::string column(int seq, int type, int sub_type, int len, std::string_view name)
+{
+    return item(isc_info_sql_sqlda_seq, seq) + item(isc_info_sql_type, type) +
+        item(isc_info_sql_sub_type, sub_type) + item(isc_info_sql_scale, 0) +
+        item(isc_info_sql_length, len) + item(isc_info_sql_field, name) +
+        item(isc_info_sql_relation, "T") + item(isc_info_sql_alias, name) +
+        char(isc_info_sql_describe_end);
+}
+
+static void put_row(std::vector<char>& buf, int32_t id, const char* name)
+{
+    char bitmap = name ? 0 : 2;
+    writer w(buf);
+    w.put_int(op_fetch_response).put_int(0).put_int(1).put_opaque(&bitmap, 1).put_int(id);
+    if (name)
+        w.put_bytes(name);
+}
+
+// Setting of the server test from environment
+static std::string env(const char* name, const char* def)
+{
+    const char* v = std::getenv(name);
+    return v && *v ? v : def;
+}
+
+// Checks if a server listens on the port
+static bool is_listening(const std::string& host, uint16_t port)
+{
+    addrinfo hints = {};
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0)
+        return false;
+
+    bool ok = false;
+    for (auto ai = res; ai && !ok; ai = ai->ai_next) {
+        int fd = ::socket(ai->ai_family, ai->ai_socktype, 0);
+        if (fd < 0)
+            continue;
+        ok = ::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+        ::close(fd);
+    }
+    ::freeaddrinfo(res);
+    return ok;
+}
+
+// Server side of SRP for user SYSDBA with password masterkey
+struct srp_server
+{
+    using bigint = fb::detail::bigint;
+    using sha1_int = fb::detail::int_hash<fb::detail::sha1>;
+
+    srp_server()
+    {
+        bigint x = (sha1_int() << salt << (sha1_int() << "SYSDBA:masterkey").digest()).value();
+        v = bigint::pow_mod(2, x, n);
+        pub = (fb::srp_client::multiplier() * v + bigint::pow_mod(2, b, n)) % n;
+    }
+
+    // Salt and public key as sent in op_cond_accept or op_accept_data
+    std::string data() const
+    {
+        std::string key = pub.hex();
+        std::string ret = { char(salt.size()), char(salt.size() >> 8) };
+        ret.append(salt);
+        ret.push_back(char(key.size()));
+        ret.push_back(char(key.size() >> 8));
+        return ret.append(key);
+    }
+
+    // Session key and expected proof (Srp256) of client key
+    void agree(const std::string& client_key)
+    {
+        bigint a = bigint::from_hex(client_key);
+        bigint u = (sha1_int() << a << pub).value();
+        key = (sha1_int() << bigint::pow_mod(a * bigint::pow_mod(v, u, n) % n, b, n)).digest();
+
+        bigint n1 = bigint::pow_mod((sha1_int() << n).value(), (sha1_int() << bigint(2)).value(), n);
+        bigint n2 = (sha1_int() << "SYSDBA").value();
+        proof = (fb::detail::int_hash<fb::detail::sha256>()
+            << n1 << n2 << salt << a << pub << key).value().hex();
+    }
+
+    const bigint& n = fb::srp_client::prime();
+    std::string salt = "0123456789abcdef0123456789abcdef";
+    bigint b = bigint::from_hex("C0FFEE");
+    bigint v;
+    bigint pub;
+    std::array<uint8_t, 20> key = {};
+    std::string proof;
+};
+
+// Authenticating server, with the proof in op_cont_auth (op_cond_accept)
+// or in the attachment (op_accept_data), then encrypted
+static void serve_srp(int listener, int32_t accept_op, std::string& log)
+{
+    peer p { ::accept(listener, nullptr, nullptr) };
+    srp_server srp;
+
+    CHECK   (p.get_int() == op_connect);
+    p.read(12);
+    p.get_bytes();
+    CHECK   (p.get_int() == 1);
+
+    // Login and public key in parts prefixed with a sequence number
+    std::string uid = p.get_bytes(), login, client_key;
+    for (size_t at = 0; at + 2 <= uid.size();) {
+        uint8_t tag = uid[at];
+        size_t len = uint8_t(uid[at + 1]);
+        auto val = uid.substr(at + 2, len);
+        if (tag == cnct_login)
+            login = val;
+        else if (tag == cnct_specific_data)
+            client_key += val.substr(1);
+        at += 2 + len;
+    }
+    log += login;
+    CHECK   (p.get_int() == protocol_version13);
+    p.read(16);
+    srp.agree(client_key);
+
+    std::vector<char> buf;
+    writer(buf).put_int(accept_op).put_int(protocol_version13).put_int(arch_generic)
+        .put_int(ptype_lazy_send).put_bytes(srp.data()).put_bytes("Srp256").put_int(0).put_bytes("");
+    p.send(buf);
+
+    if (accept_op == op_cond_accept) {
+        CHECK   (p.get_int() == op_cont_auth);
+        log += p.get_bytes() == srp.proof ? " proof" : " bad-proof";
+        CHECK   (p.get_bytes() == "Srp256");
+        p.get_bytes();
+        p.get_bytes();
+        p.respond(0);
+    }
+
+    CHECK   (p.get_int() == op_crypt);
+    CHECK   (p.get_bytes() == "Arc4");
+    CHECK   (p.get_bytes() == "Symmetric");
+    p.encrypt(srp.key);
+    p.respond(0);
+
+    CHECK   (p.get_int() == op_attach);
+    p.get_int();
+    log += " " + p.get_bytes();
+    std::string auth = { char(isc_dpb_specific_auth_data), char(srp.proof.size()) };
+    log += p.get_bytes().find(auth + srp.proof) != std::string::npos ? " dpb-proof" : " dpb";
+    p.respond(1);
+
+    CHECK   (p.get_int() == op_detach);
+    p.get_int();
+    p.respond(0);
+    ::close(p.fd);
+}
+
+// Server for one session of the test below
+static void serve(int listener, std::string& log)
+{
+    peer p { ::accept(listener, nullptr, nullptr) };
+
+    // op_connect, only protocol 13 is offered
+    CHECK   (p.get_int() == op_connect);
+    p.read(12);
+    log += p.get_bytes();
+    CHECK   (p.get_int() == 1);
+    p.get_bytes();
+    CHECK   (p.get_int() == protocol_version13);
+    p.read(16);
+    std::vector<char> buf;
+    writer(buf).put_int(op_accept).put_int(protocol_version13).put_int(arch_generic).put_int(ptype_lazy_send);
+    p.send(buf);
+
+    CHECK   (p.get_int() == op_attach);
+    p.get_int();
+    p.get_bytes();
+    log += p.get_bytes().find("sysdba") != std::string::npos ? " dpb" : " no-user";
+    p.respond(1);
+
+    CHECK   (p.get_int() == op_transaction);
+    p.get_int();
+    p.get_bytes();
+    p.respond(7);
+
+    // Allocate, prepare and execute arrive together
+    CHECK   (p.get_int() == op_allocate_statement);
+    p.get_int();
+    CHECK   (p.get_int() == op_prepare_statement);
+    CHECK   (p.get_int() == 7);
+    CHECK   (p.get_int() == invalid_object);
+    p.get_int();
+    log += " " + p.get_bytes();
+    p.get_bytes();
+    p.get_int();
+    CHECK   (p.get_int() == op_execute);
+    p.read(8);
+    CHECK   (p.get_bytes().size() == 6 + 3 * 2 + 3 + 2);
+    CHECK   (p.get_int() == 0);
+    CHECK   (p.get_int() == 1);
+    p.read(4);                                      // null bitmap
+    CHECK   (reader(p.read(8).data(), 8).get_int64() == 5);
+    CHECK   (p.read(4).substr(0, 2) == "ab");
+
+    p.respond(3);
+    p.respond(0, item(isc_info_sql_stmt_type, isc_info_sql_stmt_select) +
+        char(isc_info_sql_select) + item(isc_info_sql_describe_vars, 2) +
+        column(1, SQL_LONG, 0, 4, "ID") +
+        item(isc_info_sql_sqlda_seq, 2) + char(isc_info_truncated));
+    p.respond(0);
+
+    // Rest of the description
+    CHECK   (p.get_int() == op_info_sql);
+    CHECK   (p.get_int() == 3);
+    p.get_int();
+    CHECK   (p.get_bytes().substr(0, 4) == std::string({ isc_info_sql_sqlda_start, 2, 2, 0 }));
+    p.get_int();
+    p.respond(0, char(isc_info_sql_select) + item(isc_info_sql_describe_vars, 2) +
+        column(2, SQL_VARYING | 1, 4, 20, "NAME") + char(isc_info_end));
+
+    // Two batches, the first split across writes
+    CHECK   (p.get_int() == op_fetch);
+    CHECK   (p.get_int() == 3);
+    p.get_bytes();
+    p.get_int();
+    CHECK   (p.get_int() == 2);
+    buf.clear();
+    put_row(buf, 1, "alpha");
+    writer(buf).put_int(op_dummy);
+    put_row(buf, 2, nullptr);
+    writer(buf).put_int(op_fetch_response).put_int(0).put_int(0);
+    p.send({ buf.begin(), buf.begin() + 13 });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    p.send({ buf.begin() + 13, buf.end() });
+
+    CHECK   (p.get_int() == op_fetch);
+    p.read(4);
+    p.get_bytes();
+    p.read(8);
+    buf.clear();
+    put_row(buf, 3, "gamma");
+    writer(buf).put_int(op_fetch_response).put_int(fetch_eof).put_int(0);
+    p.send(buf);
+
+    // Deferred free goes first
+    CHECK   (p.get_int() == op_free_statement);
+    CHECK   (p.get_int() == 3);
+    CHECK   (p.get_int() == dsql_drop);
+    CHECK   (p.get_int() == op_allocate_statement);
+    p.get_int();
+    CHECK   (p.get_int() == op_prepare_statement);
+    p.read(12);
+    p.get_bytes();
+    p.get_bytes();
+    p.get_int();
+    CHECK   (p.get_int() == op_execute);
+    p.read(8);
+    CHECK   (p.get_bytes().empty());
+    p.read(8);
+
+    p.respond(0);
+    p.respond(4);
+    buf.clear();
+    writer(buf).put_int(op_response).put_int(0).put_int64(0).put_bytes("")
+        .put_int(isc_arg_gds).put_int(335544569)
+        .put_int(isc_arg_gds).put_int(335544436)
+        .put_int(isc_arg_number).put_int(-204)
+        .put_int(isc_arg_string).put_bytes("NOPE")
+        .put_int(isc_arg_sql_state).put_bytes("42S02")
+        .put_int(isc_arg_end);
+    p.send(buf);
+    p.respond(0);
+
+    CHECK   (p.get_int() == op_free_statement);
+    p.read(8);
+    CHECK   (p.get_int() == op_commit);
+    CHECK   (p.get_int() == 7);
+    CHECK   (p.get_int() == op_detach);
+    p.get_int();
+    p.respond(0);
+    p.respond(0);
+    p.respond(0);
+    ::close(p.fd);
+}
+
+
+TEST_CASE("testing wire params")
+{
+    fb::wire_params p(5, "ab", nullptr, std::optional<double>(), true);
+    CHECK   (p.size() == 5);
+    auto blr = p.blr();
+    CHECK   (blr.size() == 6 + (2 + 3 + 3 + 3 + 1) + 5 * 2 + 2);
+    CHECK   (blr[4] == 10);
+    CHECK   (uint8_t(blr[6]) == blr_int64);
+    CHECK   (uint8_t(blr.back()) == blr_eoc);
+
+    // Null bitmap, int64, text and boolean
+    auto msg = p.message();
+    CHECK   (msg.size() == 4 + 8 + 4 + 4);
+    CHECK   (msg[0] == (4 | 8));
+}
+
+TEST_CASE("testing wire connection")
+{
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    REQUIRE (::bind(listener, reinterpret_cast<sockaddr*>(&addr), len) == 0);
+    ::listen(listener, 1);
+    getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &len);
+
+    std::string log;
+    std::thread server([&] {
+        try { serve(listener, log); }
+        catch (const std::exception& e) { log += e.what(); }
+    });
+
+    fb::wire_loop loop;
+    fb::wire_connection::settings s;
+    s.host = "127.0.0.1";
+    s.port = ntohs(addr.sin_port);
+    s.database = "employee";
+    s.fetch_size = 2;
+    auto conn = fb::wire_connection::create(loop, s);
+
+    std::vector<std::string> rows;
+    std::string names;
+    fb::exception error("none");
+    bool done = false;
+
+    conn->connect([&](std::exception_ptr err) {
+        REQUIRE (!err);
+        conn->start([&](std::exception_ptr, fb::wire_transaction tr) {
+            conn->execute(tr, "select id, name from t where id < ? and name > ?", fb::wire_params(5, "ab"),
+                [&, tr](std::exception_ptr err, fb::wire_result& res) {
+                    CHECK   (!err);
+                    for (auto& var : res.fields())
+                        names += std::string(var.name()) + " ";
+                    for (auto& row : res)
+                        rows.push_back(std::to_string(row["ID"].value<int>()) + "=" +
+                            row["NAME"].value_or(std::string("null")));
+
+                    conn->execute(tr, "select * from nope", [&, tr](std::exception_ptr err, fb::wire_result&) {
+                        try { std::rethrow_exception(err); }
+                        catch (const fb::exception& e) { error = e; }
+                        conn->commit(tr, nullptr);
+                        conn->close([&](std::exception_ptr) { done = true; });
+                    });
+                });
+        });
+    });
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!done && std::chrono::steady_clock::now() < deadline)
+        loop.run_once(100);
+    server.join();
+    ::close(listener);
+
+    CHECK   (done);
+    CHECK   (log == "employee dpb select id, name from t where id < ? and name > ?");
+    CHECK   (names == "ID NAME ");
+    CHECK   (rows == std::vector<std::string>{ "1=alpha", "2=null", "3=gamma" });
+    CHECK   (error.code() == 335544569);
+    CHECK   (!conn->is_connected());
+    CHECK   (conn->pending() == 0);
+}
+
+TEST_CASE("testing wire authentication and encryption")
+{
+    for (int32_t op : { op_accept_data, op_cond_accept }) {
+        CAPTURE (op);
+        int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        REQUIRE (::bind(listener, reinterpret_cast<sockaddr*>(&addr), len) == 0);
+        ::listen(listener, 1);
+        getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &len);
+
+        std::string log;
+        std::thread server([&] {
+            try { serve_srp(listener, op, log); }
+            catch (const std::exception& e) { log += e.what(); }
+        });
+
+        fb::wire_loop loop;
+        fb::wire_connection::settings s;
+        s.host = "127.0.0.1";
+        s.port = ntohs(addr.sin_port);
+        s.database = "employee";
+        s.user = "sysdba";
+        auto conn = fb::wire_connection::create(loop, s);
+
+        bool connected = false, done = false;
+        conn->connect([&](std::exception_ptr err) {
+            connected = !err;
+            conn->close([&](std::exception_ptr) { done = true; });
+        });
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!done && std::chrono::steady_clock::now() < deadline)
+            loop.run_once(100);
+        server.join();
+        ::close(listener);
+
+        CHECK   (connected);
+        CHECK   (done);
+        // Proof is sent once, in op_cont_auth or in the attachment
+        if (op == op_cond_accept)
+            CHECK   (log == "SYSDBA proof employee dpb");
+        else
+            CHECK   (log == "SYSDBA employee dpb-proof");
+    }
+}
+
+// Local Firebird 3 or later server, skipped if none listens. Select
+// another one with FB_TEST_HOST, FB_TEST_PORT, FB_TEST_DATABASE,
+// FB_TEST_USER and FB_TEST_PASSWORD.
+TEST_CASE("testing wire connection to server")
+{
+    fb::wire_connection::settings s;
+    s.host = env("FB_TEST_HOST", "127.0.0.1");
+    s.port = uint16_t(std::stoi(env("FB_TEST_PORT", "3050")));
+    s.database = env("FB_TEST_DATABASE", "employee");
+    s.user = env("FB_TEST_USER", "sysdba");
+    s.password = env("FB_TEST_PASSWORD", "masterkey");
+    s.fetch_size = 2;
+
+    if (!is_listening(s.host, s.port)) {
+        MESSAGE("no server on " << s.host << ":" << s.port << ", skipped");
+        return;
+    }
+
+    fb::wire_loop loop;
+    auto conn = fb::wire_connection::create(loop, s);
+
+    std::vector<std::string> rows;
+    std::string values;
+    std::string failure;
+    fb::exception error("none");
+    bool done = false;
+
+    auto failed = [&](std::exception_ptr err) {
+        if (!err)
+            return false;
+        try { std::rethrow_exception(err); }
+        catch (const std::exception& e) { failure = e.what(); }
+        conn->close([&](std::exception_ptr) { done = true; });
+        return true;
+    };
+
+    conn->connect([&](std::exception_ptr err) {
+        if (failed(err))
+            return;
+        conn->start([&](std::exception_ptr err, fb::wire_transaction tr) {
+            if (failed(err))
+                return;
+            // System tables are in every database, read in two batches
+            conn->execute(tr, "select rdb$relation_id as id, trim(rdb$relation_name) as name "
+                "from rdb$relations where rdb$relation_id < ? order by 1", fb::wire_params(3),
+                [&, tr](std::exception_ptr err, fb::wire_result& res) {
+                    if (failed(err))
+                        return;
+                    for (auto& row : res)
+                        rows.push_back(std::to_string(row["ID"].value<int>()) + "=" +
+                            row["NAME"].value<std::string>());
+
+                    conn->execute(tr, "select cast(? as integer) + 1 as n, "
+                        "cast(? as varchar(10)) || 'c' as s from rdb$database", fb::wire_params(5, "ab"),
+                        [&, tr](std::exception_ptr err, fb::wire_result& res) {
+                            if (failed(err))
+                                return;
+                            for (auto& row : res)
+                                values = std::to_string(row["N"].value<int>()) + " " +
+                                    row["S"].value<std::string>();
+
+                            conn->execute(tr, "select * from fb_wire_no_such_table",
+                                [&, tr](std::exception_ptr err, fb::wire_result&) {
+                                    try { std::rethrow_exception(err); }
+                                    catch (const fb::exception& e) { error = e; }
+                                    conn->commit(tr, [&](std::exception_ptr err) {
+                                        if (failed(err))
+                                            return;
+                                        conn->close([&](std::exception_ptr) { done = true; });
+                                    });
+                                });
+                        });
+                });
+        });
+    });
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!done && std::chrono::steady_clock::now() < deadline)
+        loop.run_once(100);
+
+    CHECK   (done);
+    CHECK   (failure == "");
+    CHECK   (rows == std::vector<std::string>{ "0=RDB$PAGES", "1=RDB$DATABASE", "2=RDB$FIELDS" });
+    CHECK   (values == "6 abc");
+    CHECK   (error.code() == 335544569);
+    CHECK   (!conn->is_connected());
+}
@@ -0,0 +1,43 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "firebird.hpp"
+
+using namespace std::chrono_literals;
+
+
+// Database is not connected, every transaction fails
+TEST_CASE("testing failed rows are reported")
+{
+    fb::database db("employee");
+    std::vector<int> lost;
+    {
+        fb::write_behind<int, std::string>::settings s;
+        s.capacity = 16;
+        s.commit_rows = 4;
+        fb::write_behind<int, std::string> w(db,
+            "insert into country (id, name) values (?, ?)", s);
+        w.on_failure([&](const fb::exception&, auto& rows) {
+            for (auto& [id, name] : rows)
+                lost.push_back(id);
+        });
+
+        for (int i = 0; i < 10; ++i)
+            CHECK   (w.push(i, "name"));
+        w.flush();
+
+        auto st = w.stats();
+        CHECK   (st.pushed == 10);
+        CHECK   (st.failed == 10);
+        CHECK   (st.written == 0);
+        CHECK   (st.commits == 0);
+        CHECK   (w.size() == 0);
+
+        // Rows pushed before destruction are handled too
+        for (int i = 10; i < 20; ++i)
+            w.push(i, "name");
+    }
+    std::sort(lost.begin(), lost.end());
+    CHECK   (lost.size() == 20);
+    CHECK   (lost.back() == 19);
+}
@@ -0,0 +1,350 @@
+/// \file fb_codegen.cpp
+/// Generates a C++ header with row structs of tables, views and
+/// selectable procedures of a database. Every struct has an enum of
+/// column indexes, a statement selecting the columns in that order,
+/// and column decoders of the declared SQL types (see decoder.hpp).
+///
+///     fb_codegen [-u user] [-p password] [-n namespace] [-o file] dsn [name...]
+///
+/// Without names, all user tables, views and procedures are generated.
+
+#include "firebird.hpp"
+#include "decoder.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+
+/// Column of a table or output parameter of a procedure.
+struct column
+{
+    std::string name;
+    /// RDB$FIELD_TYPE
+    int type;
+    short scale;
+    bool nullable;
+};
+
+/// Table, view or procedure.
+struct relation
+{
+    std::vector<column> columns;
+    /// Number of input parameters (procedures).
+    size_t inputs = 0;
+    bool is_procedure = false;
+};
+
+/// SQL type and C++ type of a column.
+struct type_info
+{
+    const char* sql;
+    std::string cpp;
+};
+
+/// Map RDB$FIELD_TYPE to SQL type of XSQLVAR and C++ type.
+static std::optional<type_info> map_type(int type, short scale)
+{
+    auto integer = [scale](const char* sql, const char* cpp) {
+        if (scale == 0)
+            return type_info{ sql, cpp };
+        return type_info{ sql, std::string("fb::scaled_integer<") + cpp + ">" };
+    };
+
+    switch (type) {
+    case 7:     return integer("SQL_SHORT", "int16_t");
+    case 8:     return integer("SQL_LONG", "int32_t");
+    case 16:    return integer("SQL_INT64", "int64_t");
+    case 10:    return type_info{ "SQL_FLOAT", "float" };
+    case 27:    return type_info{ "SQL_DOUBLE", "double" };
+    case 11:    return type_info{ "SQL_D_FLOAT", "double" };
+    case 14:    return type_info{ "SQL_TEXT", "std::string" };
+    case 37:    return type_info{ "SQL_VARYING", "std::string" };
+    case 35:    return type_info{ "SQL_TIMESTAMP", "fb::timestamp_t" };
+    case 12:    return type_info{ "SQL_TYPE_DATE", "fb::timestamp_t" };
+    case 13:    return type_info{ "SQL_TYPE_TIME", "fb::timestamp_t" };
+    case 261:   return type_info{ "SQL_BLOB", "fb::blob_id_t" };
+    case 23:    return type_info{ "SQL_BOOLEAN", "bool" };
+    default:    return std::nullopt;
+    }
+}
+
+/// Make C++ identifier of an SQL name.
+static std::string identifier(std::string_view name)
+{
+    static const std::set<std::string_view> keywords = {
+        "alignas", "alignof", "and", "asm", "auto", "bool", "break", "case",
+        "catch", "char", "class", "const", "constexpr", "continue", "decltype",
+        "default", "delete", "do", "double", "else", "enum", "explicit",
+        "export", "extern", "false", "float", "for", "friend", "goto", "if",
+        "inline", "int", "long", "mutable", "namespace", "new", "noexcept",
+        "not", "nullptr", "operator", "or", "private", "protected", "public",
+        "register", "return", "short", "signed", "sizeof", "static", "struct",
+        "switch", "template", "this", "throw", "true", "try", "typedef",
+        "typeid", "typename", "union", "unsigned", "using", "virtual", "void",
+        "volatile", "while", "xor",
+        // Members of generated structs
+        "column", "decoders", "decode", "names", "select_all", "inputs",
+    };
+
+    std::string ret;
+    for (char ch : name)
+        ret += std::isalnum(uint8_t(ch)) ? char(std::tolower(uint8_t(ch))) : '_';
+    if (ret.empty() || std::isdigit(uint8_t(ret[0])))
+        ret.insert(0, "_");
+    if (keywords.count(ret))
+        ret += '_';
+    return ret;
+}
+
+/// Make enumerator of an SQL name (upper case as in the schema).
+static std::string enumerator(std::string_view name)
+{
+    std::string ret = identifier(name);
+    std::transform(ret.begin(), ret.end(), ret.begin(),
+        [](char ch) { return char(std::toupper(uint8_t(ch))); });
+    return ret;
+}
+
+/// Quote SQL name if needed.
+static std::string sql_name(std::string_view name)
+{
+    bool plain = !name.empty() && std::isupper(uint8_t(name[0]));
+    for (char ch : name)
+        plain = plain && (std::isupper(uint8_t(ch)) || std::isdigit(uint8_t(ch)) || ch == '_' || ch == '$');
+    if (plain)
+        return std::string(name);
+
+    std::string ret = "\"";
+    for (char ch : name)
+        ret += ch == '"' ? std::string("\"\"") : std::string(1, ch);
+    return ret + "\"";
+}
+
+/// Escape text for a C++ string literal.
+static std::string literal(std::string_view s)
+{
+    std::string ret = "\"";
+    for (char ch : s) {
+        if (ch == '"' || ch == '\\')
+            ret += '\\';
+        ret += ch;
+    }
+    return ret + "\"";
+}
+
+/// Get trimmed text of a CHAR column.
+static std::string text(const fb::sqlvar& v)
+{
+    auto s = v.value_or(std::string());
+    s.erase(s.find_last_not_of(' ') + 1);
+    return s;
+}
+
+/// Read columns of tables and views, and outputs of procedures.
+static std::map<std::string, relation> read_schema(fb::database& db)
+{
+    std::map<std::string, relation> ret;
+
+    fb::query tables(db,
+        "select rf.rdb$relation_name, rf.rdb$field_name, f.rdb$field_type, "
+        "coalesce(f.rdb$field_scale, 0), "
+        "iif(f.rdb$computed_blr is null, coalesce(rf.rdb$null_flag, f.rdb$null_flag, 0), 0) "
+        "from rdb$relation_fields rf "
+        "join rdb$relations r on r.rdb$relation_name = rf.rdb$relation_name "
+        "join rdb$fields f on f.rdb$field_name = rf.rdb$field_source "
+        "where coalesce(r.rdb$system_flag, 0) = 0 "
+        "order by rf.rdb$relation_name, rf.rdb$field_position");
+    for (auto& row : tables.execute()) {
+        ret[text(row[0])].columns.push_back({ text(row[1]),
+            row[2].value<int>(), row[3].value<short>(), row[4].value<int>() == 0 });
+    }
+
+    // Parameter type 0 is input, 1 is output
+    fb::query procs(db,
+        "select pp.rdb$procedure_name, pp.rdb$parameter_name, pp.rdb$parameter_type, "
+        "f.rdb$field_type, coalesce(f.rdb$field_scale, 0), "
+        "coalesce(pp.rdb$null_flag, f.rdb$null_flag, 0) "
+        "from rdb$procedure_parameters pp "
+        "join rdb$fields f on f.rdb$field_name = pp.rdb$field_source "
+        "where coalesce(pp.rdb$system_flag, 0) = 0 "
+        "order by pp.rdb$procedure_name, pp.rdb$parameter_type, pp.rdb$parameter_number");
+    for (auto& row : procs.execute()) {
+        auto& r = ret[text(row[0])];
+        r.is_procedure = true;
+        if (row[2].value<int>() == 0)
+            ++r.inputs;
+        else {
+            r.columns.push_back({ text(row[1]),
+                row[3].value<int>(), row[4].value<short>(), row[5].value<int>() == 0 });
+        }
+    }
+    return ret;
+}
+
+/// Write struct of a relation.
+static void generate(std::ostream& os, const std::string& name, const relation& rel)
+{
+    std::vector<std::pair<const column*, type_info>> cols;
+    for (auto& c : rel.columns) {
+        if (auto t = map_type(c.type, c.scale))
+            cols.emplace_back(&c, *t);
+    }
+    if (cols.empty())
+        return;
+
+    std::string id = identifier(name);
+    // Member may not have the name of the struct
+    auto member = [&id](const column* c) {
+        auto ret = identifier(c->name);
+        return ret == id ? ret + '_' : ret;
+    };
+
+    os << "/// " << (rel.is_procedure ? "Procedure " : "Table ") << name << ".\n"
+       << "struct " << id << "\n{\n";
+
+    os << "    /// Column indexes of select_all.\n"
+       << "    enum column : size_t\n    {\n";
+    for (auto& [c, t] : cols)
+        os << "        " << enumerator(c->name) << ",\n";
+    os << "    };\n\n";
+
+    // Statement selecting the columns
+    std::string sql = "select ";
+    for (auto& [c, t] : cols)
+        sql += (&c == &cols.front().first ? "" : ", ") + sql_name(c->name);
+    sql += " from " + sql_name(name);
+    if (rel.is_procedure && rel.inputs) {
+        sql += "(";
+        for (size_t i = 0; i < rel.inputs; ++i)
+            sql += i ? ", ?" : "?";
+        sql += ")";
+    }
+    os << "    /// Statement selecting all columns in order.\n"
+       << "    static constexpr std::string_view select_all =\n"
+       << "        " << literal(sql) << ";\n\n";
+    if (rel.is_procedure) {
+        os << "    /// Number of input parameters.\n"
+           << "    static constexpr size_t inputs = " << rel.inputs << ";\n\n";
+    }
+
+    os << "    /// Column names.\n"
+       << "    static constexpr std::array<std::string_view, " << cols.size() << "> names = {\n";
+    for (auto& [c, t] : cols)
+        os << "        " << literal(c->name) << ",\n";
+    os << "    };\n\n";
+
+    os << "    /// Decoders of the columns.\n"
+       << "    using decoders = std::tuple<\n";
+    for (auto& [c, t] : cols) {
+        os << "        fb::column_decoder<" << t.sql << ", " << c->scale << ", "
+           << (c->nullable ? "true" : "false") << ">"
+           << (&c == &cols.back().first ? ">;\n\n" : ",\n");
+    }
+
+    for (auto& [c, t] : cols) {
+        std::string init = "{}";
+        if (t.cpp.rfind("fb::scaled_integer", 0) == 0 && !c->nullable)
+            init = "{ 0, " + std::to_string(c->scale) + " }";
+        os << "    " << (c->nullable ? "std::optional<" + t.cpp + ">" : t.cpp)
+           << ' ' << member(c) << init << ";\n";
+    }
+
+    os << "\n    /// Decode row of select_all.\n"
+       << "    static " << id << " decode(const fb::sqlda& row)\n"
+       << "    {\n"
+       << "        " << id << " r;\n";
+    for (auto& [c, t] : cols) {
+        auto e = enumerator(c->name);
+        os << "        r." << member(c) << " = std::tuple_element_t<"
+           << e << ", decoders>::decode(row[" << e << "]);\n";
+    }
+    os << "        return r;\n"
+       << "    }\n"
+       << "};\n\n";
+}
+
+static int usage()
+{
+    std::cerr << "usage: fb_codegen [-u user] [-p password] [-n namespace] [-o file] dsn [name...]\n";
+    return 2;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string user = "sysdba", password = "masterkey", ns = "schema", out;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view a = argv[i];
+        if (a == "-u" && i + 1 < argc)
+            user = argv[++i];
+        else if (a == "-p" && i + 1 < argc)
+            password = argv[++i];
+        else if (a == "-n" && i + 1 < argc)
+            ns = argv[++i];
+        else if (a == "-o" && i + 1 < argc)
+            out = argv[++i];
+        else if (a.size() > 1 && a[0] == '-')
+            return usage();
+        else
+            args.emplace_back(a);
+    }
+    if (args.empty())
+        return usage();
+
+    std::map<std::string, relation> schema;
+    try {
+        fb::database db(args[0], user, password);
+        db.connect();
+        schema = read_schema(db);
+    }
+    catch (const fb::exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+
+    // Only requested names (as in the schema, or upper case)
+    if (args.size() > 1) {
+        std::map<std::string, relation> selected;
+        for (size_t i = 1; i < args.size(); ++i) {
+            auto name = args[i];
+            if (!schema.count(name))
+                std::transform(name.begin(), name.end(), name.begin(),
+                    [](char ch) { return char(std::toupper(uint8_t(ch))); });
+            auto it = schema.find(name);
+            if (it == schema.end()) {
+                std::cerr << "not found: " << args[i] << std::endl;
+                return 1;
+            }
+            selected.insert(*it);
+        }
+        schema.swap(selected);
+    }
+
+    std::ofstream file;
+    if (!out.empty()) {
+        file.open(out);
+        if (!file) {
+            std::cerr << "can't open " << out << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& os = out.empty() ? std::cout : file;
+
+    os << "/// \\file " << (out.empty() ? "schema.hpp" : out.substr(out.find_last_of('/') + 1)) << "\n"
+       << "/// Generated by fb_codegen, do not edit.\n\n"
+       << "#pragma once\n"
+       << "#include \"decoder.hpp\"\n\n"
+       << "#include <array>\n"
+       << "#include <optional>\n"
+       << "#include <string>\n"
+       << "#include <string_view>\n"
+       << "#include <tuple>\n\n"
+       << "namespace " << ns << "\n{\n\n";
+    for (auto& [name, rel] : schema)
+        generate(os, name, rel);
+    os << "} // namespace " << ns << "\n";
+    return 0;
+}
@@ -0,0 +1,275 @@
+/// \file fb_replay.cpp
+/// Replays a workload log recorded by fb::workload_capture against
+/// a database and reports latency distributions.
+///
+/// Every captured attachment is replayed by a thread with a connection
+/// of its own, keeping the original pacing (optionally sped up) or as
+/// fast as possible.
+///
+///     fb_replay [-f] [-s speed] [-u user] [-p password] log dsn
+
+#include "firebird.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <thread>
+
+using namespace std::chrono;
+
+/// Latency of a replayed statement.
+struct sample
+{
+    /// Index of the statement text.
+    size_t sql;
+    nanoseconds captured;
+    nanoseconds replayed;
+};
+
+/// Replay options.
+struct options
+{
+    std::string log;
+    std::string dsn;
+    std::string user = "sysdba";
+    std::string password = "masterkey";
+    bool fast = false;
+    double speed = 1;
+};
+
+/// Result of a session.
+struct session_result
+{
+    std::vector<sample> samples;
+    size_t errors = 0;
+    std::string last_error;
+};
+
+/// Get percentile of sorted values.
+static nanoseconds percentile(const std::vector<nanoseconds>& sorted, double p)
+{
+    if (sorted.empty())
+        return {};
+    return sorted[std::min(size_t(p * sorted.size()), sorted.size() - 1)];
+}
+
+/// Format duration in milliseconds.
+static std::string ms(nanoseconds d)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.3f", d.count() / 1e6);
+    return buf;
+}
+
+/// Replay entries of one captured attachment.
+static void replay_session(const options& opt, const std::vector<fb::workload_entry>& entries,
+    const std::vector<std::string>& texts, steady_clock::time_point began, session_result& res)
+{
+    fb::database db(opt.dsn, opt.user, opt.password);
+    try {
+        db.connect();
+    }
+    catch (const fb::exception& ex) {
+        res.errors = entries.size();
+        res.last_error = ex.what();
+        return;
+    }
+
+    // Captured transaction id to replayed transaction
+    std::unordered_map<uint64_t, fb::transaction> trans;
+    auto get_transaction = [&](uint64_t id) -> fb::transaction& {
+        auto it = trans.find(id);
+        if (it == trans.end())
+            it = trans.emplace(id, fb::transaction(db)).first;
+        return it->second;
+    };
+
+    for (auto& e : entries) {
+        if (!opt.fast) {
+            auto at = began + duration_cast<nanoseconds>(e.offset / opt.speed);
+            std::this_thread::sleep_until(at);
+        }
+
+        try {
+            switch (e.kind) {
+            case fb::workload_entry::start:
+                trans.insert_or_assign(e.transaction,
+                    fb::transaction(db, std::string_view(e.tpb.data(), e.tpb.size())));
+                get_transaction(e.transaction).start();
+                break;
+            case fb::workload_entry::commit:
+                get_transaction(e.transaction).commit();
+                trans.erase(e.transaction);
+                break;
+            case fb::workload_entry::rollback:
+                get_transaction(e.transaction).rollback();
+                trans.erase(e.transaction);
+                break;
+            case fb::workload_entry::execute: {
+                auto start = steady_clock::now();
+                fb::query q(get_transaction(e.transaction), e.sql);
+                if (!e.params.empty()) {
+                    auto& params = q.params(e.params.size());
+                    for (size_t i = 0; i < e.params.size() && i < params.size(); ++i) {
+                        auto& p = e.params[i];
+                        if (p.is_null())
+                            params[i].set(nullptr);
+                        else
+                            params[i].set(p.type, p.data.data(), p.data.size());
+                    }
+                }
+                q.execute();
+                for (auto& row : q)
+                    (void)row;
+
+                size_t idx = std::lower_bound(texts.begin(), texts.end(), e.sql) - texts.begin();
+                res.samples.push_back({ idx, e.elapsed, steady_clock::now() - start });
+                break;
+            }
+            }
+        }
+        catch (const fb::exception& ex) {
+            ++res.errors;
+            res.last_error = ex.what();
+        }
+    }
+
+    // Transactions left open by the capture
+    for (auto& [id, tr] : trans) {
+        try {
+            tr.rollback();
+        }
+        catch (...) { }
+    }
+}
+
+/// Print latency distribution.
+static void report(std::ostream& os, const std::string& name,
+    std::vector<nanoseconds> captured, std::vector<nanoseconds> replayed)
+{
+    std::sort(captured.begin(), captured.end());
+    std::sort(replayed.begin(), replayed.end());
+    os << name << " (" << replayed.size() << " executions, ms)\n";
+    os << "             p50       p90       p99     p99.9       max\n";
+    auto line = [&](const char* title, const std::vector<nanoseconds>& v) {
+        os << title;
+        for (double p : { .5, .9, .99, .999, 1. }) {
+            auto s = ms(percentile(v, p));
+            os << std::string(10 - std::min(s.size(), size_t(9)), ' ') << s;
+        }
+        os << '\n';
+    };
+    line("  captured", captured);
+    line("  replayed", replayed);
+}
+
+static int usage()
+{
+    std::cerr << "usage: fb_replay [-f] [-s speed] [-u user] [-p password] log dsn\n"
+        "  -f  replay as fast as possible (default is original pacing)\n"
+        "  -s  speed up pacing by factor\n";
+    return 2;
+}
+
+int main(int argc, char* argv[])
+{
+    options opt;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view a = argv[i];
+        if (a == "-f")
+            opt.fast = true;
+        else if (a == "-s" && i + 1 < argc)
+            opt.speed = std::atof(argv[++i]);
+        else if (a == "-u" && i + 1 < argc)
+            opt.user = argv[++i];
+        else if (a == "-p" && i + 1 < argc)
+            opt.password = argv[++i];
+        else if (a.size() > 1 && a[0] == '-')
+            return usage();
+        else
+            args.emplace_back(a);
+    }
+    if (args.size() != 2 || opt.speed <= 0)
+        return usage();
+    opt.log = args[0];
+    opt.dsn = args[1];
+
+    // Entries by attachment, in order of start
+    std::map<int64_t, std::vector<fb::workload_entry>> sessions;
+    std::vector<std::string> texts;
+    try {
+        fb::workload_reader r(opt.log);
+        fb::workload_entry e;
+        while (r.next(e)) {
+            if (e.kind == fb::workload_entry::execute)
+                texts.push_back(e.sql);
+            sessions[e.session].push_back(std::move(e));
+        }
+    }
+    catch (const fb::exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+    std::sort(texts.begin(), texts.end());
+    texts.erase(std::unique(texts.begin(), texts.end()), texts.end());
+
+    for (auto& [id, entries] : sessions) {
+        std::stable_sort(entries.begin(), entries.end(),
+            [](auto& a, auto& b) { return a.offset < b.offset; });
+    }
+
+    std::cout << "replaying " << sessions.size() << " sessions, "
+        << texts.size() << " statements" << std::endl;
+
+    std::vector<session_result> results(sessions.size());
+    std::vector<std::thread> threads;
+    auto began = steady_clock::now();
+    size_t n = 0;
+    for (auto& [id, entries] : sessions) {
+        threads.emplace_back(replay_session, std::cref(opt), std::cref(entries),
+            std::cref(texts), began, std::ref(results[n++]));
+    }
+    for (auto& t : threads)
+        t.join();
+    auto wall = steady_clock::now() - began;
+
+    // Overall and per statement (by total replayed time)
+    std::vector<nanoseconds> captured, replayed;
+    std::vector<std::vector<nanoseconds>> by_sql[2];
+    by_sql[0].resize(texts.size());
+    by_sql[1].resize(texts.size());
+    size_t errors = 0;
+    for (auto& r : results) {
+        errors += r.errors;
+        if (r.errors)
+            std::cerr << "error: " << r.last_error << std::endl;
+        for (auto& s : r.samples) {
+            captured.push_back(s.captured);
+            replayed.push_back(s.replayed);
+            by_sql[0][s.sql].push_back(s.captured);
+            by_sql[1][s.sql].push_back(s.replayed);
+        }
+    }
+
+    std::cout << replayed.size() << " executions, " << errors << " errors in "
+        << ms(wall) << " ms (" << size_t(replayed.size() / std::max(duration<double>(wall).count(), 1e-9))
+        << " per second)\n\n";
+    report(std::cout, "all statements", captured, replayed);
+
+    std::vector<std::pair<nanoseconds, size_t>> order;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        nanoseconds total{};
+        for (auto d : by_sql[1][i])
+            total += d;
+        order.emplace_back(total, i);
+    }
+    std::sort(order.rbegin(), order.rend());
+    for (size_t i = 0; i < std::min(order.size(), size_t(10)); ++i) {
+        size_t idx = order[i].second;
+        std::cout << '\n';
+        report(std::cout, fb::fingerprint(texts[idx]), by_sql[0][idx], by_sql[1][idx]);
+    }
+    return errors ? 1 : 0;
+}